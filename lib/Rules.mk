@@ -1,8 +1,9 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
-	lookup3.cc message.cc memory.cc transport.cc \
-	fasttransport.cc latency.cc configuration.cc)
+	lookup3.cc message.cc memory.cc transport.cc timerwheel.cc histogram.cc \
+	fasttransport.cc loopbacktransport.cc udptransport.cc latency.cc \
+	configuration.cc)
 
 LIB-hash := $(o)lookup3.o
 
@@ -14,6 +15,14 @@ LIB-memory := $(o)memory.o
 
 LIB-configuration := $(o)configuration.o $(LIB-message)
 
+LIB-timerwheel := $(o)timerwheel.o
+
+LIB-histogram := $(o)histogram.o
+
 LIB-transport := $(o)transport.o $(LIB-message) $(LIB-configuration)
 
-LIB-fasttransport := $(o)fasttransport.o $(LIB-transport)
\ No newline at end of file
+LIB-fasttransport := $(o)fasttransport.o $(LIB-timerwheel) $(LIB-histogram) $(LIB-transport)
+
+LIB-loopbacktransport := $(o)loopbacktransport.o $(LIB-timerwheel) $(LIB-transport)
+
+LIB-udptransport := $(o)udptransport.o $(LIB-timerwheel) $(LIB-transport)
@@ -39,6 +39,7 @@
 #include <event2/event.h>
 #include <event2/thread.h>
 
+#include <cstring>
 #include <memory>
 #include <random>
 
@@ -54,43 +55,141 @@
 #include <sched.h>
 
 #include <numa.h>
-#include <boost/fiber/all.hpp>
 
 static std::mutex fasttransport_lock;
 static volatile bool fasttransport_initialized = false;
 
+// When set, the transports of a process share one Nexus per NUMA node,
+// listening on kBaseSmUdpPort + numa_node; otherwise every transport
+// has its own Nexus on kBaseSmUdpPort + id
+static bool fasttransport_shared_nexus = false;
+static std::map<uint8_t, erpc::Nexus *> fasttransport_nexus;
+
+// The statistics of all the transports of the process
+static std::vector<fasttransport_stats_t *> fasttransport_stats;
+static uint64_t fasttransport_poll_backoff_us = 0;
+static size_t fasttransport_max_resp_size = 0;
+
+static inline void fasttransport_record(AppContext *c, int kind,
+                                        uint8_t reqType, size_t cycles) {
+    std::atomic<LatencyHistogram *> &slot = c->stats->hist[kind][reqType];
+    LatencyHistogram *hist = slot.load(std::memory_order_relaxed);
+    if (unlikely(hist == nullptr)) {
+        hist = new LatencyHistogram();
+        slot.store(hist, std::memory_order_release);
+    }
+    hist->Record(erpc::to_nsec(cycles, c->freq_ghz));
+}
+
 // Function called when we received a response to a
 // request we sent on this transport
 static void fasttransport_response(void *_context, void *_tag) {
     auto *c = static_cast<AppContext *>(_context);
     auto *rt = reinterpret_cast<req_tag_t *>(_tag);
     Debug("Received respose, reqType = %d", rt->reqType);
-    rt->src->ReceiveResponse(rt->reqType,
-                            reinterpret_cast<char *>(rt->resp_msgbuf.buf));
-    c->rpc->free_msg_buffer(rt->req_msgbuf);
-    c->rpc->free_msg_buffer(rt->resp_msgbuf);
+    c->delivered++;
+    if (rt->resp_msgbuf.get_data_size() == 0) {
+        // eRPC fails the requests of a session that was reset with an
+        // empty response; the receiver's timeouts take care of them
+        Warning("Dropped request, reqType = %d: session reset", rt->reqType);
+    } else {
+        fasttransport_record(c, FASTTRANSPORT_LAT_RTT, rt->reqType,
+                             erpc::rdtsc() - rt->sent_tsc);
+        rt->src->ReceiveResponse(rt->reqType,
+                                reinterpret_cast<char *>(rt->resp_msgbuf.buf));
+    }
+    if (rt->fanout != nullptr) {
+        // the group keeps its buffers for the next fan-out
+        if (--rt->fanout->refs == 0) {
+            c->client.fanout_pool.free(rt->fanout);
+        }
+        return;
+    }
+    c->client.msgbuf_cache.free(c->rpc, rt->req_msgbuf, rt->req_cap);
+    c->client.msgbuf_cache.free(c->rpc, rt->resp_msgbuf, rt->resp_cap);
     c->client.req_tag_pool.free(rt);
 }
 
+// Session management handler: keeps the state of our client sessions
+// up to date, and queues those that failed or dropped for a reconnect
+static void fasttransport_sm_handler(int session_num,
+                                     erpc::SmEventType sm_event_type,
+                                     erpc::SmErrType sm_err_type,
+                                     void *_context) {
+    auto *c = static_cast<AppContext *>(_context);
+
+    Debug("Rpc %u: Session number %d %s. Error %s. "
+            "Time elapsed = %.3f s.\n",
+            c->rpc->get_rpc_id(), session_num,
+            erpc::sm_event_type_str(sm_event_type).c_str(),
+            erpc::sm_err_type_str(sm_err_type).c_str(),
+            c->rpc->sec_since_creation());
+
+    if (session_num < 0 ||
+        static_cast<size_t>(session_num) >= c->client.session_slots.size() ||
+        c->client.session_slots[session_num] < 0) {
+        Warning("Rpc %u: SM event for unknown session %d",
+                c->rpc->get_rpc_id(), session_num);
+        return;
+    }
+    int slot = c->client.session_slots[session_num];
+    fasttransport_session_t &session = c->client.sessions[slot];
+
+    switch (sm_event_type) {
+    case erpc::SmEventType::kConnected:
+        session.connected = true;
+        break;
+    case erpc::SmEventType::kConnectFailed:
+    case erpc::SmEventType::kDisconnected:
+        // eRPC buries the session after this call; we cannot create the
+        // new one from the handler, so the event loop does it later
+        Warning("Rpc %u: session %d %s (%s), reconnecting",
+                c->rpc->get_rpc_id(), session_num,
+                erpc::sm_event_type_str(sm_event_type).c_str(),
+                erpc::sm_err_type_str(sm_err_type).c_str());
+        c->client.session_slots[session_num] = -1;
+        session.num = -1;
+        session.connected = false;
+        c->client.reconnects.push_back(slot);
+        break;
+    default:
+        // we never disconnect sessions ourselves
+        Warning("Rpc %u: unexpected SM event %s on session %d",
+                c->rpc->get_rpc_id(),
+                erpc::sm_event_type_str(sm_event_type).c_str(), session_num);
+    }
+}
+
+// Make sure msgbuf can hold size bytes; buffers only ever grow
+static inline void fasttransport_reserve(erpc::Rpc<erpc::CTransport> *rpc,
+                                         erpc::MsgBuffer *msgbuf,
+                                         size_t *cap,
+                                         size_t size) {
+    if (*cap < size) {
+        if (*cap > 0) rpc->free_msg_buffer(*msgbuf);
+        *msgbuf = rpc->alloc_msg_buffer_or_die(size);
+        *cap = size;
+    } else {
+        rpc->resize_msg_buffer(msgbuf, size);
+    }
+}
+
 // Function called when we received a request
 static void fasttransport_request(erpc::ReqHandle *req_handle, void *_context) {
-    // save the req_handle for when we are in the SendMessage function
+    // save the req_handle for when we are in the SendResponse function
     auto *c = static_cast<AppContext *>(_context);
-#if MULTIPLE_ACTIVE_REQUESTS
-    c->server.req_handles[c->server.req_handle_idx] = req_handle;
-    // upcall to the app
-    c->server.receiver->ReceiveRequest(c->server.req_handle_idx,
-                                req_handle->get_req_msgbuf()->get_req_type(),
-                                reinterpret_cast<char *>(req_handle->get_req_msgbuf()->buf),
-                                reinterpret_cast<char *>(req_handle->pre_resp_msgbuf.buf));
-    c->server.req_handle_idx++;
-#else
-    c->server.req_handle = req_handle;
+    c->delivered++;
+    size_t now = erpc::rdtsc();
+    uint8_t reqType = req_handle->get_req_msgbuf()->get_req_type();
+    fasttransport_record(c, FASTTRANSPORT_LAT_QUEUE, reqType,
+                         now - c->server.turn_tsc);
+    uint64_t idx = c->server.req_handles.Insert(
+        fasttransport_req_t{ req_handle, now, reqType });
+    c->server.crt_req_handle = idx;
     // upcall to the app
-    c->server.receiver->ReceiveRequest(req_handle->get_req_msgbuf()->get_req_type(),
+    c->server.receiver->ReceiveRequest(idx, reqType,
                                 reinterpret_cast<char *>(req_handle->get_req_msgbuf()->buf),
                                 reinterpret_cast<char *>(req_handle->pre_resp_msgbuf.buf));
-#endif
 }
 
 FastTransport::FastTransport(const transport::Configuration &config,
@@ -109,6 +208,11 @@ FastTransport::FastTransport(const transport::Configuration &config,
     Assert(numa_node <=  numa_max_node());
 
     c = new AppContext();
+    c->client.sessions.resize(config.n * nthreads);
+    // eRPC never delivers more requests than its sessions have slots
+    c->server.req_handles.Reserve(
+        erpc::Rpc<erpc::CTransport>::get_max_num_sessions() *
+        erpc::kSessionReqWindow);
 
     // The first thread to grab the lock initializes the transport
     fasttransport_lock.lock();
@@ -143,16 +247,16 @@ FastTransport::FastTransport(const transport::Configuration &config,
 
     // Setup eRPC
 
-    // TODO: why sharing one nexus object between threads does not scale?
-    // TODO: create one nexus per numa node
-    // right now we create one nexus object per thread
-    std::string local_uri = ip + ":" + std::to_string(erpc::kBaseSmUdpPort + id);
-    nexus = new erpc::Nexus(local_uri, numa_node, 0);
-    Warning("Created nexus object with local_uri = %s", local_uri.c_str());
-
-    // register receive handlers
-    for (uint8_t j = 1; j <= nr_req_types; j++) {
-        nexus->register_req_func(j, fasttransport_request, erpc::ReqFuncType::kForeground);
+    if (fasttransport_shared_nexus) {
+        auto it = fasttransport_nexus.find(numa_node);
+        if (it != fasttransport_nexus.end()) {
+            nexus = it->second;
+        } else {
+            nexus = CreateNexus(ip, erpc::kBaseSmUdpPort + numa_node, nr_req_types);
+            fasttransport_nexus[numa_node] = nexus;
+        }
+    } else {
+        nexus = CreateNexus(ip, erpc::kBaseSmUdpPort + id, nr_req_types);
     }
 
     // Create the RPC object
@@ -160,20 +264,115 @@ FastTransport::FastTransport(const transport::Configuration &config,
     c->rpc = new erpc::Rpc<erpc::CTransport> (nexus,
                                             static_cast<void *>(c),
                                             static_cast<uint8_t>(id),
-                                            basic_sm_handler, phy_port);
+                                            fasttransport_sm_handler, phy_port);
     c->rpc->retry_connect_on_invalid_rpc_id = true;
+    if (fasttransport_max_resp_size > 0) {
+        c->rpc->set_pre_resp_msgbuf_size(fasttransport_max_resp_size);
+    }
+    c->freq_ghz = c->rpc->get_freq_ghz();
+    c->stats = new fasttransport_stats_t();
+    c->stats->id = id;
+    c->stats->poll.SetMaxSleep(fasttransport_poll_backoff_us);
+    fasttransport_stats.push_back(c->stats);
     fasttransport_lock.unlock();
 }
 
 FastTransport::~FastTransport() {
 }
 
+void FastTransport::ShareNexusPerNumaNode(bool share) {
+    std::lock_guard<std::mutex> lock(fasttransport_lock);
+    ASSERT(fasttransport_nexus.empty());
+    fasttransport_shared_nexus = share;
+}
+
+uint16_t FastTransport::NexusPort(uint8_t rpcIdx) {
+    if (fasttransport_shared_nexus) {
+        return erpc::kBaseSmUdpPort + ServerNumaNode(rpcIdx);
+    }
+    return erpc::kBaseSmUdpPort + rpcIdx;
+}
+
+// Called with fasttransport_lock held
+erpc::Nexus *FastTransport::CreateNexus(const std::string &ip, uint16_t port,
+                                        uint8_t nr_req_types) {
+    std::string local_uri = ip + ":" + std::to_string(port);
+    erpc::Nexus *nexus = new erpc::Nexus(local_uri, numa_node, 0);
+    Warning("Created nexus object with local_uri = %s", local_uri.c_str());
+
+    // register receive handlers; this must happen before any Rpc
+    // object uses the nexus
+    for (uint8_t j = 1; j <= nr_req_types; j++) {
+        nexus->register_req_func(j, fasttransport_request, erpc::ReqFuncType::kForeground);
+    }
+    return nexus;
+}
+
 void FastTransport::Register(TransportReceiver *receiver, int replicaIdx) {
 
 	ASSERT(replicaIdx < config.n);
 
     if (replicaIdx > -1) c->server.receiver = receiver;
     this->replicaIdx = replicaIdx;
+
+    // clients talk to all the server threads, so get the handshakes
+    // out of the way of the first requests
+    if (replicaIdx == -1) ConnectAll();
+}
+
+void FastTransport::ConnectAll() {
+    if (connecting) return;
+    connecting = true;
+    for (size_t slot = 0; slot < c->client.sessions.size(); slot++) {
+        if (c->client.sessions[slot].num < 0) OpenSession(slot);
+    }
+}
+
+// Starts connecting the session in slot, without waiting
+void FastTransport::OpenSession(int slot) {
+    int replica = slot / nthreads;
+    uint8_t rpcIdx = slot % nthreads;
+    // connect through the nexus the server thread registered with
+    std::string uri = config.replica(replica).host + ":" +
+                      std::to_string(NexusPort(rpcIdx));
+    int session_num = c->rpc->create_session(uri, rpcIdx);
+    if (session_num < 0) {
+        Warning("Failed to create eRPC session to %s, RPC id: %d: %s",
+                uri.c_str(), rpcIdx, strerror(-session_num));
+        c->client.reconnects.push_back(slot);
+        return;
+    }
+    Debug("Opening eRPC session to %s, RPC id: %d", uri.c_str(), rpcIdx);
+
+    std::vector<int> &slots = c->client.session_slots;
+    if (static_cast<size_t>(session_num) >= slots.size()) {
+        slots.resize(session_num + 1, -1);
+    }
+    slots[session_num] = slot;
+    c->client.sessions[slot].num = session_num;
+    c->client.sessions[slot].connected = false;
+}
+
+// Opens again, after a delay, the sessions the SM handler gave up on
+void FastTransport::ScheduleReconnects() {
+    std::vector<int> slots;
+    slots.swap(c->client.reconnects);
+    for (int slot : slots) {
+        timers.Arm(FASTTRANSPORT_RECONNECT_US, [this, slot]() {
+            // a send may have reopened it already
+            if (c->client.sessions[slot].num < 0) OpenSession(slot);
+        });
+    }
+}
+
+// Runs the event loop until the session in slot is connected
+int FastTransport::WaitForSession(int slot) {
+    fasttransport_session_t &session = c->client.sessions[slot];
+    if (session.num < 0) OpenSession(slot);
+    while (!session.connected) {
+        RunOnce();
+    }
+    return session.num;
 }
 
 inline char *FastTransport::GetRequestBuf(size_t reqLen, size_t respLen) {
@@ -182,34 +381,22 @@ inline char *FastTransport::GetRequestBuf(size_t reqLen, size_t respLen) {
         reqLen = c->rpc->get_max_data_per_pkt();
     if (respLen == 0)
         respLen = c->rpc->get_max_data_per_pkt();
-    c->client.crt_req_tag = c->client.req_tag_pool.alloc();
-    c->client.crt_req_tag->req_msgbuf = c->rpc->alloc_msg_buffer_or_die(reqLen);
-    c->client.crt_req_tag->resp_msgbuf = c->rpc->alloc_msg_buffer_or_die(respLen);
-    return reinterpret_cast<char *>(c->client.crt_req_tag->req_msgbuf.buf);
+    req_tag_t *rt = c->client.req_tag_pool.alloc();
+    MsgBufferCache &cache = c->client.msgbuf_cache;
+    rt->req_msgbuf = cache.alloc(c->rpc, reqLen, &rt->req_cap);
+    rt->resp_msgbuf = cache.alloc(c->rpc, respLen, &rt->resp_cap);
+    c->client.crt_req_tag = rt;
+    return reinterpret_cast<char *>(rt->req_msgbuf.buf);
 }
 
 inline int FastTransport::GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) {
-    auto session_key = std::make_pair(replicaIdx, dstRpcIdx);
-
-    const auto iter = c->client.sessions[src].find(session_key);
-    if (iter == c->client.sessions[src].end()) {
-        // create a new session to the replica core
-        // use the dafault port from eRPC for control path
-        // TODO: pass in the number of numa nodes at the server (in the form of the mapping function)
-        //int numa_nodes_at_servers = 2;
-        //int numa_nodes_at_servers = 1;
-        int session_id = c->rpc->create_session(config.replica(replicaIdx).host + ":" +
-                                       //std::to_string(erpc::kBaseSmUdpPort + dstRpcIdx % numa_nodes_at_servers), dstRpcIdx);
-                                       std::to_string(erpc::kBaseSmUdpPort + dstRpcIdx), dstRpcIdx);
-        while (!c->rpc->is_connected(session_id)) {
-            c->rpc->run_event_loop_once();
-        }
-        c->client.sessions[src][session_key] = session_id;
-        Warning("Opened eRPC session to %s, RPC id: %d", (config.replica(replicaIdx).host + ":" + std::to_string(erpc::kBaseSmUdpPort)).c_str(), dstRpcIdx);
-        return session_id;
-    } else {
-        return iter->second;
+    ASSERT(dstRpcIdx < nthreads);
+    int slot = replicaIdx * nthreads + dstRpcIdx;
+    const fasttransport_session_t &session = c->client.sessions[slot];
+    if (likely(session.connected)) {
+        return session.num;
     }
+    return WaitForSession(slot);
 }
 
 // This function assumes the message has already been copied to the
@@ -220,53 +407,89 @@ bool FastTransport::SendRequestToReplica(TransportReceiver *src,
                                         uint8_t dstRpcIdx,
                                         size_t msgLen) {
     ASSERT(replicaIdx < config.n);
+    // waiting for the session runs the event loop, whose upcalls may
+    // send requests of their own
+    req_tag_t *crt = c->client.crt_req_tag;
+    c->client.crt_req_tag = nullptr;
     int session_id = GetSession(src, replicaIdx, dstRpcIdx);
 
-    c->client.crt_req_tag->src = src;
-    c->client.crt_req_tag->reqType = reqType;
-    c->rpc->resize_msg_buffer(&c->client.crt_req_tag->req_msgbuf, msgLen);
+    crt->src = src;
+    crt->reqType = reqType;
+    c->rpc->resize_msg_buffer(&crt->req_msgbuf, msgLen);
+    crt->sent_tsc = erpc::rdtsc();
     c->rpc->enqueue_request(session_id, reqType,
-                            &c->client.crt_req_tag->req_msgbuf,
-                            &c->client.crt_req_tag->resp_msgbuf,
+                            &crt->req_msgbuf,
+                            &crt->resp_msgbuf,
                             fasttransport_response,
-                            reinterpret_cast<void *>(c->client.crt_req_tag));
-    while (src->Blocked()) {
-        c->rpc->run_event_loop_once();
-        boost::this_fiber::yield();
-    }
+                            reinterpret_cast<void *>(crt));
+    WaitFor([src]() { return !src->Blocked(); });
     return true;
 }
 
+fanout_t *FastTransport::AllocFanout() {
+    fanout_t *group = c->client.fanout_pool.alloc();
+    if (group->tags.size() < static_cast<size_t>(config.n)) {
+        group->tags.resize(config.n);
+    }
+    // held by SendRequestToAll until all the copies are enqueued, as
+    // opening a session runs the event loop and may deliver responses
+    group->refs = 1;
+    return group;
+}
+
 // Sends to all replicas except if the sender is a replica,
 // it doesn't send to the sending replica
 bool FastTransport::SendRequestToAll(TransportReceiver *src,
                                     uint8_t reqType,
                                     uint8_t dstRpcIdx,
                                     size_t msgLen) {
-    c->rpc->resize_msg_buffer(&c->client.crt_req_tag->req_msgbuf, msgLen);
+    req_tag_t *crt = c->client.crt_req_tag;
+    c->client.crt_req_tag = nullptr;
+    c->rpc->resize_msg_buffer(&crt->req_msgbuf, msgLen);
+    crt->src = src;
+    crt->reqType = reqType;
+
+    // the current request buffer goes to the last destination,
+    // all the others get a copy from a fan-out group
+    int last = config.n - 1;
+    if (last == this->replicaIdx) last--;
+    if (last < 0) {
+        // nobody to send to
+        c->client.msgbuf_cache.free(c->rpc, crt->req_msgbuf, crt->req_cap);
+        c->client.msgbuf_cache.free(c->rpc, crt->resp_msgbuf, crt->resp_cap);
+        c->client.req_tag_pool.free(crt);
+        return true;
+    }
 
-    for (int i = 0; i < config.n; i++) {
+    // size the responses like the caller asked in GetRequestBuf
+    size_t respLen = crt->resp_cap;
+    fanout_t *group = nullptr;
+
+    for (int i = 0; i <= last; i++) {
         // skip the sending replica
         if (this->replicaIdx == i) continue;
         int session_id = GetSession(src, i, dstRpcIdx);
 
-        if (i == config.n - 1) {
-            c->client.crt_req_tag->src = src;
-            c->client.crt_req_tag->reqType = reqType;
+        if (i == last) {
+            crt->sent_tsc = erpc::rdtsc();
             c->rpc->enqueue_request(session_id, reqType,
-                                &c->client.crt_req_tag->req_msgbuf,
-                                &c->client.crt_req_tag->resp_msgbuf,
-                                fasttransport_response,
-                                reinterpret_cast<void *>(c->client.crt_req_tag));
+                                    &crt->req_msgbuf,
+                                    &crt->resp_msgbuf,
+                                    fasttransport_response,
+                                    reinterpret_cast<void *>(crt));
         } else {
             // need to use different erpc::MsgBuffer per session
-            auto *rt = c->client.req_tag_pool.alloc();
-            rt->req_msgbuf = c->rpc->alloc_msg_buffer_or_die(msgLen);
-            rt->resp_msgbuf = c->rpc->alloc_msg_buffer_or_die(c->rpc->get_max_data_per_pkt());
+            if (group == nullptr) group = AllocFanout();
+            req_tag_t *rt = &group->tags[i];
+            fasttransport_reserve(c->rpc, &rt->req_msgbuf, &rt->req_cap, msgLen);
+            fasttransport_reserve(c->rpc, &rt->resp_msgbuf, &rt->resp_cap, respLen);
             rt->reqType = reqType;
             rt->src = src;
+            rt->fanout = group;
             std::memcpy(reinterpret_cast<char *>(rt->req_msgbuf.buf),
-                        reinterpret_cast<char *>(c->client.crt_req_tag->req_msgbuf.buf), msgLen);
+                        reinterpret_cast<char *>(crt->req_msgbuf.buf), msgLen);
+            group->refs++;
+            rt->sent_tsc = erpc::rdtsc();
             c->rpc->enqueue_request(session_id, reqType,
                                     &rt->req_msgbuf,
                                     &rt->resp_msgbuf,
@@ -274,132 +497,116 @@ bool FastTransport::SendRequestToAll(TransportReceiver *src,
                                     reinterpret_cast<void *>(rt));
         }
     }
-    if (this->replicaIdx == config.n - 1) {
-        // TODO: free the current buffer
+    if (group != nullptr && --group->refs == 0) {
+        c->client.fanout_pool.free(group);
     }
 
-    while (src->Blocked()) {
-        c->rpc->run_event_loop_once();
-        boost::this_fiber::yield();
-    }
+    WaitFor([src]() { return !src->Blocked(); });
     return true;
 }
 
-// For cases when there are multiple active requests that need response
+// For requests answered after ReceiveRequest returned
 bool FastTransport::SendResponse(uint64_t reqHandleIdx, size_t msgLen) {
-    // we get here from fasttransport_rpc_request
-#if MULTIPLE_ACTIVE_REQUESTS
-    auto &resp = c->server.req_handles[reqHandleIdx]->pre_resp_msgbuf;
+    fasttransport_req_t req = c->server.req_handles.Take(reqHandleIdx);
+    auto &resp = req.req_handle->pre_resp_msgbuf;
     c->rpc->resize_msg_buffer(&resp, msgLen);
-    c->rpc->enqueue_response(c->server.req_handles[reqHandleIdx], &resp);
-    c->server.req_handles.erase(reqHandleIdx);
+    c->rpc->enqueue_response(req.req_handle, &resp);
+    fasttransport_record(c, FASTTRANSPORT_LAT_SERVICE, req.reqType,
+                         erpc::rdtsc() - req.start_tsc);
     Debug("Sent response, msgLen = %lu\n", msgLen);
-#else
-    Panic("Compile fasttransport with MULTIPLE_ACTIVE_REQUESTS true");
-#endif
     return true;
 }
 
-// Assumes we already put the response in c->server.req_handle->pre_resp_msgbuf
+// Assumes we already put the response in the pre_resp_msgbuf of the
+// request being delivered
 bool FastTransport::SendResponse(size_t msgLen) {
-    // we get here from fasttransport_rpc_request
-    auto &resp = c->server.req_handle->pre_resp_msgbuf;
-    c->rpc->resize_msg_buffer(&resp, msgLen);
-    c->rpc->enqueue_response(c->server.req_handle, &resp);
-    Debug("Sent response, msgLen = %lu\n", msgLen);
-    return true;
+    // we get here from fasttransport_request
+    return SendResponse(c->server.crt_req_handle, msgLen);
 }
 
-void FastTransport::Run() {
-    while(!stop) {
-        // if (replicaIdx == -1)
-        //    event_base_loop(eventBase, EVLOOP_ONCE|EVLOOP_NONBLOCK);
-        c->rpc->run_event_loop_once();
+void FastTransport::PrintMsgBufferStats() {
+    const MsgBufferCache &cache = c->client.msgbuf_cache;
+    for (size_t cls = 0; cls < FASTTRANSPORT_BUF_CLASSES; cls++) {
+        const MsgBufferCache::ClassStats &stats = cache.get_stats(cls);
+        if (stats.hits + stats.misses == 0) continue;
+        Notice("RPC %d: MsgBuffer class %lu bytes: %lu hits, %lu misses",
+               id, MsgBufferCache::ClassSize(cls), stats.hits, stats.misses);
     }
 }
 
-int FastTransport::Timer(uint64_t ms, timer_callback_t cb) {
-    FastTransportTimerInfo *info = new FastTransportTimerInfo();
-
-    struct timeval tv;
-    tv.tv_sec = ms/1000;
-    tv.tv_usec = (ms % 1000) * 1000;
-
-    timers_lock.lock();
-    uint64_t t_id = lastTimerId;
-    lastTimerId++;
-    timers_lock.unlock();
-
-    info->transport = this;
-    info->id = t_id;
-    info->cb = cb;
-    info->ev = event_new(eventBase, -1, 0,
-                         TimerCallback, info);
-
-    if (info->ev == NULL) {
-        Debug("Error creating new Timer event : %lu", t_id);
-    }
-
-    timers_lock.lock();
-    timers[info->id] = info;
-    timers_lock.unlock();
-
-    int ret = event_add(info->ev, &tv);
-    if (ret != 0) {
-        Debug("Error adding new Timer event to eventbase %lu", t_id);
+void FastTransport::PrintLatencyStats() {
+    static const char *kinds[FASTTRANSPORT_LAT_KINDS] = {
+        "rtt", "queue", "service"
+    };
+    std::lock_guard<std::mutex> lock(fasttransport_lock);
+    LatencyHistogram merged;
+    for (int kind = 0; kind < FASTTRANSPORT_LAT_KINDS; kind++) {
+        for (int reqType = 0; reqType < 256; reqType++) {
+            merged.Reset();
+            for (fasttransport_stats_t *stats : fasttransport_stats) {
+                LatencyHistogram *hist =
+                    stats->hist[kind][reqType].load(std::memory_order_acquire);
+                if (hist != nullptr) merged.Merge(*hist);
+            }
+            if (merged.Count() == 0) continue;
+            Notice("Latency %s, reqType %d: %s", kinds[kind], reqType,
+                   merged.Summary().c_str());
+        }
     }
-    
-    return info->id;
 }
 
-bool FastTransport::CancelTimer(int id)
-{
-    FastTransportTimerInfo *info = timers[id];
-
-    if (info == NULL) {
-         return false;
+void FastTransport::PrintPollStats() {
+    std::lock_guard<std::mutex> lock(fasttransport_lock);
+    for (fasttransport_stats_t *stats : fasttransport_stats) {
+        const PollBackoff &poll = stats->poll;
+        uint64_t polls = poll.Polls();
+        if (polls == 0) continue;
+        Notice("RPC %d: %lu polls, %.2f%% busy, %lu sleeps, %.1f ms asleep",
+               stats->id, polls, 100.0 * poll.BusyPolls() / polls,
+               poll.Sleeps(), poll.SleptUs() / 1000.0);
     }
+}
 
-    event_del(info->ev);
-    event_free(info->ev);
+void FastTransport::SetPollBackoff(uint64_t maxSleepUs) {
+    std::lock_guard<std::mutex> lock(fasttransport_lock);
+    fasttransport_poll_backoff_us = maxSleepUs;
+}
 
-    timers_lock.lock();
-    timers.erase(info->id);
-    timers_lock.unlock();
+void FastTransport::SetMaxResponseSize(size_t size) {
+    std::lock_guard<std::mutex> lock(fasttransport_lock);
+    fasttransport_max_resp_size = size;
+}
 
-    delete info;
-    
-    return true;
+void FastTransport::RunOnce() {
+    uint64_t delivered = c->delivered;
+    c->server.turn_tsc = erpc::rdtsc();
+    c->rpc->run_event_loop_once();
+    if (unlikely(!c->client.reconnects.empty())) ScheduleReconnects();
+    timers.Poll();
+    c->stats->poll.Polled(c->delivered != delivered);
 }
 
-void FastTransport::CancelAllTimers() {
-    Debug("Cancelling all Timers");
-    while (!timers.empty()) {
-        auto kv = timers.begin();
-        CancelTimer(kv->first);
+void FastTransport::Run() {
+    while(!stop) {
+        RunOnce();
     }
 }
 
-void FastTransport::OnTimer(FastTransportTimerInfo *info) {
-    timers_lock.lock();
-    timers.erase(info->id);
-    timers_lock.unlock();
-
-    event_del(info->ev);
-    event_free(info->ev);
-
-    info->cb();
-
-    delete info;
+int FastTransport::Timer(uint64_t ms, timer_callback_t cb) {
+    return timers.Arm(ms * 1000, std::move(cb));
 }
 
-void FastTransport::TimerCallback(evutil_socket_t fd, short what, void *arg) {
-    FastTransport::FastTransportTimerInfo *info =
-        (FastTransport::FastTransportTimerInfo *)arg;
+int FastTransport::TimerMicro(uint64_t us, timer_callback_t cb) {
+    return timers.Arm(us, std::move(cb));
+}
 
-    ASSERT(what & EV_TIMEOUT);
+bool FastTransport::CancelTimer(int id) {
+    return timers.Cancel(id);
+}
 
-    info->transport->OnTimer(info);
+void FastTransport::CancelAllTimers() {
+    Debug("Cancelling all Timers");
+    timers.CancelAll();
 }
 
 void FastTransport::LogCallback(int severity, const char *msg) {
@@ -34,8 +34,12 @@
 #define _LIB_FASTTRANSPORT_H_
 
 #include "lib/configuration.h"
+#include "lib/histogram.h"
 #include "lib/transport.h"
 #include "lib/message.h"
+#include "lib/pollbackoff.h"
+#include "lib/reqhandletable.h"
+#include "lib/timerwheel.h"
 
 #include "rpc.h"
 #include "rpc_constants.h"
@@ -57,12 +61,6 @@
 
 #include <boost/unordered_map.hpp>
 
-// This would make fast transport to maintain a map of request handles
-// and send response to the indicated one
-// (will have a bit more overhead but required for the leader based replication
-// schemes)
-#define MULTIPLE_ACTIVE_REQUESTS false
-
 /*
  * Class FastTransport implements a multi-threaded
  * transport layer based on eRPC which works with
@@ -75,17 +73,78 @@
  * A transport receiver can either be a client or a server
  * replica. A transport instance's receivers must be
  * of the same type.
+ *
+ * Client transports open a session to every server thread of every
+ * replica when their first receiver registers, and look them up in a
+ * dense array on every send. A session that fails to connect or drops
+ * is opened again in the background, after FASTTRANSPORT_RECONNECT_US;
+ * only a send to that very session waits for it to come back.
  */
 
+struct fanout_t;
+
 // A tag attached to every request we send;
 // it is passed to the response function
 struct req_tag_t {
     erpc::MsgBuffer req_msgbuf;
     erpc::MsgBuffer resp_msgbuf;
+    // what the buffers were allocated for
+    size_t req_cap = 0;
+    size_t resp_cap = 0;
     uint8_t reqType;
     TransportReceiver *src;
+    // the fan-out group the tag belongs to, if any
+    fanout_t *fanout = nullptr;
+    // TSC when the request was enqueued
+    size_t sent_tsc;
+};
+
+// A request sent to several replicas at once. eRPC writes each
+// session's packet headers into the request MsgBuffer, so sessions
+// cannot share a single buffer; instead a group keeps one request and
+// one response buffer per destination. The group goes back to the pool,
+// buffers included, once the last response arrives, so in steady state
+// a fan-out costs one memcpy per extra replica and no allocations.
+struct fanout_t {
+    std::vector<req_tag_t> tags;
+    // responses not received yet
+    int refs = 0;
+};
+
+// A request a server thread has not answered yet
+struct fasttransport_req_t {
+    erpc::ReqHandle *req_handle;
+    size_t start_tsc;   // when its handler was called
+    uint8_t reqType;
+};
+
+// The latencies FastTransport records, per request type
+enum fasttransport_latency_t {
+    FASTTRANSPORT_LAT_RTT,      // client: request enqueued to response
+    FASTTRANSPORT_LAT_QUEUE,    // server: event loop turn to handler call
+    FASTTRANSPORT_LAT_SERVICE,  // server: handler call to response
+    FASTTRANSPORT_LAT_KINDS
 };
 
+// The statistics of one transport thread, which other threads may read.
+// The latency histograms are by kind and request type; the thread
+// creates a histogram the first time it records into it.
+struct fasttransport_stats_t {
+    uint8_t id;
+    std::atomic<LatencyHistogram *> hist[FASTTRANSPORT_LAT_KINDS][256];
+    // also decides how the thread waits when it has nothing to do
+    PollBackoff poll;
+};
+
+// A client session to one server thread of one replica
+struct fasttransport_session_t {
+    int num = -1;            // eRPC session number, -1 if none
+    bool connected = false;
+};
+
+// Delay before opening again a session that failed or dropped
+#define FASTTRANSPORT_RECONNECT_US (100 * 1000)
+
 // A basic mempool for preallocated objects of type T. eRPC has a faster,
 // hugepage-backed one.
 template <class T> class AppMemPool {
@@ -116,6 +175,76 @@ template <class T> class AppMemPool {
     }
 };
 
+// The MsgBuffer cache has one size class per power of two,
+// from FASTTRANSPORT_MIN_BUF_SIZE up
+#define FASTTRANSPORT_BUF_CLASSES 16
+#define FASTTRANSPORT_MIN_BUF_SIZE 64
+
+// A per-thread cache of the MsgBuffers we send requests from and receive
+// responses into. The replication protocols only use a handful of message
+// sizes, so after warm-up every request is served from the free lists
+// without calling into the eRPC allocator. Buffers larger than the
+// largest class are not cached.
+class MsgBufferCache {
+    public:
+        struct ClassStats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+        };
+
+        static inline size_t SizeClass(size_t size) {
+            size_t cls = 0;
+            while (cls < FASTTRANSPORT_BUF_CLASSES &&
+                   ((size_t)FASTTRANSPORT_MIN_BUF_SIZE << cls) < size) {
+                cls++;
+            }
+            return cls;
+        }
+
+        static inline size_t ClassSize(size_t cls) {
+            return (size_t)FASTTRANSPORT_MIN_BUF_SIZE << cls;
+        }
+
+        // Returns a buffer resized to size, and its capacity in cap
+        erpc::MsgBuffer alloc(erpc::Rpc<erpc::CTransport> *rpc,
+                              size_t size, size_t *cap) {
+            size_t cls = SizeClass(size);
+            if (cls == FASTTRANSPORT_BUF_CLASSES) {
+                *cap = size;
+                return rpc->alloc_msg_buffer_or_die(size);
+            }
+
+            erpc::MsgBuffer msgbuf;
+            if (free_lists[cls].empty()) {
+                stats[cls].misses++;
+                msgbuf = rpc->alloc_msg_buffer_or_die(ClassSize(cls));
+            } else {
+                stats[cls].hits++;
+                msgbuf = free_lists[cls].back();
+                free_lists[cls].pop_back();
+            }
+            rpc->resize_msg_buffer(&msgbuf, size);
+            *cap = ClassSize(cls);
+            return msgbuf;
+        }
+
+        void free(erpc::Rpc<erpc::CTransport> *rpc,
+                  const erpc::MsgBuffer &msgbuf, size_t cap) {
+            size_t cls = SizeClass(cap);
+            if (cls == FASTTRANSPORT_BUF_CLASSES) {
+                rpc->free_msg_buffer(msgbuf);
+            } else {
+                free_lists[cls].push_back(msgbuf);
+            }
+        }
+
+        const ClassStats &get_stats(size_t cls) const { return stats[cls]; }
+
+    private:
+        std::vector<erpc::MsgBuffer> free_lists[FASTTRANSPORT_BUF_CLASSES];
+        ClassStats stats[FASTTRANSPORT_BUF_CLASSES];
+};
+
 // eRPC context passed between request and responses
 class AppContext {
     public:
@@ -125,24 +254,34 @@ class AppContext {
             req_tag_t *crt_req_tag;
             // Request tags used for RPCs exchanged with the servers
             AppMemPool<req_tag_t> req_tag_pool;
-            boost::unordered_map<TransportReceiver *, boost::unordered_map<std::pair<uint8_t, uint8_t>, int>> sessions;
+            // Request and response buffers of the tags above
+            MsgBufferCache msgbuf_cache;
+            // Groups used by SendRequestToAll, they keep their buffers
+            AppMemPool<fanout_t> fanout_pool;
+            // Sessions to the server threads, shared by all the receivers
+            // of the transport and indexed by replicaIdx * nthreads + dstRpcIdx
+            std::vector<fasttransport_session_t> sessions;
+            // Index in sessions of each eRPC session number, -1 if unused
+            std::vector<int> session_slots;
+            // Sessions that failed or dropped, to be opened again
+            std::vector<int> reconnects;
         } client;
 
         struct {
-            // current req_handle
-#if MULTIPLE_ACTIVE_REQUESTS
-            boost::unordered_map<uint64_t, erpc::ReqHandle *> req_handles;
-            uint64_t req_handle_idx = 0;
-#endif
-            erpc::ReqHandle *req_handle;
-            std::vector<long> latency_get;
-            std::vector<long> latency_prepare;
-            std::vector<long> latency_commit;
+            // Requests not answered yet, and the one being delivered
+            ReqHandleTable<fasttransport_req_t> req_handles;
+            uint64_t crt_req_handle;
+            // TSC at the start of the current event loop turn
+            size_t turn_tsc = 0;
             TransportReceiver *receiver = nullptr;
         } server;
 
         // common to both servers and clients
         erpc::Rpc<erpc::CTransport> *rpc = nullptr;
+        fasttransport_stats_t *stats = nullptr;
+        double freq_ghz;
+        // requests and responses delivered so far
+        uint64_t delivered = 0;
 };
 
 class FastTransport : public Transport
@@ -158,10 +297,12 @@ public:
     virtual ~FastTransport();
     void Register(TransportReceiver *receiver,
                   int replicaIdx) override;
-    void Run();
+    void Run() override;
     void Wait();
-    void Stop();
+    void Stop() override;
+    void RunOnce() override;
     int Timer(uint64_t ms, timer_callback_t cb) override;
+    int TimerMicro(uint64_t us, timer_callback_t cb) override;
     bool CancelTimer(int id) override;
     void CancelAllTimers() override;
 
@@ -173,6 +314,45 @@ public:
     int GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) override;
 
     uint8_t GetID() override { return id; };
+
+    // Start connecting to every server thread of every replica, without
+    // waiting for the sessions to come up; Register does this for clients
+    void ConnectAll();
+
+    // Log the hit/miss counters of the MsgBuffer cache, per size class
+    void PrintMsgBufferStats();
+
+    // Merge the latency histograms of all the transports of the process
+    // and log them, per request type; safe to call from any thread
+    static void PrintLatencyStats();
+
+    // Log, for every transport thread of the process, how many turns of
+    // its event loop found work to do and how long it slept
+    static void PrintPollStats();
+
+    // Let the transports created from now on sleep up to maxSleepUs
+    // between two polls when idle (see PollBackoff); 0, the default,
+    // makes them poll without ever backing off
+    static void SetPollBackoff(uint64_t maxSleepUs);
+
+    // Let the transports created from now on answer requests with up to
+    // size bytes; by default responses must fit in one packet
+    static void SetMaxResponseSize(size_t size);
+
+    // Share one Nexus (and one session management port and thread)
+    // among all the transports of the process on the same NUMA node,
+    // instead of creating one per transport. Must be called before any
+    // transport is created, with the same setting on servers and clients.
+    static void ShareNexusPerNumaNode(bool share);
+
+    // NUMA node of a server thread; servers place their threads on two
+    // NUMA nodes, alternating every two threads
+    static uint8_t ServerNumaNode(uint8_t thread_id) {
+        return (thread_id % 4 < 2) ? 0 : 1;
+    }
+
+    // Session management port of the server thread rpcIdx
+    static uint16_t NexusPort(uint8_t rpcIdx);
 private:
     // Configuration of the replicas
     transport::Configuration config;
@@ -195,53 +375,27 @@ private:
     // Nexus object
     erpc::Nexus *nexus;
 
-    struct FastTransportTimerInfo
-    {
-        FastTransport *transport;
-        timer_callback_t cb;
-        event *ev;
-        int id;
-    };
-
     event_base *eventBase;
     std::vector<event *> signalEvents;
     AppContext *c;
     bool stop = false;
 
-    // TODO: find some other method to deal with timeouts (hidden in eRPC?)
-    uint64_t lastTimerId;
-    using timers_map = std::map<int, FastTransportTimerInfo *>;
-    timers_map timers;
-    std::mutex timers_lock;
+    // Timers are polled between two turns of the eRPC event loop
+    TimerWheel timers;
+
+    // Set once ConnectAll has started opening the sessions
+    bool connecting = false;
 
-    void OnTimer(FastTransportTimerInfo *info);
+    erpc::Nexus *CreateNexus(const std::string &ip, uint16_t port,
+                             uint8_t nr_req_types);
+    fanout_t *AllocFanout();
+    void OpenSession(int slot);
+    int WaitForSession(int slot);
+    void ScheduleReconnects();
     static void SocketCallback(evutil_socket_t fd, short what, void *arg);
-    static void TimerCallback(evutil_socket_t fd, short what, void *arg);
     static void LogCallback(int severity, const char *msg);
     static void FatalCallback(int err);
     static void SignalCallback(evutil_socket_t fd, short what, void *arg);
 };
 
-// A basic session management handler that expects successful responses
-static void basic_sm_handler(int session_num, erpc::SmEventType sm_event_type,
-                      erpc::SmErrType sm_err_type, void *_context) {
-
-    auto *c = static_cast<AppContext *>(_context);
-
-    Assert(sm_err_type == erpc::SmErrType::kNoError);
-    //  "SM response with error " + erpc::sm_err_type_str(sm_err_type));
-
-    if (!(sm_event_type == erpc::SmEventType::kConnected ||
-          sm_event_type == erpc::SmEventType::kDisconnected)) {
-        throw std::runtime_error("Received unexpected SM event.");
-    }
-
-    Debug("Rpc %u: Session number %d %s. Error %s. "
-            "Time elapsed = %.3f s.\n",
-            c->rpc->get_rpc_id(), session_num,
-            erpc::sm_event_type_str(sm_event_type).c_str(),
-            erpc::sm_err_type_str(sm_err_type).c_str(),
-            c->rpc->sec_since_creation());
-}
-
 #endif  // _LIB_FASTTRANSPORT_H_
@@ -0,0 +1,70 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/histogram.cc:
+ *   Log-linear latency histogram with a single writer
+ *
+ **********************************************************************/
+
+#include "lib/histogram.h"
+
+#include <cstdio>
+
+void LatencyHistogram::Reset() {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        uint64_t n = other.counts[i].load(std::memory_order_relaxed);
+        if (n > 0) Bump(counts[i], n);
+    }
+    Bump(count, other.count.load(std::memory_order_relaxed));
+    Bump(sum, other.sum.load(std::memory_order_relaxed));
+    uint64_t otherMax = other.Max();
+    if (otherMax > Max()) max.store(otherMax, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+    uint64_t n = Count();
+    if (n == 0) return 0;
+    return static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+    // the per bucket counts may be a little ahead of the total if
+    // the owner is recording, so add them up ourselves
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        total += counts[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > total) rank = total;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = UpperBound(i);
+            return bound < Max() ? bound : Max();
+        }
+    }
+    return Max();
+}
+
+std::string LatencyHistogram::Summary() const {
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "n=%lu mean=%.1fus p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus",
+             Count(), Mean() / 1000,
+             Percentile(50) / 1000.0, Percentile(99) / 1000.0,
+             Percentile(99.9) / 1000.0, Max() / 1000.0);
+    return buf;
+}
@@ -0,0 +1,95 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/histogram.h:
+ *   Log-linear latency histogram with a single writer
+ *
+ **********************************************************************/
+
+#ifndef _LIB_HISTOGRAM_H_
+#define _LIB_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Class LatencyHistogram counts latencies in nanoseconds in the style
+ * of HdrHistogram: every power of two is split in 2^HISTOGRAM_SUB_BITS
+ * linear buckets, so percentiles are within 1 / 2^HISTOGRAM_SUB_BITS
+ * of the recorded values at any scale. Values above HISTOGRAM_MAX_NS
+ * are counted in the last bucket.
+ *
+ * Only the owner thread records into a histogram, without locks or
+ * atomic read-modify-writes; any thread may merge it into another
+ * histogram at any time, and sees a slightly stale but consistent
+ * enough picture.
+ */
+
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_MAX_NS (1ull << HISTOGRAM_MAX_BITS)
+
+class LatencyHistogram
+{
+public:
+    static const size_t SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+    static const size_t BUCKETS =
+        (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram() { Reset(); }
+
+    // Called by the owner thread only
+    void Record(uint64_t ns) {
+        if (ns >= HISTOGRAM_MAX_NS) ns = HISTOGRAM_MAX_NS - 1;
+        Bump(counts[Index(ns)], 1);
+        Bump(count, 1);
+        Bump(sum, ns);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds the samples of other to this histogram, which must not be
+    // recorded into concurrently
+    void Merge(const LatencyHistogram &other);
+    void Reset();
+
+    uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return max.load(std::memory_order_relaxed); }
+    double Mean() const;
+    // Value at or below which p percent of the samples fall
+    uint64_t Percentile(double p) const;
+
+    // e.g. "n=1000 mean=5.2us p50=4.9us p99=9.8us p999=20.1us max=35.0us"
+    std::string Summary() const;
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    static void Bump(std::atomic<uint64_t> &c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    static size_t Index(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return ns;
+        int exp = 63 - __builtin_clzll(ns);
+        int shift = exp - HISTOGRAM_SUB_BITS;
+        return ((shift + 1) << HISTOGRAM_SUB_BITS) +
+               ((ns >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value counted in bucket idx
+    static uint64_t UpperBound(size_t idx) {
+        if (idx < SUB_BUCKETS) return idx;
+        int shift = (idx >> HISTOGRAM_SUB_BITS) - 1;
+        uint64_t sub = (idx & (SUB_BUCKETS - 1)) + SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+#endif  // _LIB_HISTOGRAM_H_
@@ -0,0 +1,309 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/loopbacktransport.cc:
+ *   In-process transport that moves requests and responses between
+ *   threads over lock-free single-producer/single-consumer rings
+ *
+ **********************************************************************/
+
+#include "lib/assert.h"
+#include "lib/configuration.h"
+#include "lib/message.h"
+#include "lib/loopbacktransport.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+
+// Server transports, indexed by (replicaIdx, rpc id); this is our
+// equivalent of the eRPC session management path, so a plain lock
+// is good enough
+static std::mutex loopback_lock;
+static std::map<std::pair<int, uint8_t>, LoopbackTransport *> loopback_servers;
+
+LoopbackTransport::LoopbackTransport(const transport::Configuration &config,
+                                     int nthreads,
+                                     uint8_t id)
+    : config(config),
+      nthreads(nthreads),
+      id(id),
+      hasNewSessions(false) {
+}
+
+LoopbackTransport::~LoopbackTransport() {
+    if (replicaIdx > -1) {
+        std::lock_guard<std::mutex> lock(loopback_lock);
+        loopback_servers.erase(std::make_pair(replicaIdx, id));
+    }
+    for (loopback_req_tag_t *tag : req_tag_pool) {
+        free(tag->req_buf);
+        free(tag->resp_buf);
+        delete tag;
+    }
+}
+
+void LoopbackTransport::Register(TransportReceiver *receiver, int replicaIdx) {
+    ASSERT(replicaIdx < config.n);
+
+    this->replicaIdx = replicaIdx;
+    if (replicaIdx > -1) {
+        this->receiver = receiver;
+        std::lock_guard<std::mutex> lock(loopback_lock);
+        loopback_servers[std::make_pair(replicaIdx, id)] = this;
+    }
+}
+
+loopback_req_tag_t *LoopbackTransport::AllocTag(size_t reqLen, size_t respLen) {
+    if (reqLen == 0)
+        reqLen = LOOPBACK_MAX_MSG_SIZE;
+    if (respLen == 0)
+        respLen = LOOPBACK_MAX_MSG_SIZE;
+
+    loopback_req_tag_t *tag;
+    if (req_tag_pool.empty()) {
+        tag = new loopback_req_tag_t();
+    } else {
+        tag = req_tag_pool.back();
+        req_tag_pool.pop_back();
+    }
+
+    // buffers only ever grow, so in steady state we do not allocate
+    if (tag->req_cap < reqLen) {
+        free(tag->req_buf);
+        tag->req_buf = static_cast<char *>(malloc(reqLen));
+        tag->req_cap = reqLen;
+    }
+    if (tag->resp_cap < respLen) {
+        free(tag->resp_buf);
+        tag->resp_buf = static_cast<char *>(malloc(respLen));
+        tag->resp_cap = respLen;
+    }
+    return tag;
+}
+
+void LoopbackTransport::FreeTag(loopback_req_tag_t *tag) {
+    req_tag_pool.push_back(tag);
+}
+
+char *LoopbackTransport::GetRequestBuf(size_t reqLen, size_t respLen) {
+    crt_req_tag = AllocTag(reqLen, respLen);
+    return crt_req_tag->req_buf;
+}
+
+int LoopbackTransport::GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) {
+    auto session_key = std::make_pair(replicaIdx, dstRpcIdx);
+
+    const auto iter = sessionIdx.find(session_key);
+    if (iter != sessionIdx.end()) {
+        return iter->second;
+    }
+
+    // Wait for the replica thread to come up
+    LoopbackTransport *server = nullptr;
+    while (server == nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(loopback_lock);
+            auto it = loopback_servers.find(std::make_pair((int)replicaIdx, dstRpcIdx));
+            if (it != loopback_servers.end()) {
+                server = it->second;
+            }
+        }
+        if (server == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    auto *session = new LoopbackSession();
+    session->client = this;
+    session->server = server;
+    {
+        std::lock_guard<std::mutex> lock(server->newSessionsLock);
+        server->newSessions.push_back(session);
+        server->hasNewSessions.store(true, std::memory_order_release);
+    }
+
+    int session_id = clientSessions.size();
+    clientSessions.push_back(session);
+    sessionIdx[session_key] = session_id;
+    Debug("Opened loopback session to replica %d, RPC id: %d", replicaIdx, dstRpcIdx);
+    return session_id;
+}
+
+void LoopbackTransport::Enqueue(int session_id, loopback_req_tag_t *tag, size_t msgLen) {
+    ASSERT(msgLen <= tag->req_cap);
+    loopback_msg_t m = { tag, tag->reqType, msgLen };
+    LoopbackSession *session = clientSessions[session_id];
+    while (!session->requests.TryPush(m)) {
+        // Drain our responses so that the server can make progress, and
+        // serve the requests sent to us: the server may be a replica
+        // that is itself stuck sending to us. The requests are served
+        // nested in the upcall we may be in, whose handle is kept.
+        if (hasNewSessions.load(std::memory_order_acquire)) {
+            AdoptNewSessions();
+        }
+        const uint64_t req = crtReq;
+        PollRequests();
+        crtReq = req;
+        PollResponses();
+    }
+}
+
+// This function assumes the message has already been copied to the
+// request buffer
+bool LoopbackTransport::SendRequestToReplica(TransportReceiver *src,
+                                             uint8_t reqType,
+                                             uint8_t replicaIdx,
+                                             uint8_t dstRpcIdx,
+                                             size_t msgLen) {
+    ASSERT(replicaIdx < config.n);
+    int session_id = GetSession(src, replicaIdx, dstRpcIdx);
+
+    crt_req_tag->src = src;
+    crt_req_tag->reqType = reqType;
+    Enqueue(session_id, crt_req_tag, msgLen);
+    crt_req_tag = nullptr;
+
+    WaitFor([src]() { return !src->Blocked(); });
+    return true;
+}
+
+// Sends to all replicas except if the sender is a replica,
+// it doesn't send to the sending replica
+bool LoopbackTransport::SendRequestToAll(TransportReceiver *src,
+                                         uint8_t reqType,
+                                         uint8_t dstRpcIdx,
+                                         size_t msgLen) {
+    // the current request buffer goes to the last destination,
+    // all the others get their own copy
+    int last = config.n - 1;
+    if (last == this->replicaIdx) last--;
+
+    for (int i = 0; i <= last; i++) {
+        // skip the sending replica
+        if (this->replicaIdx == i) continue;
+        int session_id = GetSession(src, i, dstRpcIdx);
+
+        loopback_req_tag_t *tag;
+        if (i == last) {
+            tag = crt_req_tag;
+        } else {
+            tag = AllocTag(msgLen, crt_req_tag->resp_cap);
+            std::memcpy(tag->req_buf, crt_req_tag->req_buf, msgLen);
+        }
+        tag->src = src;
+        tag->reqType = reqType;
+        Enqueue(session_id, tag, msgLen);
+    }
+    if (last < 0) {
+        // nobody to send to
+        FreeTag(crt_req_tag);
+    }
+    crt_req_tag = nullptr;
+
+    WaitFor([src]() { return !src->Blocked(); });
+    return true;
+}
+
+void LoopbackTransport::Respond(const PendingResponse &p, size_t msgLen) {
+    ASSERT(msgLen <= p.tag->resp_cap);
+    loopback_msg_t m = { p.tag, p.reqType, msgLen };
+    // the client always drains its responses, so this cannot deadlock
+    while (!p.session->responses.TryPush(m)) {
+        std::this_thread::yield();
+    }
+    Debug("Sent response, msgLen = %lu\n", msgLen);
+}
+
+// For requests answered after ReceiveRequest returned
+bool LoopbackTransport::SendResponse(uint64_t reqHandleIdx, size_t msgLen) {
+    Respond(pendingResps.Take(reqHandleIdx), msgLen);
+    return true;
+}
+
+// Assumes we already put the response in the response buffer
+// passed to ReceiveRequest
+bool LoopbackTransport::SendResponse(size_t msgLen) {
+    return SendResponse(crtReq, msgLen);
+}
+
+void LoopbackTransport::AdoptNewSessions() {
+    std::lock_guard<std::mutex> lock(newSessionsLock);
+    for (LoopbackSession *session : newSessions) {
+        serverSessions.push_back(session);
+    }
+    newSessions.clear();
+    hasNewSessions.store(false, std::memory_order_relaxed);
+}
+
+bool LoopbackTransport::PollRequests() {
+    bool polled = false;
+    loopback_msg_t m;
+    for (size_t i = 0; i < serverSessions.size(); i++) {
+        LoopbackSession *session = serverSessions[i];
+        while (session->requests.TryPop(&m)) {
+            polled = true;
+            Debug("Received request, reqType = %d", m.reqType);
+            crtReq = pendingResps.Insert(
+                PendingResponse{ session, m.tag, m.reqType });
+            receiver->ReceiveRequest(crtReq, m.reqType,
+                                     m.tag->req_buf, m.tag->resp_buf);
+        }
+    }
+    return polled;
+}
+
+bool LoopbackTransport::PollResponses() {
+    bool polled = false;
+    loopback_msg_t m;
+    // the receivers may open new sessions from the upcall,
+    // so do not hold on to iterators
+    for (size_t i = 0; i < clientSessions.size(); i++) {
+        while (clientSessions[i]->responses.TryPop(&m)) {
+            polled = true;
+            Debug("Received response, reqType = %d", m.reqType);
+            m.tag->src->ReceiveResponse(m.reqType, m.tag->resp_buf);
+            FreeTag(m.tag);
+        }
+    }
+    return polled;
+}
+
+void LoopbackTransport::RunOnce() {
+    if (hasNewSessions.load(std::memory_order_acquire)) {
+        AdoptNewSessions();
+    }
+    PollRequests();
+    PollResponses();
+    timers.Poll();
+}
+
+void LoopbackTransport::Run() {
+    while (!stop) {
+        RunOnce();
+    }
+}
+
+void LoopbackTransport::Stop() {
+    Debug("Stopping transport!");
+    stop = true;
+}
+
+int LoopbackTransport::Timer(uint64_t ms, timer_callback_t cb) {
+    return timers.Arm(ms * 1000, std::move(cb));
+}
+
+int LoopbackTransport::TimerMicro(uint64_t us, timer_callback_t cb) {
+    return timers.Arm(us, std::move(cb));
+}
+
+bool LoopbackTransport::CancelTimer(int id) {
+    return timers.Cancel(id);
+}
+
+void LoopbackTransport::CancelAllTimers() {
+    Debug("Cancelling all Timers");
+    timers.CancelAll();
+}
@@ -0,0 +1,191 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/loopbacktransport.h:
+ *   In-process transport that moves requests and responses between
+ *   threads over lock-free single-producer/single-consumer rings
+ *
+ **********************************************************************/
+
+#ifndef _LIB_LOOPBACKTRANSPORT_H_
+#define _LIB_LOOPBACKTRANSPORT_H_
+
+#include "lib/configuration.h"
+#include "lib/reqhandletable.h"
+#include "lib/timerwheel.h"
+#include "lib/transport.h"
+#include "lib/message.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Class LoopbackTransport implements the Transport interface for
+ * replicas and clients that all live in the same process. It is meant
+ * for profiling the replication protocols and the concurrency control
+ * without a fast NIC (and without any network noise).
+ *
+ * Like FastTransport, there is one transport instance per thread and
+ * the instance id plays the role of the eRPC rpc id: a server thread
+ * registers itself as (replicaIdx, id) and clients address it with
+ * (replicaIdx, dstRpcIdx). A "session" between two transports is a
+ * pair of SPSC rings, one carrying requests and one carrying the
+ * matching responses back. Messages are never copied between threads;
+ * the rings carry pointers to the buffers handed out by GetRequestBuf.
+ */
+
+#define LOOPBACK_RING_SIZE 1024
+#define LOOPBACK_MAX_MSG_SIZE 65536
+
+// A bounded, lock-free ring with exactly one producer thread
+// and exactly one consumer thread
+template <class T, size_t N> class SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Called only by the producer
+    bool TryPush(const T &t) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots[h & (N - 1)] = t;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Called only by the consumer
+    bool TryPop(T *t) {
+        const size_t tl = tail.load(std::memory_order_relaxed);
+        if (tl == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *t = slots[tl & (N - 1)];
+        tail.store(tl + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // keep the producer and consumer indices on different cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) T slots[N];
+};
+
+// A tag attached to every request we send; it owns the request and
+// the response buffers and is recycled once the response is delivered
+struct loopback_req_tag_t {
+    char *req_buf = nullptr;
+    char *resp_buf = nullptr;
+    size_t req_cap = 0;
+    size_t resp_cap = 0;
+    uint8_t reqType;
+    TransportReceiver *src;
+};
+
+// What travels over the rings
+struct loopback_msg_t {
+    loopback_req_tag_t *tag;
+    uint8_t reqType;
+    size_t len;
+};
+
+class LoopbackTransport;
+
+struct LoopbackSession {
+    LoopbackTransport *client;
+    LoopbackTransport *server;
+    SpscRing<loopback_msg_t, LOOPBACK_RING_SIZE> requests;
+    SpscRing<loopback_msg_t, LOOPBACK_RING_SIZE> responses;
+};
+
+class LoopbackTransport : public Transport
+{
+public:
+    LoopbackTransport(const transport::Configuration &config,
+                      int nthreads,
+                      uint8_t id);
+    virtual ~LoopbackTransport();
+    void Register(TransportReceiver *receiver,
+                  int replicaIdx) override;
+    void Run() override;
+    void Stop() override;
+    int Timer(uint64_t ms, timer_callback_t cb) override;
+    int TimerMicro(uint64_t us, timer_callback_t cb) override;
+    bool CancelTimer(int id) override;
+    void CancelAllTimers() override;
+
+    bool SendRequestToReplica(TransportReceiver *src, uint8_t reqType, uint8_t replicaIdx, uint8_t dstRpcIdx, size_t msgLen) override;
+    bool SendRequestToAll(TransportReceiver *src, uint8_t reqType, uint8_t dstRpcIdx, size_t msgLen) override;
+    bool SendResponse(uint64_t reqHandleIdx, size_t msgLen) override;
+    bool SendResponse(size_t msgLen) override;
+    char *GetRequestBuf(size_t reqLen, size_t respLen) override;
+    int GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) override;
+
+    uint8_t GetID() override { return id; };
+
+    // Poll all the rings and the timers once; this is the equivalent
+    // of eRPC's run_event_loop_once
+    void RunOnce() override;
+
+private:
+    // A request handed to the receiver that has not been answered yet
+    struct PendingResponse {
+        LoopbackSession *session;
+        loopback_req_tag_t *tag;
+        uint8_t reqType;
+    };
+
+    // Configuration of the replicas
+    transport::Configuration config;
+
+    // Number of server threads
+    int nthreads;
+
+    // used as the RPC id, must be unique per transport thread
+    uint8_t id;
+
+    // Index of the replica server
+    int replicaIdx = -1;
+
+    TransportReceiver *receiver = nullptr;
+    volatile bool stop = false;
+
+    // This is maintained between calls to GetRequestBuf and SendRequest
+    loopback_req_tag_t *crt_req_tag = nullptr;
+    std::vector<loopback_req_tag_t *> req_tag_pool;
+
+    // Sessions on which we are the client, indexed by session number
+    std::vector<LoopbackSession *> clientSessions;
+    std::map<std::pair<uint8_t, uint8_t>, int> sessionIdx;
+
+    // Sessions on which we are the server
+    std::vector<LoopbackSession *> serverSessions;
+    // Sessions opened by other threads, not yet picked up by us
+    std::mutex newSessionsLock;
+    std::vector<LoopbackSession *> newSessions;
+    std::atomic<bool> hasNewSessions;
+
+    // Requests being served
+    ReqHandleTable<PendingResponse> pendingResps;
+    // Handle of the request being delivered
+    uint64_t crtReq = 0;
+
+    // Timers are only touched by the owner thread
+    TimerWheel timers;
+
+    loopback_req_tag_t *AllocTag(size_t reqLen, size_t respLen);
+    void FreeTag(loopback_req_tag_t *tag);
+    void Enqueue(int session_id, loopback_req_tag_t *tag, size_t msgLen);
+    void Respond(const PendingResponse &p, size_t msgLen);
+    void AdoptNewSessions();
+    bool PollRequests();
+    bool PollResponses();
+};
+
+#endif  // _LIB_LOOPBACKTRANSPORT_H_
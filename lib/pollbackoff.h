@@ -0,0 +1,103 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/pollbackoff.h:
+ *   Adaptive backoff for busy-polling event loops
+ *
+ **********************************************************************/
+
+#ifndef _LIB_POLLBACKOFF_H_
+#define _LIB_POLLBACKOFF_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include <immintrin.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+/*
+ * Class PollBackoff decides what a polling thread does after a turn of
+ * its event loop that found nothing to do. The first
+ * POLLBACKOFF_SPIN_POLLS empty turns in a row poll again right away,
+ * the next POLLBACKOFF_PAUSE_POLLS ones pause the core for a few cycles
+ * first, and after that the thread sleeps between two turns, 1us at
+ * first and twice as long each time, up to the configured maximum. The
+ * first turn that finds work snaps back to pure polling.
+ *
+ * A maximum sleep of 0 disables backing off. Otherwise, the first
+ * request after an idle period waits up to that long, and so can the
+ * timers of the thread.
+ *
+ * The counters are written by the owner thread only and may be read
+ * from any thread.
+ */
+
+#define POLLBACKOFF_SPIN_POLLS 1024
+#define POLLBACKOFF_PAUSE_POLLS 4096
+
+class PollBackoff
+{
+public:
+    explicit PollBackoff(uint64_t maxSleepUs = 0) : maxSleepUs(maxSleepUs) {}
+
+    void SetMaxSleep(uint64_t us) { maxSleepUs = us; }
+
+    // Called by the owner thread after every turn of its event loop
+    void Polled(bool busy) {
+        Bump(polls, 1);
+        if (busy) {
+            Bump(busyPolls, 1);
+            emptyPolls = 0;
+            sleepUs = 1;
+            return;
+        }
+        if (maxSleepUs == 0) return;
+        emptyPolls++;
+        if (emptyPolls <= POLLBACKOFF_SPIN_POLLS) return;
+        if (emptyPolls <= POLLBACKOFF_SPIN_POLLS + POLLBACKOFF_PAUSE_POLLS) {
+            _mm_pause();
+            return;
+        }
+        Sleep();
+    }
+
+    uint64_t Polls() const { return polls.load(std::memory_order_relaxed); }
+    uint64_t BusyPolls() const { return busyPolls.load(std::memory_order_relaxed); }
+    uint64_t Sleeps() const { return sleeps.load(std::memory_order_relaxed); }
+    uint64_t SleptUs() const { return sleptUs.load(std::memory_order_relaxed); }
+
+private:
+    uint64_t maxSleepUs;
+    uint64_t emptyPolls = 0;
+    uint64_t sleepUs = 1;
+    bool slackSet = false;
+
+    std::atomic<uint64_t> polls{0};
+    std::atomic<uint64_t> busyPolls{0};
+    std::atomic<uint64_t> sleeps{0};
+    std::atomic<uint64_t> sleptUs{0};
+
+    static void Bump(std::atomic<uint64_t> &c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    void Sleep() {
+        if (!slackSet) {
+            // the default 50us timer slack would dwarf our sleeps
+            prctl(PR_SET_TIMERSLACK, 1000UL);
+            slackSet = true;
+        }
+        struct timespec ts;
+        ts.tv_sec = sleepUs / 1000000;
+        ts.tv_nsec = (sleepUs % 1000000) * 1000;
+        nanosleep(&ts, nullptr);
+        Bump(sleeps, 1);
+        Bump(sleptUs, sleepUs);
+        sleepUs *= 2;
+        if (sleepUs > maxSleepUs) sleepUs = maxSleepUs;
+    }
+};
+
+#endif  // _LIB_POLLBACKOFF_H_
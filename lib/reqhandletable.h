@@ -0,0 +1,89 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/reqhandletable.h:
+ *   Table of the requests a server transport has not answered yet
+ *
+ **********************************************************************/
+
+#ifndef _LIB_REQHANDLETABLE_H_
+#define _LIB_REQHANDLETABLE_H_
+
+#include "lib/message.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Class ReqHandleTable maps the request handles a transport passes to
+ * TransportReceiver::ReceiveRequest to whatever it needs to answer the
+ * request later. Handles index a slot array directly; the upper 32 bits
+ * carry the generation of the slot, so answering a request twice, or
+ * answering with a handle whose slot has been reused, is caught instead
+ * of answering somebody else's request.
+ *
+ * Freed slots are reused first, so in steady state inserting and taking
+ * a handle touch a single slot and never allocate. The table starts
+ * with the given capacity and doubles when it runs out of slots;
+ * transports that know how many requests can be in flight at once
+ * (e.g. from eRPC's session credits) size it so that it never grows.
+ */
+
+template <class T> class ReqHandleTable
+{
+public:
+    explicit ReqHandleTable(size_t capacity = 64) { Reserve(capacity); }
+
+    // Grows the table to at least capacity slots
+    void Reserve(size_t capacity) {
+        if (capacity > slots.size()) Grow(capacity - slots.size());
+    }
+
+    uint64_t Insert(const T &value) {
+        if (freeSlots.empty()) Grow(slots.empty() ? 1 : slots.size());
+        uint32_t idx = freeSlots.back();
+        freeSlots.pop_back();
+        Slot &slot = slots[idx];
+        slot.value = value;
+        slot.used = true;
+        return (static_cast<uint64_t>(slot.gen) << 32) | idx;
+    }
+
+    // Returns the value of handle and frees its slot
+    T Take(uint64_t handle) {
+        uint32_t idx = static_cast<uint32_t>(handle);
+        uint32_t gen = static_cast<uint32_t>(handle >> 32);
+        if (idx >= slots.size() || !slots[idx].used || slots[idx].gen != gen) {
+            Panic("Unknown request handle %lu", handle);
+        }
+        Slot &slot = slots[idx];
+        slot.used = false;
+        slot.gen++;
+        freeSlots.push_back(idx);
+        return slot.value;
+    }
+
+    // Number of requests in the table
+    size_t Size() const { return slots.size() - freeSlots.size(); }
+
+private:
+    struct Slot {
+        T value;
+        uint32_t gen = 0;
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    void Grow(size_t n) {
+        size_t old = slots.size();
+        slots.resize(old + n);
+        // hand out the lower indices first
+        for (size_t i = old + n; i-- > old;) {
+            freeSlots.push_back(i);
+        }
+    }
+};
+
+#endif  // _LIB_REQHANDLETABLE_H_
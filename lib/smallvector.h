@@ -0,0 +1,105 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/smallvector.h:
+ *   Vector of trivially copyable elements with inline capacity
+ *
+ **********************************************************************/
+
+#ifndef _LIB_SMALLVECTOR_H_
+#define _LIB_SMALLVECTOR_H_
+
+#include "lib/message.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Class SmallVector keeps its first N elements inside the object and
+ * only moves them to the heap when it outgrows them. clear() keeps the
+ * capacity, so a SmallVector that is cleared and refilled over and over
+ * stops allocating once it has reached its largest size.
+ *
+ * Elements are copied with memcpy and never constructed or destroyed,
+ * so they must be trivially copyable. Growing invalidates pointers to
+ * the elements.
+ */
+
+template <class T, size_t N> class SmallVector
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SmallVector elements must be trivially copyable");
+
+public:
+    SmallVector() : ptr(storage), len(0), cap(N) {}
+    SmallVector(const SmallVector &other) : SmallVector() {
+        append(other.data(), other.size());
+    }
+    SmallVector &operator=(const SmallVector &other) {
+        if (this != &other) {
+            clear();
+            append(other.data(), other.size());
+        }
+        return *this;
+    }
+    ~SmallVector() {
+        if (ptr != storage) free(ptr);
+    }
+
+    T *data() { return ptr; }
+    const T *data() const { return ptr; }
+    size_t size() const { return len; }
+    size_t capacity() const { return cap; }
+    bool empty() const { return len == 0; }
+
+    T &operator[](size_t i) { return ptr[i]; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    T *begin() { return ptr; }
+    T *end() { return ptr + len; }
+    const T *begin() const { return ptr; }
+    const T *end() const { return ptr + len; }
+
+    void clear() { len = 0; }
+
+    void reserve(size_t n) {
+        if (n > cap) Grow(n);
+    }
+
+    // New elements are left uninitialized
+    void resize(size_t n) {
+        reserve(n);
+        len = n;
+    }
+
+    void push_back(const T &value) {
+        if (len == cap) Grow(len + 1);
+        ptr[len++] = value;
+    }
+
+    void append(const T *values, size_t n) {
+        reserve(len + n);
+        if (n > 0) memcpy(ptr + len, values, n * sizeof(T));
+        len += n;
+    }
+
+private:
+    T *ptr;
+    size_t len;
+    size_t cap;
+    T storage[N];
+
+    void Grow(size_t n) {
+        size_t newCap = cap * 2 > n ? cap * 2 : n;
+        T *newPtr = static_cast<T *>(malloc(newCap * sizeof(T)));
+        if (newPtr == nullptr) {
+            Panic("Failed to grow SmallVector to %lu elements", newCap);
+        }
+        if (len > 0) memcpy(newPtr, ptr, len * sizeof(T));
+        if (ptr != storage) free(ptr);
+        ptr = newPtr;
+        cap = newCap;
+    }
+};
+
+#endif  // _LIB_SMALLVECTOR_H_
@@ -0,0 +1,158 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/timerwheel.cc:
+ *   Hashed timer wheel polled from the transport event loops
+ *
+ **********************************************************************/
+
+#include "lib/assert.h"
+#include "lib/timerwheel.h"
+
+#include <time.h>
+
+TimerWheel::TimerWheel() {
+    for (size_t i = 0; i < TIMERWHEEL_SLOTS; i++) {
+        slots[i] = NIL;
+    }
+    current = NowUs() / TIMERWHEEL_TICK_US;
+}
+
+uint64_t TimerWheel::NowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+TimerWheel::Entry *TimerWheel::Lookup(int id) {
+    if (id <= 0) return nullptr;
+    uint32_t idx = static_cast<uint32_t>(id) & IDX_MASK;
+    uint32_t gen = static_cast<uint32_t>(id) >> IDX_BITS;
+    if (idx >= entries.size()) return nullptr;
+    Entry *e = &entries[idx];
+    if (!e->armed || e->gen != gen) return nullptr;
+    return e;
+}
+
+void TimerWheel::Link(uint32_t idx) {
+    Entry &e = entries[idx];
+    uint32_t slot = e.deadline & (TIMERWHEEL_SLOTS - 1);
+    e.slot = slot;
+    e.prev = NIL;
+    e.next = slots[slot];
+    if (e.next != NIL) entries[e.next].prev = idx;
+    slots[slot] = idx;
+}
+
+void TimerWheel::Unlink(uint32_t idx) {
+    Entry &e = entries[idx];
+    if (e.slot == NIL) return;
+    if (e.prev != NIL) {
+        entries[e.prev].next = e.next;
+    } else {
+        slots[e.slot] = e.next;
+    }
+    if (e.next != NIL) entries[e.next].prev = e.prev;
+    e.slot = NIL;
+}
+
+void TimerWheel::Release(uint32_t idx) {
+    Entry &e = entries[idx];
+    e.armed = false;
+    e.cb = nullptr;
+    // skip generation 0 so that ids stay positive
+    e.gen = (e.gen + 1) & GEN_MASK;
+    if (e.gen == 0) e.gen = 1;
+    freeEntries.push_back(idx);
+    armed--;
+}
+
+int TimerWheel::Arm(uint64_t us, timer_callback_t cb) {
+    uint64_t now = NowUs() / TIMERWHEEL_TICK_US;
+    if (armed == 0) {
+        // nothing to catch up with
+        current = now;
+    }
+
+    uint32_t idx;
+    if (freeEntries.empty()) {
+        ASSERT(entries.size() < IDX_MASK);
+        idx = entries.size();
+        entries.emplace_back();
+        entries[idx].gen = 1;
+    } else {
+        idx = freeEntries.back();
+        freeEntries.pop_back();
+    }
+
+    Entry &e = entries[idx];
+    e.deadline = now + (us + TIMERWHEEL_TICK_US - 1) / TIMERWHEEL_TICK_US;
+    // a timer due before the next tick we process fires on the next poll
+    if (e.deadline < current) e.deadline = current;
+    e.cb = std::move(cb);
+    e.armed = true;
+    Link(idx);
+    armed++;
+    return MakeId(idx, e.gen);
+}
+
+bool TimerWheel::Cancel(int id) {
+    Entry *e = Lookup(id);
+    if (e == nullptr) {
+        return false;
+    }
+    uint32_t idx = static_cast<uint32_t>(id) & IDX_MASK;
+    Unlink(idx);
+    Release(idx);
+    return true;
+}
+
+void TimerWheel::CancelAll() {
+    for (uint32_t idx = 0; idx < entries.size(); idx++) {
+        if (entries[idx].armed) {
+            Unlink(idx);
+            Release(idx);
+        }
+    }
+}
+
+void TimerWheel::PollSlow(uint64_t nowUs) {
+    uint64_t now = nowUs / TIMERWHEEL_TICK_US;
+    if (now < current) return;
+
+    // Callbacks may poll again (e.g. by running the event loop), so
+    // work on our own list of due timers
+    std::vector<int> due;
+    due.swap(expired);
+
+    // After a long pause, one pass over the wheel covers every tick
+    uint64_t ticks = now - current + 1;
+    if (ticks > TIMERWHEEL_SLOTS) ticks = TIMERWHEEL_SLOTS;
+    for (uint64_t t = 0; t < ticks; t++) {
+        uint32_t idx = slots[(current + t) & (TIMERWHEEL_SLOTS - 1)];
+        while (idx != NIL) {
+            Entry &e = entries[idx];
+            uint32_t next = e.next;
+            if (e.deadline <= now) {
+                Unlink(idx);
+                due.push_back(MakeId(idx, e.gen));
+            }
+            idx = next;
+        }
+    }
+    current = now + 1;
+
+    for (int id : due) {
+        // an earlier callback may have cancelled this one
+        Entry *e = Lookup(id);
+        if (e == nullptr) continue;
+        timer_callback_t cb = std::move(e->cb);
+        Release(static_cast<uint32_t>(id) & IDX_MASK);
+        cb();
+    }
+
+    due.clear();
+    if (expired.empty()) {
+        expired.swap(due);
+    }
+}
@@ -0,0 +1,94 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/timerwheel.h:
+ *   Hashed timer wheel polled from the transport event loops
+ *
+ **********************************************************************/
+
+#ifndef _LIB_TIMERWHEEL_H_
+#define _LIB_TIMERWHEEL_H_
+
+#include "lib/transport.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Class TimerWheel keeps the timers of one transport thread. Timers
+ * hash into TIMERWHEEL_SLOTS buckets by their deadline, in ticks of
+ * TIMERWHEEL_TICK_US microseconds; a timer further away than one turn
+ * of the wheel just stays in its bucket until its deadline comes
+ * around. Arming and cancelling are O(1) and do not allocate once the
+ * timer slab has grown to the number of concurrently armed timers.
+ *
+ * The wheel is not thread safe: it must only be used by the thread
+ * that owns the transport, which calls Poll between two turns of its
+ * event loop.
+ *
+ * Timer ids carry a generation, so cancelling a timer that already
+ * fired (or was cancelled) is a harmless no-op even if its entry has
+ * since been reused. Ids are always positive.
+ */
+
+#define TIMERWHEEL_SLOTS 1024
+#define TIMERWHEEL_TICK_US 1
+
+class TimerWheel
+{
+public:
+    TimerWheel();
+
+    // Arms a timer firing cb in us microseconds, returns its id
+    int Arm(uint64_t us, timer_callback_t cb);
+    // Returns false if the timer was not armed
+    bool Cancel(int id);
+    void CancelAll();
+
+    // Fires the timers that are due; callbacks may arm and cancel timers
+    void Poll() {
+        if (armed > 0) {
+            PollSlow(NowUs());
+        }
+    }
+
+    size_t Armed() const { return armed; }
+
+    static uint64_t NowUs();
+
+private:
+    static const int IDX_BITS = 20;
+    static const uint32_t IDX_MASK = (1u << IDX_BITS) - 1;
+    static const uint32_t GEN_MASK = (1u << (31 - IDX_BITS)) - 1;
+    static const uint32_t NIL = UINT32_MAX;
+
+    struct Entry {
+        uint64_t deadline;  // in ticks
+        timer_callback_t cb;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t slot;      // NIL if not linked in a slot
+        uint32_t gen;
+        bool armed;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    uint32_t slots[TIMERWHEEL_SLOTS];
+    size_t armed = 0;
+    // Ticks up to (excluding) this one have been processed
+    uint64_t current;
+    // Timers due in the current poll, reused between polls
+    std::vector<int> expired;
+
+    static int MakeId(uint32_t idx, uint32_t gen) {
+        return static_cast<int>((gen << IDX_BITS) | idx);
+    }
+    Entry *Lookup(int id);
+    void Link(uint32_t idx);
+    void Unlink(uint32_t idx);
+    void Release(uint32_t idx);
+    void PollSlow(uint64_t now);
+};
+
+#endif  // _LIB_TIMERWHEEL_H_
@@ -33,8 +33,27 @@
 #include "lib/assert.h"
 #include "lib/transport.h"
 
+#include <boost/fiber/operations.hpp>
+
 TransportReceiver::~TransportReceiver(){}
 
+void
+Transport::WaitFor(const std::function<bool (void)> &done)
+{
+    if (done()) return;
+
+    waiters++;
+    do {
+        // give the other fibers a chance to send their requests first
+        boost::this_fiber::yield();
+        if (++visits >= waiters) {
+            visits = 0;
+            RunOnce();
+        }
+    } while (!done());
+    waiters--;
+}
+
 Timeout::Timeout(Transport *transport, uint64_t ms, timer_callback_t cb)
     : transport(transport), ms(ms), cb(cb)
 {
@@ -43,11 +43,16 @@ class TransportReceiver
 {
 public:
     virtual ~TransportReceiver();
+    // Receivers that answer every request before returning implement
+    // this one and answer with Transport::SendResponse(msgLen)
     virtual void ReceiveRequest(uint8_t reqType, char *reqBuf, char *respBuf) {
-        PPanic("Not implemented; did you forget to set the MULTIPLE_ACTIVE_REQUESTS flag accordingly?");
+        PPanic("Not implemented.");
     };
+    // Receivers that may answer later implement this one, keep
+    // reqHandleIdx, and answer with Transport::SendResponse(reqHandleIdx,
+    // msgLen); the transports always call this one
     virtual void ReceiveRequest(uint64_t reqHandleIdx, uint8_t reqType, char *reqBuf, char *respBuf) {
-        PPanic("Not implemented; did you forget to set the MULTIPLE_ACTIVE_REQUESTS flag accordingly?");
+        ReceiveRequest(reqType, reqBuf, respBuf);
     };
     virtual void ReceiveResponse(uint8_t reqType, char *respBuf) = 0;
     virtual bool Blocked() = 0;
@@ -61,11 +66,20 @@ public:
     virtual ~Transport() {}
     virtual void Register(TransportReceiver *receiver,
                           int replicaIdx) = 0;
+    // Run the event loop of the calling thread until Stop is called
+    virtual void Run() = 0;
+    virtual void Stop() = 0;
+    // Run one iteration of the event loop; receivers with requests
+    // in flight call this while they wait for the responses
+    virtual void RunOnce() = 0;
+    // Answers the request being delivered by ReceiveRequest
     virtual bool SendResponse(size_t msgLen) = 0;
-    virtual bool SendResponse(uint64_t bufIdx, size_t msgLen) = 0;
+    // Answers the request with the given handle, at any time
+    virtual bool SendResponse(uint64_t reqHandleIdx, size_t msgLen) = 0;
     virtual bool SendRequestToReplica(TransportReceiver *src, uint8_t reqType, uint8_t replicaIdx, uint8_t coreIdx, size_t msgLen) = 0;
     virtual bool SendRequestToAll(TransportReceiver *src, uint8_t reqType, uint8_t coreIdx, size_t msgLen) = 0;
     virtual int Timer(uint64_t ms, timer_callback_t cb) = 0;
+    virtual int TimerMicro(uint64_t us, timer_callback_t cb) = 0;
     virtual bool CancelTimer(int id) = 0;
     virtual void CancelAllTimers() = 0;
 
@@ -73,6 +87,20 @@ public:
     virtual int GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) = 0;
 
     virtual uint8_t GetID() = 0;
+
+    // Runs the event loop until done returns true, letting the other
+    // fibers of the thread run in between. The fibers waiting on the
+    // transport share one turn of the event loop per round of the
+    // scheduler, so the requests they send during a round go out in
+    // one burst and the responses received meanwhile are dispatched
+    // together.
+    virtual void WaitFor(const std::function<bool (void)> &done);
+
+protected:
+    // Fibers in WaitFor, and how many of them ran since the last turn
+    // of the event loop
+    int waiters = 0;
+    int visits = 0;
 };
 
 class Timeout
@@ -58,17 +58,10 @@ public:
         }
     }
     
-    virtual bool
-    SendMessage(TransportReceiver *src, const TransportAddress &dst,
-                const Message &m)
-    {
-        const ADDR &dstAddr = dynamic_cast<const ADDR &>(dst);
-        return SendMessageInternal(src, dstAddr, m, false);
-    }
-
-    virtual bool
-    SendMessageToReplica(TransportReceiver *src, int replicaIdx,
-                         const Message &m)
+    // Returns the cached address of replica replicaIdx in the
+    // configuration src registered with
+    const ADDR &
+    ReplicaAddress(TransportReceiver *src, int replicaIdx)
     {
         const transport::Configuration *cfg = configurations[src];
         ASSERT(cfg != NULL);
@@ -76,47 +69,13 @@ public:
         if (!replicaAddressesInitialized) {
             LookupAddresses();
         }
-        
+
         auto kv = replicaAddresses[cfg].find(replicaIdx);
         ASSERT(kv != replicaAddresses[cfg].end());
-        
-        return SendMessageInternal(src, kv->second, m, false);
+        return kv->second;
     }
 
-    virtual bool
-    SendMessageToAll(TransportReceiver *src, const Message &m)
-    {
-        const transport::Configuration *cfg = configurations[src];
-        ASSERT(cfg != NULL);
-
-        if (!replicaAddressesInitialized) {
-            LookupAddresses();
-        }
-
-        auto kv = multicastAddresses.find(cfg);
-        if (kv != multicastAddresses.end()) {
-            // Send by multicast if we can
-            return SendMessageInternal(src, kv->second, m, true);
-        } else {
-            // ...or by individual messages to every replica if not
-            const ADDR &srcAddr = dynamic_cast<const ADDR &>(src->GetAddress());
-            for (auto & kv2 : replicaAddresses[cfg]) {
-                if (srcAddr == kv2.second) {
-                    continue;
-                }
-                if (!SendMessageInternal(src, kv2.second, m, false)) {
-                    return false;
-                }
-            }
-            return true;
-        }
-    }
-    
 protected:
-    virtual bool SendMessageInternal(TransportReceiver *src,
-                                     const ADDR &dst,
-                                     const Message &m,
-                                     bool multicast = false) = 0;
     virtual ADDR LookupAddress(const transport::Configuration &cfg,
                                int replicaIdx) = 0;
     virtual const ADDR *
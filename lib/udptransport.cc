@@ -0,0 +1,684 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/udptransport.cc:
+ *   Request/response transport over kernel UDP sockets, for
+ *   deployments without eRPC-capable NICs
+ *
+ **********************************************************************/
+
+#include "lib/assert.h"
+#include "lib/configuration.h"
+#include "lib/message.h"
+#include "lib/udptransport.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <netdb.h>
+#include <unistd.h>
+
+
+// The server threads of a replica must join the reuseport group in the
+// order of their ids, so that the socket index the BPF program returns
+// matches the dstRpcIdx; keyed by the replica's "host:port"
+static std::mutex udptransport_bind_lock;
+static std::condition_variable udptransport_bind_cv;
+static std::map<std::string, int> udptransport_next_bind;
+
+static inline uint64_t udp_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static sockaddr_in udp_resolve(const std::string &host, const std::string &port) {
+    struct addrinfo hints, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = 0;
+    hints.ai_flags    = AI_PASSIVE;
+
+    int res = getaddrinfo(host.empty() ? NULL : host.c_str(),
+                          port.c_str(), &hints, &ai);
+    if (res != 0) {
+        Panic("Failed to resolve %s:%s: %s",
+              host.c_str(), port.c_str(), gai_strerror(res));
+    }
+    ASSERT(ai->ai_addr->sa_family == AF_INET);
+    sockaddr_in addr = *reinterpret_cast<sockaddr_in *>(ai->ai_addr);
+    freeaddrinfo(ai);
+    return addr;
+}
+
+static int udp_socket() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        PPanic("Failed to create socket");
+    }
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK, 1) < 0) {
+        PPanic("Failed to set O_NONBLOCK");
+    }
+
+    int n = UDP_SOCKET_BUF_SIZE;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_RCVBUF");
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (char *)&n, sizeof(n)) < 0) {
+        PWarning("Failed to set SO_SNDBUF");
+    }
+    return fd;
+}
+
+UDPTransport::UDPTransport(const transport::Configuration &config,
+                           const std::string &ip,
+                           int nthreads,
+                           uint8_t id)
+    : config(config),
+      ip(ip),
+      nthreads(nthreads),
+      id(id) {
+}
+
+UDPTransport::~UDPTransport() {
+    if (fd >= 0) {
+        close(fd);
+    }
+    for (udp_req_tag_t *tag : req_tag_pool) {
+        free(tag->buf);
+        delete tag;
+    }
+    for (char *buf : resp_buf_pool) {
+        free(buf);
+    }
+    for (RecvBatch *batch : recvBatches) {
+        for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+            free(batch->bufs[i]);
+        }
+        delete batch;
+    }
+    for (auto &r : reassemblies) {
+        free(r.second.buf);
+    }
+}
+
+void UDPTransport::Register(TransportReceiver *receiver, int replicaIdx) {
+    ASSERT(replicaIdx < config.n);
+
+    RegisterConfiguration(receiver, config, replicaIdx);
+    this->replicaIdx = replicaIdx;
+
+    if (replicaIdx > -1) {
+        this->receiver = receiver;
+        OpenServerSocket(ReplicaAddress(receiver, replicaIdx).addr);
+    } else if (fd < 0) {
+        OpenClientSocket();
+    }
+}
+
+void UDPTransport::OpenServerSocket(const sockaddr_in &addr) {
+    ASSERT(fd < 0);
+    fd = udp_socket();
+
+    int n = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (char *)&n, sizeof(n)) < 0) {
+        PPanic("Failed to set SO_REUSEPORT");
+    }
+
+    std::string key = config.replica(replicaIdx).host + ":" +
+                      config.replica(replicaIdx).port;
+    std::unique_lock<std::mutex> lock(udptransport_bind_lock);
+    udptransport_bind_cv.wait(lock, [&] {
+        return udptransport_next_bind[key] == id;
+    });
+
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        PPanic("Failed to bind to %s", key.c_str());
+    }
+
+    if (id == 0) {
+        // Steer each datagram to the socket at index dstRpcIdx;
+        // the filter sees the UDP payload
+        struct sock_filter code[] = {
+            { BPF_LD | BPF_B | BPF_ABS, 0, 0,
+              (uint32_t)offsetof(udp_msg_header_t, dstRpcIdx) },
+            { BPF_RET | BPF_A, 0, 0, 0 },
+        };
+        struct sock_fprog prog = { 2, code };
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                       &prog, sizeof(prog)) < 0) {
+            PPanic("Failed to attach the reuseport steering program");
+        }
+    }
+
+    udptransport_next_bind[key]++;
+    udptransport_bind_cv.notify_all();
+    Notice("Listening on UDP %s, RPC id: %d", key.c_str(), id);
+}
+
+void UDPTransport::OpenClientSocket() {
+    fd = udp_socket();
+
+    sockaddr_in addr = udp_resolve(ip, "0");
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        PPanic("Failed to bind client socket");
+    }
+}
+
+UDPTransportAddress UDPTransport::LookupAddress(const transport::Configuration &cfg,
+                                                int replicaIdx) {
+    const transport::ReplicaAddress &r = cfg.replica(replicaIdx);
+    return UDPTransportAddress(udp_resolve(r.host, r.port));
+}
+
+const UDPTransportAddress *
+UDPTransport::LookupMulticastAddress(const transport::Configuration *cfg) {
+    // requests are answered per replica, we never multicast
+    return nullptr;
+}
+
+udp_req_tag_t *UDPTransport::AllocTag() {
+    udp_req_tag_t *tag;
+    if (req_tag_pool.empty()) {
+        tag = new udp_req_tag_t();
+        tag->buf = static_cast<char *>(
+            malloc(sizeof(udp_msg_header_t) + UDP_MAX_MSG_SIZE));
+    } else {
+        tag = req_tag_pool.back();
+        req_tag_pool.pop_back();
+    }
+    return tag;
+}
+
+void UDPTransport::FreeTag(udp_req_tag_t *tag) {
+    req_tag_pool.push_back(tag);
+}
+
+char *UDPTransport::AllocRespBuf() {
+    if (resp_buf_pool.empty()) {
+        return static_cast<char *>(
+            malloc(sizeof(udp_msg_header_t) + UDP_MAX_MSG_SIZE));
+    }
+    char *buf = resp_buf_pool.back();
+    resp_buf_pool.pop_back();
+    return buf;
+}
+
+char *UDPTransport::GetRequestBuf(size_t reqLen, size_t respLen) {
+    ASSERT(reqLen <= UDP_MAX_MSG_SIZE);
+    ASSERT(respLen <= UDP_MAX_MSG_SIZE);
+    crt_req_tag = AllocTag();
+    return crt_req_tag->buf + sizeof(udp_msg_header_t);
+}
+
+// UDP is connectionless, a session is just the replica's address
+int UDPTransport::GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) {
+    ReplicaAddress(src, replicaIdx);
+    return replicaIdx;
+}
+
+void UDPTransport::SendRequest(udp_req_tag_t *tag, uint8_t replicaIdx) {
+    const UDPTransportAddress &dst = ReplicaAddress(tag->src, replicaIdx);
+    outQueue.push_back(OutMsg{ tag->buf, sizeof(udp_msg_header_t) + tag->len,
+                               dst.addr, false });
+}
+
+// This function assumes the message has already been copied to the
+// request buffer
+bool UDPTransport::SendRequestToReplica(TransportReceiver *src,
+                                        uint8_t reqType,
+                                        uint8_t replicaIdx,
+                                        uint8_t dstRpcIdx,
+                                        size_t msgLen) {
+    ASSERT(replicaIdx < config.n);
+    ASSERT(msgLen <= UDP_MAX_MSG_SIZE);
+
+    udp_req_tag_t *tag = crt_req_tag;
+    crt_req_tag = nullptr;
+
+    tag->src = src;
+    tag->reqType = reqType;
+    tag->dstRpcIdx = dstRpcIdx;
+    tag->len = msgLen;
+    tag->reqId = ++lastReqId;
+    tag->waiting = 1ULL << replicaIdx;
+    tag->sentAt = udp_now_us();
+    tag->retransmits = 0;
+
+    auto *hdr = reinterpret_cast<udp_msg_header_t *>(tag->buf);
+    hdr->dstRpcIdx = dstRpcIdx;
+    hdr->reqType = reqType;
+    hdr->isResponse = 0;
+    hdr->replicaIdx = 0;
+    hdr->len = msgLen;
+    hdr->reqId = tag->reqId;
+
+    pending[tag->reqId] = tag;
+    SendRequest(tag, replicaIdx);
+
+    WaitFor([src]() { return !src->Blocked(); });
+    return true;
+}
+
+// Sends to all replicas except if the sender is a replica,
+// it doesn't send to the sending replica; all the datagrams
+// point to the same buffer
+bool UDPTransport::SendRequestToAll(TransportReceiver *src,
+                                    uint8_t reqType,
+                                    uint8_t dstRpcIdx,
+                                    size_t msgLen) {
+    ASSERT(config.n <= 64);
+    ASSERT(msgLen <= UDP_MAX_MSG_SIZE);
+
+    udp_req_tag_t *tag = crt_req_tag;
+    crt_req_tag = nullptr;
+
+    tag->src = src;
+    tag->reqType = reqType;
+    tag->dstRpcIdx = dstRpcIdx;
+    tag->len = msgLen;
+    tag->reqId = ++lastReqId;
+    tag->waiting = 0;
+    tag->sentAt = udp_now_us();
+    tag->retransmits = 0;
+
+    auto *hdr = reinterpret_cast<udp_msg_header_t *>(tag->buf);
+    hdr->dstRpcIdx = dstRpcIdx;
+    hdr->reqType = reqType;
+    hdr->isResponse = 0;
+    hdr->replicaIdx = 0;
+    hdr->len = msgLen;
+    hdr->reqId = tag->reqId;
+
+    for (int i = 0; i < config.n; i++) {
+        // skip the sending replica
+        if (this->replicaIdx == i) continue;
+        tag->waiting |= 1ULL << i;
+        SendRequest(tag, i);
+    }
+
+    if (tag->waiting == 0) {
+        // nobody to send to
+        FreeTag(tag);
+    } else {
+        pending[tag->reqId] = tag;
+    }
+
+    WaitFor([src]() { return !src->Blocked(); });
+    return true;
+}
+
+void UDPTransport::Respond(const PendingResponse &p, size_t msgLen) {
+    ASSERT(msgLen <= UDP_MAX_MSG_SIZE);
+    auto *hdr = reinterpret_cast<udp_msg_header_t *>(p.buf);
+    hdr->dstRpcIdx = 0;
+    hdr->reqType = p.reqType;
+    hdr->isResponse = 1;
+    hdr->replicaIdx = replicaIdx;
+    hdr->len = msgLen;
+    hdr->reqId = p.reqId;
+    outQueue.push_back(OutMsg{ p.buf, sizeof(udp_msg_header_t) + msgLen,
+                               p.dst, true });
+    Debug("Sent response, msgLen = %lu\n", msgLen);
+
+    // keep it for retransmissions of the request
+    auto it = recentReqs.find(MakeRecentKey(p.dst, p.reqId));
+    if (it != recentReqs.end()) {
+        it->second.answered = true;
+        it->second.response.assign(p.buf, sizeof(udp_msg_header_t) + msgLen);
+    }
+}
+
+// For requests answered after ReceiveRequest returned
+bool UDPTransport::SendResponse(uint64_t reqHandleIdx, size_t msgLen) {
+    Respond(pendingResps.Take(reqHandleIdx), msgLen);
+    return true;
+}
+
+// Assumes we already put the response in the response buffer
+// passed to ReceiveRequest
+bool UDPTransport::SendResponse(size_t msgLen) {
+    return SendResponse(crtReq, msgLen);
+}
+
+void UDPTransport::Flush() {
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+
+    // Cut the messages in datagrams; a message that fits in one is
+    // sent with the header already in its buffer
+    size_t nrDgrams = 0;
+    for (const OutMsg &m : outQueue) {
+        size_t len = m.len - sizeof(udp_msg_header_t);
+        nrDgrams += len <= UDP_MAX_DGRAM_SIZE ?
+                    1 : (len + UDP_MAX_DGRAM_SIZE - 1) / UDP_MAX_DGRAM_SIZE;
+    }
+    outDgrams.resize(nrDgrams);
+
+    size_t d = 0;
+    for (OutMsg &m : outQueue) {
+        auto *hdr = reinterpret_cast<udp_msg_header_t *>(m.buf);
+        char *payload = m.buf + sizeof(udp_msg_header_t);
+        size_t len = m.len - sizeof(udp_msg_header_t);
+        if (len <= UDP_MAX_DGRAM_SIZE) {
+            hdr->fragIdx = 0;
+            hdr->nrFrags = 1;
+            OutDgram &dg = outDgrams[d];
+            dg.iovs[0] = { hdr, sizeof(udp_msg_header_t) };
+            dg.iovs[1] = { payload, len };
+            dg.dst = &m.dst;
+            d++;
+            continue;
+        }
+
+        uint16_t nrFrags = (len + UDP_MAX_DGRAM_SIZE - 1) / UDP_MAX_DGRAM_SIZE;
+        for (uint16_t i = 0; i < nrFrags; i++) {
+            OutDgram &dg = outDgrams[d];
+            size_t off = (size_t)i * UDP_MAX_DGRAM_SIZE;
+            dg.hdr = *hdr;
+            dg.hdr.fragIdx = i;
+            dg.hdr.nrFrags = nrFrags;
+            dg.iovs[0] = { &dg.hdr, sizeof(udp_msg_header_t) };
+            dg.iovs[1] = { payload + off,
+                           std::min(len - off, (size_t)UDP_MAX_DGRAM_SIZE) };
+            dg.dst = &m.dst;
+            d++;
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < nrDgrams) {
+        size_t batch = std::min(nrDgrams - sent, (size_t)UDP_BATCH_SIZE);
+        for (size_t i = 0; i < batch; i++) {
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = outDgrams[sent + i].dst;
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = outDgrams[sent + i].iovs;
+            msgs[i].msg_hdr.msg_iovlen = 2;
+        }
+
+        int n = sendmmsg(fd, msgs, batch, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                // the socket buffer is full, retry
+                continue;
+            }
+            // drop the datagram, the retransmission will take care of it
+            PWarning("Failed to send UDP datagram");
+            n = 1;
+        }
+        sent += n;
+    }
+
+    for (OutMsg &m : outQueue) {
+        if (m.isResponse) {
+            resp_buf_pool.push_back(m.buf);
+        }
+    }
+    outQueue.clear();
+}
+
+void UDPTransport::Retransmit() {
+    uint64_t now = udp_now_us();
+    if (now - lastRetransmitScan < UDP_RETRANSMIT_US / 2) {
+        return;
+    }
+    lastRetransmitScan = now;
+
+    for (auto it = pending.begin(); it != pending.end(); ) {
+        udp_req_tag_t *tag = it->second;
+        if (now - tag->sentAt < UDP_RETRANSMIT_US) {
+            ++it;
+            continue;
+        }
+
+        if (tag->retransmits == UDP_MAX_RETRANSMITS) {
+            // the tag is not queued: it was flushed when last sent
+            Debug("Giving up on request %lu, waiting for %lx",
+                  tag->reqId, tag->waiting);
+            it = pending.erase(it);
+            FreeTag(tag);
+            continue;
+        }
+
+        Debug("Retransmitting request %lu", tag->reqId);
+        tag->sentAt = now;
+        tag->retransmits++;
+        for (int i = 0; i < config.n; i++) {
+            if (tag->waiting & (1ULL << i)) {
+                SendRequest(tag, i);
+            }
+        }
+        ++it;
+    }
+}
+
+UDPTransport::RecentKey
+UDPTransport::MakeRecentKey(const sockaddr_in &from, uint64_t reqId) {
+    return RecentKey{ from.sin_addr.s_addr, from.sin_port, reqId };
+}
+
+bool UDPTransport::HandleDuplicate(udp_msg_header_t *hdr, const sockaddr_in &from) {
+    const uint64_t now = udp_now_us();
+    while (!recentOrder.empty() &&
+           now - recentOrder.front().second > UDP_RECENT_US) {
+        recentReqs.erase(recentOrder.front().first);
+        recentOrder.pop_front();
+    }
+
+    const RecentKey key = MakeRecentKey(from, hdr->reqId);
+    auto ret = recentReqs.emplace(key, RecentRequest{ false, std::string() });
+    if (ret.second) {
+        recentOrder.emplace_back(key, now);
+        return false;
+    }
+
+    const RecentRequest &r = ret.first->second;
+    if (r.answered) {
+        Debug("Answering retransmitted request %lu again", hdr->reqId);
+        char *buf = AllocRespBuf();
+        memcpy(buf, r.response.data(), r.response.size());
+        outQueue.push_back(OutMsg{ buf, r.response.size(), from, true });
+    } else {
+        Debug("Dropping retransmitted request %lu, still being served",
+              hdr->reqId);
+    }
+    return true;
+}
+
+char *UDPTransport::Reassemble(udp_msg_header_t *hdr, const sockaddr_in &from,
+                               size_t dgramLen) {
+    const uint64_t now = udp_now_us();
+    // a message whose fragments stopped coming is sent again in full
+    // by the retransmission, and answered long before this
+    while (!reassemblyOrder.empty() &&
+           now - reassemblyOrder.front().second > UDP_RECENT_US) {
+        auto it = reassemblies.find(reassemblyOrder.front().first);
+        if (it != reassemblies.end() &&
+            it->second.startedAt == reassemblyOrder.front().second) {
+            free(it->second.buf);
+            reassemblies.erase(it);
+        }
+        reassemblyOrder.pop_front();
+    }
+
+    const size_t off = (size_t)hdr->fragIdx * UDP_MAX_DGRAM_SIZE;
+    const size_t len = dgramLen - sizeof(udp_msg_header_t);
+    if (hdr->len > UDP_MAX_MSG_SIZE || hdr->fragIdx >= hdr->nrFrags ||
+        off + len > hdr->len) {
+        Warning("Received a malformed fragment");
+        return nullptr;
+    }
+
+    const FragKey key{ from.sin_addr.s_addr, from.sin_port,
+                       hdr->isResponse, hdr->reqId };
+    auto ret = reassemblies.emplace(key, Reassembly{ nullptr, 0, now });
+    Reassembly &r = ret.first->second;
+    if (ret.second) {
+        r.buf = static_cast<char *>(
+            malloc(sizeof(udp_msg_header_t) + hdr->len));
+        *reinterpret_cast<udp_msg_header_t *>(r.buf) = *hdr;
+        reassemblyOrder.emplace_back(key, now);
+    } else if (reinterpret_cast<udp_msg_header_t *>(r.buf)->len != hdr->len) {
+        Warning("Received a malformed fragment");
+        return nullptr;
+    }
+
+    memcpy(r.buf + sizeof(udp_msg_header_t) + off, hdr + 1, len);
+    r.have |= 1ULL << hdr->fragIdx;
+    if (r.have != (hdr->nrFrags == 64 ? ~0ULL : (1ULL << hdr->nrFrags) - 1)) {
+        return nullptr;
+    }
+
+    char *buf = r.buf;
+    reassemblies.erase(ret.first);
+    return buf;
+}
+
+void UDPTransport::HandleRequest(udp_msg_header_t *hdr, const sockaddr_in &from) {
+    Debug("Received request, reqType = %d", hdr->reqType);
+    if (HandleDuplicate(hdr, from)) {
+        return;
+    }
+
+    PendingResponse p;
+    p.buf = AllocRespBuf();
+    p.dst = from;
+    p.reqId = hdr->reqId;
+    p.reqType = hdr->reqType;
+
+    char *reqBuf = reinterpret_cast<char *>(hdr + 1);
+    char *respBuf = p.buf + sizeof(udp_msg_header_t);
+    crtReq = pendingResps.Insert(p);
+    receiver->ReceiveRequest(crtReq, hdr->reqType, reqBuf, respBuf);
+}
+
+void UDPTransport::HandleResponse(udp_msg_header_t *hdr) {
+    auto it = pending.find(hdr->reqId);
+    if (it == pending.end()) {
+        // duplicate response to a retransmitted request
+        return;
+    }
+
+    udp_req_tag_t *tag = it->second;
+    uint64_t bit = 1ULL << hdr->replicaIdx;
+    if (!(tag->waiting & bit)) {
+        return;
+    }
+    tag->waiting &= ~bit;
+    if (tag->waiting == 0) {
+        pending.erase(it);
+    }
+
+    Debug("Received response, reqType = %d", hdr->reqType);
+    tag->src->ReceiveResponse(hdr->reqType, reinterpret_cast<char *>(hdr + 1));
+
+    if (tag->waiting == 0) {
+        FreeTag(tag);
+    }
+}
+
+bool UDPTransport::Poll() {
+    if (pollDepth == (int)recvBatches.size()) {
+        auto *batch = new RecvBatch();
+        for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+            batch->bufs[i] = static_cast<char *>(
+                malloc(sizeof(udp_msg_header_t) + UDP_MAX_DGRAM_SIZE));
+        }
+        recvBatches.push_back(batch);
+    }
+    RecvBatch *batch = recvBatches[pollDepth];
+
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        batch->iovs[i].iov_base = batch->bufs[i];
+        batch->iovs[i].iov_len = sizeof(udp_msg_header_t) + UDP_MAX_DGRAM_SIZE;
+        memset(&batch->msgs[i], 0, sizeof(batch->msgs[i]));
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(fd, batch->msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n <= 0) {
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            PWarning("Failed to receive UDP datagrams");
+        }
+        return false;
+    }
+
+    pollDepth++;
+    for (int i = 0; i < n; i++) {
+        if (batch->msgs[i].msg_len < sizeof(udp_msg_header_t)) {
+            Warning("Received a truncated datagram");
+            continue;
+        }
+        auto *hdr = reinterpret_cast<udp_msg_header_t *>(batch->bufs[i]);
+        char *whole = nullptr;
+        if (hdr->nrFrags > 1) {
+            whole = Reassemble(hdr, batch->addrs[i], batch->msgs[i].msg_len);
+            if (whole == nullptr) {
+                continue;
+            }
+            hdr = reinterpret_cast<udp_msg_header_t *>(whole);
+        }
+        if (hdr->isResponse) {
+            HandleResponse(hdr);
+        } else if (receiver != nullptr) {
+            HandleRequest(hdr, batch->addrs[i]);
+        }
+        free(whole);
+    }
+    pollDepth--;
+    return true;
+}
+
+void UDPTransport::RunOnce() {
+    // retransmissions go out before we receive anything, so a
+    // request buffer is never freed while it is still queued
+    if (!pending.empty()) {
+        Retransmit();
+    }
+    if (!outQueue.empty()) {
+        Flush();
+    }
+    Poll();
+    if (!outQueue.empty()) {
+        Flush();
+    }
+    timers.Poll();
+}
+
+void UDPTransport::Run() {
+    while (!stop) {
+        RunOnce();
+    }
+}
+
+void UDPTransport::Stop() {
+    Debug("Stopping transport!");
+    stop = true;
+}
+
+int UDPTransport::Timer(uint64_t ms, timer_callback_t cb) {
+    return timers.Arm(ms * 1000, std::move(cb));
+}
+
+int UDPTransport::TimerMicro(uint64_t us, timer_callback_t cb) {
+    return timers.Arm(us, std::move(cb));
+}
+
+bool UDPTransport::CancelTimer(int id) {
+    return timers.Cancel(id);
+}
+
+void UDPTransport::CancelAllTimers() {
+    Debug("Cancelling all Timers");
+    timers.CancelAll();
+}
@@ -0,0 +1,309 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * lib/udptransport.h:
+ *   Request/response transport over kernel UDP sockets, for
+ *   deployments without eRPC-capable NICs
+ *
+ **********************************************************************/
+
+#ifndef _LIB_UDPTRANSPORT_H_
+#define _LIB_UDPTRANSPORT_H_
+
+#include "lib/configuration.h"
+#include "lib/reqhandletable.h"
+#include "lib/timerwheel.h"
+#include "lib/transport.h"
+#include "lib/transportcommon.h"
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*
+ * Class UDPTransport implements the Transport interface on top of
+ * plain UDP sockets, one transport instance per thread.
+ *
+ * All the server threads of a replica bind the replica's address with
+ * SO_REUSEPORT, each with its own socket, in the order of their
+ * transport ids. A classic BPF program attached to the reuseport group
+ * steers every datagram to the socket whose index is the dstRpcIdx
+ * carried in the message header, so a client picks the server core
+ * exactly as it does with eRPC.
+ *
+ * Sends are queued and flushed once per event loop turn with a single
+ * sendmmsg; receives are drained with recvmmsg. Requests that are not
+ * answered within UDP_RETRANSMIT_US are sent again to the replicas
+ * that did not answer yet, at most UDP_MAX_RETRANSMITS times: a
+ * replica that is down must not be retried forever after the caller
+ * moved on with the answers of the others. Duplicate answers are
+ * dropped.
+ *
+ * Servers remember the requests they received for UDP_RECENT_US, by
+ * sender and request id, so that a retransmission is never delivered
+ * twice: it is answered again from the saved response, or dropped if
+ * the first copy is still being served.
+ *
+ * Messages larger than a datagram, e.g. a response carrying a value of
+ * MAX_VALUE_SIZE bytes, are sent as several fragments of up to
+ * UDP_MAX_DGRAM_SIZE bytes and put back together by the receiver
+ * before they are delivered. A lost fragment is recovered by
+ * retransmitting the whole request.
+ */
+
+// Largest request or response payload
+#define UDP_MAX_MSG_SIZE (1 << 20)
+// Largest payload we carry in one datagram
+#define UDP_MAX_DGRAM_SIZE 65000
+// Max number of datagrams per sendmmsg/recvmmsg call
+#define UDP_BATCH_SIZE 32
+#define UDP_RETRANSMIT_US 10000
+#define UDP_MAX_RETRANSMITS 50
+// Outlives the last retransmission of a request
+#define UDP_RECENT_US (UDP_RETRANSMIT_US * (UDP_MAX_RETRANSMITS + 2))
+#define UDP_SOCKET_BUF_SIZE (4 * 1024 * 1024)
+
+// Prepended to every datagram
+struct udp_msg_header_t {
+    uint8_t dstRpcIdx;  // must stay first, the reuseport filter reads it
+    uint8_t reqType;
+    uint8_t isResponse;
+    uint8_t replicaIdx; // of the sender of a response
+    uint16_t fragIdx;
+    uint16_t nrFrags;
+    uint32_t len;       // of the whole message
+    uint64_t reqId;
+};
+static_assert((UDP_MAX_MSG_SIZE + UDP_MAX_DGRAM_SIZE - 1) / UDP_MAX_DGRAM_SIZE <= 64,
+              "the fragments of a message must fit in a 64-bit mask");
+
+class UDPTransportAddress
+{
+public:
+    UDPTransportAddress() { memset(&addr, 0, sizeof(addr)); }
+    explicit UDPTransportAddress(const sockaddr_in &addr) : addr(addr) {}
+
+    bool operator==(const UDPTransportAddress &other) const {
+        return addr.sin_addr.s_addr == other.addr.sin_addr.s_addr &&
+               addr.sin_port == other.addr.sin_port;
+    }
+    bool operator<(const UDPTransportAddress &other) const {
+        if (addr.sin_addr.s_addr != other.addr.sin_addr.s_addr)
+            return addr.sin_addr.s_addr < other.addr.sin_addr.s_addr;
+        return addr.sin_port < other.addr.sin_port;
+    }
+
+    sockaddr_in addr;
+};
+
+// A tag attached to every request we send; it owns the request
+// buffer, which we keep around for retransmissions
+struct udp_req_tag_t {
+    char *buf = nullptr;  // header followed by the request
+    size_t len;           // request length, without the header
+    uint64_t reqId;
+    uint8_t reqType;
+    uint8_t dstRpcIdx;
+    TransportReceiver *src;
+    uint64_t waiting;     // bitmap of the replicas that did not answer yet
+    uint64_t sentAt;
+    uint32_t retransmits;
+};
+
+class UDPTransport : public TransportCommon<UDPTransportAddress>
+{
+public:
+    UDPTransport(const transport::Configuration &config,
+                 const std::string &ip,
+                 int nthreads,
+                 uint8_t id);
+    virtual ~UDPTransport();
+    void Register(TransportReceiver *receiver,
+                  int replicaIdx) override;
+    void Run() override;
+    void Stop() override;
+    int Timer(uint64_t ms, timer_callback_t cb) override;
+    int TimerMicro(uint64_t us, timer_callback_t cb) override;
+    bool CancelTimer(int id) override;
+    void CancelAllTimers() override;
+
+    bool SendRequestToReplica(TransportReceiver *src, uint8_t reqType, uint8_t replicaIdx, uint8_t dstRpcIdx, size_t msgLen) override;
+    bool SendRequestToAll(TransportReceiver *src, uint8_t reqType, uint8_t dstRpcIdx, size_t msgLen) override;
+    bool SendResponse(uint64_t reqHandleIdx, size_t msgLen) override;
+    bool SendResponse(size_t msgLen) override;
+    char *GetRequestBuf(size_t reqLen, size_t respLen) override;
+    int GetSession(TransportReceiver *src, uint8_t replicaIdx, uint8_t dstRpcIdx) override;
+
+    uint8_t GetID() override { return id; };
+
+    // One turn of the event loop: retransmit, flush the queued
+    // datagrams, then drain the socket
+    void RunOnce() override;
+
+private:
+    // A request handed to the receiver that has not been answered yet
+    struct PendingResponse {
+        char *buf;        // header followed by the response
+        sockaddr_in dst;
+        uint64_t reqId;
+        uint8_t reqType;
+    };
+
+    // A request a server received, by sender and request id
+    struct RecentKey {
+        uint32_t addr;
+        uint16_t port;
+        uint64_t reqId;
+
+        bool operator==(const RecentKey &other) const {
+            return addr == other.addr && port == other.port &&
+                   reqId == other.reqId;
+        }
+    };
+    struct RecentKeyHash {
+        size_t operator()(const RecentKey &k) const {
+            return std::hash<uint64_t>()(k.reqId * 0x9e3779b97f4a7c15ULL ^
+                                         ((uint64_t)k.addr << 16 | k.port));
+        }
+    };
+    struct RecentRequest {
+        bool answered;
+        // header followed by the response, once answered
+        std::string response;
+    };
+
+    // A message being put back together from its fragments
+    struct FragKey {
+        uint32_t addr;
+        uint16_t port;
+        uint8_t isResponse;
+        uint64_t reqId;
+
+        bool operator==(const FragKey &other) const {
+            return addr == other.addr && port == other.port &&
+                   isResponse == other.isResponse && reqId == other.reqId;
+        }
+    };
+    struct FragKeyHash {
+        size_t operator()(const FragKey &k) const {
+            return std::hash<uint64_t>()(k.reqId * 0x9e3779b97f4a7c15ULL ^
+                                         ((uint64_t)k.addr << 17 |
+                                          (uint64_t)k.port << 1 |
+                                          k.isResponse));
+        }
+    };
+    struct Reassembly {
+        char *buf;        // header followed by the message
+        uint64_t have;    // bitmap of the fragments received
+        uint64_t startedAt;
+    };
+
+    // A message waiting for the next sendmmsg
+    struct OutMsg {
+        char *buf;
+        size_t len;
+        sockaddr_in dst;
+        bool isResponse;  // response buffers go back to the pool once sent
+    };
+
+    // One datagram of a message, sent as its header and a slice
+    // of the payload
+    struct OutDgram {
+        udp_msg_header_t hdr;
+        struct iovec iovs[2];
+        sockaddr_in *dst;
+    };
+
+    // recvmmsg buffers; upcalls may run the event loop again
+    // (e.g. a client sending its next request from ReceiveResponse),
+    // so every nesting level gets its own batch
+    struct RecvBatch {
+        char *bufs[UDP_BATCH_SIZE];
+        sockaddr_in addrs[UDP_BATCH_SIZE];
+        struct iovec iovs[UDP_BATCH_SIZE];
+        struct mmsghdr msgs[UDP_BATCH_SIZE];
+    };
+
+    // Configuration of the replicas
+    transport::Configuration config;
+
+    // Local address clients bind to, may be empty
+    std::string ip;
+
+    // Number of server threads
+    int nthreads;
+
+    // used as the RPC id, must be unique per transport thread
+    uint8_t id;
+
+    // Index of the replica server
+    int replicaIdx = -1;
+
+    TransportReceiver *receiver = nullptr;
+    volatile bool stop = false;
+
+    int fd = -1;
+
+    // This is maintained between calls to GetRequestBuf and SendRequest
+    udp_req_tag_t *crt_req_tag = nullptr;
+    std::vector<udp_req_tag_t *> req_tag_pool;
+    // Requests sent and not fully answered, by request id
+    std::unordered_map<uint64_t, udp_req_tag_t *> pending;
+    uint64_t lastReqId = 0;
+    uint64_t lastRetransmitScan = 0;
+
+    // Response buffers
+    std::vector<char *> resp_buf_pool;
+    ReqHandleTable<PendingResponse> pendingResps;
+    // Handle of the request being delivered
+    uint64_t crtReq;
+    // Requests received in the last UDP_RECENT_US, oldest first
+    std::unordered_map<RecentKey, RecentRequest, RecentKeyHash> recentReqs;
+    std::deque<std::pair<RecentKey, uint64_t>> recentOrder;
+
+    std::vector<OutMsg> outQueue;
+    std::vector<OutDgram> outDgrams;
+    // Messages partly received, oldest first
+    std::unordered_map<FragKey, Reassembly, FragKeyHash> reassemblies;
+    std::deque<std::pair<FragKey, uint64_t>> reassemblyOrder;
+    std::vector<RecvBatch *> recvBatches;
+    int pollDepth = 0;
+
+    // Timers are only touched by the owner thread
+    TimerWheel timers;
+
+    UDPTransportAddress LookupAddress(const transport::Configuration &cfg,
+                                      int replicaIdx) override;
+    const UDPTransportAddress *
+    LookupMulticastAddress(const transport::Configuration *cfg) override;
+
+    void OpenServerSocket(const sockaddr_in &addr);
+    void OpenClientSocket();
+    udp_req_tag_t *AllocTag();
+    void FreeTag(udp_req_tag_t *tag);
+    char *AllocRespBuf();
+    void SendRequest(udp_req_tag_t *tag, uint8_t replicaIdx);
+    void Respond(const PendingResponse &p, size_t msgLen);
+    void Flush();
+    void Retransmit();
+    bool Poll();
+    static RecentKey MakeRecentKey(const sockaddr_in &from, uint64_t reqId);
+    // Returns whether the request was received before, answering it
+    // again if it was answered
+    bool HandleDuplicate(udp_msg_header_t *hdr, const sockaddr_in &from);
+    // Returns the whole message once its last fragment arrived, to be
+    // freed by the caller, or nullptr
+    char *Reassemble(udp_msg_header_t *hdr, const sockaddr_in &from,
+                     size_t dgramLen);
+    void HandleRequest(udp_msg_header_t *hdr, const sockaddr_in &from);
+    void HandleResponse(udp_msg_header_t *hdr);
+};
+
+#endif  // _LIB_UDPTRANSPORT_H_
@@ -40,6 +40,7 @@
 #include "lib/assert.h"
 #include "lib/message.h"
 #include "store/common/transaction.h"
+#include "store/common/transactionview.h"
 #include "replication/common/viewstamp.h"
 
 #include <boost/functional/hash.hpp>
@@ -68,8 +69,8 @@ struct RecordEntry
     // latest request for this transaction
     // TODO: do we need this?
     //Request request;
-    // Read and write sets
-    Transaction txn;
+    // Read and write sets, as serialized in the prepare request
+    PackedTransaction txn;
     // Commit timestamp
     Timestamp ts;
     // to know to which client request we need to reply
@@ -84,8 +84,7 @@ void Client::Invoke(uint64_t txn_nr,
     pendingReqs[reqId] = req;
 
     Debug("Invoke for req_nr = %lu", reqId);
-    size_t txnLen = txn.getReadSet().size() * sizeof(read_t) +
-                    txn.getWriteSet().size() * sizeof(write_t);
+    size_t txnLen = txn.serializedSize();
     size_t reqLen = sizeof(request_header_t) + txnLen;
     auto *reqBuf = reinterpret_cast<request_header_t *>(
       transport->GetRequestBuf(
@@ -98,8 +97,8 @@ void Client::Invoke(uint64_t txn_nr,
     reqBuf->client_id = clientid;
     reqBuf->timestamp = ts.getTimestamp();
     reqBuf->id = ts.getID();
-    reqBuf->nr_reads = txn.getReadSet().size();
-    reqBuf->nr_writes = txn.getWriteSet().size();
+    reqBuf->nr_reads = txn.readSetSize();
+    reqBuf->nr_writes = txn.writeSetSize();
     txn.serialize(reinterpret_cast<char *>(reqBuf + 1));
     blocked = true;
     // TODO: Send to the leader; for now just assume replica 0 is the leader
@@ -134,19 +133,22 @@ void Client::InvokeUnlogged(uint64_t txn_nr,
     // function does not return errors)
     // TODO: deal with timeouts?
     pendingUnloggedReqs[reqId] = req;
+    ASSERT(request.size() <= MAX_KEY_SIZE);
+    size_t reqLen = sizeof(unlogged_request_t) + request.size();
     auto *reqBuf = reinterpret_cast<unlogged_request_t *>(
       transport->GetRequestBuf(
-        sizeof(unlogged_request_t),
-        sizeof(unlogged_response_t)
+        reqLen,
+        sizeof(unlogged_response_t) + MAX_VALUE_SIZE
       )
     );
     reqBuf->req_nr = reqId;
-    memcpy(reqBuf->key, request.c_str(), request.size());
+    reqBuf->key_len = request.size();
+    memcpy(reqBuf + 1, request.data(), request.size());
     blocked = true;
     transport->SendRequestToReplica(this,
                                     unloggedReqType,
                                     replicaIdx, core_id,
-                                    sizeof(unlogged_request_t));
+                                    reqLen);
 }
 
 void Client::ReceiveResponse(uint8_t reqType, char *respBuf) {
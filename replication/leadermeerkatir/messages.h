@@ -26,18 +26,22 @@ struct request_response_t {
     int status;
 };
 
+// followed by key_len bytes of key
 struct unlogged_request_t {
     uint64_t req_nr;
-    char key[64];
-};
+    uint16_t key_len;
+} __attribute__((packed));
 
+// followed by value_len bytes of value; fingerprint is what the
+// client may send in its read set instead of the key, or 0
 struct unlogged_response_t {
     uint64_t req_nr;
     uint64_t timestamp;
     uint64_t id;
-    char value[64];
+    uint64_t fingerprint;
     int status;
-};
+    uint32_t value_len;
+} __attribute__((packed));
 
 struct prepare_request_header_t {
     request_header_t request_header;
@@ -175,7 +175,8 @@ void Replica::HandleRequest(uint64_t reqHandleIdx, char *reqBuf, char *respBuf)
             entry->respBuf = respBuf;
 
             // Send prepare record to the other replicas
-            size_t txnLen = req->nr_reads * sizeof(read_t) + req->nr_writes * sizeof(write_t);
+            size_t txnLen = Transaction::serializedSize(req->nr_reads, req->nr_writes,
+                                                        reinterpret_cast<const char *>(req + 1));
             size_t reqLen = sizeof(prepare_request_header_t) + txnLen;
             auto *prepareReq = reinterpret_cast<prepare_request_header_t *>(
               transport->GetRequestBuf(
@@ -236,7 +237,7 @@ void Replica::HandlePrepare(uint64_t reqHandleIdx, char *reqBuf, char *respBuf)
         entry = &record.Add(0, txnid, req->request_header.req_nr, PREPARED_OK, // TODO: set txn status from application
                             RECORD_STATE_TENTATIVE, "");
         // Save the transaction
-        entry->txn = Transaction(req->request_header.nr_reads, req->request_header.nr_writes, (char *)(req + 1));
+        entry->txn.assign(req->request_header.nr_reads, req->request_header.nr_writes, (char *)(req + 1));
         entry->ts = Timestamp(req->timestamp, req->id);
     }
 
@@ -39,6 +39,7 @@
 
 #include <random>
 
+
 namespace replication {
 namespace meerkatir {
 
@@ -68,6 +69,12 @@ Client::Client(const transport::Configuration &config,
 
 Client::~Client()
 {
+    for (auto &p : pendingConsensusReqs) {
+        StopTimers(p.second);
+    }
+    for (auto &p : pendingUnloggedReqs) {
+        transport->CancelTimer(p.second.timer);
+    }
 }
 
 // TODO: make this more general -- the replication layer must not do the app
@@ -106,31 +113,42 @@ void Client::InvokeConsensus(uint64_t txn_nr,
                           decide_t decide,
                           consensus_continuation_t continuation,
                           error_continuation_t error_continuation) {
+    Wait(InvokeConsensusAsync(txn_nr, core_id, txn, timestamp, decide,
+                              continuation, error_continuation));
+}
+
+req_handle_t Client::InvokeConsensusAsync(uint64_t txn_nr,
+                          uint8_t core_id,
+                          const Transaction &txn,
+                          const Timestamp &timestamp,
+                          decide_t decide,
+                          consensus_continuation_t continuation,
+                          error_continuation_t error_continuation) {
     uint64_t reqId = ++lastReqId;
-    //auto timer = std::unique_ptr<Timeout>(new Timeout(
-    //    transport, 500, [this, reqId]() { ResendConsensusRequest(reqId); }));
-    //auto transition_to_slow_path_timer =
-    //    std::unique_ptr<Timeout>(new Timeout(transport, 500, [this, reqId]() {
-    //        // TODO: new way to deal with this
-    //        //TransitionToConsensusSlowPath(reqId);
-    //    }));
-
-    crtConsensusReq =
+
+    PendingConsensusRequest &req = pendingConsensusReqs[reqId] =
         PendingConsensusRequest(reqId,
                                   txn_nr,
                                   core_id,
                                   continuation,
-                                  //nullptr,
-                                  //nullptr,
-                                  //std::move(timer),
-                                  //std::move(transition_to_slow_path_timer),
                                   decide,
-                                  error_continuation);
-    // TODO: how do we deal with timeouts? (do we need to patch eRPC?)
-    //req->transition_to_slow_path_timer->Start();
-    //SendConsensus(req);
-    size_t txnLen = txn.getReadSet().size() * sizeof(read_t) +
-                    txn.getWriteSet().size() * sizeof(write_t);
+                                  error_continuation,
+                                  &txn,
+                                  timestamp);
+    req.timer = transport->TimerMicro(RETRY_TIMEOUT_US, [this, reqId]() {
+        ResendConsensusRequest(reqId);
+    });
+    req.transition_to_slow_path_timer =
+        transport->TimerMicro(SLOW_PATH_TIMEOUT_US, [this, reqId]() {
+            TransitionToConsensusSlowPath(reqId);
+        });
+    SendConsensus(req);
+    return reqId;
+}
+
+void Client::SendConsensus(const PendingConsensusRequest &req) {
+    const Transaction &txn = *req.txn;
+    size_t txnLen = txn.serializedSize();
     size_t reqLen = sizeof(consensus_request_header_t) + txnLen;
     auto *reqBuf = reinterpret_cast<consensus_request_header_t *>(
       transport->GetRequestBuf(
@@ -138,19 +156,31 @@ void Client::InvokeConsensus(uint64_t txn_nr,
         sizeof(consensus_response_t)
       )
     );
-    reqBuf->req_nr = reqId;
-    reqBuf->txn_nr = txn_nr;
-    reqBuf->id = timestamp.getID();
-    reqBuf->timestamp = timestamp.getTimestamp();
+    reqBuf->req_nr = req.req_nr;
+    reqBuf->txn_nr = req.txn_nr;
+    reqBuf->id = req.timestamp.getID();
+    reqBuf->timestamp = req.timestamp.getTimestamp();
     reqBuf->client_id = clientid;
-    reqBuf->nr_reads = txn.getReadSet().size();
-    reqBuf->nr_writes = txn.getWriteSet().size();
+    reqBuf->nr_reads = txn.readSetSize();
+    reqBuf->nr_writes = txn.writeSetSize();
 
     txn.serialize(reinterpret_cast<char *>(reqBuf + 1));
-    blocked = true;
     transport->SendRequestToAll(this,
                                 consensusReqType,
-                                core_id, reqLen);
+                                req.core_id, reqLen);
+}
+
+void Client::ResendConsensusRequest(const uint64_t reqId) {
+    auto it = pendingConsensusReqs.find(reqId);
+    if (it == pendingConsensusReqs.end()) {
+        return;
+    }
+    PendingConsensusRequest &req = it->second;
+    Warning("Client timeout; resending consensus request: %lu", reqId);
+    req.timer = transport->TimerMicro(RETRY_TIMEOUT_US, [this, reqId]() {
+        ResendConsensusRequest(reqId);
+    });
+    SendConsensus(req);
 }
 
 void Client::InvokeUnlogged(uint64_t txn_nr,
@@ -159,71 +189,174 @@ void Client::InvokeUnlogged(uint64_t txn_nr,
                          const string &request,
                          unlogged_continuation_t continuation,
                          error_continuation_t error_continuation,
-                         uint32_t timeout) {
-    uint64_t reqId = ++lastReqId;
-    //auto timer = std::unique_ptr<Timeout>(new Timeout(
-    //    transport, timeout,
-    //    [this, reqId]() { UnloggedRequestTimeoutCallback(reqId); }));
+                         uint32_t timeout,
+                         const Timestamp &snapshot) {
+    Wait(InvokeUnloggedAsync(txn_nr, core_id, replicaIdx, request,
+                             continuation, error_continuation, timeout,
+                             snapshot));
+}
 
-    crtUnloggedReq =
-        PendingUnloggedRequest(request,
-                                 reqId,
-                                 txn_nr,
-                                 core_id,
-                                 continuation,
-                                 error_continuation);
-                                 //nullptr,
-                                 //std::move(timer));
+req_handle_t Client::InvokeUnloggedAsync(uint64_t txn_nr,
+                         uint8_t core_id,
+                         int replicaIdx,
+                         const string &request,
+                         unlogged_continuation_t continuation,
+                         error_continuation_t error_continuation,
+                         uint32_t timeout,
+                         const Timestamp &snapshot) {
+    uint64_t reqId = AddPendingUnlogged(txn_nr, core_id, request,
+                                        continuation, error_continuation,
+                                        timeout);
 
     // TODO: find a way to get sending errors (the eRPC's enqueue_request
     // function does not return errors)
-    // TODO: deal with timeouts?
+    ASSERT(request.size() <= MAX_KEY_SIZE);
+    size_t reqLen = sizeof(unlogged_request_t) + request.size();
     auto *reqBuf = reinterpret_cast<unlogged_request_t *>(
       transport->GetRequestBuf(
-        sizeof(unlogged_request_t),
-        sizeof(unlogged_response_t)
+        reqLen,
+        sizeof(unlogged_response_t) + MAX_VALUE_SIZE
       )
     );
     reqBuf->req_nr = reqId;
-    memcpy(reqBuf->key, request.c_str(), request.size());
-    blocked = true;
+    reqBuf->timestamp = snapshot.getTimestamp();
+    reqBuf->id = snapshot.getID();
+    reqBuf->key_len = request.size();
+    memcpy(reqBuf + 1, request.data(), request.size());
     transport->SendRequestToReplica(this,
                                     unloggedReqType,
                                     replicaIdx, core_id,
-                                    sizeof(unlogged_request_t));
+                                    reqLen);
+    return reqId;
+}
+
+req_handle_t Client::InvokeMultiGetAsync(uint64_t txn_nr,
+                         uint8_t core_id,
+                         int replicaIdx,
+                         const std::vector<string> &keys,
+                         unlogged_continuation_t continuation,
+                         error_continuation_t error_continuation,
+                         uint32_t timeout,
+                         const Timestamp &snapshot) {
+    uint64_t reqId = AddPendingUnlogged(txn_nr, core_id, string(),
+                                        continuation, error_continuation,
+                                        timeout);
+
+    size_t reqLen = sizeof(multiget_request_t);
+    for (const string &key : keys) {
+        ASSERT(key.size() <= MAX_KEY_SIZE);
+        reqLen += sizeof(uint16_t) + key.size();
+    }
+    auto *reqBuf = reinterpret_cast<multiget_request_t *>(
+      transport->GetRequestBuf(
+        reqLen,
+        maxUnloggedRespSize
+      )
+    );
+    reqBuf->req_nr = reqId;
+    reqBuf->timestamp = snapshot.getTimestamp();
+    reqBuf->id = snapshot.getID();
+    reqBuf->nr_keys = keys.size();
+    char *ptr = reinterpret_cast<char *>(reqBuf + 1);
+    for (const string &key : keys) {
+        uint16_t key_len = key.size();
+        memcpy(ptr, &key_len, sizeof(key_len));
+        ptr += sizeof(key_len);
+        memcpy(ptr, key.data(), key.size());
+        ptr += key.size();
+    }
+    transport->SendRequestToReplica(this,
+                                    multiGetReqType,
+                                    replicaIdx, core_id,
+                                    reqLen);
+    return reqId;
+}
+
+uint64_t Client::AddPendingUnlogged(uint64_t txn_nr,
+                                    uint8_t core_id,
+                                    const string &request,
+                                    unlogged_continuation_t continuation,
+                                    error_continuation_t error_continuation,
+                                    uint32_t timeout) {
+    uint64_t reqId = ++lastReqId;
+
+    PendingUnloggedRequest &req = pendingUnloggedReqs[reqId] =
+        PendingUnloggedRequest(request,
+                                 reqId,
+                                 txn_nr,
+                                 core_id,
+                                 continuation,
+                                 error_continuation);
+    req.timer = transport->Timer(timeout, [this, reqId]() {
+        UnloggedRequestTimeoutCallback(reqId);
+    });
+    return reqId;
+}
+
+bool Client::Done(req_handle_t handle) const {
+    return pendingConsensusReqs.find(handle) == pendingConsensusReqs.end() &&
+           pendingUnloggedReqs.find(handle) == pendingUnloggedReqs.end();
+}
+
+void Client::Wait(req_handle_t handle) {
+    // The other fibers on this thread share the transport, so let
+    // them run (and send their own requests) while we wait
+    transport->WaitFor([this, handle]() { return Done(handle); });
+}
+
+void Client::UnloggedRequestTimeoutCallback(const uint64_t reqId) {
+    auto it = pendingUnloggedReqs.find(reqId);
+    if (it == pendingUnloggedReqs.end()) {
+        return;
+    }
+    Warning("Unlogged request timed out: %lu", reqId);
+    PendingUnloggedRequest req = std::move(it->second);
+    pendingUnloggedReqs.erase(it);
+    if (req.error_continuation) {
+        req.error_continuation(req.request, ErrorCode::TIMEOUT);
+    }
 }
 
+void Client::TransitionToConsensusSlowPath(const uint64_t reqId) {
+    auto it = pendingConsensusReqs.find(reqId);
+    if (it == pendingConsensusReqs.end()) {
+        return;
+    }
+    PendingConsensusRequest &req = it->second;
+    req.transition_to_slow_path_timer = 0;
+    if (req.on_slow_path || req.sent_confirms) {
+        return;
+    }
 
-// void IRClient::TransitionToConsensusSlowPath(const uint64_t reqId) {
-//     Warning("Client timeout; taking consensus slow path: reqId=%lu", reqId);
-//     PendingConsensusRequest *req =
-//         dynamic_cast<PendingConsensusRequest *>(pendingReqs[reqId]);
-//     ASSERT(req != NULL);
-//     req->on_slow_path = true;
+    Debug("Client timeout; taking consensus slow path: reqId=%lu", reqId);
+    req.on_slow_path = true;
 
-//     // We've already transitioned into the slow path, so don't transition into
-//     // the slow-path again.
-//     //ASSERT(req->transition_to_slow_path_timer);
-//     //req->transition_to_slow_path_timer.reset();
+    // It's possible that we already have a quorum of responses (but not a
+    // super quorum).
+    if (req.consensusReplyQuorum.size() >= config.QuorumSize()) {
+        HandleSlowPathConsensus(req, false);
+    }
+}
 
-//     // It's possible that we already have a quorum of responses (but not a
-//     // super quorum).
-//     const std::map<int, consensus_response_t> *quorum =
-//         req->consensusReplyQuorum.CheckForQuorum();
-//     if (quorum != nullptr) {
-//         HandleSlowPathConsensus(reqId, *quorum, false, req);
-//     }
-// }
+void Client::StopTimers(PendingConsensusRequest &req) {
+    transport->CancelTimer(req.timer);
+    req.timer = 0;
+    if (req.transition_to_slow_path_timer != 0) {
+        transport->CancelTimer(req.transition_to_slow_path_timer);
+        req.transition_to_slow_path_timer = 0;
+    }
+}
 
-void Client::HandleSlowPathConsensus(const bool finalized_result_found) {
-    ASSERT(finalized_result_found || consensusReplyQuorum.size() >= config.QuorumSize());
+void Client::HandleSlowPathConsensus(PendingConsensusRequest &req,
+                                     const bool finalized_result_found) {
+    ASSERT(finalized_result_found || req.consensusReplyQuorum.size() >= config.QuorumSize());
 
     // If a finalized result wasn't found, call decide to determine the
     // finalized result.
     if (!finalized_result_found) {
         uint64_t view = 0;
         boost::unordered_map<int, std::size_t> results;
-        for (const auto &p : consensusReplyQuorum) {
+        for (const auto &p : req.consensusReplyQuorum) {
             const consensus_response_t *r = &p.second;
             results[r->status] += 1;
 
@@ -236,45 +369,61 @@ void Client::HandleSlowPathConsensus(const bool finalized_result_found) {
 
         // Upcall into the application, and put the result in the request
         // to store for later retries.
-        ASSERT(crtConsensusReq.decide != NULL);
-        crtConsensusReq.decidedStatus = crtConsensusReq.decide(results);
-        crtConsensusReq.reply_consensus_view = view;
+        ASSERT(req.decide != NULL);
+        req.decidedStatus = req.decide(results);
+        req.reply_consensus_view = view;
     }
 
     // Set up a new timer for the finalize phase.
-    //req->timer = std::unique_ptr<Timeout>(
-    //    new Timeout(transport, 500, [this, req_nr]() {  //
-    //        ResendFinalizeConsensusRequest(req_nr, true);
-    //    }));
+    StopTimers(req);
+    uint64_t reqId = req.req_nr;
+    req.timer = transport->TimerMicro(RETRY_TIMEOUT_US, [this, reqId]() {
+        ResendFinalizeConsensusRequest(reqId);
+    });
+
+    req.sent_confirms = true;
+    SendFinalizeConsensus(req);
+}
 
-    // Send finalize message.
+void Client::SendFinalizeConsensus(const PendingConsensusRequest &req) {
     auto *reqBuf = reinterpret_cast<finalize_consensus_request_t *>(
       transport->GetRequestBuf(
         sizeof(finalize_consensus_request_t),
         sizeof(finalize_consensus_response_t)
       )
     );
-    reqBuf->req_nr = crtConsensusReq.req_nr;
+    reqBuf->req_nr = req.req_nr;
     reqBuf->client_id = clientid;
-    reqBuf->status = crtConsensusReq.decidedStatus;
-    reqBuf->txn_nr = crtConsensusReq.txn_nr;
+    reqBuf->status = req.decidedStatus;
+    reqBuf->txn_nr = req.txn_nr;
 
-    crtConsensusReq.sent_confirms = true;
-    //req->timer->Start();
     transport->SendRequestToAll(this,
                                 finalizeConsensusReqType,
-                                crtConsensusReq.core_id,
+                                req.core_id,
                                 sizeof(finalize_consensus_request_t));
 }
 
-void Client::HandleFastPathConsensus() {
-    ASSERT(consensusReplyQuorum.size() >= config.FastQuorumSize());
-    Debug("Handling fast path for request %lu.", crtConsensusReq.req_nr);
+void Client::ResendFinalizeConsensusRequest(const uint64_t reqId) {
+    auto it = pendingConsensusReqs.find(reqId);
+    if (it == pendingConsensusReqs.end()) {
+        return;
+    }
+    PendingConsensusRequest &req = it->second;
+    Warning("Client timeout; resending finalize consensus request: %lu", reqId);
+    req.timer = transport->TimerMicro(RETRY_TIMEOUT_US, [this, reqId]() {
+        ResendFinalizeConsensusRequest(reqId);
+    });
+    SendFinalizeConsensus(req);
+}
+
+void Client::HandleFastPathConsensus(PendingConsensusRequest &req) {
+    ASSERT(req.consensusReplyQuorum.size() >= config.FastQuorumSize());
+    Debug("Handling fast path for request %lu.", req.req_nr);
 
     // We've received a super quorum of responses. Now, we have to check to see
     // if we have a super quorum of _matching_ responses.
     boost::unordered_map<int, std::size_t> results;
-    for (const auto &m : consensusReplyQuorum) {
+    for (const auto &m : req.consensusReplyQuorum) {
         const int result = m.second.status;
         results[result]++;
     }
@@ -286,42 +435,40 @@ void Client::HandleFastPathConsensus() {
 
         // A super quorum of matching requests was found!
         Debug("A super quorum of matching requests was found for request %lu.",
-              crtConsensusReq.req_nr);
-        crtConsensusReq.decidedStatus = result.first;
+              req.req_nr);
+        req.decidedStatus = result.first;
 
-        // Stop the transition to slow path timer
-        //req->transition_to_slow_path_timer->Stop();
+        // Stop the transition to slow path and retry timers
+        StopTimers(req);
 
         // aaasz: we don't need to send finalize consensus on fast path anymore;
         // the client will immediately send the inconsistent request to commit/abort
 
+        // Remove from the pending list before returning to the client,
+        // the continuation may well send the next request
+        PendingConsensusRequest done = std::move(req);
+        pendingConsensusReqs.erase(done.req_nr);
+
         // Return to the client.
-        if (!crtConsensusReq.continuationInvoked) {
-            crtConsensusReq.consensus_continuation(crtConsensusReq.decidedStatus);
-            crtConsensusReq.continuationInvoked = true;
+        if (!done.continuationInvoked) {
+            done.consensus_continuation(done.decidedStatus);
         }
-
-        blocked = false;
-        consensusReplyQuorum.clear();
-        crtConsensusReq.req_nr = 0;
         return;
     }
 
     // There was not a super quorum of matching results, so we transition into
     // the slow path.
     Debug("A super quorum of matching requests was NOT found for request %lu.",
-          crtConsensusReq.req_nr);
-    crtConsensusReq.on_slow_path = true;
-    //if (req->transition_to_slow_path_timer) {
-    //    req->transition_to_slow_path_timer.reset();
-    //}
-    HandleSlowPathConsensus(false);
+          req.req_nr);
+    req.on_slow_path = true;
+    HandleSlowPathConsensus(req, false);
 }
 
 void Client::ReceiveResponse(uint8_t reqType, char *respBuf) {
     Debug("[%lu] received response", clientid);
     switch(reqType){
         case unloggedReqType:
+        case multiGetReqType:
             HandleUnloggedReply(respBuf);
             break;
         case inconsistentReqType:
@@ -340,7 +487,8 @@ void Client::ReceiveResponse(uint8_t reqType, char *respBuf) {
 
 void Client::HandleUnloggedReply(char *respBuf) {
     auto *resp = reinterpret_cast<unlogged_response_t *>(respBuf);
-    if (resp->req_nr != crtUnloggedReq.req_nr) {
+    auto it = pendingUnloggedReqs.find(resp->req_nr);
+    if (it == pendingUnloggedReqs.end()) {
         Warning("Received unlogged reply when no request was pending; req_nr = %lu", resp->req_nr);
         return;
     }
@@ -348,12 +496,12 @@ void Client::HandleUnloggedReply(char *respBuf) {
     Debug("[%lu] Received unlogged reply", clientid);
 
     // delete timer event
-    //req->timer->Stop();
-    // invoke application callback
-    crtUnloggedReq.get_continuation(respBuf);
+    transport->CancelTimer(it->second.timer);
     // remove from pending list
-    blocked = false;
-    crtUnloggedReq.req_nr = 0;
+    unlogged_continuation_t continuation = std::move(it->second.get_continuation);
+    pendingUnloggedReqs.erase(it);
+    // invoke application callback
+    continuation(respBuf);
 }
 
 void Client::HandleInconsistentReply(char *respBuf) {
@@ -369,17 +517,19 @@ void Client::HandleConsensusReply(char *respBuf) {
         "request %lu.",
         resp->replicaid, resp->view, resp->req_nr);
 
-    if (resp->req_nr != crtConsensusReq.req_nr) {
-        Warning(
+    auto it = pendingConsensusReqs.find(resp->req_nr);
+    if (it == pendingConsensusReqs.end()) {
+        // late replies are expected once we are done with a request
+        Debug(
             "Client was not expecting a ReplyConsensusMessage for request %lu, "
             "so it is ignoring the request.",
             resp->req_nr);
         return;
     }
 
-    //ASSERT(req != nullptr);
+    PendingConsensusRequest &req = it->second;
 
-    if (crtConsensusReq.sent_confirms) {
+    if (req.sent_confirms) {
         Debug(
             "Client has already received a quorum or super quorum of "
             "HandleConsensusReply for request %lu and has already sent out "
@@ -391,31 +541,29 @@ void Client::HandleConsensusReply(char *respBuf) {
     // save the response
     //req->consensusReplyQuorum.Add(resp->view, resp->replicaid, *resp);
     // TODO: check view number
-    consensusReplyQuorum[resp->replicaid] = *resp;
+    req.consensusReplyQuorum[resp->replicaid] = *resp;
 
     if (resp->finalized) {
         Debug("The HandleConsensusReply for request %lu was finalized.", resp->req_nr);
         // If we receive a finalized message, then we immediately transition
         // into the slow path.
-        crtConsensusReq.on_slow_path = true;
-        //if (req->transition_to_slow_path_timer) {
-        //    req->transition_to_slow_path_timer.reset();
-        //}
+        req.on_slow_path = true;
 
-        crtConsensusReq.decidedStatus = resp->status;
-        crtConsensusReq.reply_consensus_view = resp->view;
+        req.decidedStatus = resp->status;
+        req.reply_consensus_view = resp->view;
         // TODO: what if finalize in a different view?
-        HandleSlowPathConsensus(true);
-    } else if (crtConsensusReq.on_slow_path && consensusReplyQuorum.size() >= config.QuorumSize()) {
-        HandleSlowPathConsensus(false);
-    } else if (!crtConsensusReq.on_slow_path && consensusReplyQuorum.size() >= config.FastQuorumSize()) {
-        HandleFastPathConsensus();
+        HandleSlowPathConsensus(req, true);
+    } else if (req.on_slow_path && req.consensusReplyQuorum.size() >= config.QuorumSize()) {
+        HandleSlowPathConsensus(req, false);
+    } else if (!req.on_slow_path && req.consensusReplyQuorum.size() >= config.FastQuorumSize()) {
+        HandleFastPathConsensus(req);
     }
 }
 
 void Client::HandleFinalizeConsensusReply(char *respBuf) {
     auto *resp = reinterpret_cast<finalize_consensus_response_t *>(respBuf);
-    if (resp->req_nr != crtConsensusReq.req_nr) {
+    auto it = pendingConsensusReqs.find(resp->req_nr);
+    if (it == pendingConsensusReqs.end()) {
         Debug(
             "We received a FinalizeConsensusReply for operation %lu, but we weren't "
             "waiting for any FinalizeConsensusReply. We are ignoring the message.",
@@ -428,30 +576,31 @@ void Client::HandleFinalizeConsensusReply(char *respBuf) {
         "request %lu.",
         resp->replicaid, resp->view, resp->req_nr);
 
+    PendingConsensusRequest &req = it->second;
+
     // TODO: check view
-    finalizeReplyQuorum[resp->replicaid] = *resp;
-    if (finalizeReplyQuorum.size() >= config.QuorumSize()) {
-        //req->timer->Stop();
-        if (!crtConsensusReq.continuationInvoked) {
+    req.finalizeReplyQuorum[resp->replicaid] = *resp;
+    if (req.finalizeReplyQuorum.size() >= config.QuorumSize()) {
+        StopTimers(req);
+        PendingConsensusRequest done = std::move(req);
+        pendingConsensusReqs.erase(it);
+
+        if (!done.continuationInvoked) {
             // Return to the client.
-            if (resp->view == crtConsensusReq.reply_consensus_view) {
-                crtConsensusReq.consensus_continuation(crtConsensusReq.decidedStatus);
+            if (resp->view == done.reply_consensus_view) {
+                done.consensus_continuation(done.decidedStatus);
             } else {
                 Debug(
                     "We received a majority of ConfirmMessages for request %lu "
                     "with view %lu, but the view from ReplyConsensusMessages "
                     "was %lu.",
-                    resp->req_nr, resp->view, crtConsensusReq.reply_consensus_view);
-                if (crtConsensusReq.error_continuation) {
-                    crtConsensusReq.error_continuation(
-                        crtConsensusReq.request, ErrorCode::MISMATCHED_CONSENSUS_VIEWS);
+                    resp->req_nr, resp->view, done.reply_consensus_view);
+                if (done.error_continuation) {
+                    done.error_continuation(
+                        done.request, ErrorCode::MISMATCHED_CONSENSUS_VIEWS);
                 }
             }
         }
-        blocked = false;
-        finalizeReplyQuorum.clear();
-        consensusReplyQuorum.clear();
-        crtConsensusReq.req_nr = 0;
     }
 }
 
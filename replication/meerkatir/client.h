@@ -39,6 +39,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 #include <boost/unordered_map.hpp>
 
 namespace replication {
@@ -70,17 +71,36 @@ using continuation_t =
 using error_continuation_t =
     std::function<void(const string &request, ErrorCode err)>;
 
+// Completion handle of an asynchronous request (its req_nr)
+using req_handle_t = uint64_t;
+
 
 class Client : public TransportReceiver
 {
 public:
     static const uint32_t DEFAULT_UNLOGGED_OP_TIMEOUT = 1000; // milliseconds
+    // How long a consensus request waits for a super quorum before it
+    // settles for the slow path. With three replicas the super quorum
+    // is all of them, so this is only meant to catch a replica that is
+    // down or stalled: it is well above the tail of a prepare round,
+    // and short enough that prepared writes do not hold their keys
+    // much longer than the round itself.
+    static const uint64_t SLOW_PATH_TIMEOUT_US = 2 * 1000;
+    // Consensus and finalize requests are sent again after this long
+    static const uint64_t RETRY_TIMEOUT_US = 500 * 1000;
 
     Client(const transport::Configuration &config,
              Transport *transport,
              uint64_t clientid = 0);
     virtual ~Client();
 
+    // The Invoke* functions block the calling fiber until the
+    // continuation has run; the *Async variants return as soon as the
+    // request is sent, and the caller waits for it with Wait. The
+    // transaction given to InvokeConsensusAsync must outlive the
+    // request, it is serialized again if the request is retried.
+    // Unlogged reads with a snapshot read as of that timestamp; the
+    // default Timestamp() reads the latest versions.
     virtual void InvokeUnlogged(
         uint64_t txn_nr,
         uint8_t core_id,
@@ -88,7 +108,28 @@ public:
         const string &request,
         unlogged_continuation_t continuation,
         error_continuation_t error_continuation = nullptr,
-        uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT);
+        uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT,
+        const Timestamp &snapshot = Timestamp());
+    virtual req_handle_t InvokeUnloggedAsync(
+        uint64_t txn_nr,
+        uint8_t core_id,
+        int replicaIdx,
+        const string &request,
+        unlogged_continuation_t continuation,
+        error_continuation_t error_continuation = nullptr,
+        uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT,
+        const Timestamp &snapshot = Timestamp());
+    // Reads several keys in one unlogged request; the continuation gets
+    // a multiget_response_t, which may answer only the first keys
+    virtual req_handle_t InvokeMultiGetAsync(
+        uint64_t txn_nr,
+        uint8_t core_id,
+        int replicaIdx,
+        const std::vector<string> &keys,
+        unlogged_continuation_t continuation,
+        error_continuation_t error_continuation = nullptr,
+        uint32_t timeout = DEFAULT_UNLOGGED_OP_TIMEOUT,
+        const Timestamp &snapshot = Timestamp());
     virtual void InvokeInconsistent(
         uint64_t txn_nr,
         uint8_t core_id,
@@ -103,9 +144,24 @@ public:
         decide_t decide,
         consensus_continuation_t continuation,
         error_continuation_t error_continuation = nullptr);
+    virtual req_handle_t InvokeConsensusAsync(
+        uint64_t txn_nr,
+        uint8_t core_id,
+        const Transaction &txn,
+        const Timestamp &timestamp,
+        decide_t decide,
+        consensus_continuation_t continuation,
+        error_continuation_t error_continuation = nullptr);
+
+    // Returns true once the continuation of the request has run
+    bool Done(req_handle_t handle) const;
+    // Runs the event loop until the request is done
+    void Wait(req_handle_t handle);
+
     void ReceiveRequest(uint8_t reqType, char *reqBuf, char *respBuf) override { PPanic("Not implemented."); };
     void ReceiveResponse(uint8_t reqType, char *respBuf) override;
-    bool Blocked() override { return blocked; };
+    // We wait for our requests in Wait, never in the transport
+    bool Blocked() override { return false; };
 
 protected:
     struct PendingRequest {
@@ -115,21 +171,18 @@ protected:
         uint8_t core_id;
         continuation_t continuation;
         bool continuationInvoked = false;
-        //std::unique_ptr<Timeout> timer;
+        // Timeout or retry timer, 0 when not armed
+        int timer = 0;
 
         inline PendingRequest() {};
         inline PendingRequest(string request, uint64_t req_nr,
                               uint64_t txn_nr, uint8_t core_id,
-                              continuation_t continuation
-                              //std::unique_ptr<Timeout> timer,
-                              )
+                              continuation_t continuation)
             : request(request),
               req_nr(req_nr),
               txn_nr(txn_nr),
               core_id(core_id),
-              continuation(continuation)
-              //timer(std::move(timer)),
-              {};
+              continuation(continuation) {};
         virtual ~PendingRequest(){};
     };
 
@@ -143,10 +196,7 @@ protected:
             uint8_t core_id,
             unlogged_continuation_t get_continuation,
             error_continuation_t error_continuation)
-            //std::unique_ptr<Timeout> timer)
-            : PendingRequest(request, clientReqId, clienttxn_nr, core_id, nullptr
-                            //std::move(timer),
-                            ),
+            : PendingRequest(request, clientReqId, clienttxn_nr, core_id, nullptr),
               error_continuation(error_continuation),
               get_continuation(get_continuation){};
     };
@@ -159,8 +209,13 @@ protected:
         consensus_continuation_t consensus_continuation;
 
         // The timer to give up on the fast path and transition to the slow
-        // path. After this timer is run for the first time, it is nulled.
-        //std::unique_ptr<Timeout> transition_to_slow_path_timer;
+        // path, 0 once it has fired or was cancelled.
+        int transition_to_slow_path_timer = 0;
+
+        // What we are agreeing on, kept to send the request again; the
+        // caller keeps the transaction alive until the request is done
+        const Transaction *txn = nullptr;
+        Timestamp timestamp;
 
         // The view for which a majority result (or finalized result) was
         // found. The view of a majority of confirms must match this view.
@@ -171,44 +226,50 @@ protected:
         // phase.
         bool sent_confirms = false;
 
+        // Replies received so far, by replica id
+        boost::unordered_map<int, consensus_response_t> consensusReplyQuorum;
+        boost::unordered_map<int, finalize_consensus_response_t> finalizeReplyQuorum;
+
         inline PendingConsensusRequest() {};
         inline PendingConsensusRequest(
             uint64_t clientReqId, uint64_t clienttxn_nr,
             uint8_t core_id,
             consensus_continuation_t consensus_continuation,
-            //std::unique_ptr<Timeout> timer,
-            //std::unique_ptr<Timeout> transition_to_slow_path_timer,
             decide_t decide,
-            error_continuation_t error_continuation)
-            : PendingRequest("", clientReqId, clienttxn_nr, core_id, nullptr
-                            //std::move(timer),
-                           ),
+            error_continuation_t error_continuation,
+            const Transaction *txn,
+            const Timestamp &timestamp)
+            : PendingRequest("", clientReqId, clienttxn_nr, core_id, nullptr),
               decide(decide),
               on_slow_path(false),
               error_continuation(error_continuation),
-              consensus_continuation(consensus_continuation){};
-              //transition_to_slow_path_timer(
-              //    std::move(transition_to_slow_path_timer)){};
+              consensus_continuation(consensus_continuation),
+              txn(txn),
+              timestamp(timestamp) {};
     };
 
     transport::Configuration config;
     uint64_t lastReqId;
 
-    // We assume this client is single-threaded and synchronous,
-    // so we can re-use these structures among consecutive requests
-    boost::unordered_map<int, consensus_response_t> consensusReplyQuorum;
-    boost::unordered_map<int, finalize_consensus_response_t> finalizeReplyQuorum;
-    PendingConsensusRequest crtConsensusReq;
-    PendingUnloggedRequest crtUnloggedReq;
+    // Requests in flight, by req_nr; the client is single-threaded,
+    // but the fibers sharing it may each have several requests pending
+    boost::unordered_map<uint64_t, PendingConsensusRequest> pendingConsensusReqs;
+    boost::unordered_map<uint64_t, PendingUnloggedRequest> pendingUnloggedReqs;
 
     Transport *transport;
     uint64_t clientid;
-    bool blocked;
 
     // `TransitionToConsensusSlowPath` is called after a timeout to end the
     // possibility of taking the fast path and transition into taking the slow
     // path.
-    void TransitionToConsensusSlowPath();
+    void TransitionToConsensusSlowPath(const uint64_t reqId);
+
+    void SendConsensus(const PendingConsensusRequest &req);
+    void SendFinalizeConsensus(const PendingConsensusRequest &req);
+    void ResendConsensusRequest(const uint64_t reqId);
+    void ResendFinalizeConsensusRequest(const uint64_t reqId);
+    // Stops the timers of a request that is done
+    void StopTimers(PendingConsensusRequest &req);
 
     // HandleSlowPathConsensus is called in one of two scenarios:
     //
@@ -222,7 +283,8 @@ protected:
     //
     // In either case, HandleSlowPathConsensus intitiates the finalize phase of
     // a consensus request.
-    void HandleSlowPathConsensus(const bool finalized_result_found);
+    void HandleSlowPathConsensus(PendingConsensusRequest &req,
+                                 const bool finalized_result_found);
 
     // HandleFastPathConsensus is called when we're on the fast path and
     // receive a super quorum of responses from the same view.
@@ -232,8 +294,14 @@ protected:
     // Otherwise, it transitions into the slow path which will also initiate
     // the finalize phase of a consensus request, but not yet return to the
     // user.
-    void HandleFastPathConsensus();
+    void HandleFastPathConsensus(PendingConsensusRequest &req);
 
+    // Registers a new unlogged request and arms its timeout
+    uint64_t AddPendingUnlogged(uint64_t txn_nr, uint8_t core_id,
+                                const string &request,
+                                unlogged_continuation_t continuation,
+                                error_continuation_t error_continuation,
+                                uint32_t timeout);
     void UnloggedRequestTimeoutCallback(const uint64_t reqId);
 
     // new handlers
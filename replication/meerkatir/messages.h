@@ -1,6 +1,11 @@
 #ifndef _MEERKATIR_MESSAGES_H_
 #define _MEERKATIR_MESSAGES_H_
 
+#include "store/common/transaction.h"
+
+#include <cstddef>
+#include <cstdint>
+
 namespace replication {
 namespace meerkatir {
 
@@ -10,19 +15,60 @@ const uint8_t unloggedReqType = 1;
 const uint8_t consensusReqType = 2;
 const uint8_t finalizeConsensusReqType = 3; //slow path prepare
 const uint8_t inconsistentReqType = 4;
+const uint8_t multiGetReqType = 5;
 
+// followed by key_len bytes of key; timestamp and id are the snapshot
+// to read at, or 0 to read the latest version
 struct unlogged_request_t {
     uint64_t req_nr;
-    char key[64];
-};
+    uint64_t timestamp;
+    uint64_t id;
+    uint16_t key_len;
+} __attribute__((packed));
 
+// followed by value_len bytes of value; fingerprint is what the
+// client may send in its read set instead of the key, or 0
 struct unlogged_response_t {
     uint64_t req_nr;
     uint64_t timestamp;
     uint64_t id;
-    char value[64];
+    uint64_t fingerprint;
     int status;
-};
+    uint32_t value_len;
+} __attribute__((packed));
+
+// followed by nr_keys keys, each a uint16_t length and the key bytes;
+// the snapshot is as in unlogged_request_t
+struct multiget_request_t {
+    uint64_t req_nr;
+    uint64_t timestamp;
+    uint64_t id;
+    uint16_t nr_keys;
+} __attribute__((packed));
+
+// followed by the results for the first nr_keys keys of the request, in
+// order, each a multiget_result_t and value_len bytes of value; the
+// server answers as many keys as fit in maxUnloggedRespSize, and the
+// client asks again for the others
+struct multiget_response_t {
+    uint64_t req_nr;
+    uint16_t nr_keys;
+} __attribute__((packed));
+
+struct multiget_result_t {
+    uint64_t timestamp;
+    uint64_t id;
+    uint64_t fingerprint;
+    int status;
+    uint32_t value_len;
+} __attribute__((packed));
+
+// Largest response to an unlogged request; it fits a single get
+// response, or a multi-get response with at least one value
+const size_t maxUnloggedRespSize = sizeof(multiget_response_t) +
+                                   sizeof(multiget_result_t) + MAX_VALUE_SIZE;
+static_assert(maxUnloggedRespSize >= sizeof(unlogged_response_t) + MAX_VALUE_SIZE,
+              "a get response must fit in maxUnloggedRespSize");
 
 struct inconsistent_request_t {
     uint64_t client_id;
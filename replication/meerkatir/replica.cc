@@ -37,6 +37,9 @@ void Replica::ReceiveRequest(uint8_t reqType, char *reqBuf, char *respBuf) {
         case unloggedReqType:
             HandleUnloggedRequest(reqBuf, respBuf, respLen);
             break;
+        case multiGetReqType:
+            app->MultiGetUpcall(reqBuf, respBuf, respLen);
+            break;
         case inconsistentReqType:
             HandleInconsistentRequest(reqBuf, respBuf, respLen);
             break;
@@ -74,10 +77,21 @@ void Replica::HandleInconsistentRequest(char *reqBuf, char *respBuf, size_t &res
     view_t crt_txn_view;
     RecordEntryState crt_txn_state;
     string crt_txn_result;
+    if (entry == NULL && finished.find(txnid) != finished.end()) {
+        // a resend of a commit or abort we already applied
+        auto *resp = reinterpret_cast<inconsistent_response_t *>(respBuf);
+        resp->req_nr = req->req_nr;
+        respLen = sizeof(inconsistent_response_t);
+        return;
+    }
     if (entry != NULL) {
         if (req->req_nr <= entry->req_nr) {
             Warning("Client request from the past.");
-            // If a client request number from the past, ignore it
+            // If a client request number from the past, ignore it, but
+            // still answer it: every request gets a response
+            auto *resp = reinterpret_cast<inconsistent_response_t *>(respBuf);
+            resp->req_nr = req->req_nr;
+            respLen = sizeof(inconsistent_response_t);
             return;
         }
 
@@ -113,9 +127,21 @@ void Replica::HandleInconsistentRequest(char *reqBuf, char *respBuf, size_t &res
 
     // TODO: for now just trim the log as soon as the transaction was finalized
     // this is not safe for a complete checkpoint
+    AddFinished(txnid, entry->txn_status);
     record.Remove(txnid);
 }
 
+void Replica::AddFinished(txnid_t txnid, TransactionStatus status) {
+    if (!finished.emplace(txnid, status).second) {
+        return;
+    }
+    finishedOrder.push_back(txnid);
+    if (finishedOrder.size() > maxFinished) {
+        finished.erase(finishedOrder.front());
+        finishedOrder.pop_front();
+    }
+}
+
 void Replica::HandleConsensusRequest(char *reqBuf, char *respBuf, size_t &respLen) {
     auto *req = reinterpret_cast<consensus_request_header_t *>(reqBuf);
 
@@ -130,6 +156,22 @@ void Replica::HandleConsensusRequest(char *reqBuf, char *respBuf, size_t &respLe
     view_t crt_txn_view;
     RecordEntryState crt_txn_state;
     string crt_txn_result;
+    if (entry == NULL) {
+        auto it = finished.find(txnid);
+        if (it != finished.end()) {
+            // A resend of a prepare whose transaction was committed or
+            // aborted since; preparing it again would leave it in the
+            // readers and writers of its keys for good.
+            auto *resp = reinterpret_cast<consensus_response_t *>(respBuf);
+            resp->view = 0;
+            resp->replicaid = myIdx;
+            resp->req_nr = req->req_nr;
+            resp->finalized = true;
+            resp->status = it->second == COMMITTED ? REPLY_OK : REPLY_FAIL;
+            respLen = sizeof(consensus_response_t);
+            return;
+        }
+    }
     if (entry != NULL) {
         //if (clientreq_nr <= entry->req_nr) {
             // If a client request number from the past, ignore it
@@ -229,7 +271,11 @@ void Replica::HandleFinalizeConsensusRequest(char *reqBuf, char *respBuf, size_t
     }
 }
 
+// The request latencies are kept by the transport, see
+// FastTransport::PrintLatencyStats
 void Replica::PrintStats() {
+    Notice("Replica %d: %lu transactions in the record", myIdx,
+           record.Entries().size());
 }
 
 } // namespace ir
@@ -9,6 +9,7 @@
 #ifndef _IR_REPLICA_H_
 #define _IR_REPLICA_H_
 
+#include <deque>
 #include <memory>
 
 #include "lib/assert.h"
@@ -47,6 +48,11 @@ public:
     // Invoke unreplicated operation
     virtual void UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) { };
 
+    // Invoke unreplicated read of several keys (see multiget_request_t)
+    virtual void MultiGetUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
+        Panic("Multi-get requests are not supported.");
+    };
+
     // Sync
     virtual void Sync(const std::map<txnid_t, RecordEntry>& record) { };
     // Merge
@@ -87,16 +93,22 @@ private:
     Transport *transport;
     AppReplica *app;
 
-    std::vector<uint64_t> latency_get;
-    std::vector<uint64_t> latency_prepare;
-    std::vector<uint64_t> latency_commit;
-
     // Transactions are fully partitioned across cores => no synchronization needed;
     // The record now maintains just one entry per transaction (as opposed to
     // one entry per operation, i.e., consensus, inconsistent);
     // The upcalls into the application now provide the old state of the
     // transaction and the app computes its next state;
     Record record;
+
+    // Outcomes of the last maxFinished transactions whose records were
+    // removed, oldest first, so that late resends of their requests
+    // are answered rather than run again
+    static const size_t maxFinished = 1 << 16;
+    boost::unordered_map<txnid_t, TransactionStatus,
+                         boost::hash<std::pair<uint64_t, uint64_t>>> finished;
+    std::deque<txnid_t> finishedOrder;
+
+    void AddFinished(txnid_t txnid, TransactionStatus status);
 };
 
 } // namespace ir
@@ -1,13 +1,30 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
-SRCS += $(addprefix $(d), benchClient.cc retwisClient.cc terminalClient.cc)
+SRCS += $(addprefix $(d), benchClient.cc retwisClient.cc terminalClient.cc \
+	localcluster.cc nexusBench.cc kvsBench.cc makeSnapshot.cc walBench.cc)
 
-OBJS-all-clients := $(OBJS-meerkatstore-client) $(OBJS-meerkatstore-leader-client)
+OBJS-all-clients := $(OBJS-meerkatstore-client) $(OBJS-meerkatstore-leader-client) \
+		$(LIB-udptransport)
 
-$(d)benchClient: $(OBJS-all-clients) $(o)benchClient.o
+# the replicas, to run them in process over the loopback transport
+OBJS-local-cluster := $(LIB-loopbacktransport) \
+		$(OBJS-meerkatstore-server) $(OBJS-meerkatstore-leader-server) \
+		$(o)localcluster.o
 
-$(d)retwisClient: $(OBJS-all-clients) $(o)retwisClient.o
+$(d)benchClient: $(OBJS-all-clients) $(OBJS-local-cluster) $(o)benchClient.o
+
+$(d)retwisClient: $(OBJS-all-clients) $(OBJS-local-cluster) $(o)retwisClient.o
 
 $(d)terminalClient: $(OBJS-all-clients) $(o)terminalClient.o
 
-BINS += $(d)benchClient $(d)retwisClient $(d)terminalClient
+$(d)nexusBench: $(LIB-fasttransport) $(o)nexusBench.o
+
+$(d)kvsBench: $(LIB-message) $(LIB-store-common) $(LIB-store-backend) $(o)kvsBench.o
+
+$(d)makeSnapshot: $(LIB-message) $(LIB-store-common) $(o)makeSnapshot.o
+
+$(d)walBench: $(LIB-message) $(LIB-histogram) $(LIB-store-common) \
+		$(LIB-store-backend) $(o)walBench.o
+
+BINS += $(d)benchClient $(d)retwisClient $(d)terminalClient $(d)nexusBench \
+	$(d)kvsBench $(d)makeSnapshot $(d)walBench
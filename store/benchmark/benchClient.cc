@@ -11,6 +11,9 @@
 #include "store/meerkatstore/meerkatir/client.h"
 #include "store/meerkatstore/leadermeerkatir/client.h"
 #include "store/common/flags.h"
+#include "store/benchmark/localcluster.h"
+#include "lib/loopbacktransport.h"
+#include "lib/udptransport.h"
 
 #include <boost/fiber/all.hpp>
 
@@ -36,7 +39,7 @@ bool replicated = true;
 
 void client_fiber_func(int thread_id,
                 transport::Configuration config,
-                FastTransport *transport) {
+                Transport *transport) {
     Client* client;
     vector<string> results;
 
@@ -208,13 +211,27 @@ void* client_thread_func(int thread_id, transport::Configuration config) {
     key_dis = std::uniform_int_distribution<uint32_t>(0, FLAGS_numKeys - 1);
 
     // create the transport
-    FastTransport *transport = new FastTransport(config,
-                                                FLAGS_ip,
-                                                FLAGS_numServerThreads,
-                                                0,
-                                                FLAGS_physPort,
-                                                0,
-                                                thread_id);
+    Transport *transport;
+    FastTransport *fast_transport = nullptr;
+    if (FLAGS_transport == "loopback") {
+        transport = new LoopbackTransport(config,
+                                          FLAGS_numServerThreads,
+                                          thread_id);
+    } else if (FLAGS_transport == "udp") {
+        transport = new UDPTransport(config,
+                                     FLAGS_ip,
+                                     FLAGS_numServerThreads,
+                                     thread_id);
+    } else {
+        fast_transport = new FastTransport(config,
+                                           FLAGS_ip,
+                                           FLAGS_numServerThreads,
+                                           0,
+                                           FLAGS_physPort,
+                                           0,
+                                           thread_id);
+        transport = fast_transport;
+    }
 
     // create the client fibers
     boost::fibers::fiber client_fibers[FLAGS_numClientFibers];
@@ -227,6 +244,10 @@ void* client_thread_func(int thread_id, transport::Configuration config) {
     for (int i = 0; i < FLAGS_numClientFibers; i++) {
         client_fibers[i].join();
     }
+
+    if (fast_transport != nullptr) {
+        fast_transport->PrintMsgBufferStats();
+    }
     return NULL;
 };
 
@@ -272,6 +293,16 @@ int main(int argc, char **argv) {
     }
     transport::Configuration config(configStream);
 
+    FastTransport::ShareNexusPerNumaNode(FLAGS_shareNexus);
+    FastTransport::SetPollBackoff(FLAGS_pollBackoffUs);
+
+    // Bring up the replicas in this process when there is no network
+    if (FLAGS_transport == "loopback") {
+        StartLocalCluster(config, FLAGS_mode, FLAGS_numServerThreads,
+                          keys, FLAGS_shardIndex, FLAGS_numShards,
+                          FLAGS_fingerprintReads, FLAGS_kvs);
+    }
+
     // Create the transport threads; each transport thread will run
     // FLAGS_numClientThreads client fibers
     std::vector<std::thread> client_thread_arr(FLAGS_numClientThreads);
@@ -281,6 +312,8 @@ int main(int argc, char **argv) {
         erpc::bind_to_core(client_thread_arr[i], 0, i);
     }
     for (auto &thread : client_thread_arr) thread.join();
+    FastTransport::PrintLatencyStats();
+    FastTransport::PrintPollStats();
 
     return 0;
 }
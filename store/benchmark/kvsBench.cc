@@ -0,0 +1,211 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/kvsBench.cc:
+ *   Measures key lookups in AtomicKvs against the node-based map it
+ *   used to keep its entries in.
+ *
+ *   --numKeys keys are loaded into each structure in turn, and then a
+ *   single thread looks up KVSBENCH_LOOKUPS keys drawn uniformly and,
+ *   if --zipf is above 0, drawn from a Zipfian distribution with that
+ *   coefficient. A lookup finds the entry of the key and loads its
+ *   timestamp word, like every AtomicKvs operation starts with. Both
+ *   structures see the same keys in the same order.
+ *
+ **********************************************************************/
+
+#include "store/common/backend/atomic_kvs.h"
+#include "store/common/flags.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <malloc.h>
+
+#define KVSBENCH_LOOKUPS 20000000
+// lookup keys are generated in batches of this many, outside of the
+// measured time
+#define KVSBENCH_BATCH 1000000
+
+// What AtomicKvs used to keep in its boost::unordered_map
+struct MapEntry {
+    std::atomic<uint64_t> word{0};
+    char value[56];
+} __attribute__((__aligned__(64)));
+
+typedef boost::unordered_map<std::string, MapEntry> EntryMap;
+
+static std::string bench_key(uint64_t i) {
+    return "key" + std::to_string(i);
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Megabytes allocated with malloc and friends
+static long heap_mb() {
+    return mallinfo2().uordblks >> 20;
+}
+
+// Zipfian key indices in [0, n), as in Gray et al., "Quickly generating
+// billion-record synthetic databases"; needs 0 < theta < 1
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(uint64_t n, double theta) : n(n), theta(theta), dis(0, 1) {
+        double zeta2 = Zeta(2);
+        zetan = Zeta(n);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+
+    uint64_t Next(std::mt19937_64 &gen) {
+        double u = dis(gen);
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+        uint64_t i = n * std::pow(eta * u - eta + 1, alpha);
+        return i < n ? i : n - 1;
+    }
+
+private:
+    uint64_t n;
+    double theta;
+    double zetan, alpha, eta;
+    std::uniform_real_distribution<double> dis;
+
+    double Zeta(uint64_t count) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= count; i++) {
+            sum += 1.0 / std::pow((double)i, theta);
+        }
+        return sum;
+    }
+};
+
+// The lookups of one distribution, as key indices
+static std::vector<uint32_t> lookup_indices(bool zipf) {
+    std::mt19937_64 gen(42);
+    std::vector<uint32_t> indices(KVSBENCH_LOOKUPS);
+    if (zipf) {
+        ZipfGenerator zipfGen(FLAGS_numKeys, FLAGS_zipf);
+        for (auto &i : indices) {
+            // scatter the popular keys over the key space
+            i = (zipfGen.Next(gen) * 0x9E3779B97F4A7C15ull) % FLAGS_numKeys;
+        }
+    } else {
+        std::uniform_int_distribution<uint64_t> dis(0, FLAGS_numKeys - 1);
+        for (auto &i : indices) {
+            i = dis(gen);
+        }
+    }
+    return indices;
+}
+
+// Returns the average lookup time in nanoseconds
+template <class F>
+static double time_lookups(const std::vector<uint32_t> &indices, F lookup) {
+    std::vector<std::string> keys(KVSBENCH_BATCH);
+    double seconds = 0;
+    uint64_t sum = 0;
+    for (size_t first = 0; first < indices.size(); first += KVSBENCH_BATCH) {
+        size_t n = std::min<size_t>(KVSBENCH_BATCH, indices.size() - first);
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = bench_key(indices[first + i]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            sum += lookup(keys[i]);
+        }
+        seconds += elapsed_s(start);
+    }
+    // keep the lookups from being optimized away
+    if (sum == 1) printf(" ");
+    return seconds * 1e9 / indices.size();
+}
+
+static void report(const char *structure, const char *dist, double load_s,
+                   long mb, double ns) {
+    printf("%-10s %-8s %10lu %8.2f %8ld %10.1f %8.2f\n", structure, dist,
+           FLAGS_numKeys, load_s, mb, ns, 1000.0 / ns);
+    fflush(stdout);
+}
+
+static void bench_map(const std::vector<std::pair<const char *,
+                      std::vector<uint32_t>>> &runs) {
+    long base_mb = heap_mb();
+    auto start = std::chrono::steady_clock::now();
+    EntryMap *map = new EntryMap();
+    map->reserve(FLAGS_numKeys);
+    for (uint64_t i = 0; i < FLAGS_numKeys; i++) {
+        (*map)[bench_key(i)];
+    }
+    double load_s = elapsed_s(start);
+    long mb = heap_mb() - base_mb;
+
+    for (const auto &run : runs) {
+        double ns = time_lookups(run.second, [map](const std::string &key) {
+            return map->find(key)->second.word.load();
+        });
+        report("map", run.first, load_s, mb, ns);
+    }
+    delete map;
+}
+
+static void bench_atomic_kvs(const std::vector<std::pair<const char *,
+                             std::vector<uint32_t>>> &runs) {
+    long base_mb = heap_mb();
+    auto start = std::chrono::steady_clock::now();
+    AtomicKvs *kvs = new AtomicKvs(FLAGS_numKeys);
+    for (uint64_t i = 0; i < FLAGS_numKeys; i++) {
+        kvs->Put(bench_key(i), "", Timestamp());
+    }
+    double load_s = elapsed_s(start);
+    long mb = heap_mb() - base_mb;
+
+    for (const auto &run : runs) {
+        // IsWriteLocked is a lookup and a load of the timestamp word
+        double ns = time_lookups(run.second, [kvs](const std::string &key) {
+            return kvs->IsWriteLocked(key) ? 1 : 0;
+        });
+        report("atomickvs", run.first, load_s, mb, ns);
+    }
+    delete kvs;
+}
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_numKeys == 0 || FLAGS_numKeys > UINT32_MAX) {
+        fprintf(stderr, "--numKeys must be between 1 and %u\n", UINT32_MAX);
+        return EXIT_FAILURE;
+    }
+    if (FLAGS_zipf >= 1) {
+        fprintf(stderr, "--zipf must be below 1\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::pair<const char *, std::vector<uint32_t>>> runs;
+    runs.emplace_back("uniform", lookup_indices(false));
+    if (FLAGS_zipf > 0) {
+        runs.emplace_back("zipf", lookup_indices(true));
+    }
+
+    printf("# %d lookups per run, zipf %.2f\n", KVSBENCH_LOOKUPS, FLAGS_zipf);
+    printf("# structure dist          keys   load_s  heap_mb ns/lookup  Mops/s\n");
+    fflush(stdout);
+
+    // one structure at a time, to keep the peak memory down at 100M keys
+    bench_map(runs);
+    bench_atomic_kvs(runs);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/localcluster.cc:
+ *   Runs the replicas of a shard inside the benchmark process,
+ *   on top of the loopback transport.
+ *
+ **********************************************************************/
+
+#include "store/benchmark/localcluster.h"
+
+#include "lib/assert.h"
+#include "lib/loopbacktransport.h"
+#include "store/meerkatstore/meerkatir/server.h"
+#include "store/meerkatstore/leadermeerkatir/server.h"
+
+#include <thread>
+
+template <class S, class R>
+static void replica_thread_func(S *server,
+                                transport::Configuration config,
+                                int replicaIdx,
+                                int nthreads,
+                                uint8_t thread_id) {
+    LoopbackTransport *transport = new LoopbackTransport(config,
+                                                         nthreads,
+                                                         thread_id);
+    // the replica registers itself with the transport
+    new R(config, replicaIdx, transport, server);
+    transport->Run();
+}
+
+template <class S, class R>
+static void start_replicas(const transport::Configuration &config,
+                           int nthreads,
+                           const std::vector<std::string> &keys,
+                           uint32_t shardIndex,
+                           uint32_t numShards,
+                           bool fingerprintReads,
+                           const std::string &kvs) {
+    for (int r = 0; r < config.n; r++) {
+        S *server = new S(fingerprintReads, kvs);
+        server->Reserve(keys.size() / numShards + keys.size() / numShards / 8);
+
+        for (const std::string &key : keys) {
+            // same key to shard mapping as the server_main's
+            uint64_t hash = 5381;
+            const char* str = key.c_str();
+            for (unsigned int j = 0; j < key.length(); j++) {
+                hash = ((hash << 5) + hash) + (uint64_t)str[j];
+            }
+
+            if (hash % numShards == shardIndex) {
+                server->Load(key, "null", Timestamp());
+            }
+        }
+
+        for (int i = 0; i < nthreads; i++) {
+            std::thread t(replica_thread_func<S, R>, server, config, r,
+                          nthreads, (uint8_t)i);
+            t.detach();
+        }
+    }
+}
+
+void StartLocalCluster(const transport::Configuration &config,
+                       const std::string &mode,
+                       int nthreads,
+                       const std::vector<std::string> &keys,
+                       uint32_t shardIndex,
+                       uint32_t numShards,
+                       bool fingerprintReads,
+                       const std::string &kvs) {
+    if (mode == "meerkatstore") {
+        start_replicas<meerkatstore::meerkatir::Server,
+                       replication::meerkatir::Replica>(
+            config, nthreads, keys, shardIndex, numShards, fingerprintReads,
+            kvs);
+    } else if (mode == "meerkatstore-leader") {
+        start_replicas<meerkatstore::leadermeerkatir::Server,
+                       replication::leadermeerkatir::Replica>(
+            config, nthreads, keys, shardIndex, numShards, fingerprintReads,
+            kvs);
+    } else {
+        Panic("Unknown mode for the local cluster: %s", mode.c_str());
+    }
+}
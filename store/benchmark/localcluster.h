@@ -0,0 +1,33 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/localcluster.h:
+ *   Runs the replicas of a shard inside the benchmark process,
+ *   on top of the loopback transport.
+ *
+ **********************************************************************/
+
+#ifndef _BENCHMARK_LOCALCLUSTER_H_
+#define _BENCHMARK_LOCALCLUSTER_H_
+
+#include "lib/configuration.h"
+
+#include <string>
+#include <vector>
+
+// Starts all the config.n replicas of shard shardIndex, each with
+// nthreads server threads listening on a LoopbackTransport. The keys
+// that belong to the shard are loaded before the threads are started.
+// The server threads are detached and run until the process exits.
+// fingerprintReads and kvs are passed on to the servers (see
+// --fingerprintReads and --kvs).
+void StartLocalCluster(const transport::Configuration &config,
+                       const std::string &mode,
+                       int nthreads,
+                       const std::vector<std::string> &keys,
+                       uint32_t shardIndex,
+                       uint32_t numShards,
+                       bool fingerprintReads = false,
+                       const std::string &kvs = "pthread");
+
+#endif /* _BENCHMARK_LOCALCLUSTER_H_ */
@@ -0,0 +1,57 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/makeSnapshot.cc:
+ *   Builds the binary snapshot that servers load with --snapshotFile
+ *   out of a keys file.
+ *
+ *   The first --numKeys lines of --keysFile are split into --numShards
+ *   shards the way the servers split them, each with the value "null"
+ *   at timestamp 0 like the servers load keys files, and written to
+ *   --snapshotFile.
+ *
+ **********************************************************************/
+
+#include "store/common/flags.h"
+#include "store/common/snapshot.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_keysFile == "" || FLAGS_snapshotFile == "") {
+        fprintf(stderr, "options --keysFile and --snapshotFile are required\n");
+        return EXIT_FAILURE;
+    }
+    if (FLAGS_numShards == 0) {
+        fprintf(stderr, "option --numShards must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(FLAGS_keysFile);
+    if (!in) {
+        fprintf(stderr, "Could not read keys from: %s\n", FLAGS_keysFile.c_str());
+        return EXIT_FAILURE;
+    }
+
+    SnapshotWriter writer(FLAGS_snapshotFile, FLAGS_numShards);
+    std::string key;
+    uint64_t n = 0;
+    for (; n < FLAGS_numKeys && std::getline(in, key); n++) {
+        // same key to shard mapping as the server_main's
+        uint64_t hash = 5381;
+        const char* str = key.c_str();
+        for (unsigned int j = 0; j < key.length(); j++) {
+            hash = ((hash << 5) + hash) + (uint64_t)str[j];
+        }
+        writer.Add(hash % FLAGS_numShards, key, "null", Timestamp());
+    }
+    writer.Finish();
+
+    printf("Wrote %lu keys in %u shards to %s\n", n, FLAGS_numShards,
+           FLAGS_snapshotFile.c_str());
+    return EXIT_SUCCESS;
+}
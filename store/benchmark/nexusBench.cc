@@ -0,0 +1,178 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/nexusBench.cc:
+ *   Measures how eRPC setup costs grow with the number of transport
+ *   threads in a process, with one Nexus per thread or per NUMA node.
+ *
+ *   For 1, 2, 4, ... up to --numClientThreads threads, a fresh child
+ *   process creates one FastTransport per thread and connects it to
+ *   every server thread of every replica in --configFile. It then
+ *   reports the time spent creating the transports and connecting the
+ *   sessions, and the resident memory, hugepages and OS threads that
+ *   were added. The replicas must be running, with the same
+ *   --shareNexus setting.
+ *
+ **********************************************************************/
+
+#include "lib/fasttransport.h"
+#include "store/common/flags.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct bench_thread_result_t {
+    double setup_us;
+    double connect_us;
+};
+
+static std::atomic<int> threads_done;
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns the value of the first line starting with field in file,
+// e.g. "VmRSS:" in /proc/self/status
+static long read_proc_field(const char *file, const std::string &field) {
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, field.size(), field) == 0) {
+            return std::stol(line.substr(field.size()));
+        }
+    }
+    return 0;
+}
+
+static void bench_thread_func(uint8_t id, transport::Configuration config,
+                              int nthreads, bench_thread_result_t *result) {
+    auto start = std::chrono::steady_clock::now();
+    FastTransport *transport = new FastTransport(config,
+                                                 FLAGS_ip,
+                                                 FLAGS_numServerThreads,
+                                                 0,
+                                                 FLAGS_physPort,
+                                                 0,
+                                                 id);
+    result->setup_us = elapsed_us(start);
+
+    // the handshakes overlap, like on a client transport
+    start = std::chrono::steady_clock::now();
+    transport->ConnectAll();
+    for (int i = 0; i < config.n; i++) {
+        for (int j = 0; j < FLAGS_numServerThreads; j++) {
+            transport->GetSession(nullptr, i, j);
+        }
+    }
+    result->connect_us = elapsed_us(start);
+
+    // keep the sessions open until everybody is connected, so that
+    // the memory we measure covers all of them
+    threads_done++;
+    while (threads_done < nthreads) {
+        transport->RunOnce();
+    }
+}
+
+static void run_bench(const transport::Configuration &config, int nthreads) {
+    long rss_kb = read_proc_field("/proc/self/status", "VmRSS:");
+    long os_threads = read_proc_field("/proc/self/status", "Threads:");
+    long hugepages = read_proc_field("/proc/meminfo", "HugePages_Free:");
+    long hugepage_kb = read_proc_field("/proc/meminfo", "Hugepagesize:");
+
+    FastTransport::ShareNexusPerNumaNode(FLAGS_shareNexus);
+
+    std::vector<bench_thread_result_t> results(nthreads);
+    std::vector<std::thread> thread_arr(nthreads);
+    for (int i = 0; i < nthreads; i++) {
+        thread_arr[i] = std::thread(bench_thread_func, i, config, nthreads,
+                                    &results[i]);
+    }
+    while (threads_done < nthreads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    long rss_delta_kb = read_proc_field("/proc/self/status", "VmRSS:") - rss_kb;
+    // the benchmark threads themselves are not overhead
+    long os_threads_delta = read_proc_field("/proc/self/status", "Threads:") -
+                            os_threads - nthreads;
+    long hugepages_delta = hugepages -
+                           read_proc_field("/proc/meminfo", "HugePages_Free:");
+
+    double setup_sum = 0, setup_max = 0, connect_sum = 0, connect_max = 0;
+    for (const auto &r : results) {
+        setup_sum += r.setup_us;
+        setup_max = std::max(setup_max, r.setup_us);
+        connect_sum += r.connect_us;
+        connect_max = std::max(connect_max, r.connect_us);
+    }
+
+    for (auto &thread : thread_arr) thread.join();
+
+    printf("%7d %6d %9.2f %9.2f %11.2f %11.2f %8d %8.1f %8.1f %7ld\n",
+           nthreads, FLAGS_shareNexus ? 1 : nthreads,
+           setup_sum / nthreads / 1000, setup_max / 1000,
+           connect_sum / nthreads / 1000, connect_max / 1000,
+           nthreads * config.n * FLAGS_numServerThreads,
+           rss_delta_kb / 1024.0,
+           hugepages_delta * hugepage_kb / 1024.0,
+           os_threads_delta);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::ifstream configStream(FLAGS_configFile);
+    if (configStream.fail()) {
+        fprintf(stderr, "unable to read configuration file: %s\n",
+                FLAGS_configFile.c_str());
+        return EXIT_FAILURE;
+    }
+    transport::Configuration config(configStream);
+
+    if (FLAGS_numClientThreads > 64) {
+        fprintf(stderr, "at most 64 threads are supported\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("# nexus mode: %s\n", FLAGS_shareNexus ? "per NUMA node" : "per thread");
+    printf("# threads  nexus  setup_ms  setup_max  connect_ms  connect_max "
+           "sessions   rss_mb  huge_mb  os_thr\n");
+    fflush(stdout);
+
+    // Every run gets its own process: transports are never torn down,
+    // and the nexus ports must be free for the next run
+    std::vector<int> counts;
+    for (uint32_t n = 1; n < FLAGS_numClientThreads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(FLAGS_numClientThreads);
+
+    for (int n : counts) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            PPanic("fork failed");
+        } else if (pid == 0) {
+            run_bench(config, n);
+            // skip the destructors, eRPC objects are still alive
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "run with %d threads failed\n", n);
+        }
+    }
+    return 0;
+}
@@ -8,9 +8,13 @@
 
 #include "store/common/truetime.h"
 #include "store/common/frontend/client.h"
+#include "store/common/backend/thread_safe_kvs.h"
 #include "store/meerkatstore/meerkatir/client.h"
 #include "store/meerkatstore/leadermeerkatir/client.h"
 #include "store/common/flags.h"
+#include "store/benchmark/localcluster.h"
+#include "lib/loopbacktransport.h"
+#include "lib/udptransport.h"
 
 #include <boost/fiber/all.hpp>
 
@@ -36,7 +40,7 @@ bool replicated = true;
 
 void client_fiber_func(int thread_id,
                 transport::Configuration config,
-                FastTransport *transport) {
+                Transport *transport) {
     Client* client;
     vector<string> results;
 
@@ -128,10 +132,14 @@ void client_fiber_func(int thread_id,
         status = true;
 
         gettimeofday(&t1, NULL);
-        client->Begin();
 
         // Decide which type of retwis transaction it is going to be.
         ttype = rand() % 100;
+        if (ttype >= 50 && FLAGS_snapshotReads) {
+            client->BeginReadOnly();
+        } else {
+            client->Begin();
+        }
 
         if (ttype < 5) {
             // 5% - Add user transaction. 1,3
@@ -191,8 +199,15 @@ void client_fiber_func(int thread_id,
             }
 
             sort(keyIdx.begin(), keyIdx.end());
+            // the reads are independent, issue them all at once
+            std::vector<string> getKeys, values;
+            std::vector<int> statuses;
+            for (int i = 0; i < nGets; i++) {
+                getKeys.push_back(keys[keyIdx[i]]);
+            }
+            client->MultiGet(getKeys, values, statuses);
             for (int i = 0; i < nGets && status; i++) {
-                if ((ret = client->Get(keys[keyIdx[i]], value))) {
+                if ((ret = statuses[i])) {
                     Warning("Aborting due to %s %d", keys[keyIdx[i]].c_str(), ret);
                     status = false;
                 }
@@ -241,13 +256,27 @@ void client_fiber_func(int thread_id,
 
 void* client_thread_func(int thread_id, transport::Configuration config) {
     // create the transport
-    FastTransport *transport = new FastTransport(config,
-                                                FLAGS_ip,
-                                                FLAGS_numServerThreads,
-                                                0,
-                                                FLAGS_physPort,
-                                                0,
-                                                thread_id);
+    Transport *transport;
+    FastTransport *fast_transport = nullptr;
+    if (FLAGS_transport == "loopback") {
+        transport = new LoopbackTransport(config,
+                                          FLAGS_numServerThreads,
+                                          thread_id);
+    } else if (FLAGS_transport == "udp") {
+        transport = new UDPTransport(config,
+                                     FLAGS_ip,
+                                     FLAGS_numServerThreads,
+                                     thread_id);
+    } else {
+        fast_transport = new FastTransport(config,
+                                           FLAGS_ip,
+                                           FLAGS_numServerThreads,
+                                           0,
+                                           FLAGS_physPort,
+                                           0,
+                                           thread_id);
+        transport = fast_transport;
+    }
 
     // create the client fibers
     boost::fibers::fiber client_fibers[FLAGS_numClientFibers];
@@ -260,6 +289,10 @@ void* client_thread_func(int thread_id, transport::Configuration config) {
     for (int i = 0; i < FLAGS_numClientFibers; i++) {
         client_fibers[i].join();
     }
+
+    if (fast_transport != nullptr) {
+        fast_transport->PrintMsgBufferStats();
+    }
     return NULL;
 };
 
@@ -309,6 +342,22 @@ int main(int argc, char **argv) {
     }
     transport::Configuration config(configStream);
 
+    FastTransport::ShareNexusPerNumaNode(FLAGS_shareNexus);
+    FastTransport::SetPollBackoff(FLAGS_pollBackoffUs);
+
+    // Bring up the replicas in this process when there is no network
+    if (FLAGS_transport == "loopback") {
+        if (FLAGS_snapshotReads && FLAGS_mode == "meerkatstore" &&
+            !KvsSupportsSnapshots(FLAGS_kvs)) {
+            fprintf(stderr, "option --snapshotReads is not supported "
+                    "with --kvs=%s\n", FLAGS_kvs.c_str());
+            exit(EXIT_FAILURE);
+        }
+        StartLocalCluster(config, FLAGS_mode, FLAGS_numServerThreads,
+                          keys, FLAGS_shardIndex, FLAGS_numShards,
+                          FLAGS_fingerprintReads, FLAGS_kvs);
+    }
+
     // Create the transport threads; each transport thread will run
     // FLAGS_numClientThreads client fibers
     std::vector<std::thread> client_thread_arr(FLAGS_numClientThreads);
@@ -318,6 +367,8 @@ int main(int argc, char **argv) {
         erpc::bind_to_core(client_thread_arr[i], 0, i);
     }
     for (auto &thread : client_thread_arr) thread.join();
+    FastTransport::PrintLatencyStats();
+    FastTransport::PrintPollStats();
 
     return 0;
 }
@@ -49,6 +49,7 @@ main(int argc, char **argv)
     transport::Configuration config(configStream);
 
     // Create the transport
+    FastTransport::ShareNexusPerNumaNode(FLAGS_shareNexus);
     FastTransport *transport = new FastTransport(config,
                                                 FLAGS_ip,
                                                 FLAGS_numServerThreads,
@@ -0,0 +1,136 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/benchmark/walBench.cc:
+ *   Measures the cost of durable commits with the commit log.
+ *
+ *   --numServerThreads threads commit transactions of
+ *   up to --tLen * --wPer / 100 writes of WALBENCH_VALUE_SIZE bytes to keys
+ *   drawn uniformly out of --numKeys, for --duration seconds at every
+ *   durability level in turn: none, which only applies the writes to a
+ *   PthreadKvs, async and sync, which log them to --walDir first, like
+ *   the servers do. The log files of a level are removed before it
+ *   runs. Reports commits per second and the latency of a commit.
+ *
+ **********************************************************************/
+
+#include "lib/histogram.h"
+#include "store/common/commitlog.h"
+#include "store/common/flags.h"
+#include "store/common/transaction.h"
+#include "store/common/transactionview.h"
+#include "store/common/backend/pthread_kvs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#define WALBENCH_VALUE_SIZE 64
+
+static std::string bench_key(uint64_t i) {
+    return "key" + std::to_string(i);
+}
+
+static void remove_logs() {
+    for (uint32_t i = 0; i < FLAGS_numServerThreads; i++) {
+        unlink((FLAGS_walDir + "/wal." + std::to_string(i)).c_str());
+    }
+}
+
+static void bench(const char *durability, PthreadKvs *kvs, int nwrites) {
+    std::unique_ptr<CommitLog> log;
+    if (std::string(durability) != "none") {
+        remove_logs();
+        log.reset(new CommitLog(FLAGS_walDir, FLAGS_numServerThreads,
+                                std::string(durability) == "sync",
+                                std::chrono::microseconds(FLAGS_groupCommitUs)));
+    }
+
+    std::atomic<bool> done(false);
+    std::vector<LatencyHistogram> histograms(FLAGS_numServerThreads);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < FLAGS_numServerThreads; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 gen(t);
+            std::uniform_int_distribution<uint64_t> dis(0, FLAGS_numKeys - 1);
+            const std::string value(WALBENCH_VALUE_SIZE, 'v');
+            std::vector<char> buf;
+            uint64_t seq = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                Transaction txn;
+                for (int i = 0; i < nwrites; i++) {
+                    txn.addWriteSet(bench_key(dis(gen)), value);
+                }
+                buf.resize(txn.serializedSize());
+                txn.serialize(buf.data());
+                TransactionView view(0, txn.writeSetSize(), buf.data());
+                Timestamp timestamp(++seq, t);
+
+                auto start = std::chrono::steady_clock::now();
+                if (log) {
+                    log->Append(timestamp, view);
+                }
+                for (const auto &write : view.getWrites()) {
+                    kvs->Put(std::string(write.key), std::string(write.value),
+                             timestamp);
+                }
+                histograms[t].Record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_duration));
+    done = true;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    log.reset();
+
+    LatencyHistogram all;
+    for (const LatencyHistogram &histogram : histograms) {
+        all.Merge(histogram);
+    }
+    printf("%-6s %10.0f  %s\n", durability,
+           (double)all.Count() / FLAGS_duration, all.Summary().c_str());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_walDir == "") {
+        fprintf(stderr, "option --walDir is required\n");
+        return EXIT_FAILURE;
+    }
+    if (FLAGS_numServerThreads == 0 || FLAGS_numKeys == 0) {
+        fprintf(stderr, "--numServerThreads and --numKeys must be above 0\n");
+        return EXIT_FAILURE;
+    }
+    const int nwrites = std::max(1u, FLAGS_tLen * FLAGS_wPer / 100);
+
+    PthreadKvs kvs;
+    for (uint64_t i = 0; i < FLAGS_numKeys; i++) {
+        kvs.Put(bench_key(i), std::string(WALBENCH_VALUE_SIZE, 'v'),
+                Timestamp());
+    }
+
+    printf("# %u threads, %d writes per commit, group commit every %u us\n",
+           FLAGS_numServerThreads, nwrites, FLAGS_groupCommitUs);
+    printf("# level  commits/s  latency\n");
+    fflush(stdout);
+    for (const char *durability : {"none", "async", "sync"}) {
+        bench(durability, &kvs, nwrites);
+    }
+    remove_logs();
+    return 0;
+}
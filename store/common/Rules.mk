@@ -1,10 +1,10 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
-SRCS += $(addprefix $(d), promise.cc timestamp.cc tracer.cc \
+SRCS += $(addprefix $(d), commitlog.cc promise.cc snapshot.cc timestamp.cc tracer.cc \
 				transaction.cc truetime.cc)
 
 
-LIB-store-common := $(o)promise.o $(o)timestamp.o \
+LIB-store-common := $(o)commitlog.o $(o)promise.o $(o)snapshot.o $(o)timestamp.o \
 							$(o)tracer.o $(o)transaction.o $(o)truetime.o
 
-include $(d)backend/Rules.mk $(d)frontend/Rules.mk
+include $(d)backend/Rules.mk $(d)frontend/Rules.mk $(d)tests/Rules.mk
@@ -1,10 +1,11 @@
 d := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRCS += $(addprefix $(d), \
-				kvstore.cc lockserver.cc txnstore.cc versionstore.cc \
-				pthread_kvs.cc atomic_kvs.cc)
+				kvstore.cc lockserver.cc txnstore.cc mvcc_kvs.cc \
+				pthread_kvs.cc atomic_kvs.cc epoch.cc thread_safe_kvs.cc)
 
 LIB-store-backend := $(o)kvstore.o $(o)lockserver.o $(o)txnstore.o \
-					 $(o)versionstore.o $(o)pthread_kvs.o $(o)atomic_kvs.o
+					 $(o)mvcc_kvs.o $(o)pthread_kvs.o $(o)atomic_kvs.o $(o)epoch.o \
+					 $(o)thread_safe_kvs.o
 
 include $(d)tests/Rules.mk
@@ -30,6 +30,8 @@
 
 #include "store/common/backend/atomic_kvs.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
 namespace {
@@ -63,62 +65,176 @@ uint64_t AtomicKvs::TimestampWord::ToWord() const {
     return locked_part | timestamp_part | id_part;
 }
 
+AtomicKvs::AtomicKvs(size_t capacity) : keys_(epochs_, capacity) {}
+
+AtomicKvs::~AtomicKvs() {
+    keys_.ForEach([](Entry& entry) { free(entry.blob.load()); });
+}
+
+void AtomicKvs::Reserve(size_t n) {
+    keys_.Reserve(n);
+}
+
+void AtomicKvs::StartLoad(int nthreads) {
+    load_batches_.resize(nthreads);
+}
+
+void AtomicKvs::LoadPut(int thread, const std::string& key,
+                        const std::string& value, const Timestamp& timestamp) {
+    // No one sees the entry before FinishLoad, so it needs no lock.
+    Entry& entry = load_batches_[thread].Add(key);
+    StoreValue(entry, value);
+    entry.word.store(TimestampWord(false, timestamp).ToWord());
+}
+
+void AtomicKvs::FinishLoad() {
+    keys_.Load(load_batches_);
+    load_batches_.clear();
+}
+
+bool AtomicKvs::LoadValue(Entry& entry, std::string* value) {
+    Blob* blob = entry.blob.load();
+    if (blob != nullptr) {
+        value->assign(blob->data(), blob->size);
+        return true;
+    }
+
+    const uint32_t size = entry.size.load();
+    if (size == Entry::deleted_size) {
+        value->clear();
+        return false;
+    }
+    // A concurrent write may have just moved the value out of the blob,
+    // so the size may still be that of an older value.
+    value->assign(entry.inline_value,
+                  std::min<uint32_t>(size, Entry::max_inline_size));
+    return true;
+}
+
+void AtomicKvs::StoreValue(Entry& entry, const std::string& value) {
+    ASSERT(value.size() <= max_value_size);
+
+    if (value.size() <= Entry::max_inline_size) {
+        std::memcpy(entry.inline_value, value.data(), value.size());
+        entry.size.store(value.size());
+        epochs_.Retire(entry.blob.exchange(nullptr));
+        return;
+    }
+
+    const size_t capacity =
+        (sizeof(Blob) + value.size() + CACHE_LINE_SIZE - 1) &
+        ~(CACHE_LINE_SIZE - 1);
+    Blob* blob = static_cast<Blob*>(malloc(capacity));
+    if (blob == nullptr) {
+        Panic("Failed to allocate a %lu byte value", value.size());
+    }
+    blob->size = value.size();
+    std::memcpy(blob->data(), value.data(), value.size());
+    epochs_.Retire(entry.blob.exchange(blob));
+}
+
+void AtomicKvs::ClearValue(Entry& entry) {
+    entry.size.store(Entry::deleted_size);
+    epochs_.Retire(entry.blob.exchange(nullptr));
+}
+
 bool AtomicKvs::Get(const std::string& key,
                     std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
 
-    const auto iter = kvs_.find(key);
-    if (iter == kvs_.end()) {
+    // One guard for the lookup and the read
+    EpochDomain::Guard guard(epochs_);
+    Entry* entry = keys_.Find(key);
+    if (entry == nullptr) {
         return false;
     }
 
-    Entry& entry = iter->second;
-    bool done = false;
-    while (!done) {
+    return ReadEntry(*entry, timestamped_value);
+}
+
+bool AtomicKvs::ReadEntry(
+    Entry& entry, std::pair<Timestamp, std::string>* timestamped_value) {
+    EpochDomain::Guard guard(epochs_);
+    while (true) {
         TimestampWord timestamp_word_before(entry.word.load());
         timestamped_value->first = timestamp_word_before.timestamp();
-        timestamped_value->second = entry.value;
+        const bool present = LoadValue(entry, &timestamped_value->second);
         //TODO: put compiler barrier here (check if still necessary if we have an std::atomic access)
         TimestampWord timestamp_word_after(entry.word.load());
-        done = !timestamp_word_before.locked() &&
-               timestamp_word_before.ToWord() == timestamp_word_after.ToWord();
+        if (!timestamp_word_before.locked() &&
+            timestamp_word_before.ToWord() == timestamp_word_after.ToWord()) {
+            return present;
+        }
+    }
+}
+
+void AtomicKvs::MultiGet(
+    const std::vector<std::string>& keys,
+    std::vector<std::pair<Timestamp, std::string>>* timestamped_values,
+    std::vector<bool>* found) {
+    ASSERT(timestamped_values != nullptr && found != nullptr);
+    timestamped_values->resize(keys.size());
+    found->resize(keys.size());
+
+    // Prefetch the index buckets of all the keys, then look all the keys
+    // up and prefetch their entries, so that the cache misses of the
+    // different keys overlap instead of being taken one after the other.
+    std::vector<uint64_t> hashes(keys.size());
+    std::vector<Entry*> entries(keys.size(), nullptr);
+    {
+        EpochDomain::Guard guard(epochs_);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            hashes[i] = KeyIndex<Entry>::Hash(keys[i]);
+            keys_.Prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            entries[i] = keys_.Find(keys[i], hashes[i]);
+            if (entries[i] != nullptr) {
+                __builtin_prefetch(entries[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        (*found)[i] = entries[i] != nullptr &&
+                      ReadEntry(*entries[i], &(*timestamped_values)[i]);
     }
-    return true;
 }
 
-void AtomicKvs::GetWithLock(
+bool AtomicKvs::GetWithLock(
     const std::string& key,
     std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
-    const auto iter = kvs_.find(key);
-    ASSERT(iter != kvs_.end());
+    Entry* found = keys_.Find(key);
+    ASSERT(found != nullptr);
 
-    Entry& entry = iter->second;
+    Entry& entry = *found;
     timestamped_value->first = TimestampWord(entry.word.load()).timestamp();
-    timestamped_value->second = entry.value;
+    return LoadValue(entry, &timestamped_value->second);
 }
 
 bool AtomicKvs::TryGet(const std::string& key,
                        std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
 
-    const auto iter = kvs_.find(key);
-    if (iter == kvs_.end()) {
+    EpochDomain::Guard guard(epochs_);
+    Entry* found = keys_.Find(key);
+    if (found == nullptr) {
         return false;
     }
 
-    Entry& entry = iter->second;
+    Entry& entry = *found;
     TimestampWord timestamp_word_before(entry.word.load());
     timestamped_value->first = timestamp_word_before.timestamp();
-    timestamped_value->second = entry.value;
+    const bool present = LoadValue(entry, &timestamped_value->second);
     //TODO: put compiler barrier here (check if still necessary if we have an std::atomic access)
     TimestampWord timestamp_word_after(entry.word.load());
-    return !timestamp_word_before.locked() &&
+    return present && !timestamp_word_before.locked() &&
            timestamp_word_before.ToWord() == timestamp_word_after.ToWord();
 }
 
 void AtomicKvs::WriteLock(const std::string& key, Timestamp* timestamp) {
-    Entry& entry = kvs_[key];
+    Entry& entry = keys_.FindOrInsert(key);
     while (true) {
         uint64_t word_before = entry.word.load();
         const TimestampWord timestamp_word_before(word_before);
@@ -138,7 +254,7 @@ void AtomicKvs::WriteLock(const std::string& key, Timestamp* timestamp) {
 }
 
 bool AtomicKvs::TryWriteLock(const std::string& key, Timestamp* timestamp) {
-    Entry& entry = kvs_[key];
+    Entry& entry = keys_.FindOrInsert(key);
     uint64_t word_before = entry.word.load();
     const TimestampWord timestamp_word_before(word_before);
     if (timestamp_word_before.locked()) {
@@ -158,47 +274,51 @@ bool AtomicKvs::TryWriteLock(const std::string& key, Timestamp* timestamp) {
 
 void AtomicKvs::PutWithLock(const std::string& key, const std::string& value,
                             const Timestamp& timestamp) {
-    // value.size() has to be less than the max_value_size, as opposed to less
-    // than or equal to the max_value_size, because we need one character in
-    // value for the null terminator.
-    ASSERT(value.size() < AtomicKvs::Entry::max_value_size);
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    const Timestamp replaced = TimestampWord(entry->word.load()).timestamp();
+    if (timestamp >= replaced) {
+        SaveForCheckpoint(*entry, replaced, timestamp);
+        StoreValue(*entry, value);
+        entry->word.store(TimestampWord(true, timestamp).ToWord());
+    }
+}
 
-    Entry& entry = kvs_[key];
-    if (timestamp >= TimestampWord(entry.word.load()).timestamp()) {
-        std::strcpy(entry.value, value.c_str());
-        entry.word.store(TimestampWord(true, timestamp).ToWord());
+void AtomicKvs::DeleteWithLock(const std::string& key,
+                               const Timestamp& timestamp) {
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    const Timestamp replaced = TimestampWord(entry->word.load()).timestamp();
+    if (timestamp >= replaced) {
+        SaveForCheckpoint(*entry, replaced, timestamp);
+        ClearValue(*entry);
+        entry->word.store(TimestampWord(true, timestamp).ToWord());
     }
 }
 
 void AtomicKvs::WriteUnlock(const std::string& key) {
-    Entry& entry = kvs_[key];
-    const TimestampWord word(entry.word.load());
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    const TimestampWord word(entry->word.load());
     ASSERT(word.locked() == true);
-    entry.word.store(TimestampWord(false, word.timestamp()).ToWord());
+    entry->word.store(TimestampWord(false, word.timestamp()).ToWord());
 }
 
-void AtomicKvs::Put(const std::string& key, const std::string& value,
-                    const Timestamp& timestamp) {
-    // value.size() has to be less than the max_value_size, as opposed to less
-    // than or equal to the max_value_size, because we need one character in
-    // value for the null terminator.
-    ASSERT(value.size() < AtomicKvs::Entry::max_value_size);
-
-    Entry& entry = kvs_[key];
-
+bool AtomicKvs::LockIfNewer(Entry& entry, const Timestamp& timestamp,
+                            Timestamp* replaced) {
     bool lock_acquired = false;
     while (!lock_acquired) {
         uint64_t word_before = entry.word.load();
         TimestampWord timestamp_word_before(word_before);
 
-        // We only write `value` if `timestamp` is larger than or equal to the
+        // We only write if `timestamp` is larger than or equal to the
         // current timestamp. Because of this, timestamps increase
         // monotonically. Thus, if we have a timestamp smaller than the current
         // timestamp, we'll never have a timestamp larger than the current
-        // timestamp, so we'll never end up writing our value. Thus, it's safe
-        // to return early and not write anything.
+        // timestamp, so we'll never end up writing. Thus, it's safe to
+        // return early and not write anything.
         if (timestamp < timestamp_word_before.timestamp()) {
-            return;
+            return false;
         }
 
         if (timestamp_word_before.locked()) {
@@ -208,14 +328,90 @@ void AtomicKvs::Put(const std::string& key, const std::string& value,
         TimestampWord timestamp_word(true, timestamp);
         lock_acquired = entry.word.compare_exchange_weak(
             word_before, timestamp_word.ToWord());
+        *replaced = timestamp_word_before.timestamp();
     }
+    return true;
+}
 
-    std::strcpy(entry.value, value.c_str());
-    entry.word.store(TimestampWord(false, timestamp).ToWord());
+void AtomicKvs::Put(const std::string& key, const std::string& value,
+                    const Timestamp& timestamp) {
+    Entry& entry = keys_.FindOrInsert(key);
+    Timestamp replaced;
+    if (LockIfNewer(entry, timestamp, &replaced)) {
+        SaveForCheckpoint(entry, replaced, timestamp);
+        StoreValue(entry, value);
+        entry.word.store(TimestampWord(false, timestamp).ToWord());
+    }
+}
+
+void AtomicKvs::Delete(const std::string& key, const Timestamp& timestamp) {
+    // A key that is not there yet still gets a tombstone, so that an
+    // older Put that arrives later does not add it.
+    Entry& entry = keys_.FindOrInsert(key);
+    Timestamp replaced;
+    if (LockIfNewer(entry, timestamp, &replaced)) {
+        SaveForCheckpoint(entry, replaced, timestamp);
+        ClearValue(entry);
+        entry.word.store(TimestampWord(false, timestamp).ToWord());
+    }
 }
 
 bool AtomicKvs::IsWriteLocked(const std::string& key) {
-    Entry& entry = kvs_[key];
-    const TimestampWord word(entry.word.load());
-    return word.locked();
+    Entry* entry = keys_.Find(key);
+    return entry != nullptr && TimestampWord(entry->word.load()).locked();
+}
+
+void AtomicKvs::SaveForCheckpoint(Entry& entry, const Timestamp& replaced,
+                                  const Timestamp& timestamp) {
+    Checkpoint* checkpoint = active_checkpoint_.load(std::memory_order_acquire);
+    if (checkpoint == nullptr || replaced > checkpoint->cut ||
+        timestamp <= checkpoint->cut) {
+        return;
+    }
+
+    // Only the first write above the cut gets here, since the ones after
+    // it replace versions above the cut.
+    Replaced version;
+    version.timestamp = replaced;
+    version.present = LoadValue(entry, &version.value);
+    std::lock_guard<std::mutex> lock(checkpoint->mutex);
+    checkpoint->replaced.emplace(&entry, std::move(version));
+}
+
+bool AtomicKvs::StartCheckpoint(const Timestamp& cut) {
+    ASSERT(active_checkpoint_.load() == nullptr);
+    checkpoint_.reset(new Checkpoint(cut));
+    active_checkpoint_.store(checkpoint_.get());
+    return true;
+}
+
+void AtomicKvs::FinishCheckpoint(const CheckpointFunc& f) {
+    Checkpoint* checkpoint = active_checkpoint_.load();
+    ASSERT(checkpoint != nullptr);
+
+    keys_.ForEachAdded([this, checkpoint, &f](std::string_view key,
+                                              Entry& entry) {
+        std::pair<Timestamp, std::string> version;
+        bool present = ReadEntry(entry, &version);
+        if (version.first > checkpoint->cut) {
+            // The write that took the entry above the cut saved the
+            // version before it stored its own.
+            std::lock_guard<std::mutex> lock(checkpoint->mutex);
+            auto it = checkpoint->replaced.find(&entry);
+            if (it == checkpoint->replaced.end()) {
+                Panic("Key %.*s was written above the cut before the "
+                      "checkpoint started", (int)key.size(), key.data());
+            }
+            version.first = it->second.timestamp;
+            version.second = it->second.value;
+            present = it->second.present;
+        }
+        if (present) {
+            f(key, version.second, version.first);
+        }
+    });
+
+    active_checkpoint_.store(nullptr);
+    std::lock_guard<std::mutex> lock(checkpoint->mutex);
+    checkpoint->replaced.clear();
 }
@@ -32,12 +32,15 @@
 #define _ATOMIC_KVS_H_
 
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "store/common/backend/epoch.h"
+#include "store/common/backend/keyindex.h"
 #include "store/common/backend/thread_safe_kvs.h"
-#include <boost/unordered_map.hpp>
-
-#define CACHE_LINE_SIZE 64
 
 // AtomicKvs implements the ThreadSafeKvs using atomic reads and writes. Most
 // notably, AtomicKvs implements invisible reads like Silo [1] and Tictoc [2].
@@ -84,13 +87,58 @@
 // equal and the locked bit is not set, then the read was successful.
 // Otherwise, the thread keeps trying.
 //
+// # Values
+// Values are binary strings of up to max_value_size bytes. Values of up
+// to Entry::max_inline_size bytes live in the entry itself, where readers
+// may copy half-written bytes and then retry because the word changed.
+// Longer ones live in an immutable Blob that holds its own size: a writer
+// builds a new blob and swaps the pointer of the entry while it holds the
+// lock bit of the word, so a reader always copies a whole value, if maybe
+// not the latest one.
+//
+// # Deletes
+// A deleted key keeps its entry as a tombstone: Delete takes the lock bit
+// like a write, drops the value and leaves the word with the timestamp of
+// the delete, so that writes with smaller timestamps still lose to it and
+// a Put with a larger one brings the key back in place. Readers tell a
+// tombstone by its size, which they read between the two loads of the
+// word like any value. Entries are never freed, so reads never have to
+// worry about their entry going away.
+//
+// # Reclamation
+// A replaced blob may still be read by threads that loaded its pointer
+// before the swap, so it is retired to an EpochDomain rather than freed.
+// Readers hold a Guard of the domain while they read, which keeps reads
+// invisible: the guard only writes a slot of the reading thread.
+//
+// # Index
+// Entries live in a KeyIndex, which finds them without locks and never
+// moves them; it shares the EpochDomain of the values.
+//
+// # Checkpoints
+// A checkpoint at cut copies out the version at or before cut of every
+// key, while writes go on. The first write to move an entry from at or
+// before cut to above it saves the version it replaces, under the lock
+// bit, before it stores its own. The checkpoint reads every entry like
+// Get does, and takes the saved version instead of any it finds above
+// the cut. Writers only pay for a load of the checkpoint pointer unless
+// they cross the cut.
+//
 // [1]: https://scholar.google.com/scholar?cluster=1808818331949135820
 // [2]: https://scholar.google.com/scholar?cluster=7246772973103959497
 class AtomicKvs : public ThreadSafeKvs {
 public:
+    // capacity is the number of keys to make room for up front
+    explicit AtomicKvs(size_t capacity = 0);
+    ~AtomicKvs() override;
+
     bool Get(const std::string& key,
              std::pair<Timestamp, std::string>* timestamped_value) override;
-    void GetWithLock(
+    void MultiGet(
+        const std::vector<std::string>& keys,
+        std::vector<std::pair<Timestamp, std::string>>* timestamped_values,
+        std::vector<bool>* found) override;
+    bool GetWithLock(
         const std::string& key,
         std::pair<Timestamp, std::string>* timestamped_value) override;
     bool TryGet(const std::string& key,
@@ -100,9 +148,20 @@ public:
     bool IsWriteLocked(const std::string& key) override;
     void PutWithLock(const std::string& key, const std::string& value,
                      const Timestamp& timestamp) override;
+    void DeleteWithLock(const std::string& key,
+                        const Timestamp& timestamp) override;
     void WriteUnlock(const std::string& key) override;
     void Put(const std::string& key, const std::string& value,
              const Timestamp& timestamp) override;
+    void Delete(const std::string& key, const Timestamp& timestamp) override;
+    void Reserve(size_t n) override;
+    void StartLoad(int nthreads) override;
+    void LoadPut(int thread, const std::string& key, const std::string& value,
+                 const Timestamp& timestamp) override;
+    void FinishLoad() override;
+    bool SupportsCheckpoints() const override { return true; }
+    bool StartCheckpoint(const Timestamp& cut) override;
+    void FinishCheckpoint(const CheckpointFunc& f) override;
 
 private:
     // See above for documentation. tl;dr:
@@ -132,40 +191,96 @@ private:
         Timestamp timestamp_;
     };
 
+public:
+    static constexpr size_t max_value_size = 64 << 10;
+
+private:
+    // Never modified once it is visible to readers.
+    struct Blob {
+        uint32_t size;
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
     struct Entry {
-        Entry() : word(0) {
-            for (int i = 0; i < max_value_size; ++i) {
-                value[i] = '\0';
-            }
-        }
+        // New entries are tombstones until something is put in them.
+        Entry() : word(0), blob(nullptr), size(deleted_size) {}
 
         // Note: std::atomic<uint64_t> ensures word is naturally-aligned
         // (on a 64-bit boundary), which makes loads atomic on 64-bit
         // architectures without any other synchronization instructions;
         // this enables invisible reads.
         //
-        // Used as a short lock to ensure the consistency of value
+        // Used as a short lock to ensure the consistency of the value
         std::atomic<uint64_t> word;
 
-        // TODO(mwhittaker): Previously, this was a string. This led to a
-        // concurrency bug. A Get reads the word, then reads the value, then
-        // reads the word. If the two words are the same, the read is
-        // successful. The problem is during the read, another thread can be
-        // writing the value. When two threads concurrently read and write the
-        // same string, things can crash.
-        //
-        // Instead of that, we use a char[]. Does that fix things? It seems to,
-        // but I'm not 100% sure that it's guaranteed to work. We use a size of
-        // enough bytes to pad to the cache line size. If the strings you write
-        // are bigger than this, things might crash.
-        //
-        // value should always end in a null terminator.
-        static constexpr int max_value_size =
-                    CACHE_LINE_SIZE - sizeof(word);
-        char value[max_value_size];
+        // The value is in blob if there is one, and else in the first
+        // size bytes of inline_value, unless size is deleted_size.
+        std::atomic<Blob*> blob;
+        std::atomic<uint32_t> size;
+        static constexpr uint32_t deleted_size = UINT32_MAX;
+
+        // We use enough bytes to pad to the cache line size.
+        static constexpr int max_inline_size =
+                    CACHE_LINE_SIZE - sizeof(word) - sizeof(blob) -
+                    sizeof(size);
+        char inline_value[max_inline_size];
     } __attribute__((__aligned__(CACHE_LINE_SIZE)));
 
-    boost::unordered_map<std::string, Entry> kvs_;
+    // Reads the timestamp and value of entry, retrying until they are
+    // consistent; returns false if the entry is a tombstone.
+    bool ReadEntry(Entry& entry,
+                   std::pair<Timestamp, std::string>* timestamped_value);
+
+    // Copies the value of entry into value and returns whether there is
+    // one; the caller must hold a Guard of epochs_ or the lock of the entry,
+    // and the result is only meaningful if the timestamp word did not
+    // change meanwhile.
+    static bool LoadValue(Entry& entry, std::string* value);
+
+    // Sets the value of entry, which the caller must have locked.
+    void StoreValue(Entry& entry, const std::string& value);
+
+    // Turns entry, which the caller must have locked, into a tombstone.
+    void ClearValue(Entry& entry);
+
+    // Locks entry for a write at timestamp, unless the entry already has
+    // a larger timestamp; returns whether it locked it, and the timestamp
+    // the write replaces in replaced.
+    static bool LockIfNewer(Entry& entry, const Timestamp& timestamp,
+                            Timestamp* replaced);
+
+    // A version that a write above the cut replaced during a checkpoint
+    struct Replaced {
+        Timestamp timestamp;
+        bool present;
+        std::string value;
+    };
+
+    struct Checkpoint {
+        explicit Checkpoint(const Timestamp& cut) : cut(cut) {}
+        const Timestamp cut;
+        std::mutex mutex;
+        std::unordered_map<const Entry*, Replaced> replaced;
+    };
+
+    // Saves the version of entry at replaced for the running checkpoint,
+    // if a write at timestamp takes it above the cut; the caller must
+    // have locked the entry.
+    void SaveForCheckpoint(Entry& entry, const Timestamp& replaced,
+                           const Timestamp& timestamp);
+
+    EpochDomain epochs_;
+    // Keys that were never written, or were deleted, have tombstones.
+    KeyIndex<Entry> keys_;
+    // Keys LoadPut adds, a batch per loading thread, until FinishLoad
+    std::vector<KeyIndex<Entry>::Batch> load_batches_;
+
+    // The last checkpoint, which writers see through active_checkpoint_
+    // while it runs. Writers may still hold the pointer after it ends,
+    // so it is only replaced by the next StartCheckpoint, which runs
+    // without writers.
+    std::unique_ptr<Checkpoint> checkpoint_;
+    std::atomic<Checkpoint*> active_checkpoint_{nullptr};
 };
 
 #endif  //  _ATOMIC_KVS_H_
@@ -0,0 +1,120 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/epoch.cc:
+ *   Epoch-based reclamation of memory shared with lock-free readers
+ *
+ **********************************************************************/
+
+#include "store/common/backend/epoch.h"
+
+#include "lib/message.h"
+
+#include <cstdlib>
+#include <mutex>
+
+namespace {
+
+std::mutex threadIdsMutex;
+std::vector<int> freeThreadIds;
+int nextThreadId = 0;
+
+struct ThreadId {
+    ThreadId() {
+        std::lock_guard<std::mutex> lock(threadIdsMutex);
+        if (freeThreadIds.empty()) {
+            id = nextThreadId++;
+        } else {
+            id = freeThreadIds.back();
+            freeThreadIds.pop_back();
+        }
+        if (id >= EpochDomain::max_threads) {
+            Panic("More than %d threads use epoch domains",
+                  EpochDomain::max_threads);
+        }
+    }
+
+    ~ThreadId() {
+        std::lock_guard<std::mutex> lock(threadIdsMutex);
+        freeThreadIds.push_back(id);
+    }
+
+    int id;
+};
+
+}  // namespace
+
+int EpochDomain::ThisThread() {
+    static thread_local ThreadId threadId;
+    return threadId.id;
+}
+
+EpochDomain::Guard::Guard(EpochDomain &domain)
+    : epoch(domain.slots[ThisThread()].epoch),
+      outermost(epoch.load(std::memory_order_relaxed) == 0) {
+    // Sequentially consistent, so that a writer that reclaims after this
+    // store either sees the epoch or unlinked its memory before this
+    // thread loads the pointer to it.
+    if (outermost) {
+        epoch.store(domain.globalEpoch.load());
+    }
+}
+
+EpochDomain::Guard::~Guard() {
+    if (outermost) {
+        epoch.store(0, std::memory_order_release);
+    }
+}
+
+EpochDomain::EpochDomain() : globalEpoch(1) {}
+
+EpochDomain::~EpochDomain() {
+    for (Slot &slot : slots) {
+        for (const Retired &retired : slot.retired) {
+            Free(retired);
+        }
+    }
+}
+
+void EpochDomain::Free(const Retired &retired) {
+    if (retired.deleter == nullptr) {
+        free(retired.memory);
+    } else {
+        retired.deleter(retired.context, retired.memory);
+    }
+}
+
+void EpochDomain::Retire(void *memory, Deleter deleter, void *context) {
+    if (memory == nullptr) {
+        return;
+    }
+    Slot &slot = slots[ThisThread()];
+    slot.retired.push_back(
+        Retired{memory, deleter, context, globalEpoch.load()});
+    if (slot.retired.size() % reclaim_batch == 0) {
+        Reclaim(slot);
+    }
+}
+
+void EpochDomain::Reclaim(Slot &slot) {
+    // Readers that start from now on cannot see the memory retired so
+    // far; those that are still reading may, unless they started after
+    // it was retired.
+    uint64_t oldest = globalEpoch.fetch_add(1) + 1;
+    for (const Slot &other : slots) {
+        const uint64_t epoch = other.epoch.load();
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for (const Retired &retired : slot.retired) {
+        if (retired.epoch < oldest) {
+            Free(retired);
+        } else {
+            slot.retired[kept++] = retired;
+        }
+    }
+    slot.retired.resize(kept);
+}
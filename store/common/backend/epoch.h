@@ -0,0 +1,98 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/epoch.h:
+ *   Epoch-based reclamation of memory shared with lock-free readers
+ *
+ **********************************************************************/
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Class EpochDomain frees memory that lock-free readers may still be
+ * using once none of them can anymore.
+ *
+ * Every thread that uses a domain gets a slot in it. Readers publish
+ * the global epoch in their slot with a Guard for the duration of a
+ * read; the slot is theirs alone, so reads write no shared memory.
+ * Writers that unlink memory Retire() it into their own slot, tagged
+ * with the global epoch at the time, and every reclaim_batch
+ * retirements they advance the epoch and free what was retired before
+ * the oldest epoch any reader is still in. Whatever is left is freed
+ * when the domain is destroyed.
+ *
+ * Threads are numbered process-wide, and a thread that exits hands its
+ * number, and with it its slot in every domain, to the next thread
+ * that needs one. At most max_threads threads may use domains at once.
+ */
+class EpochDomain
+{
+public:
+    static constexpr int max_threads = 256;
+
+    // Frees memory; context is whatever was passed to Retire
+    typedef void (*Deleter)(void *context, void *memory);
+
+    EpochDomain();
+    EpochDomain(const EpochDomain &) = delete;
+    EpochDomain &operator=(const EpochDomain &) = delete;
+    ~EpochDomain();
+
+    // Publishes the global epoch in the slot of the calling thread while
+    // it is alive. Guards nest; only the outermost one publishes.
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain &domain);
+        ~Guard();
+
+    private:
+        std::atomic<uint64_t> &epoch;
+        const bool outermost;
+    };
+
+    // Frees memory with deleter, or with free() if deleter is nullptr,
+    // once no Guard that might have seen it is left; nullptr is ignored.
+    void Retire(void *memory, Deleter deleter = nullptr,
+                void *context = nullptr);
+
+    // Number of the calling thread, below max_threads
+    static int ThisThread();
+
+private:
+    struct Retired {
+        void *memory;
+        Deleter deleter;
+        void *context;
+        uint64_t epoch;
+    };
+
+    struct Slot {
+        // Epoch the thread of the slot is reading in, 0 when it is not
+        // reading.
+        std::atomic<uint64_t> epoch{0};
+        // Memory retired by the thread of the slot; only it touches it.
+        std::vector<Retired> retired;
+    } __attribute__((__aligned__(CACHE_LINE_SIZE)));
+
+    // Retirements between two reclamations
+    static constexpr size_t reclaim_batch = 64;
+
+    // Epochs start at 1 so that 0 means idle.
+    std::atomic<uint64_t> globalEpoch;
+    Slot slots[max_threads];
+
+    // Frees the memory of slot that no reader can see anymore
+    void Reclaim(Slot &slot);
+    static void Free(const Retired &retired);
+};
+
+#endif  // _EPOCH_H_
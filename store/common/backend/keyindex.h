@@ -0,0 +1,292 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/keyindex.h:
+ *   Concurrent index of per-key entries for the ThreadSafeKvs backends
+ *
+ **********************************************************************/
+
+#ifndef _KEY_INDEX_H_
+#define _KEY_INDEX_H_
+
+#include "lib/assert.h"
+#include "lib/message.h"
+#include "store/common/backend/epoch.h"
+#include "store/common/backend/tagindex.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Class KeyIndex owns an entry of type E per key. Every key lives in an
+ * Item, which holds the entry in its first cache line and the key right
+ * after it. Items are carved out of large chunks and found through a
+ * TagIndex, so a lookup hashes the key once and then usually touches one
+ * index bucket and the item. Items never move and are only destroyed
+ * with the index, so callers may keep pointers to entries.
+ *
+ * Lookups run without locks, under a Guard of the EpochDomain of the
+ * index, which retires the bucket arrays that inserts replace. Threads
+ * that add keys take a mutex and look the key up again under it, so a
+ * key is only ever added once.
+ *
+ * Loaders that know their keys are new and distinct add them in bulk
+ * instead: every thread fills a Batch of its own, without locks, and
+ * Load then puts the items of all the batches in the index in one pass.
+ */
+template <class E> class KeyIndex
+{
+public:
+    struct Item {
+        E entry;
+        uint64_t hash;
+        uint32_t key_len;
+
+        // The key follows key_len, in the padding of the Item and beyond.
+        static size_t KeyOffset() {
+            return offsetof(Item, key_len) + sizeof(uint32_t);
+        }
+        std::string_view key() const {
+            return std::string_view(
+                reinterpret_cast<const char *>(this) + KeyOffset(), key_len);
+        }
+    };
+
+private:
+    // Item chunks are allocated this large
+    static constexpr size_t chunkSize = 1 << 20;
+
+    // Bytes an item with a key of key_len bytes takes in its chunk
+    static size_t ItemSize(size_t key_len) {
+        return (std::max(sizeof(Item), Item::KeyOffset() + key_len) +
+                CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+    }
+
+    // Chunks items are allocated from; the last one is filled up to
+    // used bytes, the others up to their ends. Not thread-safe.
+    class Chunks
+    {
+    public:
+        Chunks() : used(chunkSize) {}
+        Chunks(Chunks &&other)
+            : chunks(std::move(other.chunks)), ends(std::move(other.ends)),
+              used(other.used) {
+            other.chunks.clear();
+            other.ends.clear();
+            other.used = chunkSize;
+        }
+        Chunks &operator=(Chunks &&other) {
+            std::swap(chunks, other.chunks);
+            std::swap(ends, other.ends);
+            std::swap(used, other.used);
+            return *this;
+        }
+
+        Item *New(std::string_view key, uint64_t hash) {
+            const size_t size = ItemSize(key.size());
+            ASSERT(size <= chunkSize);
+            if (used + size > chunkSize) {
+                char *chunk = static_cast<char *>(aligned_alloc(CACHE_LINE_SIZE, chunkSize));
+                if (chunk == nullptr) {
+                    Panic("Failed to allocate a chunk of keys");
+                }
+                if (!chunks.empty()) {
+                    ends.push_back(used);
+                }
+                chunks.push_back(chunk);
+                used = 0;
+            }
+            char *memory = chunks.back() + used;
+            used += size;
+
+            Item *item = new (memory) Item();
+            item->hash = hash;
+            item->key_len = key.size();
+            std::memcpy(memory + Item::KeyOffset(), key.data(), key.size());
+            return item;
+        }
+
+        // Takes the chunks of other over; new items keep filling the
+        // last chunk of other
+        void Append(Chunks &other) {
+            if (other.chunks.empty()) {
+                return;
+            }
+            if (!chunks.empty()) {
+                ends.push_back(used);
+            }
+            chunks.insert(chunks.end(), other.chunks.begin(),
+                          other.chunks.end());
+            ends.insert(ends.end(), other.ends.begin(), other.ends.end());
+            used = other.used;
+            other = Chunks();
+        }
+
+        // Every chunk with the bytes used in it
+        std::vector<std::pair<char *, size_t>> Used() const {
+            std::vector<std::pair<char *, size_t>> result;
+            for (size_t i = 0; i < chunks.size(); i++) {
+                result.emplace_back(chunks[i], i < ends.size() ? ends[i] : used);
+            }
+            return result;
+        }
+
+        void Free() {
+            for (char *chunk : chunks) {
+                free(chunk);
+            }
+            chunks.clear();
+            ends.clear();
+            used = chunkSize;
+        }
+
+    private:
+        std::vector<char *> chunks;
+        std::vector<size_t> ends;
+        size_t used;
+    };
+
+public:
+    // Items one thread adds in bulk; they are not in the index until
+    // Load, and are destroyed with the batch if it is never loaded.
+    class Batch
+    {
+    public:
+        Batch() = default;
+        Batch(Batch &&) = default;
+        Batch &operator=(Batch &&) = delete;
+        ~Batch() {
+            for (Item *item : items) {
+                item->~Item();
+            }
+            chunks.Free();
+        }
+
+        // Returns a new, default-constructed entry for key
+        E &Add(std::string_view key) {
+            Item *item = chunks.New(key, Hash(key));
+            items.push_back(item);
+            return item->entry;
+        }
+
+    private:
+        friend class KeyIndex;
+        Chunks chunks;
+        std::vector<Item *> items;
+    };
+
+    KeyIndex(EpochDomain &epochs, size_t capacity)
+        : epochs(epochs), index(capacity) {}
+    KeyIndex(const KeyIndex &) = delete;
+    KeyIndex &operator=(const KeyIndex &) = delete;
+    ~KeyIndex() {
+        index.ForEach([](Item *item) { item->~Item(); });
+        chunks.Free();
+    }
+
+    static uint64_t Hash(std::string_view key) {
+        return TagIndex<Item>::Hash(key);
+    }
+
+    // Returns the entry of key, or nullptr if there is none
+    E *Find(std::string_view key) { return Find(key, Hash(key)); }
+
+    E *Find(std::string_view key, uint64_t hash) {
+        EpochDomain::Guard guard(epochs);
+        Item *item = index.Find(key, hash);
+        return item == nullptr ? nullptr : &item->entry;
+    }
+
+    // Brings the home bucket of hash into the cache ahead of a Find; the
+    // caller must hold a Guard.
+    void Prefetch(uint64_t hash) const { index.Prefetch(hash); }
+
+    // Returns the entry of key, default-constructing it if the key is not
+    // there yet
+    E &FindOrInsert(std::string_view key) {
+        const uint64_t hash = Hash(key);
+        E *entry = Find(key, hash);
+        if (entry != nullptr) {
+            return *entry;
+        }
+
+        // Only inserts replace the bucket array, so holding the insert
+        // lock keeps it alive without a guard. Another thread may have
+        // added the key since the lookup above.
+        std::lock_guard<std::mutex> lock(insertMutex);
+        Item *item = index.Find(key, hash);
+        if (item != nullptr) {
+            return item->entry;
+        }
+
+        item = chunks.New(key, hash);
+        epochs.Retire(index.Insert(item));
+        return item->entry;
+    }
+
+    // Adds the items of batches, whose keys must not be in the index
+    // nor in two batches, and empties them. Lookups may run meanwhile.
+    void Load(std::vector<Batch> &batches) {
+        std::lock_guard<std::mutex> lock(insertMutex);
+        size_t n = index.Size();
+        for (const Batch &batch : batches) {
+            n += batch.items.size();
+        }
+        epochs.Retire(index.Reserve(n));
+        for (Batch &batch : batches) {
+            epochs.Retire(index.InsertBulk(batch.items.data(),
+                                           batch.items.size()));
+            batch.items.clear();
+            chunks.Append(batch.chunks);
+        }
+    }
+
+    // Makes room for n keys
+    void Reserve(size_t n) {
+        std::lock_guard<std::mutex> lock(insertMutex);
+        epochs.Retire(index.Reserve(n));
+    }
+
+    // Calls f on every entry; must not run concurrently with inserts
+    template <class F> void ForEach(F f) {
+        index.ForEach([&f](Item *item) { f(item->entry); });
+    }
+
+    // Calls f(key, entry) on every entry added before the call. Unlike
+    // ForEach, it may run concurrently with lookups and inserts, and it
+    // needs no Guard: it walks the chunks, whose items never move.
+    template <class F> void ForEachAdded(F f) {
+        std::vector<std::pair<char *, size_t>> used;
+        {
+            std::lock_guard<std::mutex> lock(insertMutex);
+            used = chunks.Used();
+        }
+        for (const auto &chunk : used) {
+            size_t offset = 0;
+            while (offset < chunk.second) {
+                Item *item = reinterpret_cast<Item *>(chunk.first + offset);
+                f(item->key(), item->entry);
+                offset += ItemSize(item->key_len);
+            }
+        }
+    }
+
+private:
+    EpochDomain &epochs;
+    TagIndex<Item> index;
+
+    // Serializes the threads that add keys; guards index against
+    // concurrent inserts, and chunks.
+    std::mutex insertMutex;
+
+    Chunks chunks;
+};
+
+#endif  // _KEY_INDEX_H_
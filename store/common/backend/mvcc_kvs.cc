@@ -0,0 +1,386 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/mvcc_kvs.cc:
+ *   Thread-safe multi-versioned key-value store
+ *
+ **********************************************************************/
+
+#include "store/common/backend/mvcc_kvs.h"
+#include "store/common/transaction.h"
+#include "store/common/truetime.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+MvccKvs::Chunks::~Chunks() {
+    for (char* chunk : list) {
+        free(chunk);
+    }
+}
+
+MvccKvs::MvccKvs(size_t capacity)
+    : keys_(epochs_, capacity), horizon_(0) {}
+
+MvccKvs::~MvccKvs() {
+    // Arena versions go away with their chunks.
+    keys_.ForEach([](Entry& entry) {
+        Version* version = entry.head.load();
+        while (version != nullptr) {
+            Version* next = version->next.load();
+            if (version->size_class == large_class) {
+                free(version);
+            }
+            version = next;
+        }
+    });
+}
+
+void MvccKvs::Reserve(size_t n) {
+    keys_.Reserve(n);
+}
+
+void MvccKvs::StartLoad(int nthreads) {
+    load_batches_.resize(nthreads);
+}
+
+void MvccKvs::LoadPut(int thread, const std::string& key,
+                      const std::string& value, const Timestamp& timestamp) {
+    // No one sees the entry before FinishLoad, so it needs no lock.
+    Entry& entry = load_batches_[thread].Add(key);
+    Install(entry, &value, timestamp);
+}
+
+void MvccKvs::FinishLoad() {
+    keys_.Load(load_batches_);
+    load_batches_.clear();
+}
+
+MvccKvs::Version* MvccKvs::NewVersion(size_t size) {
+    const size_t bytes = sizeof(Version) + size;
+    if (bytes > max_arena_size) {
+        void* memory = malloc(bytes);
+        if (memory == nullptr) {
+            Panic("Failed to allocate a %lu byte value", size);
+        }
+        Version* version = new (memory) Version();
+        version->size_class = large_class;
+        return version;
+    }
+
+    int size_class = 0;
+    while ((min_arena_size << size_class) < bytes) {
+        size_class++;
+    }
+    Arena& arena = arenas_[EpochDomain::ThisThread()];
+    Version* version = arena.free[size_class];
+    if (version != nullptr) {
+        arena.free[size_class] = version->next.load(std::memory_order_relaxed);
+    } else {
+        const size_t class_size = min_arena_size << size_class;
+        if (arena.chunk_used + class_size > arena_chunk_size) {
+            arena.chunk = static_cast<char*>(
+                aligned_alloc(CACHE_LINE_SIZE, arena_chunk_size));
+            if (arena.chunk == nullptr) {
+                Panic("Failed to allocate a chunk of versions");
+            }
+            std::lock_guard<std::mutex> lock(chunks_.mutex);
+            chunks_.list.push_back(arena.chunk);
+            arena.chunk_used = 0;
+        }
+        version = new (arena.chunk + arena.chunk_used) Version();
+        arena.chunk_used += class_size;
+    }
+    version->size_class = size_class;
+    return version;
+}
+
+void MvccKvs::FreeVersion(void* context, void* memory) {
+    Version* version = static_cast<Version*>(memory);
+    if (version->size_class == large_class) {
+        free(version);
+        return;
+    }
+    // Versions go back to the arena of the thread that frees them.
+    MvccKvs* kvs = static_cast<MvccKvs*>(context);
+    Arena& arena = kvs->arenas_[EpochDomain::ThisThread()];
+    version->next.store(arena.free[version->size_class],
+                        std::memory_order_relaxed);
+    arena.free[version->size_class] = version;
+}
+
+bool MvccKvs::ReadVersion(
+    Version* version, std::pair<Timestamp, std::string>* timestamped_value) {
+    timestamped_value->first = version->timestamp;
+    if (version->deleted) {
+        timestamped_value->second.clear();
+        return false;
+    }
+    timestamped_value->second.assign(version->data(), version->size);
+    return true;
+}
+
+MvccKvs::VersionStatus MvccKvs::ReadAt(
+    Entry& entry, const Timestamp& timestamp,
+    std::pair<Timestamp, std::string>* timestamped_value) {
+    EpochDomain::Guard guard(epochs_);
+    Version* version = entry.head.load(std::memory_order_acquire);
+    while (version != nullptr && timestamp < version->timestamp) {
+        version = version->next.load(std::memory_order_acquire);
+    }
+    if (version != nullptr) {
+        return ReadVersion(version, timestamped_value) ? VERSION_FOUND
+                                                       : VERSION_ABSENT;
+    }
+    // A writer loads the watermark before it cuts the chain, and the
+    // watermark only moves up, so a chain cut below timestamp shows here.
+    if (timestamp < Timestamp(horizon_.load(std::memory_order_acquire), 0)) {
+        return VERSION_UNAVAILABLE;
+    }
+    return VERSION_ABSENT;
+}
+
+bool MvccKvs::Get(const std::string& key,
+                  std::pair<Timestamp, std::string>* timestamped_value) {
+    ASSERT(timestamped_value != nullptr);
+
+    EpochDomain::Guard guard(epochs_);
+    Entry* entry = keys_.Find(key);
+    if (entry == nullptr) {
+        return false;
+    }
+    Version* version = entry->head.load(std::memory_order_acquire);
+    return version != nullptr && ReadVersion(version, timestamped_value);
+}
+
+MvccKvs::VersionStatus MvccKvs::GetAt(
+    const std::string& key, const Timestamp& timestamp,
+    std::pair<Timestamp, std::string>* timestamped_value) {
+    ASSERT(timestamped_value != nullptr);
+
+    EpochDomain::Guard guard(epochs_);
+    Entry* entry = keys_.Find(key);
+    if (entry == nullptr) {
+        return VERSION_ABSENT;
+    }
+    return ReadAt(*entry, timestamp, timestamped_value);
+}
+
+bool MvccKvs::GetWithLock(
+    const std::string& key,
+    std::pair<Timestamp, std::string>* timestamped_value) {
+    ASSERT(timestamped_value != nullptr);
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+
+    // Only the lock holder replaces or trims the head.
+    Version* version = entry->head.load(std::memory_order_acquire);
+    if (version == nullptr) {
+        timestamped_value->first = Timestamp();
+        timestamped_value->second.clear();
+        return false;
+    }
+    return ReadVersion(version, timestamped_value);
+}
+
+bool MvccKvs::TryGet(const std::string& key,
+                     std::pair<Timestamp, std::string>* timestamped_value) {
+    ASSERT(timestamped_value != nullptr);
+
+    EpochDomain::Guard guard(epochs_);
+    Entry* entry = keys_.Find(key);
+    if (entry == nullptr || entry->locked.load()) {
+        return false;
+    }
+    Version* version = entry->head.load(std::memory_order_acquire);
+    return version != nullptr && ReadVersion(version, timestamped_value);
+}
+
+void MvccKvs::Lock(Entry& entry) {
+    while (!TryLock(entry)) {
+    }
+}
+
+bool MvccKvs::TryLock(Entry& entry) {
+    bool unlocked = false;
+    return !entry.locked.load(std::memory_order_relaxed) &&
+           entry.locked.compare_exchange_weak(unlocked, true,
+                                              std::memory_order_acquire);
+}
+
+void MvccKvs::WriteLock(const std::string& key, Timestamp* timestamp) {
+    Entry& entry = keys_.FindOrInsert(key);
+    Lock(entry);
+    Version* head = entry.head.load(std::memory_order_relaxed);
+    *timestamp = head == nullptr ? Timestamp() : head->timestamp;
+}
+
+bool MvccKvs::TryWriteLock(const std::string& key, Timestamp* timestamp) {
+    Entry& entry = keys_.FindOrInsert(key);
+    if (!TryLock(entry)) {
+        return false;
+    }
+    Version* head = entry.head.load(std::memory_order_relaxed);
+    *timestamp = head == nullptr ? Timestamp() : head->timestamp;
+    return true;
+}
+
+bool MvccKvs::IsWriteLocked(const std::string& key) {
+    Entry* entry = keys_.Find(key);
+    return entry != nullptr && entry->locked.load();
+}
+
+void MvccKvs::Install(Entry& entry, const std::string* value,
+                      const Timestamp& timestamp) {
+    Version* head = entry.head.load(std::memory_order_relaxed);
+    if (head != nullptr && timestamp < head->timestamp) {
+        return;
+    }
+
+    Version* version = NewVersion(value == nullptr ? 0 : value->size());
+    version->timestamp = timestamp;
+    version->deleted = value == nullptr;
+    version->size = value == nullptr ? 0 : value->size();
+    if (value != nullptr) {
+        std::memcpy(version->data(), value->data(), value->size());
+    }
+
+    if (head != nullptr && head->timestamp == timestamp) {
+        version->next.store(head->next.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+        entry.head.store(version, std::memory_order_release);
+        epochs_.Retire(head, FreeVersion, this);
+    } else {
+        version->next.store(head, std::memory_order_relaxed);
+        entry.head.store(version, std::memory_order_release);
+    }
+    Trim(entry);
+
+    Arena& arena = arenas_[EpochDomain::ThisThread()];
+    if (++arena.writes == watermark_interval) {
+        arena.writes = 0;
+        AdvanceWatermark(Timestamp(TrueTime::Earlier(timestamp.getTimestamp(),
+                                                     SNAPSHOT_RETENTION_US)));
+    }
+}
+
+void MvccKvs::Trim(Entry& entry) {
+    // Rounding the watermark down keeps more versions, never fewer.
+    const Timestamp watermark(horizon_.load(std::memory_order_acquire), 0);
+    Version* version = entry.head.load(std::memory_order_relaxed);
+    while (version != nullptr && watermark < version->timestamp) {
+        version = version->next.load(std::memory_order_relaxed);
+    }
+    if (version == nullptr) {
+        return;
+    }
+
+    Version* older = version->next.load(std::memory_order_relaxed);
+    version->next.store(nullptr, std::memory_order_release);
+    while (older != nullptr) {
+        // Retiring may free what was retired before, so step first.
+        Version* next = older->next.load(std::memory_order_relaxed);
+        epochs_.Retire(older, FreeVersion, this);
+        older = next;
+    }
+}
+
+void MvccKvs::PutWithLock(const std::string& key, const std::string& value,
+                          const Timestamp& timestamp) {
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    Install(*entry, &value, timestamp);
+}
+
+void MvccKvs::DeleteWithLock(const std::string& key,
+                             const Timestamp& timestamp) {
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    Install(*entry, nullptr, timestamp);
+}
+
+void MvccKvs::WriteUnlock(const std::string& key) {
+    Entry* entry = keys_.Find(key);
+    ASSERT(entry != nullptr);
+    ASSERT(entry->locked.load());
+    entry->locked.store(false, std::memory_order_release);
+}
+
+void MvccKvs::Put(const std::string& key, const std::string& value,
+                  const Timestamp& timestamp) {
+    Entry& entry = keys_.FindOrInsert(key);
+    Lock(entry);
+    Install(entry, &value, timestamp);
+    entry.locked.store(false, std::memory_order_release);
+}
+
+void MvccKvs::Delete(const std::string& key, const Timestamp& timestamp) {
+    // A key that is not there yet still gets a tombstone, so that an
+    // older Put that arrives later does not add it.
+    Entry& entry = keys_.FindOrInsert(key);
+    Lock(entry);
+    Install(entry, nullptr, timestamp);
+    entry.locked.store(false, std::memory_order_release);
+}
+
+Timestamp MvccKvs::OpenSnapshot(const Timestamp& timestamp) {
+    std::lock_guard<std::mutex> lock(snapshots_mutex_);
+    const Timestamp watermark = WatermarkLocked();
+    const Timestamp snapshot = timestamp < watermark ? watermark : timestamp;
+    snapshots_.insert(snapshot);
+    return snapshot;
+}
+
+void MvccKvs::CloseSnapshot(const Timestamp& timestamp) {
+    std::lock_guard<std::mutex> lock(snapshots_mutex_);
+    auto it = snapshots_.find(timestamp);
+    ASSERT(it != snapshots_.end());
+    snapshots_.erase(it);
+    UpdateHorizon();
+}
+
+void MvccKvs::AdvanceWatermark(const Timestamp& timestamp) {
+    std::lock_guard<std::mutex> lock(snapshots_mutex_);
+    if (advanced_ < timestamp) {
+        advanced_ = timestamp;
+    }
+    UpdateHorizon();
+}
+
+Timestamp MvccKvs::Watermark() {
+    std::lock_guard<std::mutex> lock(snapshots_mutex_);
+    return WatermarkLocked();
+}
+
+Timestamp MvccKvs::WatermarkLocked() const {
+    if (snapshots_.empty() || advanced_ < *snapshots_.begin()) {
+        return advanced_;
+    }
+    return *snapshots_.begin();
+}
+
+void MvccKvs::UpdateHorizon() {
+    // Neither opening a snapshot at or after the watermark nor anything
+    // else moves it back, so writers never see it go down.
+    horizon_.store(WatermarkLocked().getTimestamp(), std::memory_order_release);
+}
+
+bool MvccKvs::StartCheckpoint(const Timestamp& cut) {
+    checkpoint_ = OpenSnapshot(cut);
+    if (checkpoint_ != cut) {
+        Panic("Checkpoint at %lu.%lu is below the watermark",
+              cut.getTimestamp(), cut.getID());
+    }
+    return true;
+}
+
+void MvccKvs::FinishCheckpoint(const CheckpointFunc& f) {
+    keys_.ForEachAdded([this, &f](std::string_view key, Entry& entry) {
+        std::pair<Timestamp, std::string> version;
+        if (ReadAt(entry, checkpoint_, &version) == VERSION_FOUND) {
+            f(key, version.second, version.first);
+        }
+    });
+    CloseSnapshot(checkpoint_);
+}
@@ -0,0 +1,203 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/mvcc_kvs.h:
+ *   Thread-safe multi-versioned key-value store
+ *
+ **********************************************************************/
+
+#ifndef _MVCC_KVS_H_
+#define _MVCC_KVS_H_
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "store/common/backend/epoch.h"
+#include "store/common/backend/keyindex.h"
+#include "store/common/backend/thread_safe_kvs.h"
+
+// MvccKvs implements the ThreadSafeKvs with a chain of immutable versions
+// per key, so that GetAt can read the store as of any recent timestamp.
+//
+// # Versions
+// The entry of a key points to its newest version, and every version to
+// the next older one. A write builds a new version and swaps it in at the
+// head of the chain while it holds the lock of the entry; a write with the
+// same timestamp as the head replaces it instead. Like AtomicKvs, writes
+// older than the head are dropped. Readers load the head and walk the
+// chain without locks, so reads of recent versions stop at the first
+// version or two and never write shared memory. Deletes push a tombstone
+// version.
+//
+// Versions of up to max_arena_size bytes, header included, come from
+// per-thread arenas with a free list per power-of-two size class; larger
+// ones are malloc()ed.
+//
+// # Garbage collection
+// Readers at a timestamp at or after the watermark see the newest version
+// at or before the watermark, or a later one, so every write trims the
+// versions older than that from its chain. Trimmed versions are retired
+// to an EpochDomain, since readers may still be walking them.
+//
+// The watermark is the oldest open snapshot, and at most the largest
+// timestamp passed to AdvanceWatermark. Every watermark_interval writes,
+// writers advance it to SNAPSHOT_RETENTION_US before the timestamp they
+// write at, so that a store does not keep versions forever while reads
+// of snapshots younger than that still find theirs without registering:
+// clients only read snapshots that recent. Reads below the watermark may
+// fail to find the version they want; reads at or above it always find
+// it, even while writers trim. GetAt tells reads below the watermark that
+// find no version apart from reads of missing keys, since it cannot know
+// whether the version they want was trimmed. Snapshots opened below the
+// watermark are moved up to it.
+//
+// # Checkpoints
+// A checkpoint is a snapshot at its cut, read key by key.
+class MvccKvs : public ThreadSafeKvs {
+public:
+    // capacity is the number of keys to make room for up front
+    explicit MvccKvs(size_t capacity = 0);
+    ~MvccKvs() override;
+
+    bool Get(const std::string& key,
+             std::pair<Timestamp, std::string>* timestamped_value) override;
+    VersionStatus GetAt(
+        const std::string& key, const Timestamp& timestamp,
+        std::pair<Timestamp, std::string>* timestamped_value) override;
+    bool SupportsSnapshots() const override { return true; }
+    bool GetWithLock(
+        const std::string& key,
+        std::pair<Timestamp, std::string>* timestamped_value) override;
+    bool TryGet(const std::string& key,
+                std::pair<Timestamp, std::string>* timestamped_value) override;
+    void WriteLock(const std::string& key, Timestamp* timestamp) override;
+    bool TryWriteLock(const std::string& key, Timestamp* timestamp) override;
+    bool IsWriteLocked(const std::string& key) override;
+    void PutWithLock(const std::string& key, const std::string& value,
+                     const Timestamp& timestamp) override;
+    void DeleteWithLock(const std::string& key,
+                        const Timestamp& timestamp) override;
+    void WriteUnlock(const std::string& key) override;
+    void Put(const std::string& key, const std::string& value,
+             const Timestamp& timestamp) override;
+    void Delete(const std::string& key, const Timestamp& timestamp) override;
+    void Reserve(size_t n) override;
+    void StartLoad(int nthreads) override;
+    void LoadPut(int thread, const std::string& key, const std::string& value,
+                 const Timestamp& timestamp) override;
+    void FinishLoad() override;
+    bool SupportsCheckpoints() const override { return true; }
+    bool StartCheckpoint(const Timestamp& cut) override;
+    void FinishCheckpoint(const CheckpointFunc& f) override;
+
+    // Registers a reader at timestamp, or at the watermark if that is
+    // later, and returns the timestamp it registered. Versions that
+    // GetAt needs at that timestamp are kept until CloseSnapshot.
+    Timestamp OpenSnapshot(const Timestamp& timestamp);
+
+    // Unregisters a snapshot returned by OpenSnapshot.
+    void CloseSnapshot(const Timestamp& timestamp);
+
+    // Lets writers collect the versions that no reader at timestamp or
+    // later needs, once no snapshot older than timestamp is open.
+    void AdvanceWatermark(const Timestamp& timestamp);
+
+    Timestamp Watermark();
+
+    // Writes of a thread between two advances of the watermark.
+    static constexpr uint32_t watermark_interval = 1024;
+
+private:
+    struct Version {
+        Timestamp timestamp;
+        std::atomic<Version*> next;
+        uint32_t size;
+        // Arena size class, or large_class if malloc()ed
+        uint8_t size_class;
+        bool deleted;
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    struct Entry {
+        std::atomic<Version*> head{nullptr};
+        std::atomic<bool> locked{false};
+    };
+
+    static constexpr size_t min_arena_size = 64;
+    static constexpr size_t max_arena_size = 4096;
+    static constexpr int num_size_classes = 7;
+    static constexpr uint8_t large_class = UINT8_MAX;
+    static constexpr size_t arena_chunk_size = 1 << 20;
+
+    // Only the thread that owns an arena touches it.
+    struct Arena {
+        Version* free[num_size_classes] = {};
+        char* chunk = nullptr;
+        size_t chunk_used = arena_chunk_size;
+        uint32_t writes = 0;
+    } __attribute__((__aligned__(CACHE_LINE_SIZE)));
+
+    // The chunks of all the arenas. Destroyed after epochs_, whose
+    // destructor still returns versions to the arenas.
+    struct Chunks {
+        ~Chunks();
+        std::mutex mutex;
+        std::vector<char*> list;
+    };
+
+    // Reads the newest version of entry at or before timestamp.
+    VersionStatus ReadAt(Entry& entry, const Timestamp& timestamp,
+                std::pair<Timestamp, std::string>* timestamped_value);
+
+    // Copies version into timestamped_value; returns false for
+    // tombstones.
+    static bool ReadVersion(Version* version,
+                            std::pair<Timestamp, std::string>* timestamped_value);
+
+    static void Lock(Entry& entry);
+    static bool TryLock(Entry& entry);
+
+    // Adds a version to entry, which the caller must have locked; value
+    // is nullptr for a tombstone.
+    void Install(Entry& entry, const std::string* value,
+                 const Timestamp& timestamp);
+
+    // Retires the versions of entry that are older than the watermark
+    // needs; the caller must have locked the entry.
+    void Trim(Entry& entry);
+
+    Version* NewVersion(size_t size);
+    // EpochDomain::Deleter of versions; context is the MvccKvs.
+    static void FreeVersion(void* context, void* memory);
+
+    // The caller holds snapshots_mutex_.
+    Timestamp WatermarkLocked() const;
+
+    // Recomputes horizon_; the caller holds snapshots_mutex_.
+    void UpdateHorizon();
+
+    Chunks chunks_;
+    Arena arenas_[EpochDomain::max_threads];
+    EpochDomain epochs_;
+    // Keys that were never written have no versions; deleted keys have a
+    // tombstone at the head.
+    KeyIndex<Entry> keys_;
+    // Keys LoadPut adds, a batch per loading thread, until FinishLoad
+    std::vector<KeyIndex<Entry>::Batch> load_batches_;
+
+    std::mutex snapshots_mutex_;
+    std::multiset<Timestamp> snapshots_;
+    // Largest timestamp passed to AdvanceWatermark
+    Timestamp advanced_;
+    // The watermark, packed into one word so that writers can load it.
+    std::atomic<uint64_t> horizon_;
+
+    // Snapshot of the running checkpoint
+    Timestamp checkpoint_;
+};
+
+#endif  // _MVCC_KVS_H_
@@ -30,66 +30,103 @@
 
 #include "store/common/backend/pthread_kvs.h"
 
+PthreadKvs::PthreadKvs() {
+    int err = pthread_rwlock_init(&kvs_lock_, nullptr);
+    ASSERT(err == 0);
+}
+
+PthreadKvs::~PthreadKvs() {
+    int err = pthread_rwlock_destroy(&kvs_lock_);
+    ASSERT(err == 0);
+}
+
+PthreadKvs::Entry* PthreadKvs::Find(const std::string& key) {
+    int lock_err = pthread_rwlock_rdlock(&kvs_lock_);
+    ASSERT(lock_err == 0);
+    const auto iter = kvs_.find(key);
+    Entry* entry = iter == kvs_.end() ? nullptr : &iter->second;
+    int unlock_err = pthread_rwlock_unlock(&kvs_lock_);
+    ASSERT(unlock_err == 0);
+    return entry;
+}
+
+PthreadKvs::Entry& PthreadKvs::FindOrInsert(const std::string& key) {
+    Entry* entry = Find(key);
+    if (entry != nullptr) {
+        return *entry;
+    }
+
+    int lock_err = pthread_rwlock_wrlock(&kvs_lock_);
+    ASSERT(lock_err == 0);
+    entry = &kvs_[key];
+    int unlock_err = pthread_rwlock_unlock(&kvs_lock_);
+    ASSERT(unlock_err == 0);
+    return *entry;
+}
+
 bool PthreadKvs::Get(const std::string& key,
                      std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
 
-    const auto iter = kvs_.find(key);
-    if (iter == kvs_.end()) {
+    Entry* found = Find(key);
+    if (found == nullptr) {
         return false;
     }
 
-    Entry& entry = iter->second;
+    Entry& entry = *found;
     int lock_err = pthread_rwlock_rdlock(&entry.lock);
     ASSERT(lock_err == 0);
     timestamped_value->first = entry.timestamp;
     timestamped_value->second = entry.value;
+    const bool present = !entry.deleted;
     int unlock_err = pthread_rwlock_unlock(&entry.lock);
     ASSERT(unlock_err == 0);
-    return true;
+    return present;
 }
 
-void PthreadKvs::GetWithLock(
+bool PthreadKvs::GetWithLock(
     const std::string& key,
     std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
-    const auto iter = kvs_.find(key);
-    ASSERT(iter != kvs_.end());
-    Entry& entry = iter->second;
+    Entry* found = Find(key);
+    ASSERT(found != nullptr);
+    Entry& entry = *found;
     timestamped_value->first = entry.timestamp;
     timestamped_value->second = entry.value;
+    return !entry.deleted;
 }
 
 bool PthreadKvs::TryGet(const std::string& key,
                         std::pair<Timestamp, std::string>* timestamped_value) {
     ASSERT(timestamped_value != nullptr);
 
-    const auto iter = kvs_.find(key);
-    if (iter == kvs_.end()) {
+    Entry* found = Find(key);
+    if (found == nullptr) {
         return false;
     }
 
-    Entry& entry = iter->second;
+    Entry& entry = *found;
     if (pthread_rwlock_tryrdlock(&entry.lock) != 0) {
         return false;
     }
 
     timestamped_value->first = entry.timestamp;
     timestamped_value->second = entry.value;
+    const bool present = !entry.deleted;
     int unlock_err = pthread_rwlock_unlock(&entry.lock);
     ASSERT(unlock_err == 0);
-    return true;
+    return present;
 }
 
 void PthreadKvs::WriteLock(const std::string& key, Timestamp* timestamp) {
-    Entry& entry = kvs_[key];
+    Entry& entry = FindOrInsert(key);
     int lock_err = pthread_rwlock_wrlock(&entry.lock);
     ASSERT(lock_err == 0);
     *timestamp = entry.timestamp;
 }
 
 bool PthreadKvs::TryWriteLock(const std::string& key, Timestamp* timestamp) {
-    Entry& entry = kvs_[key];
+    Entry& entry = FindOrInsert(key);
     if (pthread_rwlock_trywrlock(&entry.lock) == 0) {
         *timestamp = entry.timestamp;
         return true;
@@ -100,38 +137,79 @@ bool PthreadKvs::TryWriteLock(const std::string& key, Timestamp* timestamp) {
 
 void PthreadKvs::PutWithLock(const std::string& key, const std::string& value,
                              const Timestamp& timestamp) {
-    Entry& entry = kvs_[key];
-    if (timestamp >= entry.timestamp) {
-        entry.value = value;
-        entry.timestamp = timestamp;
+    Entry* entry = Find(key);
+    ASSERT(entry != nullptr);
+    if (timestamp >= entry->timestamp) {
+        entry->value = value;
+        entry->timestamp = timestamp;
+        entry->deleted = false;
+    }
+}
+
+void PthreadKvs::DeleteWithLock(const std::string& key,
+                                const Timestamp& timestamp) {
+    Entry* entry = Find(key);
+    ASSERT(entry != nullptr);
+    if (timestamp >= entry->timestamp) {
+        entry->value.clear();
+        entry->timestamp = timestamp;
+        entry->deleted = true;
     }
 }
 
 void PthreadKvs::WriteUnlock(const std::string& key) {
-    Entry& entry = kvs_[key];
-    int unlocked_err = pthread_rwlock_unlock(&entry.lock);
+    Entry* entry = Find(key);
+    ASSERT(entry != nullptr);
+    int unlocked_err = pthread_rwlock_unlock(&entry->lock);
     ASSERT(unlocked_err == 0);
 }
 
 void PthreadKvs::Put(const std::string& key, const std::string& value,
                      const Timestamp& timestamp) {
-    Entry& entry = kvs_[key];
+    Entry& entry = FindOrInsert(key);
     int lock_err = pthread_rwlock_wrlock(&entry.lock);
     ASSERT(lock_err == 0);
     if (timestamp >= entry.timestamp) {
         entry.value = value;
         entry.timestamp = timestamp;
+        entry.deleted = false;
+    }
+    int unlocked_err = pthread_rwlock_unlock(&entry.lock);
+    ASSERT(unlocked_err == 0);
+}
+
+void PthreadKvs::Delete(const std::string& key, const Timestamp& timestamp) {
+    // A key that is not there yet still gets a tombstone, so that an
+    // older Put that arrives later does not add it.
+    Entry& entry = FindOrInsert(key);
+    int lock_err = pthread_rwlock_wrlock(&entry.lock);
+    ASSERT(lock_err == 0);
+    if (timestamp >= entry.timestamp) {
+        entry.value.clear();
+        entry.timestamp = timestamp;
+        entry.deleted = true;
     }
     int unlocked_err = pthread_rwlock_unlock(&entry.lock);
     ASSERT(unlocked_err == 0);
 }
 
 bool PthreadKvs::IsWriteLocked(const std::string& key) {
-    Entry& entry = kvs_[key];
-    if (pthread_rwlock_tryrdlock(&entry.lock) != 0) {
+    Entry* entry = Find(key);
+    if (entry == nullptr) {
+        return false;
+    }
+    if (pthread_rwlock_tryrdlock(&entry->lock) != 0) {
         return true;
     } else {
-        pthread_rwlock_unlock(&entry.lock);
+        pthread_rwlock_unlock(&entry->lock);
         return false;
     }
-}
\ No newline at end of file
+}
+
+void PthreadKvs::Reserve(size_t n) {
+    int lock_err = pthread_rwlock_wrlock(&kvs_lock_);
+    ASSERT(lock_err == 0);
+    kvs_.reserve(n);
+    int unlock_err = pthread_rwlock_unlock(&kvs_lock_);
+    ASSERT(unlock_err == 0);
+}
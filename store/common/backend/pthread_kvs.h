@@ -37,12 +37,19 @@
 
 #include "store/common/backend/thread_safe_kvs.h"
 
-// PthreadKvs implements the ThreadSafeKvs interface using pthread_rwlock_ts.
+// PthreadKvs implements the ThreadSafeKvs interface using pthread_rwlock_ts:
+// one per key, and one for the map of keys, which lookups take shared and
+// inserts exclusive. Entries of an std::unordered_map never move, so once
+// a thread has found an entry it no longer needs the map lock. Deleted keys
+// keep their entry as a tombstone.
 class PthreadKvs : public ThreadSafeKvs {
 public:
+    PthreadKvs();
+    ~PthreadKvs() override;
+
     bool Get(const std::string& key,
              std::pair<Timestamp, std::string>* timestamped_value) override;
-    void GetWithLock(
+    bool GetWithLock(
         const std::string& key,
         std::pair<Timestamp, std::string>* timestamped_value) override;
     bool TryGet(const std::string& key,
@@ -52,9 +59,13 @@ public:
     bool IsWriteLocked(const std::string& key) override;
     void PutWithLock(const std::string& key, const std::string& value,
                      const Timestamp& timestamp) override;
+    void DeleteWithLock(const std::string& key,
+                        const Timestamp& timestamp) override;
     void WriteUnlock(const std::string& key) override;
     void Put(const std::string& key, const std::string& value,
              const Timestamp& timestamp) override;
+    void Delete(const std::string& key, const Timestamp& timestamp) override;
+    void Reserve(size_t n) override;
 
 private:
     struct Entry {
@@ -69,9 +80,18 @@ private:
 
         std::string value;
         Timestamp timestamp;
+        // New entries are tombstones until something is put in them.
+        bool deleted = true;
         pthread_rwlock_t lock;
     };
 
+    // Returns the entry of key, or nullptr if there is none.
+    Entry* Find(const std::string& key);
+
+    // Returns the entry of key, adding the key if it is not there yet.
+    Entry& FindOrInsert(const std::string& key);
+
+    pthread_rwlock_t kvs_lock_;
     std::unordered_map<std::string, Entry> kvs_;
 };
 
@@ -0,0 +1,242 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/tagindex.h:
+ *   Open-addressing hash index with cache-line buckets and tag bytes
+ *
+ **********************************************************************/
+
+#ifndef _TAG_INDEX_H_
+#define _TAG_INDEX_H_
+
+#include "lib/message.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include <emmintrin.h>
+
+/*
+ * Class TagIndex maps string keys to items of type T, which it does not
+ * own; T::key() returns the key of an item and T::hash its Hash().
+ *
+ * The index is a power-of-two array of 64-byte buckets, each holding
+ * TAGINDEX_SLOTS item pointers and a tag byte per pointer: the top 7
+ * bits of the key hash, with the high bit set so that 0 marks an empty
+ * slot. A lookup hashes the key once, compares all the tags of its home
+ * bucket to the tag of the key with one SSE2 compare, and only
+ * dereferences the items whose tag matches, so that finding a key
+ * usually costs the bucket line and the item line. Full buckets spill
+ * into the next ones; every bucket counts the items that spilled past
+ * it, and lookups stop at the first bucket that has none.
+ *
+ * Lookups never write and may run concurrently with each other and with
+ * one Insert or Reserve; the caller serializes those. An insert fills
+ * in the item pointer before it publishes the tag, and counts a spill
+ * before it places the item past the full bucket, so a lookup either
+ * finds a complete item or misses it as if it ran before the insert.
+ * Growing the index builds a new bucket array next to the old one and
+ * then swaps them, so lookups never wait; the old array is handed back
+ * to the caller, who must free() it once no lookup can still be
+ * walking it. Items are never removed.
+ */
+
+#define TAGINDEX_SLOTS 7
+// Largest average number of items per bucket before the index grows
+#define TAGINDEX_MAX_LOAD 5
+// Items InsertBulk fetches the buckets of ahead of placing them
+#define TAGINDEX_BULK_AHEAD 8
+
+template <class T> class TagIndex
+{
+    struct Table;
+
+public:
+    // Bucket arrays replaced by Insert and Reserve, see above
+    typedef Table Retired;
+
+    explicit TagIndex(size_t capacity = 0) : size(0) {
+        table.store(NewTable(BucketsFor(capacity)));
+    }
+    TagIndex(const TagIndex &) = delete;
+    TagIndex &operator=(const TagIndex &) = delete;
+    ~TagIndex() { free(table.load()); }
+
+    static uint64_t Hash(std::string_view key) {
+        return std::hash<std::string_view>()(key);
+    }
+
+    T *Find(std::string_view key) const { return Find(key, Hash(key)); }
+
+    T *Find(std::string_view key, uint64_t hash) const {
+        const Table *t = table.load(std::memory_order_acquire);
+        const uint8_t tag = Tag(hash);
+        const __m128i tags = _mm_set1_epi8(static_cast<char>(tag));
+        for (size_t b = hash & t->mask;; b = (b + 1) & t->mask) {
+            const Bucket &bucket = t->buckets()[b];
+            __m128i bucketTags = _mm_loadl_epi64(
+                reinterpret_cast<const __m128i *>(bucket.tags));
+            // the item pointers were stored before the tags
+            std::atomic_thread_fence(std::memory_order_acquire);
+            unsigned matches = _mm_movemask_epi8(_mm_cmpeq_epi8(bucketTags, tags)) &
+                               ((1 << TAGINDEX_SLOTS) - 1);
+            while (matches != 0) {
+                int i = __builtin_ctz(matches);
+                T *item = bucket.items[i].load(std::memory_order_relaxed);
+                if (item->hash == hash && item->key() == key) {
+                    return item;
+                }
+                matches &= matches - 1;
+            }
+            if (__atomic_load_n(&bucket.overflow, __ATOMIC_ACQUIRE) == 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Brings the home bucket of hash into the cache ahead of a Find
+    void Prefetch(uint64_t hash) const {
+        const Table *t = table.load(std::memory_order_acquire);
+        __builtin_prefetch(&t->buckets()[hash & t->mask]);
+    }
+
+    // Adds item, whose key must not be in the index yet. Returns the
+    // bucket array it replaced if it had to grow, and nullptr otherwise.
+    Retired *Insert(T *item) {
+        Table *old = table.load(std::memory_order_relaxed);
+        Retired *retired = nullptr;
+        if ((size + 1) > (old->mask + 1) * TAGINDEX_MAX_LOAD) {
+            retired = Resize((old->mask + 1) * 2);
+        }
+        Place(table.load(std::memory_order_relaxed), item);
+        size++;
+        return retired;
+    }
+
+    // Adds the n items, none of whose keys may be in the index or
+    // repeat, growing it at most once; returns the replaced bucket array
+    // like Insert. The buckets of later items are fetched while earlier
+    // ones are placed.
+    Retired *InsertBulk(T *const *items, size_t n) {
+        Retired *retired = Reserve(size + n);
+        Table *t = table.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; i++) {
+            if (i + TAGINDEX_BULK_AHEAD < n) {
+                __builtin_prefetch(
+                    &t->buckets()[items[i + TAGINDEX_BULK_AHEAD]->hash & t->mask], 1);
+            }
+            Place(t, items[i]);
+        }
+        size += n;
+        return retired;
+    }
+
+    // Grows the index so that it holds n items without growing again;
+    // returns the replaced bucket array like Insert.
+    Retired *Reserve(size_t n) {
+        size_t wanted = BucketsFor(n);
+        if (wanted > table.load(std::memory_order_relaxed)->mask + 1) {
+            return Resize(wanted);
+        }
+        return nullptr;
+    }
+
+    size_t Size() const { return size; }
+
+    // Calls f on every item; must not run concurrently with Insert
+    template <class F> void ForEach(F f) const {
+        const Table *t = table.load();
+        for (size_t b = 0; b <= t->mask; b++) {
+            const Bucket &bucket = t->buckets()[b];
+            for (int i = 0; i < TAGINDEX_SLOTS; i++) {
+                if (bucket.tags[i] != 0) {
+                    f(bucket.items[i].load(std::memory_order_relaxed));
+                }
+            }
+        }
+    }
+
+private:
+    struct Bucket {
+        uint8_t tags[TAGINDEX_SLOTS];
+        // number of items that belong to this bucket or an earlier one
+        // and were placed after it, saturated at 255
+        uint8_t overflow;
+        std::atomic<T *> items[TAGINDEX_SLOTS];
+    } __attribute__((__aligned__(64)));
+    static_assert(sizeof(Bucket) == 64, "a bucket must fill one cache line");
+
+    // A bucket array with its mask in the cache line before it, so that
+    // lookups always see the two together
+    struct Table {
+        size_t mask;
+        Bucket *buckets() { return reinterpret_cast<Bucket *>(this + 1); }
+        const Bucket *buckets() const {
+            return reinterpret_cast<const Bucket *>(this + 1);
+        }
+    } __attribute__((__aligned__(64)));
+
+    std::atomic<Table *> table;
+    size_t size;
+
+    static uint8_t Tag(uint64_t hash) { return (hash >> 57) | 0x80; }
+
+    static size_t BucketsFor(size_t n) {
+        size_t count = 1;
+        while (count * TAGINDEX_MAX_LOAD < n) {
+            count *= 2;
+        }
+        return count;
+    }
+
+    static Table *NewTable(size_t count) {
+        const size_t bytes = sizeof(Table) + count * sizeof(Bucket);
+        Table *t = static_cast<Table *>(aligned_alloc(sizeof(Bucket), bytes));
+        if (t == nullptr) {
+            Panic("Failed to allocate %lu index buckets", count);
+        }
+        memset(static_cast<void *>(t), 0, bytes);
+        t->mask = count - 1;
+        return t;
+    }
+
+    static void Place(Table *t, T *item) {
+        const uint64_t hash = item->hash;
+        for (size_t b = hash & t->mask;; b = (b + 1) & t->mask) {
+            Bucket &bucket = t->buckets()[b];
+            for (int i = 0; i < TAGINDEX_SLOTS; i++) {
+                if (bucket.tags[i] == 0) {
+                    bucket.items[i].store(item, std::memory_order_relaxed);
+                    __atomic_store_n(&bucket.tags[i], Tag(hash),
+                                     __ATOMIC_RELEASE);
+                    return;
+                }
+            }
+            if (bucket.overflow < UINT8_MAX) {
+                __atomic_store_n(&bucket.overflow, bucket.overflow + 1,
+                                 __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    Retired *Resize(size_t count) {
+        Table *old = table.load(std::memory_order_relaxed);
+        Table *t = NewTable(count);
+        for (size_t b = 0; b <= old->mask; b++) {
+            const Bucket &bucket = old->buckets()[b];
+            for (int i = 0; i < TAGINDEX_SLOTS; i++) {
+                if (bucket.tags[i] != 0) {
+                    Place(t, bucket.items[i].load(std::memory_order_relaxed));
+                }
+            }
+        }
+        table.store(t, std::memory_order_release);
+        return old;
+    }
+};
+
+#endif  // _TAG_INDEX_H_
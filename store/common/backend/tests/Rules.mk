@@ -5,18 +5,14 @@ d := $(dir $(lastword $(MAKEFILE_LIST)))
 #
 GTEST_SRCS += $(addprefix $(d), \
 		kvstore-test.cc \
-		versionstore-test.cc \
 		lockserver-test.cc \
-		thread_safe_kvs_test.cc)
+		thread_safe_kvs_test.cc \
+		mvcc_kvs_test.cc)
 
 $(d)kvstore-test: $(o)kvstore-test.o $(LIB-transport) $(LIB-store-common) $(LIB-store-backend) $(GTEST_MAIN)
 
 TEST_BINS += $(d)kvstore-test
 
-$(d)versionstore-test: $(o)versionstore-test.o $(LIB-transport) $(LIB-store-common) $(LIB-store-backend) $(GTEST_MAIN)
-
-TEST_BINS += $(d)versionstore-test
-
 $(d)lockserver-test: $(o)lockserver-test.o $(LIB-transport) $(LIB-store-common) $(LIB-store-backend) $(GTEST_MAIN)
 
 TEST_BINS += $(d)lockserver-test
@@ -26,3 +22,9 @@ $(d)thread_safe_kvs_test: \
 	$(LIB-message) $(LIB-store-common) $(LIB-store-backend) $(GTEST_MAIN)
 
 TEST_BINS += $(d)thread_safe_kvs_test
+
+$(d)mvcc_kvs_test: \
+	$(o)mvcc_kvs_test.o \
+	$(LIB-message) $(LIB-store-common) $(LIB-store-backend) $(GTEST_MAIN)
+
+TEST_BINS += $(d)mvcc_kvs_test
@@ -0,0 +1,256 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/tests/mvcc_kvs_test.cc
+ *   Test cases for the multi-versioned key-value store.
+ *
+ **********************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "store/common/backend/mvcc_kvs.h"
+#include "store/common/transaction.h"
+
+namespace {
+
+// The TrueTime timestamp us microseconds after the epoch
+Timestamp Time(uint64_t us, uint64_t id = 0) {
+    return Timestamp(((us / 1000000) << 32) | (us % 1000000), id);
+}
+
+TEST(MvccKvsTest, GetAtTest) {
+    MvccKvs kvs;
+    std::pair<Timestamp, std::string> val;
+
+    kvs.Put("test1", "abc", Timestamp(10));
+    EXPECT_TRUE(kvs.Get("test1", &val));
+    EXPECT_EQ(val.second, "abc");
+    EXPECT_EQ(Timestamp(10), val.first);
+
+    kvs.Put("test2", "def", Timestamp(10));
+    EXPECT_TRUE(kvs.Get("test2", &val));
+    EXPECT_EQ(val.second, "def");
+    EXPECT_EQ(Timestamp(10), val.first);
+
+    kvs.Put("test1", "xyz", Timestamp(11));
+    EXPECT_TRUE(kvs.Get("test1", &val));
+    EXPECT_EQ(val.second, "xyz");
+    EXPECT_EQ(Timestamp(11), val.first);
+
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(10), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "abc");
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(20), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "xyz");
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(9), &val), MvccKvs::VERSION_ABSENT);
+    EXPECT_EQ(kvs.GetAt("test3", Timestamp(20), &val), MvccKvs::VERSION_ABSENT);
+
+    // Large values, and deletes as of a timestamp.
+    kvs.Put("test1", std::string(10000, 'l'), Timestamp(12));
+    kvs.Delete("test1", Timestamp(13));
+    EXPECT_FALSE(kvs.Get("test1", &val));
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(12), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, std::string(10000, 'l'));
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(11), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "xyz");
+    EXPECT_EQ(kvs.GetAt("test1", Timestamp(13), &val), MvccKvs::VERSION_ABSENT);
+
+    // Rewriting a version replaces it.
+    kvs.Put("test2", "ghi", Timestamp(10));
+    EXPECT_EQ(kvs.GetAt("test2", Timestamp(10), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "ghi");
+}
+
+TEST(MvccKvsTest, GarbageCollectionTest) {
+    MvccKvs kvs;
+    std::pair<Timestamp, std::string> val;
+
+    for (int i = 1; i <= 10; ++i) {
+        kvs.Put("key", std::to_string(i), Timestamp(i));
+    }
+
+    // Snapshots keep what they can see.
+    const Timestamp snapshot = kvs.OpenSnapshot(Timestamp(5));
+    EXPECT_EQ(snapshot, Timestamp(5));
+    kvs.AdvanceWatermark(Timestamp(100));
+    EXPECT_EQ(kvs.Watermark(), Timestamp(5));
+    kvs.Put("key", "11", Timestamp(11));
+    EXPECT_EQ(kvs.GetAt("key", snapshot, &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "5");
+    EXPECT_EQ(kvs.GetAt("key", Timestamp(8), &val), MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(val.second, "8");
+
+    // Once it is closed, the next write collects the versions older than
+    // the watermark, and reads of them can no longer tell what was there.
+    kvs.CloseSnapshot(snapshot);
+    EXPECT_EQ(kvs.Watermark(), Timestamp(100));
+    kvs.Put("key", "12", Timestamp(12));
+    EXPECT_EQ(kvs.GetAt("key", Timestamp(8), &val),
+              MvccKvs::VERSION_UNAVAILABLE);
+    EXPECT_TRUE(kvs.Get("key", &val));
+    EXPECT_EQ(val.second, "12");
+
+    // Snapshots cannot go back before the watermark.
+    EXPECT_EQ(kvs.OpenSnapshot(Timestamp(50)), Timestamp(100));
+    kvs.CloseSnapshot(Timestamp(100));
+
+    // Without snapshots, writers move the watermark along themselves, up
+    // to SNAPSHOT_RETENTION_US behind what they write; a write every
+    // millisecond spans three times that.
+    MvccKvs busy;
+    const int writes = 3 * SNAPSHOT_RETENTION_US / 1000;
+    for (int i = 1; i <= writes; ++i) {
+        busy.Put("key", std::string(i % 2 ? 10 : 5000, 'v'), Time(i * 1000));
+    }
+    EXPECT_GT(busy.Watermark(), Time(SNAPSHOT_RETENTION_US));
+    EXPECT_LE(busy.Watermark(), Time(writes * 1000 - SNAPSHOT_RETENTION_US));
+    EXPECT_EQ(busy.GetAt("key", Time(1000), &val),
+              MvccKvs::VERSION_UNAVAILABLE);
+    EXPECT_EQ(busy.GetAt("key", Time(writes * 1000 - SNAPSHOT_RETENTION_US),
+                         &val),
+              MvccKvs::VERSION_FOUND);
+    EXPECT_EQ(busy.GetAt("key", Time(writes * 1000), &val),
+              MvccKvs::VERSION_FOUND);
+}
+
+TEST(MvccKvsTest, ReadAboveWatermarkTest) {
+    MvccKvs kvs;
+    constexpr int num_writers = 2;
+    constexpr int keys_per_writer = 4;
+    constexpr int rounds = 4 * SNAPSHOT_RETENTION_US / 1000;
+    auto key = [](int w, int k) {
+        return std::to_string(w) + "/" + std::to_string(k);
+    };
+    // Round i writes at i milliseconds, with the timestamp as the value.
+    auto round = [](int i) { return Time(i * 1000); };
+    for (int w = 0; w < num_writers; ++w) {
+        for (int k = 0; k < keys_per_writer; ++k) {
+            kvs.Put(key(w, k), std::to_string(round(0).getTimestamp()),
+                    round(0));
+        }
+    }
+
+    // Writers trim their keys as the watermark goes up, while readers
+    // read right above it. A read that the watermark has not passed by
+    // the time it is over must find the newest version below it.
+    std::atomic<int> progress[num_writers] = {};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < num_writers; ++w) {
+        writers.emplace_back([&kvs, &progress, &key, &round, w]() {
+            for (int i = 1; i <= rounds; ++i) {
+                for (int k = 0; k < keys_per_writer; ++k) {
+                    kvs.Put(key(w, k), std::to_string(round(i).getTimestamp()),
+                            round(i));
+                }
+                progress[w] = i;
+            }
+        });
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> checked(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                const Timestamp snapshot(kvs.Watermark().getTimestamp(), 1);
+                // the newest round at or below the snapshot
+                const uint64_t time = snapshot.getTimestamp();
+                const int below = ((time >> 32) * 1000000 +
+                                   (time & 0xffffffff)) / 1000;
+                for (int w = 0; w < num_writers; ++w) {
+                    const int written = std::min(progress[w].load(), below);
+                    std::pair<Timestamp, std::string> vals[keys_per_writer];
+                    bool found[keys_per_writer];
+                    for (int k = 0; k < keys_per_writer; ++k) {
+                        found[k] = kvs.GetAt(key(w, k), snapshot, &vals[k]) ==
+                                   MvccKvs::VERSION_FOUND;
+                    }
+                    if (snapshot < kvs.Watermark()) {
+                        continue;
+                    }
+                    for (int k = 0; k < keys_per_writer; ++k) {
+                        EXPECT_TRUE(found[k]);
+                        EXPECT_LE(vals[k].first, snapshot);
+                        EXPECT_GE(vals[k].first, round(written));
+                        EXPECT_EQ(vals[k].second,
+                                  std::to_string(vals[k].first.getTimestamp()));
+                    }
+                    checked++;
+                }
+            }
+        });
+    }
+
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    EXPECT_GT(kvs.Watermark(), round(rounds / 2));
+    EXPECT_GT(checked.load(), 0);
+}
+
+TEST(MvccKvsTest, SnapshotReadsTest) {
+    MvccKvs kvs;
+    constexpr int num_keys = 8;
+    for (int k = 0; k < num_keys; ++k) {
+        kvs.Put(std::to_string(k), "0", Timestamp(0));
+    }
+
+    // A writer keeps all keys at the same value, one timestamp after the
+    // other, while readers check that their snapshots do not change under
+    // them.
+    std::atomic<int> latest(0);
+    std::atomic<bool> done(false);
+    std::thread writer([&kvs, &latest]() {
+        for (int i = 1; i <= 5000; ++i) {
+            for (int k = 0; k < num_keys; ++k) {
+                kvs.Put(std::to_string(k), std::to_string(i), Timestamp(i));
+            }
+            latest = i;
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&kvs, &latest, &done]() {
+            while (!done) {
+                // The writer advances the watermark to timestamps it has
+                // written at, but a snapshot moved up to the watermark may
+                // not have all its keys yet.
+                const Timestamp requested(latest.load());
+                const Timestamp snapshot = kvs.OpenSnapshot(requested);
+                if (snapshot != requested) {
+                    kvs.CloseSnapshot(snapshot);
+                    continue;
+                }
+                std::pair<Timestamp, std::string> first;
+                ASSERT_TRUE(kvs.GetAt("0", snapshot, &first) ==
+                            MvccKvs::VERSION_FOUND);
+                for (int k = 0; k < num_keys; ++k) {
+                    std::pair<Timestamp, std::string> val;
+                    ASSERT_TRUE(kvs.GetAt(std::to_string(k), snapshot, &val) ==
+                                MvccKvs::VERSION_FOUND);
+                    EXPECT_EQ(val, first);
+                }
+                kvs.CloseSnapshot(snapshot);
+            }
+        });
+    }
+
+    writer.join();
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+}
+
+}  // namespace
@@ -28,6 +28,8 @@
  *
  **********************************************************************/
 
+#include <atomic>
+#include <map>
 #include <random>
 #include <string>
 #include <thread>
@@ -36,6 +38,7 @@
 #include "gtest/gtest.h"
 
 #include "store/common/backend/atomic_kvs.h"
+#include "store/common/backend/mvcc_kvs.h"
 #include "store/common/backend/pthread_kvs.h"
 #include "store/common/backend/thread_safe_kvs.h"
 
@@ -44,7 +47,9 @@ namespace {
 TEST(ThreadSafeKvsTest, SmokeTest) {
     PthreadKvs pthread_kvs;
     AtomicKvs atomic_kvs;
-    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs};
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
 
     constexpr int num_items = 10;
     for (ThreadSafeKvs* kvs : kvss) {
@@ -111,7 +116,9 @@ TEST(ThreadSafeKvsTest, SmokeTest) {
 TEST(ThreadSafeKvsTest, ReadAndWriteTest) {
     PthreadKvs pthread_kvs;
     AtomicKvs atomic_kvs;
-    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs};
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
 
     constexpr int num_items = 10;
     for (ThreadSafeKvs* kvs : kvss) {
@@ -181,4 +188,487 @@ TEST(ThreadSafeKvsTest, ReadAndWriteTest) {
     }
 }
 
+TEST(ThreadSafeKvsTest, VariableLengthValuesTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    // Empty, inline, binary and out of line values, growing and shrinking.
+    const std::string binary("a\0b\0c", 5);
+    const std::vector<std::string> values = {
+        "", "x", binary, std::string(100, 'y'), std::string(5000, 'z'),
+        std::string(200, 'w'), "v"};
+    for (ThreadSafeKvs* kvs : kvss) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            kvs->Put("key", values[i], Timestamp(0, i));
+            std::pair<Timestamp, std::string> timestamped_value;
+            ASSERT_TRUE(kvs->Get("key", &timestamped_value));
+            EXPECT_EQ(timestamped_value.first, Timestamp(0, i));
+            EXPECT_EQ(timestamped_value.second, values[i]);
+        }
+
+        // Readers never see a mix of two values.
+        const std::string small(10, 's');
+        const std::string large(3000, 'l');
+        kvs->Put("race", small, Timestamp(0, 0));
+        std::thread writer([kvs, &small, &large]() {
+            for (int i = 1; i < 2000; ++i) {
+                kvs->Put("race", i % 2 ? large : small, Timestamp(0, i));
+            }
+        });
+        for (int i = 0; i < 2000; ++i) {
+            std::pair<Timestamp, std::string> timestamped_value;
+            kvs->Get("race", &timestamped_value);
+            EXPECT_TRUE(timestamped_value.second == small ||
+                        timestamped_value.second == large);
+        }
+        writer.join();
+    }
+}
+
+TEST(ThreadSafeKvsTest, MultiGetTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    for (ThreadSafeKvs* kvs : kvss) {
+        kvs->Put("a", "1", Timestamp(1, 0));
+        kvs->Put("b", std::string(3000, 'b'), Timestamp(2, 0));
+
+        // Missing keys are reported without disturbing the others.
+        std::vector<std::pair<Timestamp, std::string>> values;
+        std::vector<bool> found;
+        kvs->MultiGet({"b", "missing", "a", "b"}, &values, &found);
+        ASSERT_EQ(values.size(), 4);
+        ASSERT_EQ(found.size(), 4);
+        EXPECT_EQ(found, std::vector<bool>({true, false, true, true}));
+        EXPECT_EQ(values[0].first, Timestamp(2, 0));
+        EXPECT_EQ(values[0].second, std::string(3000, 'b'));
+        EXPECT_EQ(values[2].first, Timestamp(1, 0));
+        EXPECT_EQ(values[2].second, "1");
+        EXPECT_EQ(values[3].second, std::string(3000, 'b'));
+
+        kvs->MultiGet({}, &values, &found);
+        EXPECT_TRUE(values.empty());
+        EXPECT_TRUE(found.empty());
+    }
+}
+
+TEST(ThreadSafeKvsTest, ManyKeysTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    AtomicKvs reserved_atomic_kvs;
+    reserved_atomic_kvs.Reserve(20000);
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &reserved_atomic_kvs, &mvcc_kvs};
+
+    // Enough keys to grow the index several times, some of them too long
+    // to share a cache line with their entry.
+    auto key = [](int i) {
+        return (i % 10 == 0 ? std::string(100, 'k') : std::string("k")) +
+               std::to_string(i);
+    };
+    for (ThreadSafeKvs* kvs : kvss) {
+        for (int i = 0; i < 20000; ++i) {
+            kvs->Put(key(i), std::to_string(i), Timestamp(i, 0));
+        }
+        for (int i = 0; i < 20000; ++i) {
+            std::pair<Timestamp, std::string> timestamped_value;
+            ASSERT_TRUE(kvs->Get(key(i), &timestamped_value));
+            EXPECT_EQ(timestamped_value.first, Timestamp(i, 0));
+            EXPECT_EQ(timestamped_value.second, std::to_string(i));
+        }
+        std::pair<Timestamp, std::string> timestamped_value;
+        EXPECT_FALSE(kvs->Get(key(20000), &timestamped_value));
+        EXPECT_FALSE(kvs->Get("", &timestamped_value));
+    }
+}
+
+TEST(ThreadSafeKvsTest, LargeValuesTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    // Values from inline up to 64 KB, each filled with a byte that tells
+    // its size, so that readers can spot torn or freed values.
+    const std::vector<size_t> sizes = {10, 64, 1000, 4096, 20000, 65536};
+    auto value = [&sizes](size_t i) {
+        return std::string(sizes[i % sizes.size()], 'a' + i % sizes.size());
+    };
+    auto valid = [&sizes](const std::string& v) {
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if (v.size() == sizes[i]) {
+                return v == std::string(sizes[i], 'a' + i);
+            }
+        }
+        return false;
+    };
+
+    constexpr int num_keys = 4;
+    for (ThreadSafeKvs* kvs : kvss) {
+        for (int k = 0; k < num_keys; ++k) {
+            kvs->Put(std::to_string(k), value(0), Timestamp(0, 0));
+        }
+
+        // Writers come and go, so that their epoch slots are reused.
+        std::atomic<bool> done(false);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 2; ++r) {
+            readers.emplace_back([kvs, &done, &valid]() {
+                std::vector<std::string> keys;
+                for (int k = 0; k < num_keys; ++k) {
+                    keys.push_back(std::to_string(k));
+                }
+                std::vector<std::pair<Timestamp, std::string>> values;
+                std::vector<bool> found;
+                while (!done) {
+                    kvs->MultiGet(keys, &values, &found);
+                    for (const auto& timestamped_value : values) {
+                        EXPECT_TRUE(valid(timestamped_value.second));
+                    }
+                }
+            });
+        }
+        for (int round = 0; round < 5; ++round) {
+            std::vector<std::thread> writers;
+            for (int w = 0; w < 2; ++w) {
+                writers.emplace_back([kvs, round, w, &value]() {
+                    for (int i = 0; i < 300; ++i) {
+                        kvs->Put(std::to_string(i % num_keys),
+                                 value(i + w + round),
+                                 Timestamp(round * 1000 + i, w));
+                    }
+                });
+            }
+            for (std::thread& writer : writers) {
+                writer.join();
+            }
+        }
+        done = true;
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        for (int k = 0; k < num_keys; ++k) {
+            std::pair<Timestamp, std::string> timestamped_value;
+            ASSERT_TRUE(kvs->Get(std::to_string(k), &timestamped_value));
+            EXPECT_TRUE(valid(timestamped_value.second));
+        }
+    }
+}
+
+TEST(ThreadSafeKvsTest, DeleteTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    for (ThreadSafeKvs* kvs : kvss) {
+        std::pair<Timestamp, std::string> timestamped_value;
+        kvs->Put("small", "1", Timestamp(1, 0));
+        kvs->Put("large", std::string(3000, 'l'), Timestamp(1, 0));
+
+        // Deletes hide the key from readers.
+        kvs->Delete("small", Timestamp(2, 0));
+        kvs->Delete("large", Timestamp(2, 0));
+        EXPECT_FALSE(kvs->Get("small", &timestamped_value));
+        EXPECT_FALSE(kvs->TryGet("large", &timestamped_value));
+        std::vector<std::pair<Timestamp, std::string>> values;
+        std::vector<bool> found;
+        kvs->MultiGet({"small", "large"}, &values, &found);
+        EXPECT_EQ(found, std::vector<bool>({false, false}));
+
+        // Older writes lose to the tombstone, newer ones bring the key back.
+        kvs->Put("small", "old", Timestamp(1, 5));
+        EXPECT_FALSE(kvs->Get("small", &timestamped_value));
+        kvs->Put("large", std::string(2000, 'n'), Timestamp(3, 0));
+        ASSERT_TRUE(kvs->Get("large", &timestamped_value));
+        EXPECT_EQ(timestamped_value.first, Timestamp(3, 0));
+        EXPECT_EQ(timestamped_value.second, std::string(2000, 'n'));
+
+        // Deleting a missing key keeps older writes out too.
+        kvs->Delete("never", Timestamp(5, 0));
+        kvs->Put("never", "x", Timestamp(4, 0));
+        EXPECT_FALSE(kvs->Get("never", &timestamped_value));
+
+        // Keys that were only locked read as missing.
+        Timestamp timestamp;
+        kvs->WriteLock("locked", &timestamp);
+        EXPECT_EQ(timestamp, Timestamp());
+        EXPECT_FALSE(kvs->GetWithLock("locked", &timestamped_value));
+        kvs->DeleteWithLock("locked", Timestamp(1, 0));
+        kvs->WriteUnlock("locked");
+        EXPECT_FALSE(kvs->Get("locked", &timestamped_value));
+        EXPECT_FALSE(kvs->IsWriteLocked("unknown"));
+    }
+}
+
+TEST(ThreadSafeKvsTest, ConcurrentInsertTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    // Writers add and delete keys, growing the index several times, while
+    // readers check that every key they find has the value it was added
+    // with.
+    constexpr int num_writers = 3;
+    constexpr int keys_per_writer = 5000;
+    auto key = [](int w, int i) {
+        return std::to_string(w) + "/" + std::to_string(i);
+    };
+    for (ThreadSafeKvs* kvs : kvss) {
+        kvs->Put(key(0, 0), key(0, 0), Timestamp(1, 0));
+
+        std::atomic<bool> done(false);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 2; ++r) {
+            readers.emplace_back([kvs, &done, &key]() {
+                std::mt19937 gen(42);
+                std::uniform_int_distribution<> writer(0, num_writers - 1);
+                std::uniform_int_distribution<> item(0, keys_per_writer - 1);
+                while (!done) {
+                    const std::string k = key(writer(gen), item(gen));
+                    std::pair<Timestamp, std::string> timestamped_value;
+                    if (kvs->Get(k, &timestamped_value)) {
+                        EXPECT_EQ(timestamped_value.second, k);
+                    }
+                }
+            });
+        }
+
+        std::vector<std::thread> writers;
+        for (int w = 0; w < num_writers; ++w) {
+            writers.emplace_back([kvs, w, &key]() {
+                for (int i = 0; i < keys_per_writer; ++i) {
+                    kvs->Put(key(w, i), key(w, i), Timestamp(1, 0));
+                    if (i % 3 == 0) {
+                        kvs->Delete(key(w, i), Timestamp(2, 0));
+                    }
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        done = true;
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        for (int w = 0; w < num_writers; ++w) {
+            for (int i = 0; i < keys_per_writer; ++i) {
+                std::pair<Timestamp, std::string> timestamped_value;
+                EXPECT_EQ(kvs->Get(key(w, i), &timestamped_value), i % 3 != 0);
+            }
+        }
+    }
+}
+
+TEST(ThreadSafeKvsTest, BulkLoadTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    std::vector<ThreadSafeKvs*> kvss = {&pthread_kvs, &atomic_kvs,
+                                        &mvcc_kvs};
+
+    // Loaders fill several item chunks each and grow the index well past
+    // its size, while a reader looks up a key that was there before.
+    constexpr int num_loaders = 3;
+    constexpr int keys_per_loader = 20000;
+    auto key = [](int t, int i) {
+        return std::to_string(t) + "/" + std::to_string(i);
+    };
+    for (ThreadSafeKvs* kvs : kvss) {
+        kvs->Put("before", "before", Timestamp(1, 0));
+
+        std::atomic<bool> done(false);
+        std::thread reader([kvs, &done]() {
+            while (!done) {
+                std::pair<Timestamp, std::string> timestamped_value;
+                EXPECT_TRUE(kvs->Get("before", &timestamped_value));
+            }
+        });
+
+        kvs->StartLoad(num_loaders);
+        std::vector<std::thread> loaders;
+        for (int t = 0; t < num_loaders; ++t) {
+            loaders.emplace_back([kvs, t, &key]() {
+                for (int i = 0; i < keys_per_loader; ++i) {
+                    kvs->LoadPut(t, key(t, i), key(t, i), Timestamp(2, i));
+                }
+            });
+        }
+        for (std::thread& loader : loaders) {
+            loader.join();
+        }
+        kvs->FinishLoad();
+        done = true;
+        reader.join();
+
+        for (int t = 0; t < num_loaders; ++t) {
+            for (int i = 0; i < keys_per_loader; ++i) {
+                std::pair<Timestamp, std::string> timestamped_value;
+                EXPECT_TRUE(kvs->Get(key(t, i), &timestamped_value));
+                EXPECT_EQ(timestamped_value.first, Timestamp(2, i));
+                EXPECT_EQ(timestamped_value.second, key(t, i));
+            }
+        }
+
+        // Keys added after the load go on in the loaded chunks, and a
+        // checkpoint walks all of them.
+        kvs->Put("after", "after", Timestamp(3, 0));
+        std::pair<Timestamp, std::string> timestamped_value;
+        EXPECT_TRUE(kvs->Get("after", &timestamped_value));
+        if (kvs->StartCheckpoint(Timestamp(3, 0))) {
+            size_t count = 0;
+            kvs->FinishCheckpoint([&count](std::string_view,
+                                           const std::string&,
+                                           const Timestamp&) { count++; });
+            EXPECT_EQ(count, 2 + num_loaders * keys_per_loader);
+        }
+    }
+}
+
+TEST(ThreadSafeKvsTest, CheckpointTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+    EXPECT_FALSE(pthread_kvs.SupportsCheckpoints());
+    EXPECT_FALSE(pthread_kvs.StartCheckpoint(Timestamp(1, 0)));
+
+    typedef std::map<std::string, std::pair<Timestamp, std::string>>
+        Checkpoint;
+    for (ThreadSafeKvs* kvs : std::vector<ThreadSafeKvs*>{&atomic_kvs,
+                                                          &mvcc_kvs}) {
+        EXPECT_TRUE(kvs->SupportsCheckpoints());
+        kvs->Put("a", "a1", Timestamp(1, 0));
+        kvs->Put("b", std::string(2000, 'b'), Timestamp(2, 0));
+        kvs->Put("c", "c3", Timestamp(3, 0));
+        kvs->Put("d", "d4", Timestamp(4, 0));
+        kvs->Delete("d", Timestamp(5, 0));
+        ASSERT_TRUE(kvs->StartCheckpoint(Timestamp(5, 0)));
+
+        // Writes above the cut do not show, those at or below it may.
+        kvs->Put("a", "a6", Timestamp(6, 0));
+        kvs->Put("a", "a7", Timestamp(7, 0));
+        kvs->Put("b", "b6", Timestamp(6, 0));
+        kvs->Delete("c", Timestamp(6, 0));
+        kvs->Put("d", "d6", Timestamp(6, 0));
+        kvs->Put("e", "e6", Timestamp(6, 0));
+        Timestamp timestamp;
+        kvs->WriteLock("c", &timestamp);
+        kvs->PutWithLock("c", "c8", Timestamp(8, 0));
+        kvs->WriteUnlock("c");
+
+        Checkpoint checkpoint;
+        kvs->FinishCheckpoint([&checkpoint](std::string_view key,
+                                            const std::string& value,
+                                            const Timestamp& timestamp) {
+            checkpoint[std::string(key)] = {timestamp, value};
+        });
+        EXPECT_EQ(checkpoint,
+                  Checkpoint({{"a", {Timestamp(1, 0), "a1"}},
+                              {"b", {Timestamp(2, 0), std::string(2000, 'b')}},
+                              {"c", {Timestamp(3, 0), "c3"}}}));
+
+        // A later checkpoint sees the writes of the last one.
+        ASSERT_TRUE(kvs->StartCheckpoint(Timestamp(8, 0)));
+        kvs->Put("a", "a9", Timestamp(9, 0));
+        checkpoint.clear();
+        kvs->FinishCheckpoint([&checkpoint](std::string_view key,
+                                            const std::string& value,
+                                            const Timestamp& timestamp) {
+            checkpoint[std::string(key)] = {timestamp, value};
+        });
+        EXPECT_EQ(checkpoint,
+                  Checkpoint({{"a", {Timestamp(7, 0), "a7"}},
+                              {"b", {Timestamp(6, 0), "b6"}},
+                              {"c", {Timestamp(8, 0), "c8"}},
+                              {"d", {Timestamp(6, 0), "d6"}},
+                              {"e", {Timestamp(6, 0), "e6"}}}));
+    }
+}
+
+TEST(ThreadSafeKvsTest, ConcurrentCheckpointTest) {
+    AtomicKvs atomic_kvs;
+    MvccKvs mvcc_kvs;
+
+    // Writers overwrite and add keys, with timestamps above the cut,
+    // while the checkpoint runs; it must still see every key with the
+    // value it had at the cut.
+    constexpr int num_keys = 20000;
+    constexpr int num_writers = 3;
+    for (ThreadSafeKvs* kvs : std::vector<ThreadSafeKvs*>{&atomic_kvs,
+                                                          &mvcc_kvs}) {
+        for (int i = 0; i < num_keys; ++i) {
+            kvs->Put(std::to_string(i), std::to_string(i), Timestamp(1, 0));
+        }
+        ASSERT_TRUE(kvs->StartCheckpoint(Timestamp(1, 0)));
+
+        std::vector<std::thread> writers;
+        for (int w = 0; w < num_writers; ++w) {
+            writers.emplace_back([kvs, w]() {
+                for (int i = w; i < num_keys; i += num_writers) {
+                    kvs->Put(std::to_string(i), "new", Timestamp(2 + w, 0));
+                    kvs->Put("new" + std::to_string(i), "new",
+                             Timestamp(2, 0));
+                }
+            });
+        }
+
+        int n = 0;
+        kvs->FinishCheckpoint([&n](std::string_view key,
+                                   const std::string& value,
+                                   const Timestamp& timestamp) {
+            EXPECT_EQ(value, key);
+            EXPECT_EQ(timestamp, Timestamp(1, 0));
+            ++n;
+        });
+        EXPECT_EQ(n, num_keys);
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+    }
+}
+
+TEST(ThreadSafeKvsTest, SingleVersionGetAtTest) {
+    PthreadKvs pthread_kvs;
+    AtomicKvs atomic_kvs;
+    for (ThreadSafeKvs* kvs : std::vector<ThreadSafeKvs*>{&pthread_kvs,
+                                                          &atomic_kvs}) {
+        EXPECT_FALSE(kvs->SupportsSnapshots());
+        std::pair<Timestamp, std::string> val;
+        kvs->Put("a", "a1", Timestamp(1, 0));
+        kvs->Put("a", "a2", Timestamp(2, 0));
+        kvs->Put("b", "b1", Timestamp(1, 0));
+        kvs->Delete("b", Timestamp(2, 0));
+
+        // Only the newest version is there, and no one knows when a
+        // missing key went missing.
+        EXPECT_EQ(kvs->GetAt("a", Timestamp(3, 0), &val),
+                  ThreadSafeKvs::VERSION_FOUND);
+        EXPECT_EQ(val.second, "a2");
+        EXPECT_EQ(kvs->GetAt("a", Timestamp(1, 0), &val),
+                  ThreadSafeKvs::VERSION_UNAVAILABLE);
+        EXPECT_EQ(kvs->GetAt("b", Timestamp(3, 0), &val),
+                  ThreadSafeKvs::VERSION_UNAVAILABLE);
+        EXPECT_EQ(kvs->GetAt("c", Timestamp(3, 0), &val),
+                  ThreadSafeKvs::VERSION_UNAVAILABLE);
+    }
+    EXPECT_TRUE(MvccKvs().SupportsSnapshots());
+    EXPECT_FALSE(KvsSupportsSnapshots("pthread"));
+    EXPECT_FALSE(KvsSupportsSnapshots("atomic"));
+    EXPECT_TRUE(KvsSupportsSnapshots("mvcc"));
+}
+
 }  // namespace
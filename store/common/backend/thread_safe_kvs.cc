@@ -0,0 +1,36 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/backend/thread_safe_kvs.cc:
+ *   Choice of the ThreadSafeKvs backend
+ *
+ **********************************************************************/
+
+#include "store/common/backend/thread_safe_kvs.h"
+
+#include "lib/message.h"
+#include "store/common/backend/atomic_kvs.h"
+#include "store/common/backend/mvcc_kvs.h"
+#include "store/common/backend/pthread_kvs.h"
+
+ThreadSafeKvs* NewThreadSafeKvs(const std::string& name) {
+    if (name == "pthread") {
+        return new PthreadKvs();
+    } else if (name == "atomic") {
+        return new AtomicKvs();
+    } else if (name == "mvcc") {
+        return new MvccKvs();
+    }
+    Panic("Unknown key-value store: %s", name.c_str());
+    return nullptr;
+}
+
+bool KvsSupportsSnapshots(const std::string& name) {
+    if (name == "pthread" || name == "atomic") {
+        return false;
+    } else if (name == "mvcc") {
+        return true;
+    }
+    Panic("Unknown key-value store: %s", name.c_str());
+    return false;
+}
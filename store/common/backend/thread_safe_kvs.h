@@ -31,19 +31,26 @@
 #ifndef _THREAD_SAFE_KVS_H_
 #define _THREAD_SAFE_KVS_H_
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "lib/message.h"
 #include "store/common/timestamp.h"
 
 // A ThreadSafeKvs is a key-value store that can be read from and written to
-// safely by multiple concurrently executing threads. A ThreadSafeKvs is not
-// multi-versioned---it's single-versioned---but all values in the key-value
-// store are annotated with a Timestamp.
+// safely by multiple concurrently executing threads. All values in the
+// key-value store are annotated with a Timestamp. Most ThreadSafeKvs are
+// single-versioned; MvccKvs also keeps older versions for GetAt.
 //
-// NOTE that this class makes a vital assumption that all keys are initially
-// loaded by calling Put on a single thread. In other words, all concurrent
-// Puts must be to existing keys.
+// Keys can be added and deleted while the store is being read and written
+// by other threads. Put, WriteLock and TryWriteLock add a key that is not
+// there yet. Delete leaves a tombstone that keeps the timestamp of the
+// delete: Get, MultiGet and TryGet report the key as missing, a Put with a
+// smaller timestamp does not bring it back, and one with a larger
+// timestamp does.
 class ThreadSafeKvs {
 public:
     virtual ~ThreadSafeKvs() = default;
@@ -54,9 +61,47 @@ public:
     virtual bool Get(const std::string& key,
                      std::pair<Timestamp, std::string>* timestamped_value) = 0;
 
+    // What GetAt finds of a key as of a timestamp: its version then, no
+    // version (the key did not exist or was deleted), or nothing it can
+    // tell, because the version it would need is gone.
+    enum VersionStatus { VERSION_FOUND, VERSION_ABSENT, VERSION_UNAVAILABLE };
+
+    // Get the newest version of a key with a timestamp smaller than or equal
+    // to `timestamp`. Single-versioned stores only have the newest version
+    // of every key, so they find nothing they can tell if it is newer than
+    // `timestamp`, or if the key is missing, since they do not know when
+    // it was deleted. SupportsSnapshots tells whether a store keeps older
+    // versions.
+    virtual VersionStatus GetAt(
+        const std::string& key, const Timestamp& timestamp,
+        std::pair<Timestamp, std::string>* timestamped_value) {
+        if (Get(key, timestamped_value) &&
+            timestamped_value->first <= timestamp) {
+            return VERSION_FOUND;
+        }
+        return VERSION_UNAVAILABLE;
+    }
+    virtual bool SupportsSnapshots() const { return false; }
+
+    // Get the timestamps and values of several keys at once, as if by
+    // calling Get on each of them; found[i] is whether keys[i] exists.
+    // Implementations may overlap the lookups of the different keys.
+    virtual void MultiGet(
+        const std::vector<std::string>& keys,
+        std::vector<std::pair<Timestamp, std::string>>* timestamped_values,
+        std::vector<bool>* found) {
+        timestamped_values->resize(keys.size());
+        found->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            (*found)[i] = Get(keys[i], &(*timestamped_values)[i]);
+        }
+    }
+
     // Get the timestamp and value for a particular key, assuming a write lock
-    // has already been acquired on the key. This call is non-blocking.
-    virtual void GetWithLock(
+    // has already been acquired on the key. Returns false if the key is
+    // deleted, or was only just added by the lock. This call is
+    // non-blocking.
+    virtual bool GetWithLock(
         const std::string& key,
         std::pair<Timestamp, std::string>* timestamped_value) = 0;
 
@@ -83,6 +128,12 @@ public:
     virtual void PutWithLock(const std::string& key, const std::string& value,
                              const Timestamp& timestamp) = 0;
 
+    // Delete a key, if `timestamp` is larger than or equal to the current
+    // timestamp of the key, like PutWithLock writes a value. Before
+    // DeleteWithLock is called, a write lock must be obtained on the key.
+    virtual void DeleteWithLock(const std::string& key,
+                                const Timestamp& timestamp) = 0;
+
     // Unlocks a lock obtained with WriteLock. This call is non-blocking.
     virtual void WriteUnlock(const std::string& key) = 0;
 
@@ -94,6 +145,51 @@ public:
     // PutWithLock, and WriteUnlock.
     virtual void Put(const std::string& key, const std::string& value,
                      const Timestamp& timestamp) = 0;
+
+    // Delete a key at a timestamp. Delete is a blocking call and is more or
+    // less equivalent to calling WriteLock, DeleteWithLock, and WriteUnlock.
+    virtual void Delete(const std::string& key,
+                        const Timestamp& timestamp) = 0;
+
+    // Makes room for n keys ahead of loading them.
+    virtual void Reserve(size_t n) {}
+
+    // Bulk loading of keys that are not in the store yet and are all
+    // different. After StartLoad, nthreads threads call LoadPut at once,
+    // each with its own thread number below nthreads; the keys show up
+    // in the store when FinishLoad returns. Nothing else may write to
+    // the store in between. Stores without a bulk path just Put.
+    virtual void StartLoad(int nthreads) {}
+    virtual void LoadPut(int thread, const std::string& key,
+                         const std::string& value, const Timestamp& timestamp) {
+        Put(key, value, timestamp);
+    }
+    virtual void FinishLoad() {}
+
+    // Checkpoints copy the store as of a cut timestamp while it keeps
+    // being read and written. StartCheckpoint freezes the versions at or
+    // before cut that later writes replace; no writes may run
+    // concurrently with it, and cut must not be below the timestamp of
+    // any write made before it. It returns false if the store does not
+    // support checkpoints, which SupportsCheckpoints tells ahead of
+    // time. FinishCheckpoint then calls f on the newest version at or
+    // before cut of every key, leaving out deleted keys, and ends the
+    // checkpoint. One checkpoint runs at a time.
+    typedef std::function<void(std::string_view key, const std::string& value,
+                               const Timestamp& timestamp)> CheckpointFunc;
+    virtual bool SupportsCheckpoints() const { return false; }
+    virtual bool StartCheckpoint(const Timestamp& cut) { return false; }
+    virtual void FinishCheckpoint(const CheckpointFunc& f) {
+        Panic("Checkpoints are not supported by this store");
+    }
 };
 
+// Returns a new, empty ThreadSafeKvs of the kind that name stands for:
+// "pthread" for PthreadKvs, "atomic" for AtomicKvs or "mvcc" for MvccKvs.
+ThreadSafeKvs* NewThreadSafeKvs(const std::string& name);
+
+// Whether the stores NewThreadSafeKvs(name) returns support snapshots
+// (see ThreadSafeKvs::SupportsSnapshots), without making one.
+bool KvsSupportsSnapshots(const std::string& name);
+
 #endif  //  _THREAD_SAFE_KVS_H_
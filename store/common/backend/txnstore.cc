@@ -68,14 +68,14 @@ TxnStore::Put(txnid_t txn_id, const string &key, const string &value)
 }
 
 int
-TxnStore::Prepare(txnid_t txn_id, const Transaction &txn)
+TxnStore::Prepare(txnid_t txn_id, const TransactionView &txn)
 {
     Panic("Unimplemented PREPARE");
     return 0;
 }
 
 int
-TxnStore::Prepare(txnid_t txn_id, const Transaction &txn,
+TxnStore::Prepare(txnid_t txn_id, const TransactionView &txn,
     const Timestamp &timestamp, Timestamp &proposed)
 {
     Panic("Unimplemented PREPARE");
@@ -83,13 +83,13 @@ TxnStore::Prepare(txnid_t txn_id, const Transaction &txn,
 }
 
 void
-TxnStore::Commit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn)
+TxnStore::Commit(txnid_t txn_id, const Timestamp &timestamp, const TransactionView &txn)
 {
     Panic("Unimplemented COMMIT");
 }
 
 void
-TxnStore::Abort(txnid_t txn_id, const Transaction &txn)
+TxnStore::Abort(txnid_t txn_id, const TransactionView &txn)
 {
     Panic("Unimplemented ABORT");
 }
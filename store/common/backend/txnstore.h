@@ -38,6 +38,7 @@
 #include "lib/message.h"
 #include "store/common/timestamp.h"
 #include "store/common/transaction.h"
+#include "store/common/transactionview.h"
 
 class TxnStore
 {
@@ -61,16 +62,16 @@ public:
         const std::string &value);
 
     // check whether we can commit this transaction (and lock the read/write set)
-    virtual int Prepare(txnid_t txn_id, const Transaction &txn);
+    virtual int Prepare(txnid_t txn_id, const TransactionView &txn);
 
-    virtual int Prepare(txnid_t txn_id, const Transaction &txn,
+    virtual int Prepare(txnid_t txn_id, const TransactionView &txn,
         const Timestamp &timestamp, Timestamp &proposed);
 
     // commit the transaction
-    virtual void Commit(txnid_t txn_id, const Timestamp &timestamp = Timestamp(), const Transaction &txn = Transaction());
+    virtual void Commit(txnid_t txn_id, const Timestamp &timestamp = Timestamp(), const TransactionView &txn = TransactionView());
 
     // abort a running transaction
-    virtual void Abort(txnid_t txn_id, const Transaction &txn = Transaction());
+    virtual void Abort(txnid_t txn_id, const TransactionView &txn = TransactionView());
 
     // load keys
     virtual void Load(const std::string &key, const std::string &value,
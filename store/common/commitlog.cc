@@ -0,0 +1,473 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/commitlog.cc:
+ *   Write-ahead log of committed writes, with group commit
+ *
+ **********************************************************************/
+
+#include "store/common/commitlog.h"
+
+#include "lib/assert.h"
+#include "lib/hash.h"
+#include "lib/message.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static uint64_t
+AlignUp(uint64_t n, uint64_t alignment)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+static string
+ReadLogFile(int fd, const string &path)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        PPanic("Failed to stat %s", path.c_str());
+    }
+    string data(st.st_size, '\0');
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = pread(fd, &data[done], data.size() - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            PPanic("Failed to read %s", path.c_str());
+        }
+        done += n;
+    }
+    return data;
+}
+
+// Size of the record at the start of data, or 0 if there is no whole,
+// valid record there
+static size_t
+RecordSize(const char *data, size_t left)
+{
+    wal_record_t record;
+    if (left < sizeof(record)) {
+        return 0;
+    }
+    memcpy(&record, data, sizeof(record));
+    if (record.size < sizeof(record) || record.size > left ||
+        record.size % 8 != 0) {
+        return 0;
+    }
+    const size_t skip = offsetof(wal_record_t, timestamp);
+    if (::hash(data + skip, record.size - skip, 0) != record.checksum) {
+        return 0;
+    }
+
+    // the writes must fit in the record
+    size_t offset = sizeof(record);
+    for (uint32_t i = 0; i < record.nr_writes; i++) {
+        wal_write_t write;
+        if (record.size - offset < sizeof(write)) {
+            return 0;
+        }
+        memcpy(&write, data + offset, sizeof(write));
+        offset += sizeof(write);
+        if ((uint64_t)write.key_len + write.value_len > record.size - offset) {
+            return 0;
+        }
+        offset += write.key_len + write.value_len;
+    }
+    return record.size;
+}
+
+// Length of the valid records at the start of data
+static size_t
+ValidLength(const string &data)
+{
+    size_t offset = 0;
+    size_t size;
+    while ((size = RecordSize(data.data() + offset,
+                              data.size() - offset)) > 0) {
+        offset += size;
+    }
+    return offset;
+}
+
+struct LogFile {
+    string name;
+    bool rotated;
+    uint64_t rotation;
+};
+
+// The log files in dir: wal.<log>, and wal.<log>.<rotation> once rotated
+static vector<LogFile>
+ListLogFiles(const string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        PPanic("Failed to open %s", dir.c_str());
+    }
+    vector<LogFile> files;
+    struct dirent *de;
+    while ((de = readdir(d)) != nullptr) {
+        const char *name = de->d_name;
+        if (strncmp(name, "wal.", 4) != 0) {
+            continue;
+        }
+        const char *log = name + 4;
+        const size_t logLen = strspn(log, "0123456789");
+        if (logLen == 0) {
+            continue;
+        }
+        if (log[logLen] == '\0') {
+            files.push_back(LogFile{name, false, 0});
+            continue;
+        }
+        const char *rotation = log + logLen + 1;
+        if (log[logLen] == '.' && rotation[0] != '\0' &&
+            strspn(rotation, "0123456789") == strlen(rotation)) {
+            files.push_back(LogFile{name, true, strtoull(rotation, nullptr, 10)});
+        }
+    }
+    closedir(d);
+    return files;
+}
+
+string
+CommitLog::LogPath(int i) const
+{
+    return dir + "/wal." + to_string(i);
+}
+
+void
+CommitLog::OpenLog(Log &log, int i)
+{
+    const string path = LogPath(i);
+    log.fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (log.fd < 0) {
+        PPanic("Failed to open %s", path.c_str());
+    }
+
+    // new records go after the last valid one
+    const string data = ReadLogFile(log.fd, path);
+    const size_t valid = ValidLength(data);
+    if (valid < data.size()) {
+        Warning("Dropping %lu torn bytes at the end of %s",
+                data.size() - valid, path.c_str());
+        if (ftruncate(log.fd, valid) < 0) {
+            PPanic("Failed to truncate %s", path.c_str());
+        }
+    }
+    log.appended = valid;
+    log.durable = valid;
+}
+
+void
+CommitLog::SyncDir() const
+{
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) < 0) {
+        PPanic("Failed to sync %s", dir.c_str());
+    }
+    close(fd);
+}
+
+CommitLog::CommitLog(const string &dir, int nlogs, bool sync,
+                     chrono::microseconds interval)
+    : dir(dir), sync(sync), interval(interval), rotation(0), pending(false),
+      stopping(false)
+{
+    ASSERT(nlogs > 0);
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        PPanic("Failed to create %s", dir.c_str());
+    }
+
+    // files rotated before a crash stay until the next checkpoint
+    for (const LogFile &file : ListLogFiles(dir)) {
+        if (file.rotated) {
+            rotation = max(rotation, file.rotation + 1);
+        }
+    }
+
+    for (int i = 0; i < nlogs; i++) {
+        unique_ptr<Log> log(new Log());
+        OpenLog(*log, i);
+        logs.push_back(move(log));
+    }
+
+    flusher = thread(&CommitLog::FlushLoop, this);
+}
+
+CommitLog::~CommitLog()
+{
+    {
+        lock_guard<mutex> lock(flushMutex);
+        stopping = true;
+    }
+    flushCv.notify_one();
+    flusher.join();
+    for (auto &log : logs) {
+        close(log->fd);
+    }
+}
+
+CommitLog::Log &
+CommitLog::ThisThreadLog()
+{
+    static atomic<unsigned> nextThread(0);
+    static thread_local unsigned thisThread = nextThread++;
+    return *logs[thisThread % logs.size()];
+}
+
+void
+CommitLog::Append(const Timestamp &timestamp, const TransactionView &txn)
+{
+    Log &log = ThisThreadLog();
+    uint64_t end;
+    {
+        lock_guard<mutex> lock(log.mutex);
+        string &buffer = log.buffer;
+        const size_t start = buffer.size();
+
+        wal_record_t record;
+        record.checksum = 0;
+        record.timestamp = timestamp.getTimestamp();
+        record.id = timestamp.getID();
+        record.nr_writes = 0;
+        record.pad = 0;
+        buffer.append(sizeof(record), '\0');
+        for (const auto &write : txn.getWrites()) {
+            wal_write_t w;
+            w.key_len = write.key.size();
+            w.value_len = write.value.size();
+            buffer.append(reinterpret_cast<const char *>(&w), sizeof(w));
+            buffer.append(write.key);
+            buffer.append(write.value);
+            record.nr_writes++;
+        }
+        buffer.append(AlignUp(buffer.size() - start, 8) -
+                      (buffer.size() - start), '\0');
+        record.size = buffer.size() - start;
+        memcpy(&buffer[start], &record, sizeof(record));
+
+        const size_t skip = offsetof(wal_record_t, timestamp);
+        record.checksum = ::hash(&buffer[start + skip], record.size - skip, 0);
+        memcpy(&buffer[start + offsetof(wal_record_t, checksum)],
+               &record.checksum, sizeof(record.checksum));
+
+        log.appended += record.size;
+        end = log.appended;
+        log.newest = max(log.newest, timestamp);
+    }
+
+    if (sync) {
+        {
+            lock_guard<mutex> lock(flushMutex);
+            pending = true;
+        }
+        flushCv.notify_one();
+        WaitDurable(log, end);
+    }
+}
+
+void
+CommitLog::Flush()
+{
+    vector<uint64_t> ends;
+    for (auto &log : logs) {
+        lock_guard<mutex> lock(log->mutex);
+        ends.push_back(log->appended);
+    }
+    {
+        lock_guard<mutex> lock(flushMutex);
+        pending = true;
+    }
+    flushCv.notify_one();
+    for (size_t i = 0; i < logs.size(); i++) {
+        WaitDurable(*logs[i], ends[i]);
+    }
+}
+
+void
+CommitLog::WaitDurable(const Log &log, uint64_t offset)
+{
+    unique_lock<mutex> lock(flushMutex);
+    durableCv.wait(lock, [&log, offset]() {
+        return log.durable.load(memory_order_acquire) >= offset;
+    });
+}
+
+void
+CommitLog::FlushLoop()
+{
+    vector<string> batches(logs.size());
+    unique_lock<mutex> lock(flushMutex);
+    while (true) {
+        if (sync) {
+            flushCv.wait(lock, [this]() { return pending || stopping; });
+        } else {
+            flushCv.wait_for(lock, interval,
+                             [this]() { return pending || stopping; });
+        }
+        // what is appended before stopping goes out in this last round
+        const bool stop = stopping;
+        pending = false;
+
+        // the records appended during this round wait for the next one
+        lock.unlock();
+        FlushRound(batches);
+        lock.lock();
+        durableCv.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void
+CommitLog::FlushRound(vector<string> &batches)
+{
+    lock_guard<mutex> round(roundMutex);
+    vector<uint64_t> ends(logs.size());
+    for (size_t i = 0; i < logs.size(); i++) {
+        lock_guard<mutex> lock(logs[i]->mutex);
+        batches[i].swap(logs[i]->buffer);
+        ends[i] = logs[i]->appended;
+    }
+
+    for (size_t i = 0; i < logs.size(); i++) {
+        const string &batch = batches[i];
+        uint64_t offset = ends[i] - batch.size();
+        size_t done = 0;
+        while (done < batch.size()) {
+            ssize_t n = pwrite(logs[i]->fd, batch.data() + done,
+                               batch.size() - done, offset + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                PPanic("Failed to write the log in %s", dir.c_str());
+            }
+            done += n;
+        }
+    }
+
+    for (size_t i = 0; i < logs.size(); i++) {
+        if (!batches[i].empty() && fdatasync(logs[i]->fd) < 0) {
+            PPanic("Failed to sync the log in %s", dir.c_str());
+        }
+    }
+
+    for (size_t i = 0; i < logs.size(); i++) {
+        logs[i]->durable.store(ends[i], memory_order_release);
+        // keep the capacity, to swap it in again next round
+        batches[i].clear();
+    }
+}
+
+Timestamp
+CommitLog::Rotate()
+{
+    Flush();
+
+    // with no appends running, the logs stay empty once flushed
+    lock_guard<mutex> round(roundMutex);
+    Timestamp newest;
+    for (size_t i = 0; i < logs.size(); i++) {
+        Log &log = *logs[i];
+        lock_guard<mutex> lock(log.mutex);
+        ASSERT(log.buffer.empty());
+        newest = max(newest, log.newest);
+
+        const string path = LogPath(i);
+        const string rotated = path + "." + to_string(rotation);
+        if (rename(path.c_str(), rotated.c_str()) < 0) {
+            PPanic("Failed to rename %s", path.c_str());
+        }
+        close(log.fd);
+        OpenLog(log, i);
+    }
+    rotation++;
+    SyncDir();
+    return newest;
+}
+
+void
+CommitLog::DropRotated()
+{
+    for (const LogFile &file : ListLogFiles(dir)) {
+        if (file.rotated) {
+            const string path = dir + "/" + file.name;
+            if (unlink(path.c_str()) < 0) {
+                PPanic("Failed to remove %s", path.c_str());
+            }
+        }
+    }
+    SyncDir();
+}
+
+void
+CommitLog::Replay(const function<void(const Timestamp &, string_view,
+                                      string_view)> &f) const
+{
+    // the files of earlier runs with more threads, and those rotated
+    // for a checkpoint that did not finish, are replayed too
+    vector<string> files;
+    for (const LogFile &file : ListLogFiles(dir)) {
+        files.push_back(dir + "/" + file.name);
+    }
+
+    vector<string> contents;
+    vector<pair<Timestamp, const char *>> records;
+    contents.reserve(files.size());
+    for (const string &path : files) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            PPanic("Failed to open %s", path.c_str());
+        }
+        contents.push_back(ReadLogFile(fd, path));
+        close(fd);
+
+        const string &data = contents.back();
+        size_t offset = 0;
+        size_t size;
+        while ((size = RecordSize(data.data() + offset,
+                                  data.size() - offset)) > 0) {
+            wal_record_t record;
+            memcpy(&record, data.data() + offset, sizeof(record));
+            records.emplace_back(Timestamp(record.timestamp, record.id),
+                                 data.data() + offset);
+            offset += size;
+        }
+    }
+
+    stable_sort(records.begin(), records.end(),
+                [](const pair<Timestamp, const char *> &a,
+                   const pair<Timestamp, const char *> &b) {
+                    return a.first < b.first;
+                });
+
+    for (const auto &r : records) {
+        wal_record_t record;
+        memcpy(&record, r.second, sizeof(record));
+        const char *ptr = r.second + sizeof(record);
+        for (uint32_t i = 0; i < record.nr_writes; i++) {
+            wal_write_t write;
+            memcpy(&write, ptr, sizeof(write));
+            ptr += sizeof(write);
+            f(r.first, string_view(ptr, write.key_len),
+              string_view(ptr + write.key_len, write.value_len));
+            ptr += write.key_len + write.value_len;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/commitlog.h:
+ *   Write-ahead log of committed writes, with group commit
+ *
+ **********************************************************************/
+
+#ifndef _STORE_COMMITLOG_H_
+#define _STORE_COMMITLOG_H_
+
+#include "store/common/timestamp.h"
+#include "store/common/transactionview.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * The log of a directory is a set of files wal.0, wal.1, ..., one per
+ * server thread, so that committing threads do not contend on a single
+ * tail. A file is a sequence of records, each the writes of one
+ * committed transaction:
+ *
+ *   wal_record_t
+ *   wal_write_t followed by the key and the value, for every write
+ *   padding to 8 bytes
+ *
+ * A record that fails its checksum ends its file: it was torn by a
+ * crash, and nothing after it was acknowledged.
+ *
+ * Checkpoints rotate the files out of the way, to wal.0.<n>,
+ * wal.1.<n>, ..., and drop them once the checkpoint is on disk. Rotated
+ * files are replayed like the others.
+ */
+struct wal_record_t {
+    // Bytes in the record, padding included
+    uint32_t size;
+    // hash() of the bytes of the record after this field
+    uint32_t checksum;
+    uint64_t timestamp;
+    uint64_t id;
+    uint32_t nr_writes;
+    uint32_t pad;
+};
+
+struct wal_write_t {
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+/*
+ * Class CommitLog appends records to the log file of the calling thread,
+ * in memory, and has a flusher thread write them out. Every round of
+ * the flusher writes what all the threads appended since the last
+ * round and syncs the files once, so that commits share their syncs.
+ *
+ * With sync, Append returns only once its record is on disk, and the
+ * flusher starts a round as soon as a record is waiting. Otherwise
+ * Append returns at once, and the flusher writes the records out every
+ * interval; a crash loses at most the commits of the last interval.
+ */
+class CommitLog
+{
+public:
+    CommitLog(const std::string &dir, int nlogs, bool sync,
+              std::chrono::microseconds interval);
+    CommitLog(const CommitLog &) = delete;
+    CommitLog &operator=(const CommitLog &) = delete;
+    // Writes everything appended out before returning
+    ~CommitLog();
+
+    // Logs the writes of txn, committed at timestamp
+    void Append(const Timestamp &timestamp, const TransactionView &txn);
+    // Waits until everything appended so far is on disk
+    void Flush();
+
+    // Makes everything appended so far durable and moves it to rotated
+    // files, leaving the logs empty; returns the largest timestamp ever
+    // appended. Must not run concurrently with Append.
+    Timestamp Rotate();
+    // Removes the rotated files, once their writes are in a checkpoint
+    void DropRotated();
+
+    // Calls f on every write in the log files of dir, in timestamp
+    // order, the writes of a transaction in the order they were made.
+    // The files are read in memory whole. Must not run concurrently
+    // with Append.
+    void Replay(const std::function<void(const Timestamp &,
+                                         std::string_view key,
+                                         std::string_view value)> &f) const;
+
+private:
+    struct Log {
+        // Protects buffer, appended and newest
+        std::mutex mutex;
+        // Records appended and not yet handed to the flusher
+        std::string buffer;
+        // Offset in the file of the end of the last record appended
+        uint64_t appended;
+        // Offset in the file up to which records are on disk
+        std::atomic<uint64_t> durable;
+        // Largest timestamp appended
+        Timestamp newest;
+        int fd;
+    };
+
+    const std::string dir;
+    const bool sync;
+    const std::chrono::microseconds interval;
+    std::vector<std::unique_ptr<Log>> logs;
+    // Suffix of the files of the next rotation
+    uint64_t rotation;
+    // Keeps Rotate from swapping files under a round of the flusher
+    std::mutex roundMutex;
+
+    // Wakes the flusher up and waits for its rounds
+    std::mutex flushMutex;
+    std::condition_variable flushCv;
+    std::condition_variable durableCv;
+    bool pending;
+    bool stopping;
+    std::thread flusher;
+
+    std::string LogPath(int i) const;
+    // Opens log i, dropping the torn tail of the file, if any
+    void OpenLog(Log &log, int i);
+    void SyncDir() const;
+    Log &ThisThreadLog();
+    void WaitDurable(const Log &log, uint64_t offset);
+    void FlushLoop();
+    // Writes out and syncs what the logs hold; batches are the flusher's
+    // spare buffers
+    void FlushRound(std::vector<std::string> &batches);
+};
+
+#endif /* _STORE_COMMITLOG_H_ */
@@ -10,10 +10,19 @@ DEFINE_string(configFile, "", "Path to the configuration file");
 DEFINE_int32(replicaIndex, -1, "Index of the replica in the config file");
 DEFINE_string(keysFile, "", "Path to the keys file");
 DEFINE_uint32(shardIndex, 0, "Index of the shard this replica is replicating");
+DEFINE_string(snapshotFile, "", "Path to a binary snapshot of the keys (see makeSnapshot), which servers load instead of the keys file");
+DEFINE_uint32(loadThreads, 0, "Number of threads to load the snapshot with; 0 uses one per core");
 DEFINE_uint64(numKeys, 1000000, "Number of keys in the store");
 DEFINE_uint32(numShards, 1, "Number of shards");
 DEFINE_uint32(numServerThreads, 1, "Number of server replica threads");
 DEFINE_string(replScheme, "ir", "Replication scheme <ir|vr|lir>");
+DEFINE_string(kvs, "pthread", "Key-value store backend of the servers <pthread|atomic|mvcc>; atomic only fits timestamp ids below 2^15");
+DEFINE_bool(fingerprintReads, false, "Return 64-bit key fingerprints with reads, which clients then send in their read sets instead of the keys");
+DEFINE_string(durability, "none", "Durability of commits <none|async|sync>; async logs them to --walDir and syncs the log every --groupCommitUs, sync also waits for its sync before replying");
+DEFINE_string(walDir, "", "Directory of the commit log, replayed on top of the loaded keys at startup");
+DEFINE_uint32(groupCommitUs, 1000, "Microseconds between two syncs of the commit log with --durability=async");
+DEFINE_string(checkpointFile, "", "Snapshot the servers checkpoint their shard to every --checkpointInterval, and drop the commit log it covers; restart with it as --snapshotFile");
+DEFINE_uint32(checkpointInterval, 0, "Seconds between two checkpoints to --checkpointFile, 0 for none; needs --durability and --kvs=atomic or mvcc");
 
 DEFINE_string(logPath, "/mnt/log", "Path to the log files");
 DEFINE_uint32(numClientThreads, 1, "Number of client threads");
@@ -21,6 +30,7 @@ DEFINE_uint32(numClientFibers, 1, "Number of fibers per client thread");
 DEFINE_uint64(secondsFromEpoch, 0, "Synchronization point (start clock) for all clients");
 DEFINE_uint32(duration, 10, "Number of seconds to run the experiment");
 DEFINE_uint32(warmup, 3, "Number of seconds to warmup the experiment");
+DEFINE_bool(snapshotReads, false, "Run read-only transactions on a snapshot, without prepare; needs --kvs=mvcc on the servers");
 DEFINE_uint32(tLen, 10, "Length of the transaction");
 DEFINE_uint32(wPer, 50, "Percentage of writes");
 DEFINE_int32(closestReplica, -1, "Replica where to send the reads");
@@ -32,5 +42,9 @@ DEFINE_uint32(error, 0, "Error bars");
 DEFINE_string(mode, "mtapir", "What store client to run");
 DEFINE_string(ip, "", "Client's IP -- to be used on control path");
 DEFINE_uint32(physPort, 0, "Port of the NIC device to use");
+DEFINE_string(transport, "fast", "Transport to use <fast|udp|loopback>; loopback runs the replicas in the client process");
+DEFINE_bool(shareNexus, false, "Share one eRPC Nexus per NUMA node among the threads of a process; servers and clients must agree");
+DEFINE_uint32(statsInterval, 0, "Seconds between two logs of the transport latency histograms; 0 logs them only on exit");
+DEFINE_uint32(pollBackoffUs, 0, "Longest sleep of an idle transport thread between two polls, in microseconds; 0 always busy-polls");
 
 #endif /* _FLAGS_H_ */
\ No newline at end of file
@@ -43,8 +43,8 @@ BufferClient::~BufferClient() { }
 void
 BufferClient::Begin(uint64_t tid, uint8_t core_id, uint8_t preferred_read_core_id)
 {
-    // Initialize data structures.
-    txn = Transaction();
+    // Initialize data structures, keeping the memory of the last transaction.
+    txn.reset();
     this->tid = tid;
     this->core_id = core_id;
     this->preferred_read_core_id = preferred_read_core_id;
@@ -57,8 +57,9 @@ void
 BufferClient::Get(const string &key, Promise *promise)
 {
     // Read your own writes, check the write set first.
-    if (txn.getWriteSet().find(key) != txn.getWriteSet().end()) {
-        promise->Reply(REPLY_OK, (txn.getWriteSet().find(key))->second);
+    string_view written;
+    if (txn.findWrite(key, &written)) {
+        promise->Reply(REPLY_OK, string(written));
         return;
     }
 
@@ -79,11 +80,65 @@ BufferClient::Get(const string &key, Promise *promise)
     txnclient->Get(tid, preferred_read_core_id, key, pp);
     if (pp->GetReply() == REPLY_OK) {
         Debug("Adding [%s] with ts %lu", key.c_str(), pp->GetTimestamp().getTimestamp());
-        txn.addReadSet(key, pp->GetTimestamp());
+        txn.addReadSet(key, pp->GetTimestamp(), pp->GetFingerprint());
     }
     // TODO: do we just ignore a REPLY_TIMEOUT?
 }
 
+/* Get the values for a set of keys, with all the reads in flight at once. */
+void
+BufferClient::MultiGet(const vector<string> &keys,
+                       const vector<Promise *> &promises)
+{
+    ASSERT(keys.size() == promises.size());
+
+    // Read your own writes, only go to the server for the others
+    vector<string> remoteKeys;
+    vector<Promise *> remotePromises;
+    for (size_t i = 0; i < keys.size(); i++) {
+        string_view written;
+        if (txn.findWrite(keys[i], &written)) {
+            promises[i]->Reply(REPLY_OK, string(written));
+        } else {
+            remoteKeys.push_back(keys[i]);
+            remotePromises.push_back(promises[i]);
+        }
+    }
+
+    if (remoteKeys.empty()) {
+        return;
+    }
+
+    txnclient->MultiGet(tid, preferred_read_core_id, remoteKeys, remotePromises);
+    for (size_t i = 0; i < remoteKeys.size(); i++) {
+        if (remotePromises[i]->GetReply() == REPLY_OK) {
+            Debug("Adding [%s] with ts %lu", remoteKeys[i].c_str(),
+                  remotePromises[i]->GetTimestamp().getTimestamp());
+            txn.addReadSet(remoteKeys[i], remotePromises[i]->GetTimestamp(),
+                           remotePromises[i]->GetFingerprint());
+        }
+    }
+}
+
+/* Get the value of a key as of a snapshot. */
+void
+BufferClient::GetAt(const string &key, const Timestamp &timestamp,
+                    Promise *promise)
+{
+    txnclient->GetAt(tid, preferred_read_core_id, key, timestamp, promise);
+}
+
+/* Get the values of a set of keys as of a snapshot, all at once. */
+void
+BufferClient::MultiGetAt(const vector<string> &keys,
+                         const Timestamp &timestamp,
+                         const vector<Promise *> &promises)
+{
+    ASSERT(keys.size() == promises.size());
+    txnclient->MultiGetAt(tid, preferred_read_core_id, keys, timestamp,
+                          promises);
+}
+
 /* Set value for a key. (Always succeeds).
  * Returns 0 on success, else -1. */
 void
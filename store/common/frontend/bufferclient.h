@@ -49,6 +49,18 @@ public:
     // Get value corresponding to key.
     void Get(const std::string &key, Promise *promise = NULL);
 
+    // Get the values of several keys at once, one promise per key.
+    void MultiGet(const std::vector<std::string> &keys,
+                  const std::vector<Promise *> &promises);
+
+    // Get and MultiGet as of a snapshot timestamp. Snapshot reads need
+    // no validation, so they are not added to the read set.
+    void GetAt(const std::string &key, const Timestamp &timestamp,
+               Promise *promise);
+    void MultiGetAt(const std::vector<std::string> &keys,
+                    const Timestamp &timestamp,
+                    const std::vector<Promise *> &promises);
+
     // Put value for given key.
     void Put(const std::string &key, const std::string &value, Promise *promise = NULL);
 
@@ -24,9 +24,27 @@ public:
     // Begin a transaction.
     virtual void Begin() = 0;
 
+    // Begin a transaction that only reads. Stores that support it read
+    // a snapshot and commit without validation; the others run it as a
+    // regular transaction.
+    virtual void BeginReadOnly() { Begin(); }
+
     // Get the value corresponding to key.
     virtual int Get(const std::string &key, std::string &value) = 0;
 
+    // Get the values of several keys; statuses[i] is the reply for
+    // keys[i]. Stores that can have several reads in flight override
+    // this, by default the keys are read one by one.
+    virtual void MultiGet(const std::vector<std::string> &keys,
+                          std::vector<std::string> &values,
+                          std::vector<int> &statuses) {
+        values.resize(keys.size());
+        statuses.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            statuses[i] = Get(keys[i], values[i]);
+        }
+    }
+
     // Set the value for the given key.
     virtual int Put(const std::string &key, const std::string &value) = 0;
 
@@ -37,6 +37,7 @@
 #include "store/common/transaction.h"
 
 #include <string>
+#include <vector>
 
 #define DEFAULT_TIMEOUT_MS 250
 #define DEFAULT_MULTICAST_TIMEOUT_MS 500
@@ -75,6 +76,32 @@ public:
         Panic("Unimplemented.");
     }
 
+    // Get the values of several keys; all the requests are sent
+    // before waiting for the replies, one promise per key.
+    virtual void MultiGet(uint64_t id,
+                          uint8_t core_id,
+                          const std::vector<std::string> &keys,
+                          const std::vector<Promise *> &promises) {
+        Panic("Unimplemented.");
+    }
+
+    // Get and MultiGet as of a snapshot timestamp, for transactions
+    // that only read and commit without validation.
+    virtual void GetAt(uint64_t id,
+                       uint8_t core_id,
+                       const std::string &key,
+                       const Timestamp &timestamp,
+                       Promise *promise = NULL) {
+        Panic("Unimplemented.");
+    }
+    virtual void MultiGetAt(uint64_t id,
+                            uint8_t core_id,
+                            const std::vector<std::string> &keys,
+                            const Timestamp &timestamp,
+                            const std::vector<Promise *> &promises) {
+        Panic("Unimplemented.");
+    }
+
     // Prepare the transaction.
     // Message send to the supplied core.
     virtual void Prepare(uint64_t id,
@@ -36,6 +36,7 @@ Promise::Promise()
 { 
     done = false;
     reply = 0;
+    fingerprint = 0;
     timeout = 1000;
 }
 
@@ -43,6 +44,7 @@ Promise::Promise(int timeoutMS)
 { 
     done = false;
     reply = 0;
+    fingerprint = 0;
     timeout = timeoutMS;
 }
 
@@ -96,6 +98,16 @@ Promise::Reply(int r, Timestamp t, string v)
     ReplyInternal(r);
 }
 
+void
+Promise::Reply(int r, Timestamp t, string v, uint64_t fp)
+{
+//    lock_guard<mutex> l(lock);
+    value = v;
+    timestamp = t;
+    fingerprint = fp;
+    ReplyInternal(r);
+}
+
 // Functions for getting a reply from the promise
 int
 Promise::GetReply()
@@ -126,3 +138,9 @@ Promise::GetValue()
     // }
     return value;
 }
+
+uint64_t
+Promise::GetFingerprint()
+{
+    return fingerprint;
+}
@@ -47,6 +47,7 @@ private:
     int reply;
     Timestamp timestamp;
     std::string value;
+    uint64_t fingerprint;
     std::mutex lock;
     std::condition_variable cv;
 
@@ -62,6 +63,7 @@ public:
     void Reply(int r, Timestamp t);
     void Reply(int r, std::string v);
     void Reply(int r, Timestamp t, std::string v);
+    void Reply(int r, Timestamp t, std::string v, uint64_t fp);
 
     // Return configured timeout
     int GetTimeout();
@@ -70,6 +72,8 @@ public:
     int GetReply();
     Timestamp GetTimestamp();
     std::string GetValue();
+    // Key fingerprint returned with a read, 0 if none
+    uint64_t GetFingerprint();
 };
 
 #endif /* _PROMISE_H_ */
@@ -0,0 +1,305 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/snapshot.cc:
+ *   Binary snapshots of the keys of a store, for fast loading
+ *
+ **********************************************************************/
+
+#include "store/common/snapshot.h"
+
+#include "lib/assert.h"
+#include "lib/message.h"
+#include "store/common/transaction.h"
+
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <numa.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char snapshotMagic[8] = {'M', 'K', 'S', 'N', 'A', 'P', 0, 0};
+static const uint32_t snapshotVersion = 1;
+static const uint64_t snapshotAlign = 4096;
+
+static uint64_t
+AlignUp(uint64_t n, uint64_t alignment)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+Snapshot::Snapshot(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        PPanic("Failed to open snapshot %s", path.c_str());
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        PPanic("Failed to stat snapshot %s", path.c_str());
+    }
+    size = st.st_size;
+    if (size < sizeof(snapshot_header_t)) {
+        Panic("Snapshot %s is too short", path.c_str());
+    }
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        PPanic("Failed to map snapshot %s", path.c_str());
+    }
+    close(fd);
+    data = static_cast<const char *>(mapping);
+
+    auto *header = reinterpret_cast<const snapshot_header_t *>(data);
+    if (memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 ||
+        header->version != snapshotVersion) {
+        Panic("%s is not a version %u snapshot", path.c_str(), snapshotVersion);
+    }
+    if (sizeof(snapshot_header_t) +
+        header->num_shards * sizeof(snapshot_shard_t) > size) {
+        Panic("Snapshot %s is truncated", path.c_str());
+    }
+    for (uint32_t s = 0; s < header->num_shards; s++) {
+        const snapshot_shard_t &shard = Shard(s);
+        if (shard.offset > size || shard.size > size - shard.offset ||
+            shard.num_entries > shard.size / sizeof(uint64_t)) {
+            Panic("Shard %u of snapshot %s is truncated", s, path.c_str());
+        }
+    }
+}
+
+Snapshot::~Snapshot()
+{
+    munmap(const_cast<char *>(data), size);
+}
+
+uint32_t
+Snapshot::NumShards() const
+{
+    return reinterpret_cast<const snapshot_header_t *>(data)->num_shards;
+}
+
+const snapshot_shard_t &
+Snapshot::Shard(uint32_t shard) const
+{
+    auto *shards = reinterpret_cast<const snapshot_shard_t *>(
+        data + sizeof(snapshot_header_t));
+    return shards[shard];
+}
+
+size_t
+Snapshot::NumEntries(uint32_t shard) const
+{
+    ASSERT(shard < NumShards());
+    return Shard(shard).num_entries;
+}
+
+Snapshot::Entry
+Snapshot::GetEntry(uint32_t shard, size_t i) const
+{
+    const snapshot_shard_t &s = Shard(shard);
+    ASSERT(i < s.num_entries);
+    const char *section = data + s.offset;
+    const uint64_t offset = reinterpret_cast<const uint64_t *>(section)[i];
+    if (offset > s.size || s.size - offset < sizeof(snapshot_entry_t)) {
+        Panic("Entry %lu of shard %u is out of the snapshot", i, shard);
+    }
+    auto *entry = reinterpret_cast<const snapshot_entry_t *>(section + offset);
+    if ((uint64_t)entry->key_len + entry->value_len >
+        s.size - offset - sizeof(snapshot_entry_t)) {
+        Panic("Entry %lu of shard %u is out of the snapshot", i, shard);
+    }
+
+    const char *key = reinterpret_cast<const char *>(entry + 1);
+    return Entry{string_view(key, entry->key_len),
+                 string_view(key + entry->key_len, entry->value_len),
+                 Timestamp(entry->timestamp, entry->id),
+                 entry->fingerprint};
+}
+
+void
+Snapshot::ParallelForEach(uint32_t shard, int nthreads,
+                          const function<void(int, size_t, const Entry &)> &f) const
+{
+    const size_t n = NumEntries(shard);
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    const int nodes = numa_available() == -1 ? 0 : numa_max_node() + 1;
+
+    vector<thread> threads;
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([this, shard, n, nthreads, nodes, t, &f]() {
+            if (nodes > 0) {
+                numa_run_on_node(t % nodes);
+                numa_set_localalloc();
+            }
+            const size_t first = n * t / nthreads;
+            const size_t last = n * (t + 1) / nthreads;
+            if (first == last) {
+                return;
+            }
+
+            // read ahead the part of the section this thread reads
+            const snapshot_shard_t &s = Shard(shard);
+            const char *section = data + s.offset;
+            const uint64_t *offsets = reinterpret_cast<const uint64_t *>(section);
+            const uint64_t begin = offsets[first] & ~(snapshotAlign - 1);
+            const uint64_t end = last < n ? offsets[last] : s.size;
+            if (begin < end) {
+                madvise(const_cast<char *>(section) + begin, end - begin,
+                        MADV_WILLNEED);
+            }
+
+            for (size_t i = first; i < last; i++) {
+                f(t, i, GetEntry(shard, i));
+            }
+        });
+    }
+    for (thread &t : threads) {
+        t.join();
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const string &path, uint32_t numShards)
+    : path(path), spools(numShards), finished(false)
+{
+    for (uint32_t s = 0; s < numShards; s++) {
+        Spool &spool = spools[s];
+        spool.path = path + ".shard" + to_string(s) + ".tmp";
+        spool.file = fopen(spool.path.c_str(), "w+");
+        if (spool.file == nullptr) {
+            PPanic("Failed to create %s", spool.path.c_str());
+        }
+        spool.size = 0;
+    }
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    for (Spool &spool : spools) {
+        if (spool.file != nullptr) {
+            fclose(spool.file);
+            unlink(spool.path.c_str());
+        }
+    }
+}
+
+void
+SnapshotWriter::Add(uint32_t shard, string_view key, string_view value,
+                    const Timestamp &timestamp)
+{
+    ASSERT(!finished);
+    ASSERT(shard < spools.size());
+    Spool &spool = spools[shard];
+
+    snapshot_entry_t entry;
+    entry.timestamp = timestamp.getTimestamp();
+    entry.id = timestamp.getID();
+    entry.fingerprint = KeyFingerprint(key);
+    entry.key_len = key.size();
+    entry.value_len = value.size();
+    const uint64_t len = sizeof(entry) + key.size() + value.size();
+    static const char padding[8] = {};
+
+    spool.offsets.push_back(spool.size);
+    if (fwrite(&entry, sizeof(entry), 1, spool.file) != 1 ||
+        fwrite(key.data(), 1, key.size(), spool.file) != key.size() ||
+        fwrite(value.data(), 1, value.size(), spool.file) != value.size() ||
+        fwrite(padding, 1, AlignUp(len, 8) - len, spool.file) !=
+        AlignUp(len, 8) - len) {
+        PPanic("Failed to write %s", spool.path.c_str());
+    }
+    spool.size += AlignUp(len, 8);
+}
+
+void
+SnapshotWriter::Finish()
+{
+    ASSERT(!finished);
+    finished = true;
+
+    // the snapshot replaces any file at path only once it is whole and
+    // on disk, so that a crash leaves either the old file or the new one
+    const string tmpPath = path + ".tmp";
+    FILE *out = fopen(tmpPath.c_str(), "w");
+    if (out == nullptr) {
+        PPanic("Failed to create %s", tmpPath.c_str());
+    }
+
+    // lay the sections out one after the other, on page boundaries
+    snapshot_header_t header;
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.num_shards = spools.size();
+    vector<snapshot_shard_t> shards(spools.size());
+    uint64_t offset = AlignUp(sizeof(header) +
+                              shards.size() * sizeof(snapshot_shard_t),
+                              snapshotAlign);
+    for (size_t s = 0; s < spools.size(); s++) {
+        shards[s].offset = offset;
+        shards[s].num_entries = spools[s].offsets.size();
+        shards[s].size = spools[s].offsets.size() * sizeof(uint64_t) +
+                         spools[s].size;
+        offset = AlignUp(offset + shards[s].size, snapshotAlign);
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        fwrite(shards.data(), sizeof(snapshot_shard_t), shards.size(), out) !=
+        shards.size()) {
+        PPanic("Failed to write %s", tmpPath.c_str());
+    }
+
+    vector<char> buf(1 << 20);
+    for (size_t s = 0; s < spools.size(); s++) {
+        Spool &spool = spools[s];
+        if (fseek(out, shards[s].offset, SEEK_SET) < 0) {
+            PPanic("Failed to seek in %s", tmpPath.c_str());
+        }
+
+        // entry offsets are from the start of the section, which begins
+        // with the offsets themselves
+        const uint64_t base = spool.offsets.size() * sizeof(uint64_t);
+        for (uint64_t &o : spool.offsets) {
+            o += base;
+        }
+        if (fwrite(spool.offsets.data(), sizeof(uint64_t),
+                   spool.offsets.size(), out) != spool.offsets.size()) {
+            PPanic("Failed to write %s", tmpPath.c_str());
+        }
+
+        rewind(spool.file);
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), spool.file)) > 0) {
+            if (fwrite(buf.data(), 1, n, out) != n) {
+                PPanic("Failed to write %s", tmpPath.c_str());
+            }
+        }
+        if (ferror(spool.file)) {
+            PPanic("Failed to read %s", spool.path.c_str());
+        }
+        fclose(spool.file);
+        spool.file = nullptr;
+        unlink(spool.path.c_str());
+    }
+
+    // pad the last section to a page, so that every section is whole
+    if (fflush(out) != 0 || ftruncate(fileno(out), offset) < 0 ||
+        fsync(fileno(out)) < 0 || fclose(out) != 0) {
+        PPanic("Failed to write %s", tmpPath.c_str());
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+        PPanic("Failed to rename %s", tmpPath.c_str());
+    }
+    const size_t slash = path.rfind('/');
+    const string dir = slash == string::npos ? "." :
+                       slash == 0 ? "/" : path.substr(0, slash);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) < 0) {
+        PPanic("Failed to sync %s", dir.c_str());
+    }
+    close(fd);
+}
@@ -0,0 +1,127 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/snapshot.h:
+ *   Binary snapshots of the keys of a store, for fast loading
+ *
+ **********************************************************************/
+
+#ifndef _STORE_SNAPSHOT_H_
+#define _STORE_SNAPSHOT_H_
+
+#include "store/common/timestamp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * A snapshot file holds the keys, values and timestamps of every shard
+ * of a store, laid out so that a replica can map it and load its shard
+ * without parsing:
+ *
+ *   snapshot_header_t
+ *   snapshot_shard_t for each of the num_shards shards
+ *   the section of every shard, each starting on a page boundary:
+ *     uint64_t offset of every entry, from the start of the section
+ *     the entries, each a snapshot_entry_t followed by the key and the
+ *     value, padded to 8 bytes
+ *
+ * The offsets are an index image of the shard: loader threads split the
+ * entries by number and find theirs without scanning. Every entry also
+ * carries the KeyFingerprint of its key, so the loader does not hash
+ * keys for the fingerprint index. Integers are in host byte order.
+ */
+struct snapshot_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_shards;
+};
+
+struct snapshot_shard_t {
+    uint64_t offset;
+    uint64_t num_entries;
+    uint64_t size;
+};
+
+struct snapshot_entry_t {
+    uint64_t timestamp;
+    uint64_t id;
+    uint64_t fingerprint;
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+// Read-only view of a snapshot file, mapped in memory
+class Snapshot
+{
+public:
+    struct Entry {
+        std::string_view key;
+        std::string_view value;
+        Timestamp timestamp;
+        uint64_t fingerprint;
+    };
+
+    // Maps the snapshot at path; panics if it is not a valid snapshot.
+    explicit Snapshot(const std::string &path);
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    ~Snapshot();
+
+    uint32_t NumShards() const;
+    size_t NumEntries(uint32_t shard) const;
+
+    // The i-th entry of shard; the views point into the mapping.
+    Entry GetEntry(uint32_t shard, size_t i) const;
+
+    // Calls f(t, i, entry) on every entry of shard from nthreads threads,
+    // thread t on the t-th contiguous range of entries. Threads are spread
+    // round robin over the NUMA nodes, so that the memory f allocates
+    // is spread over them too. f must be safe to call concurrently.
+    void ParallelForEach(uint32_t shard, int nthreads,
+                         const std::function<void(int, size_t, const Entry &)> &f) const;
+
+private:
+    const char *data;
+    size_t size;
+
+    const snapshot_shard_t &Shard(uint32_t shard) const;
+};
+
+// Writes a snapshot file. Entries are spooled to a temporary file per
+// shard, so only their offsets are kept in memory.
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(const std::string &path, uint32_t numShards);
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+    ~SnapshotWriter();
+
+    void Add(uint32_t shard, std::string_view key, std::string_view value,
+             const Timestamp &timestamp);
+
+    // Writes the snapshot file out and syncs it, replacing any file at
+    // path atomically; no entries may be added afterwards.
+    void Finish();
+
+private:
+    struct Spool {
+        std::string path;
+        FILE *file;
+        // Offset of every entry in the spool file
+        std::vector<uint64_t> offsets;
+        uint64_t size;
+    };
+
+    const std::string path;
+    std::vector<Spool> spools;
+    bool finished;
+};
+
+#endif /* _STORE_SNAPSHOT_H_ */
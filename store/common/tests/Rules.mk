@@ -0,0 +1,20 @@
+d := $(dir $(lastword $(MAKEFILE_LIST)))
+
+#
+# gtest-based tests
+#
+GTEST_SRCS += $(addprefix $(d), \
+		commitlog_test.cc \
+		snapshot_test.cc)
+
+$(d)commitlog_test: \
+	$(o)commitlog_test.o \
+	$(LIB-message) $(LIB-store-common) $(GTEST_MAIN)
+
+TEST_BINS += $(d)commitlog_test
+
+$(d)snapshot_test: \
+	$(o)snapshot_test.o \
+	$(LIB-message) $(LIB-store-common) $(GTEST_MAIN)
+
+TEST_BINS += $(d)snapshot_test
@@ -0,0 +1,241 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/tests/commitlog_test.cc
+ *   Test cases for the write-ahead log of committed writes.
+ *
+ **********************************************************************/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "store/common/commitlog.h"
+#include "store/common/transaction.h"
+#include "store/common/transactionview.h"
+
+namespace {
+
+typedef std::tuple<Timestamp, std::string, std::string> Write;
+
+class CommitLogTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/commitlog_test.XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+    }
+
+    void TearDown() override {
+        for (const std::string &name : Files()) {
+            unlink((dir + "/" + name).c_str());
+        }
+        rmdir(dir.c_str());
+    }
+
+    // Logs the writes of one transaction, committed at timestamp
+    static void Append(CommitLog &log, const Timestamp &timestamp,
+                       const std::vector<std::pair<std::string,
+                                                   std::string>> &writes) {
+        Transaction txn;
+        for (const auto &write : writes) {
+            txn.addWriteSet(write.first, write.second);
+        }
+        std::string buf(txn.serializedSize(), '\0');
+        txn.serialize(&buf[0]);
+        log.Append(timestamp, TransactionView(txn.readSetSize(),
+                                              txn.writeSetSize(), buf.data()));
+    }
+
+    std::vector<Write> Replay() {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        std::vector<Write> writes;
+        log.Replay([&writes](const Timestamp &timestamp,
+                             std::string_view key, std::string_view value) {
+            writes.emplace_back(timestamp, std::string(key),
+                                std::string(value));
+        });
+        return writes;
+    }
+
+    std::vector<std::string> Files() {
+        std::vector<std::string> files;
+        DIR *d = opendir(dir.c_str());
+        struct dirent *de;
+        while (d != nullptr && (de = readdir(d)) != nullptr) {
+            if (de->d_name[0] != '.') {
+                files.push_back(de->d_name);
+            }
+        }
+        if (d != nullptr) {
+            closedir(d);
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    off_t FileSize(const std::string &name) {
+        struct stat st;
+        EXPECT_EQ(stat((dir + "/" + name).c_str(), &st), 0);
+        return st.st_size;
+    }
+
+    std::string dir;
+};
+
+TEST_F(CommitLogTest, ReplayTest) {
+    const std::string binaryKey("k\0\xff", 3);
+    const std::string binaryValue("\0\0v\n\0", 5);
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        Append(log, Timestamp(1, 1), {{"a", "a1"}, {binaryKey, binaryValue}});
+        Append(log, Timestamp(2, 1), {{"b", std::string(MAX_VALUE_SIZE, 'b')}});
+    }
+
+    std::vector<Write> expected = {
+        Write(Timestamp(1, 1), "a", "a1"),
+        Write(Timestamp(1, 1), binaryKey, binaryValue),
+        Write(Timestamp(2, 1), "b", std::string(MAX_VALUE_SIZE, 'b')),
+    };
+    EXPECT_EQ(Replay(), expected);
+}
+
+TEST_F(CommitLogTest, CrossFileOrderTest) {
+    // Each thread appends to its own file, with timestamps that
+    // interleave with those of the other.
+    {
+        CommitLog log(dir, 2, true, std::chrono::microseconds(100));
+        std::thread([&log]() {
+            Append(log, Timestamp(1, 0), {{"a", "1"}});
+            Append(log, Timestamp(4, 0), {{"a", "4"}});
+            Append(log, Timestamp(5, 0), {{"a", "5"}});
+        }).join();
+        std::thread([&log]() {
+            Append(log, Timestamp(2, 0), {{"b", "2"}});
+            Append(log, Timestamp(3, 0), {{"b", "3"}});
+            Append(log, Timestamp(6, 0), {{"b", "6"}});
+        }).join();
+    }
+    EXPECT_EQ(Files(), std::vector<std::string>({"wal.0", "wal.1"}));
+    EXPECT_GT(FileSize("wal.0"), 0);
+    EXPECT_GT(FileSize("wal.1"), 0);
+
+    std::vector<Write> expected = {
+        Write(Timestamp(1, 0), "a", "1"), Write(Timestamp(2, 0), "b", "2"),
+        Write(Timestamp(3, 0), "b", "3"), Write(Timestamp(4, 0), "a", "4"),
+        Write(Timestamp(5, 0), "a", "5"), Write(Timestamp(6, 0), "b", "6"),
+    };
+    EXPECT_EQ(Replay(), expected);
+}
+
+TEST_F(CommitLogTest, TornTailTest) {
+    off_t whole;
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        Append(log, Timestamp(1, 0), {{"a", "1"}});
+        Append(log, Timestamp(2, 0), {{"b", "2"}});
+        log.Flush();
+        whole = FileSize("wal.0");
+        Append(log, Timestamp(3, 0), {{"c", std::string(100, 'c')}});
+    }
+
+    // A crash in the middle of writing the last record.
+    const off_t size = FileSize("wal.0");
+    ASSERT_TRUE(truncate((dir + "/wal.0").c_str(), size - 10) == 0);
+    std::vector<Write> expected = {
+        Write(Timestamp(1, 0), "a", "1"), Write(Timestamp(2, 0), "b", "2"),
+    };
+    EXPECT_EQ(Replay(), expected);
+
+    // Reopening drops the torn bytes, and appends go after the last
+    // whole record.
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        EXPECT_EQ(FileSize("wal.0"), whole);
+        Append(log, Timestamp(4, 0), {{"d", "4"}});
+    }
+    expected.push_back(Write(Timestamp(4, 0), "d", "4"));
+    EXPECT_EQ(Replay(), expected);
+}
+
+TEST_F(CommitLogTest, ChecksumTest) {
+    off_t first;
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        Append(log, Timestamp(1, 0), {{"a", "1"}});
+        log.Flush();
+        first = FileSize("wal.0");
+        Append(log, Timestamp(2, 0), {{"b", std::string(100, 'b')}});
+        Append(log, Timestamp(3, 0), {{"c", "3"}});
+    }
+
+    // Flip a byte of the value of the second record; it and everything
+    // after it are dropped, although the third record is whole.
+    int fd = open((dir + "/wal.0").c_str(), O_RDWR);
+    ASSERT_TRUE(fd >= 0);
+    char c;
+    const off_t offset = first + sizeof(wal_record_t) + sizeof(wal_write_t) + 10;
+    ASSERT_TRUE(pread(fd, &c, 1, offset) == 1);
+    c ^= 0x1;
+    ASSERT_TRUE(pwrite(fd, &c, 1, offset) == 1);
+    close(fd);
+
+    std::vector<Write> expected = {Write(Timestamp(1, 0), "a", "1")};
+    EXPECT_EQ(Replay(), expected);
+    EXPECT_EQ(FileSize("wal.0"), first);
+}
+
+TEST_F(CommitLogTest, RotateTest) {
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        Append(log, Timestamp(2, 0), {{"a", "2"}});
+        Append(log, Timestamp(1, 0), {{"b", "1"}});
+        EXPECT_EQ(log.Rotate(), Timestamp(2, 0));
+        EXPECT_EQ(Files(), std::vector<std::string>({"wal.0", "wal.0.0"}));
+        EXPECT_EQ(FileSize("wal.0"), 0);
+        Append(log, Timestamp(3, 0), {{"a", "3"}});
+    }
+
+    // Garbage at the end of the live file does not hide the rotated one.
+    {
+        int fd = open((dir + "/wal.0").c_str(), O_WRONLY | O_APPEND);
+        ASSERT_TRUE(fd >= 0);
+        const std::string garbage(13, '\x5a');
+        ASSERT_TRUE(write(fd, garbage.data(), garbage.size()) ==
+                    (ssize_t)garbage.size());
+        close(fd);
+    }
+
+    std::vector<Write> expected = {
+        Write(Timestamp(1, 0), "b", "1"), Write(Timestamp(2, 0), "a", "2"),
+        Write(Timestamp(3, 0), "a", "3"),
+    };
+    EXPECT_EQ(Replay(), expected);
+
+    // A reopened log rotates to a new suffix, and dropping the rotated
+    // files leaves only what was appended since.
+    {
+        CommitLog log(dir, 1, true, std::chrono::microseconds(100));
+        Append(log, Timestamp(4, 0), {{"b", "4"}});
+        EXPECT_EQ(log.Rotate(), Timestamp(4, 0));
+        EXPECT_EQ(Files(),
+                  std::vector<std::string>({"wal.0", "wal.0.0", "wal.0.1"}));
+        Append(log, Timestamp(5, 0), {{"c", "5"}});
+        log.DropRotated();
+        EXPECT_EQ(Files(), std::vector<std::string>({"wal.0"}));
+    }
+    expected = {Write(Timestamp(5, 0), "c", "5")};
+    EXPECT_EQ(Replay(), expected);
+}
+
+}  // namespace
@@ -0,0 +1,186 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/common/tests/snapshot_test.cc
+ *   Test cases for writing and loading binary snapshots.
+ *
+ **********************************************************************/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "store/common/snapshot.h"
+#include "store/common/transaction.h"
+
+namespace {
+
+typedef std::tuple<std::string, std::string, Timestamp> Row;
+
+class SnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/snapshot_test.XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        path = dir + "/snapshot";
+    }
+
+    void TearDown() override {
+        unlink(path.c_str());
+        rmdir(dir.c_str());
+    }
+
+    // Rows of shard as Snapshot reads them, checking the fingerprints
+    static std::vector<Row> Rows(const Snapshot &snapshot, uint32_t shard) {
+        std::vector<Row> rows;
+        for (size_t i = 0; i < snapshot.NumEntries(shard); i++) {
+            const Snapshot::Entry e = snapshot.GetEntry(shard, i);
+            EXPECT_EQ(e.fingerprint, KeyFingerprint(e.key));
+            rows.emplace_back(std::string(e.key), std::string(e.value),
+                              e.timestamp);
+        }
+        return rows;
+    }
+
+    off_t FileSize() {
+        struct stat st;
+        EXPECT_EQ(stat(path.c_str(), &st), 0);
+        return st.st_size;
+    }
+
+    snapshot_shard_t ReadShard(uint32_t shard) {
+        snapshot_shard_t s = {};
+        int fd = open(path.c_str(), O_RDONLY);
+        EXPECT_TRUE(fd >= 0);
+        EXPECT_TRUE(pread(fd, &s, sizeof(s), sizeof(snapshot_header_t) +
+                          shard * sizeof(s)) == (ssize_t)sizeof(s));
+        close(fd);
+        return s;
+    }
+
+    void Overwrite(off_t offset, const void *data, size_t len) {
+        int fd = open(path.c_str(), O_WRONLY);
+        ASSERT_TRUE(fd >= 0);
+        ASSERT_TRUE(pwrite(fd, data, len, offset) == (ssize_t)len);
+        close(fd);
+    }
+
+    std::string dir;
+    std::string path;
+};
+
+TEST_F(SnapshotTest, RoundTripTest) {
+    const std::vector<Row> shard0 = {
+        Row("a", "1", Timestamp(1, 2)),
+        Row(std::string("k\0\xff", 3), std::string("\0\0v\n\0", 5),
+            Timestamp(3, 4)),
+        Row("empty", "", Timestamp(5, 0)),
+        Row("big", std::string(MAX_VALUE_SIZE, 'b'), Timestamp(6, 1)),
+    };
+    std::vector<Row> shard2;
+    for (int i = 0; i < 1000; i++) {
+        shard2.emplace_back(std::to_string(i), std::string(i % 17, 'v'),
+                            Timestamp(i, i % 3));
+    }
+    {
+        SnapshotWriter writer(path, 3);
+        for (const Row &row : shard0) {
+            writer.Add(0, std::get<0>(row), std::get<1>(row), std::get<2>(row));
+        }
+        for (const Row &row : shard2) {
+            writer.Add(2, std::get<0>(row), std::get<1>(row), std::get<2>(row));
+        }
+        writer.Finish();
+    }
+    // Only the snapshot is left behind.
+    EXPECT_EQ(access((path + ".tmp").c_str(), F_OK), -1);
+    EXPECT_EQ(access((path + ".shard0.tmp").c_str(), F_OK), -1);
+
+    Snapshot snapshot(path);
+    EXPECT_EQ(snapshot.NumShards(), 3u);
+    EXPECT_EQ(snapshot.NumEntries(0), shard0.size());
+    EXPECT_EQ(snapshot.NumEntries(1), 0u);
+    EXPECT_EQ(snapshot.NumEntries(2), shard2.size());
+    EXPECT_EQ(Rows(snapshot, 0), shard0);
+    EXPECT_EQ(Rows(snapshot, 1), std::vector<Row>());
+    EXPECT_EQ(Rows(snapshot, 2), shard2);
+
+    // Every entry is visited once, by the thread that owns its range.
+    const int nthreads = 4;
+    std::vector<std::atomic<int>> visits(shard2.size());
+    std::vector<int> owner(shard2.size(), -1);
+    snapshot.ParallelForEach(2, nthreads,
+        [&](int t, size_t i, const Snapshot::Entry &e) {
+            visits[i]++;
+            owner[i] = t;
+            EXPECT_EQ(std::string(e.key), std::get<0>(shard2[i]));
+        });
+    for (size_t i = 0; i < shard2.size(); i++) {
+        EXPECT_EQ(visits[i].load(), 1);
+        EXPECT_EQ(owner[i], (int)(i * nthreads / shard2.size()));
+    }
+}
+
+TEST_F(SnapshotTest, TruncatedTest) {
+    {
+        SnapshotWriter writer(path, 2);
+        writer.Add(0, "a", "1", Timestamp(1, 0));
+        writer.Add(1, "b", std::string(100, 'b'), Timestamp(2, 0));
+        writer.Finish();
+    }
+    // The file is padded to a page; the last shard loses its tail.
+    const snapshot_shard_t last = ReadShard(1);
+    EXPECT_EQ(FileSize() % 4096, 0);
+    ASSERT_TRUE(truncate(path.c_str(), last.offset + last.size - 8) == 0);
+    EXPECT_DEATH(Snapshot snapshot(path), "Shard 1 of snapshot .* is truncated");
+
+    // The shard table is cut short.
+    ASSERT_TRUE(truncate(path.c_str(), sizeof(snapshot_header_t) +
+                                       sizeof(snapshot_shard_t)) == 0);
+    EXPECT_DEATH(Snapshot snapshot(path), "Snapshot .* is truncated");
+
+    // Not even the header is there.
+    ASSERT_TRUE(truncate(path.c_str(), sizeof(snapshot_header_t) - 1) == 0);
+    EXPECT_DEATH(Snapshot snapshot(path), "Snapshot .* is too short");
+}
+
+TEST_F(SnapshotTest, CorruptTest) {
+    {
+        SnapshotWriter writer(path, 1);
+        writer.Add(0, "a", "1", Timestamp(1, 0));
+        writer.Finish();
+    }
+
+    // An entry whose lengths run past its shard is caught when read.
+    {
+        const Snapshot snapshot(path);
+        EXPECT_EQ(snapshot.NumEntries(0), 1u);
+    }
+    const snapshot_shard_t shard = ReadShard(0);
+    const uint32_t valueLen = 1 << 20;
+    Overwrite(shard.offset + sizeof(uint64_t) +
+              offsetof(snapshot_entry_t, value_len),
+              &valueLen, sizeof(valueLen));
+    {
+        const Snapshot snapshot(path);
+        EXPECT_DEATH(snapshot.GetEntry(0, 0),
+                     "Entry 0 of shard 0 is out of the snapshot");
+    }
+
+    // A snapshot of another version is refused.
+    const uint32_t version = 99;
+    Overwrite(offsetof(snapshot_header_t, version), &version, sizeof(version));
+    EXPECT_DEATH(Snapshot snapshot(path), "is not a version 1 snapshot");
+}
+
+}  // namespace
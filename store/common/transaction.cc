@@ -7,75 +7,239 @@
  **********************************************************************/
 
 #include "store/common/transaction.h"
+#include "store/common/transactionview.h"
+
+#include <algorithm>
 #include <cstring>
 
 using namespace std;
 
-Transaction::Transaction() :
-    readSet(), writeSet() { }
+Transaction::Transaction() { }
 
-Transaction::Transaction(uint8_t nr_reads, uint8_t nr_writes, char* buf) {
-    auto *read_ptr = reinterpret_cast<read_t *> (buf);
-    for (int i = 0; i < nr_reads; i++) {
-        readSet[std::string(read_ptr->key, 64)] = Timestamp(read_ptr->timestamp, read_ptr->id);
-        read_ptr++;
+Transaction::Transaction(uint8_t nr_reads, uint8_t nr_writes, char* buf) :
+    Transaction(TransactionView(nr_reads, nr_writes, buf)) { }
+
+Transaction::Transaction(const TransactionView &view) {
+    for (const auto &read : view.getReads()) {
+        if (read.fingerprint != 0 && read.key.empty()) {
+            ReadEntry entry;
+            entry.timestamp = read.timestamp.getTimestamp();
+            entry.id = read.timestamp.getID();
+            entry.fingerprint = read.fingerprint;
+            entry.key_off = 0;
+            entry.key_len = READ_BY_FINGERPRINT;
+            reads.push_back(entry);
+            readTags.push_back(0);
+        } else {
+            addReadSet(read.key, read.timestamp);
+        }
     }
 
-    auto *write_ptr = reinterpret_cast<write_t *> (read_ptr);
-    for (int i = 0; i < nr_writes; i++) {
-        writeSet[std::string(write_ptr->key, 64)] = std::string(write_ptr->value, 64);
-        write_ptr++;
+    for (const auto &write : view.getWrites()) {
+        addWriteSet(write.key, write.value);
     }
 }
 
 Transaction::~Transaction() { }
 
-const ReadSetMap&
-Transaction::getReadSet() const
+uint32_t
+Transaction::AddBytes(string_view data)
+{
+    uint32_t off = bytes.size();
+    bytes.append(data.data(), data.size());
+    return off;
+}
+
+ssize_t
+Transaction::FindRead(string_view key, uint32_t tag) const
+{
+    for (size_t i = 0; i < readTags.size(); i++) {
+        if (readTags[i] == tag && reads[i].key_len == key.size() &&
+            Bytes(reads[i].key_off, reads[i].key_len) == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+ssize_t
+Transaction::FindWrite(string_view key, uint32_t tag) const
+{
+    for (size_t i = 0; i < writeTags.size(); i++) {
+        if (writeTags[i] == tag && writes[i].key_len == key.size() &&
+            Bytes(writes[i].key_off, writes[i].key_len) == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+Transaction::Read
+Transaction::getRead(size_t i) const
 {
-    return readSet;
+    const ReadEntry &entry = reads[i];
+    Read read;
+    if (entry.key_len != READ_BY_FINGERPRINT) {
+        read.key = Bytes(entry.key_off, entry.key_len);
+    }
+    read.fingerprint = entry.fingerprint;
+    read.timestamp = Timestamp(entry.timestamp, entry.id);
+    return read;
 }
 
-const WriteSetMap&
-Transaction::getWriteSet() const
+Transaction::Write
+Transaction::getWrite(size_t i) const
 {
-    return writeSet;
+    const WriteEntry &entry = writes[i];
+    return Write{Bytes(entry.key_off, entry.key_len),
+                 Bytes(entry.value_off, entry.value_len)};
+}
+
+bool
+Transaction::findWrite(string_view key, string_view *value) const
+{
+    ssize_t i = FindWrite(key, Tag(key));
+    if (i < 0) {
+        return false;
+    }
+    *value = Bytes(writes[i].value_off, writes[i].value_len);
+    return true;
 }
 
 void
-Transaction::addReadSet(const string &key,
+Transaction::addReadSet(string_view key,
                         const Timestamp &readTime)
 {
-    readSet[key] = readTime;
+    addReadSet(key, readTime, 0);
 }
 
 void
-Transaction::addWriteSet(const string &key,
-                         const string &value)
+Transaction::addReadSet(string_view key,
+                        const Timestamp &readTime,
+                        uint64_t fingerprint)
 {
-    writeSet[key] = value;
+    ASSERT(key.size() <= MAX_KEY_SIZE);
+    uint32_t tag = Tag(key);
+    ssize_t i = FindRead(key, tag);
+    if (i < 0) {
+        ReadEntry entry;
+        entry.key_off = AddBytes(key);
+        entry.key_len = key.size();
+        reads.push_back(entry);
+        readTags.push_back(tag);
+        i = reads.size() - 1;
+    }
+    reads[i].timestamp = readTime.getTimestamp();
+    reads[i].id = readTime.getID();
+    reads[i].fingerprint = fingerprint;
+}
+
+void
+Transaction::addWriteSet(string_view key,
+                         string_view value)
+{
+    ASSERT(key.size() <= MAX_KEY_SIZE);
+    ASSERT(value.size() <= MAX_VALUE_SIZE);
+    uint32_t tag = Tag(key);
+    ssize_t i = FindWrite(key, tag);
+    if (i < 0) {
+        WriteEntry entry;
+        entry.key_off = AddBytes(key);
+        entry.key_len = key.size();
+        writes.push_back(entry);
+        writeTags.push_back(tag);
+        i = writes.size() - 1;
+    }
+    // the bytes of an overwritten value stay unused until reset()
+    writes[i].value_off = AddBytes(value);
+    writes[i].value_len = value.size();
+}
+
+size_t Transaction::serializedSize() const {
+    size_t size = reads.size() * sizeof(read_t) +
+                  writes.size() * sizeof(write_t);
+    for (const auto &read : reads) {
+        if (read.fingerprint != 0) {
+            size += sizeof(uint64_t);
+        } else {
+            size += read.key_len;
+        }
+    }
+    for (const auto &write : writes) {
+        size += write.key_len + write.value_len;
+    }
+    return size;
+}
+
+size_t Transaction::serializedSize(uint8_t nr_reads, uint8_t nr_writes,
+                                   const char *buf) {
+    const char *start = buf;
+    for (int i = 0; i < nr_reads; i++) {
+        uint16_t key_len = reinterpret_cast<const read_t *>(buf)->key_len;
+        buf += sizeof(read_t);
+        buf += key_len == READ_BY_FINGERPRINT ? sizeof(uint64_t) : key_len;
+    }
+    for (int i = 0; i < nr_writes; i++) {
+        auto *write_ptr = reinterpret_cast<const write_t *>(buf);
+        buf += sizeof(write_t) + write_ptr->key_len + write_ptr->value_len;
+    }
+    return buf - start;
 }
 
 void Transaction::serialize(char *reqBuf) const {
-    auto *read_ptr = reinterpret_cast<read_t *> (reqBuf);
-    for (auto read : readSet) {
-        read_ptr->id = read.second.getID();
-        read_ptr->timestamp = read.second.getTimestamp();
-        std::memcpy(read_ptr->key, read.first.c_str(), 64);
-        read_ptr++;
+    // sorted by key, so that the same sets always serialize the same
+    SmallVector<uint32_t, TXN_INLINE_KEYS> order;
+
+    order.resize(reads.size());
+    for (size_t i = 0; i < reads.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return getRead(a).key < getRead(b).key;
+    });
+    for (uint32_t i : order) {
+        const ReadEntry &entry = reads[i];
+        auto *read_ptr = reinterpret_cast<read_t *> (reqBuf);
+        read_ptr->id = entry.id;
+        read_ptr->timestamp = entry.timestamp;
+        reqBuf += sizeof(read_t);
+        if (entry.fingerprint != 0) {
+            read_ptr->key_len = READ_BY_FINGERPRINT;
+            std::memcpy(reqBuf, &entry.fingerprint, sizeof(entry.fingerprint));
+            reqBuf += sizeof(entry.fingerprint);
+        } else {
+            read_ptr->key_len = entry.key_len;
+            std::memcpy(reqBuf, bytes.data() + entry.key_off, entry.key_len);
+            reqBuf += entry.key_len;
+        }
     }
 
-    auto *write_ptr = reinterpret_cast<write_t *> (read_ptr);
-    for (auto write : writeSet) {
-        std::memcpy(write_ptr->key, write.first.c_str(), 64);
-        std::memcpy(write_ptr->value, write.second.c_str(), 64);
-        write_ptr++;
+    order.resize(writes.size());
+    for (size_t i = 0; i < writes.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return getWrite(a).key < getWrite(b).key;
+    });
+    for (uint32_t i : order) {
+        const WriteEntry &entry = writes[i];
+        auto *write_ptr = reinterpret_cast<write_t *> (reqBuf);
+        write_ptr->key_len = entry.key_len;
+        write_ptr->value_len = entry.value_len;
+        reqBuf += sizeof(write_t);
+        std::memcpy(reqBuf, bytes.data() + entry.key_off, entry.key_len);
+        reqBuf += entry.key_len;
+        std::memcpy(reqBuf, bytes.data() + entry.value_off, entry.value_len);
+        reqBuf += entry.value_len;
     }
 }
 
 void
-Transaction::clear()
+Transaction::reset()
 {
-    readSet.clear();
-    writeSet.clear();
+    reads.clear();
+    readTags.clear();
+    writes.clear();
+    writeTags.clear();
+    bytes.clear();
 }
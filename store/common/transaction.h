@@ -11,10 +11,12 @@
 
 #include "lib/assert.h"
 #include "lib/message.h"
+#include "lib/smallvector.h"
 #include "store/common/timestamp.h"
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <sys/types.h>
 
 // Reply types
 #define REPLY_OK 0
@@ -40,47 +42,144 @@ enum TransactionStatus {
     ABORTED
 };
 
-typedef std::unordered_map<std::string, Timestamp> ReadSetMap;
-typedef std::unordered_map<std::string, std::string> WriteSetMap;
+// 64-bit FNV-1a hash of a key, which servers may hand out with their
+// reads so that clients validate those reads by fingerprint instead of
+// by key; never 0, which stands for no fingerprint
+inline uint64_t KeyFingerprint(std::string_view key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    return hash == 0 ? 1 : hash;
+}
 
+class TransactionView;
+
+// Number of reads and of writes, and bytes of keys and values, that a
+// Transaction holds without allocating
+#define TXN_INLINE_KEYS 16
+#define TXN_INLINE_BYTES 1024
+
+/*
+ * Class Transaction collects the read and write sets of a transaction
+ * on the client. The sets are flat arrays, searched linearly by a
+ * 32-bit tag of the key before comparing keys, and all the keys and
+ * values are packed in a single byte array. reset() keeps all the
+ * capacity, so a Transaction reused from one transaction to the next
+ * stops allocating once it has held the largest one.
+ *
+ * The string_views it hands out point into the Transaction and are
+ * only valid until it is next modified.
+ */
 class Transaction {
+public:
+    struct Read {
+        // empty for reads received by fingerprint only
+        std::string_view key;
+        // fingerprint to validate the read by, 0 to validate it by key
+        uint64_t fingerprint;
+        Timestamp timestamp;
+    };
+
+    struct Write {
+        std::string_view key;
+        std::string_view value;
+    };
+
 private:
-    // map between key and timestamp at
-    // which the read happened and how
-    // many times this key has been read
-    ReadSetMap readSet;
+    struct ReadEntry {
+        uint64_t timestamp;
+        uint64_t id;
+        uint64_t fingerprint;
+        uint32_t key_off;
+        // READ_BY_FINGERPRINT if we only have the fingerprint
+        uint16_t key_len;
+    };
 
-    // map between key and value(s)
-    //std::unordered_map<std::string, std::string> writeSet;
-    WriteSetMap writeSet;
+    struct WriteEntry {
+        uint32_t key_off;
+        uint32_t value_off;
+        uint32_t value_len;
+        uint16_t key_len;
+    };
+
+    SmallVector<ReadEntry, TXN_INLINE_KEYS> reads;
+    SmallVector<uint32_t, TXN_INLINE_KEYS> readTags;
+    SmallVector<WriteEntry, TXN_INLINE_KEYS> writes;
+    SmallVector<uint32_t, TXN_INLINE_KEYS> writeTags;
+    // keys and values of reads and writes
+    SmallVector<char, TXN_INLINE_BYTES> bytes;
+
+    static uint32_t Tag(std::string_view key) {
+        return static_cast<uint32_t>(KeyFingerprint(key));
+    }
+    uint32_t AddBytes(std::string_view data);
+    std::string_view Bytes(uint32_t off, size_t len) const {
+        return std::string_view(bytes.data() + off, len);
+    }
+    // Index of the read or write of key, or -1
+    ssize_t FindRead(std::string_view key, uint32_t tag) const;
+    ssize_t FindWrite(std::string_view key, uint32_t tag) const;
 
 public:
     Transaction();
     Transaction(uint8_t nr_reads, uint8_t nr_writes, char* buf);
+    explicit Transaction(const TransactionView &view);
     ~Transaction();
 
-    //const std::unordered_map<std::string, Timestamp>& getReadSet() const;
-    const ReadSetMap& getReadSet() const;
-    //const std::unordered_map<std::string, std::string>& getWriteSet() const;
-    const WriteSetMap& getWriteSet() const;
+    // Number of reads, whether by key or by fingerprint
+    size_t readSetSize() const { return reads.size(); }
+    size_t writeSetSize() const { return writes.size(); }
+    Read getRead(size_t i) const;
+    Write getWrite(size_t i) const;
 
-    void addReadSet(const std::string &key, const Timestamp &readTime);
-    void addWriteSet(const std::string &key, const std::string &value);
+    // Read your own writes: finds the value the transaction wrote to key
+    bool findWrite(std::string_view key, std::string_view *value) const;
+
+    void addReadSet(std::string_view key, const Timestamp &readTime);
+    // fingerprint is what the server returned with the read, 0 if none
+    void addReadSet(std::string_view key, const Timestamp &readTime,
+                    uint64_t fingerprint);
+    void addWriteSet(std::string_view key, std::string_view value);
+    // Number of bytes serialize writes
+    size_t serializedSize() const;
+    // Writes the reads, then the writes, each sorted by key
     void serialize(char *reqBuf) const;
-    void clear();
+    // Empties the transaction, keeping the memory it has
+    void reset();
+
+    // Number of bytes taken by a transaction serialized with nr_reads
+    // reads and nr_writes writes, read from the lengths in buf
+    static size_t serializedSize(uint8_t nr_reads, uint8_t nr_writes,
+                                 const char *buf);
 };
 
-// transations are serialized to a buffer containing arrays
-// of these structures:
+// Keys and values travel with their lengths, so they may be binary and
+// of any size up to these limits
+#define MAX_KEY_SIZE 1024
+#define MAX_VALUE_SIZE (64 << 10)
+#define READ_BY_FINGERPRINT 0xFFFF
+
+// Replicas keep the versions that snapshot reads need for this long
+// past the newest write; read-only transactions must read their
+// snapshot within that time of taking it.
+#define SNAPSHOT_RETENTION_US (1000 * 1000)
+
+// transations are serialized to a buffer containing the reads, then
+// the writes, packed back to back without any padding. Every read is a
+// read_t followed by key_len bytes of key, or, if key_len is
+// READ_BY_FINGERPRINT, by the 64-bit fingerprint of the key; every
+// write is a write_t followed by key_len bytes of key and value_len
+// bytes of value.
 struct read_t {
         uint64_t timestamp;
         uint64_t id;
-        char key[64];
-};
+        uint16_t key_len;
+} __attribute__((packed));
 
 struct write_t {
-        char key[64];
-        char value[64];
-};
+        uint16_t key_len;
+        uint32_t value_len;
+} __attribute__((packed));
 
 #endif /* _TRANSACTION_H_ */
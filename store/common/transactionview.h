@@ -0,0 +1,158 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * common/transactionview.h:
+ *   Read-only views of serialized transactions.
+ *
+ **********************************************************************/
+
+#ifndef _TRANSACTION_VIEW_H_
+#define _TRANSACTION_VIEW_H_
+
+#include "store/common/timestamp.h"
+#include "store/common/transaction.h"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/*
+ * Class TransactionView walks a transaction serialized by
+ * Transaction::serialize (see read_t and write_t) in place: its keys
+ * and values are string_views into the serialized buffer, which must
+ * outlive the view. Nothing is copied or allocated, so servers can
+ * prepare a transaction straight out of the request buffer.
+ */
+class TransactionView {
+public:
+    typedef Transaction::Read Read;
+    typedef Transaction::Write Write;
+
+    class ReadIterator {
+    public:
+        ReadIterator(const char *ptr, size_t left) : ptr(ptr), left(left) {}
+
+        Read operator*() const {
+            auto *read_ptr = reinterpret_cast<const read_t *>(ptr);
+            const char *key = ptr + sizeof(read_t);
+            Read read;
+            read.timestamp = Timestamp(read_ptr->timestamp, read_ptr->id);
+            if (read_ptr->key_len == READ_BY_FINGERPRINT) {
+                std::memcpy(&read.fingerprint, key, sizeof(read.fingerprint));
+            } else {
+                read.key = std::string_view(key, read_ptr->key_len);
+                read.fingerprint = 0;
+            }
+            return read;
+        }
+
+        ReadIterator &operator++() {
+            uint16_t key_len = reinterpret_cast<const read_t *>(ptr)->key_len;
+            ptr += sizeof(read_t) +
+                   (key_len == READ_BY_FINGERPRINT ? sizeof(uint64_t) : key_len);
+            left--;
+            return *this;
+        }
+
+        bool operator!=(const ReadIterator &other) const {
+            return left != other.left;
+        }
+
+    private:
+        const char *ptr;
+        size_t left;
+    };
+
+    class WriteIterator {
+    public:
+        WriteIterator(const char *ptr, size_t left) : ptr(ptr), left(left) {}
+
+        Write operator*() const {
+            auto *write_ptr = reinterpret_cast<const write_t *>(ptr);
+            const char *key = ptr + sizeof(write_t);
+            return Write{std::string_view(key, write_ptr->key_len),
+                         std::string_view(key + write_ptr->key_len,
+                                          write_ptr->value_len)};
+        }
+
+        WriteIterator &operator++() {
+            auto *write_ptr = reinterpret_cast<const write_t *>(ptr);
+            ptr += sizeof(write_t) + write_ptr->key_len + write_ptr->value_len;
+            left--;
+            return *this;
+        }
+
+        bool operator!=(const WriteIterator &other) const {
+            return left != other.left;
+        }
+
+    private:
+        const char *ptr;
+        size_t left;
+    };
+
+    template <class Iterator> class Range {
+    public:
+        Range(Iterator first, Iterator last) : first(first), last(last) {}
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+
+    private:
+        Iterator first, last;
+    };
+
+    TransactionView()
+        : nr_reads(0), nr_writes(0), buf(nullptr), writesBuf(nullptr) {}
+
+    TransactionView(uint8_t nr_reads, uint8_t nr_writes, const char *buf)
+        : nr_reads(nr_reads), nr_writes(nr_writes), buf(buf),
+          writesBuf(buf + Transaction::serializedSize(nr_reads, 0, buf)) {}
+
+    Range<ReadIterator> getReads() const {
+        return Range<ReadIterator>(ReadIterator(buf, nr_reads),
+                                   ReadIterator(writesBuf, 0));
+    }
+
+    Range<WriteIterator> getWrites() const {
+        return Range<WriteIterator>(WriteIterator(writesBuf, nr_writes),
+                                    WriteIterator(nullptr, 0));
+    }
+
+    uint8_t readSetSize() const { return nr_reads; }
+    uint8_t writeSetSize() const { return nr_writes; }
+
+private:
+    uint8_t nr_reads;
+    uint8_t nr_writes;
+    const char *buf;
+    // where the writes start, after the reads
+    const char *writesBuf;
+};
+
+/*
+ * Class PackedTransaction owns a copy of a serialized transaction in a
+ * single buffer, for replicas to keep the transactions they prepared
+ * until they commit or abort them.
+ */
+class PackedTransaction {
+public:
+    PackedTransaction() : nr_reads(0), nr_writes(0) {}
+
+    // Copies the transaction serialized in buf
+    void assign(uint8_t nr_reads, uint8_t nr_writes, const char *buf) {
+        this->nr_reads = nr_reads;
+        this->nr_writes = nr_writes;
+        data.assign(buf, Transaction::serializedSize(nr_reads, nr_writes, buf));
+    }
+
+    TransactionView view() const {
+        return TransactionView(nr_reads, nr_writes, data.data());
+    }
+
+private:
+    uint8_t nr_reads;
+    uint8_t nr_writes;
+    std::string data;
+};
+
+#endif /* _TRANSACTION_VIEW_H_ */
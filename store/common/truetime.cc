@@ -53,6 +53,18 @@ TrueTime::GetTime()
     return timestamp;
 }
 
+uint64_t
+TrueTime::Earlier(uint64_t time, uint64_t us)
+{
+    // seconds in the high word, microseconds in the low one
+    const uint64_t now = (time >> 32) * 1000000 + (time & 0xffffffff);
+    if (now < us) {
+        return 0;
+    }
+    const uint64_t then = now - us;
+    return ((then / 1000000) << 32) | (then % 1000000);
+}
+
 void
 TrueTime::GetTimeAndError(uint64_t &time, uint64_t &error)
 {
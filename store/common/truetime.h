@@ -24,6 +24,10 @@ class TrueTime
     uint64_t GetTime();
     void GetTimeAndError(uint64_t &time, uint64_t &error);
 
+    // The time us microseconds before time, as GetTime returns it, or 0
+    // if that is before the epoch
+    static uint64_t Earlier(uint64_t time, uint64_t us);
+
 private:
 	uint64_t simError;
 	uint64_t simSkew;
@@ -10,7 +10,7 @@ OBJS-meerkatstore-leader-client := $(OBJS-leadermeerkatir-client)             \
 		$(o)shardclient.o $(o)client.o
 
 OBJS-meerkatstore-leader-server := $(LIB-transport)                  \
-		$(LIB-fasttransport) $(OBJS-leadermeerkatir-replica)     \
+		$(LIB-fasttransport) $(LIB-udptransport) $(OBJS-leadermeerkatir-replica)     \
 		$(OBJS-meerkatstore) $(o)server.o
 
 $(d)meerkat_server: $(OBJS-meerkatstore-leader-server) $(o)server_main.o
@@ -55,13 +55,13 @@ void Server::LeaderUpcall(txnid_t txn_id,
         return;
     }
 
-    crt_txn_state->txn = Transaction(req->nr_reads, req->nr_writes, (char *)(req + 1));
+    crt_txn_state->txn.assign(req->nr_reads, req->nr_writes, (char *)(req + 1));
     crt_txn_state->ts = Timestamp(req->timestamp, req->id);
 
     int status;
     Timestamp proposed;
     status = store->Prepare(txn_id,
-                            crt_txn_state->txn,
+                            TransactionView(req->nr_reads, req->nr_writes, (char *)(req + 1)),
                             crt_txn_state->ts,
                             proposed);
 
@@ -78,7 +78,7 @@ void Server::LeaderUpcall(txnid_t txn_id,
 
 void Server::LeaderUpcallPostPrepare(txnid_t txn_id,
                                      replication::RecordEntry *crt_txn_state) {
-    store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn);
+    store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn.view());
 }
 
 void Server::ReplicaUpcall(txnid_t txn_id,
@@ -89,7 +89,7 @@ void Server::ReplicaUpcall(txnid_t txn_id,
         Warning("Trying to commit an un-prepared transaction.");
         return;
     }
-    store->ForceCommit(txn_id, crt_txn_state->ts, crt_txn_state->txn);
+    store->ForceCommit(txn_id, crt_txn_state->ts, crt_txn_state->txn.view());
 }
 
 void Server::UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
@@ -97,21 +97,45 @@ void Server::UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
     pair<Timestamp, string> val;
 
     auto *req = reinterpret_cast<replication::leadermeerkatir::unlogged_request_t *>(reqBuf);
-    std::string key = string(req->key, 64);
+    std::string key = string(reinterpret_cast<char *>(req + 1), req->key_len);
     int status = store->Get(key, val);
 
     auto *resp = reinterpret_cast<replication::leadermeerkatir::unlogged_response_t *>(respBuf);
-    respLen = sizeof(replication::leadermeerkatir::unlogged_response_t);
+    ASSERT(val.second.size() <= MAX_VALUE_SIZE);
+    respLen = sizeof(replication::leadermeerkatir::unlogged_response_t) + val.second.size();
     resp->status = status;
     resp->req_nr = req->req_nr;
     resp->timestamp = val.first.getTimestamp();
     resp->id = val.first.getID();
-    memcpy(resp->value, val.second.c_str(), 64);
+    resp->fingerprint = status == REPLY_OK ? store->Fingerprint(key) : 0;
+    resp->value_len = val.second.size();
+    memcpy(resp + 1, val.second.data(), val.second.size());
 }
 
 void Server::Load(const string &key, const string &value, const Timestamp timestamp) {
     store->Load(key, value, timestamp);
 }
 
+void Server::Load(const Snapshot &snapshot, uint32_t shard, int nthreads) {
+    store->Load(snapshot, shard, nthreads);
+}
+
+void Server::Recover(CommitLog *log) {
+    store->Recover(log);
+}
+
+bool Server::Checkpoint(const string &path, uint32_t shard,
+                        uint32_t numShards) {
+    return store->Checkpoint(path, shard, numShards);
+}
+
+bool Server::SupportsCheckpoints() const {
+    return store->SupportsCheckpoints();
+}
+
+void Server::Reserve(size_t n) {
+    store->Reserve(n);
+}
+
 } // namespace leadermeerkatir
 } // namespace meerkatstore
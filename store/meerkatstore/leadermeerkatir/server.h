@@ -33,10 +33,9 @@
 #define _MEERKATSTORE_LEADERMEERKATIR_SERVER_H_
 
 #include <memory>
+#include <string>
 
 #include "replication/leadermeerkatir/replica.h"
-#include "store/common/backend/atomic_kvs.h"
-#include "store/common/backend/pthread_kvs.h"
 #include "store/common/backend/thread_safe_kvs.h"
 #include "store/common/timestamp.h"
 #include "store/common/truetime.h"
@@ -48,11 +47,14 @@ namespace leadermeerkatir {
 
 class Server : public replication::leadermeerkatir::AppReplica {
 public:
-    Server()
+    // kvsBackend names the backend of the store (see NewThreadSafeKvs).
+    explicit Server(bool fingerprintReads = false,
+                    const std::string &kvsBackend = "pthread")
         : twopc(twopc),
           replicated(replicated),
-          kvs(new PthreadKvs()),
-          store(new Store(/*twopc=*/false, /*replicated=*/true, kvs.get())) {}
+          kvs(NewThreadSafeKvs(kvsBackend)),
+          store(new Store(/*twopc=*/false, /*replicated=*/true, kvs.get(),
+                          fingerprintReads)) {}
 
     void LeaderUpcall(txnid_t txn_id,
                       replication::RecordEntry *crt_txn_state,
@@ -64,6 +66,16 @@ public:
     void UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) override;
     void Load(const string &key, const string &value,
               const Timestamp timestamp);
+    // Loads a shard of a snapshot from nthreads threads
+    void Load(const Snapshot &snapshot, uint32_t shard, int nthreads);
+    // Makes room for loading n keys
+    void Reserve(size_t n);
+    // Replays log over the loaded keys and logs the commits to it
+    void Recover(CommitLog *log);
+    // Checkpoints shard to a snapshot at path while serving; returns
+    // false if the key-value store cannot
+    bool Checkpoint(const string &path, uint32_t shard, uint32_t numShards);
+    bool SupportsCheckpoints() const;
 private:
     const bool twopc;
     const bool replicated;
@@ -10,9 +10,11 @@ OBJS-meerkatstore-client := $(OBJS-meerkatir-client)             \
 		$(o)shardclient.o $(o)client.o
 
 OBJS-meerkatstore-server := $(LIB-transport)                  \
-		$(LIB-fasttransport) $(OBJS-meerkatir-replica)     \
+		$(LIB-fasttransport) $(LIB-udptransport) $(OBJS-meerkatir-replica)     \
 		$(OBJS-meerkatstore) $(o)server.o
 
 $(d)meerkat_server: $(OBJS-meerkatstore-server) $(o)server_main.o
 
-BINS += $(d)meerkat_server
\ No newline at end of file
+BINS += $(d)meerkat_server
+
+include $(d)tests/Rules.mk
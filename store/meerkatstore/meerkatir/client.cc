@@ -52,7 +52,7 @@ Client::Client(const transport::Configuration &config,
                 bool twopc, bool replicated, TrueTime timeServer)
     : t_id(0), preferred_thread_id(preferred_thread_id),
       preferred_read_thread_id(preferred_read_thread_id),
-      timeServer(timeServer), core_dis(0, nsthreads -1)
+      readOnly(false), snapshotLost(false), timeServer(timeServer), core_dis(0, nsthreads -1)
 {
     // Initialize all state here;
     srand(time(NULL));
@@ -95,9 +95,25 @@ Client::Begin()
 {
     Debug("BEGIN [%lu]", t_id + 1);
     t_id++;
+    readOnly = false;
+    snapshotLost = false;
     bclient->Begin(t_id, preferred_thread_id, preferred_read_thread_id);
 }
 
+/* Begins a read-only transaction. All its reads are of the snapshot at
+ * the current time, so they need no validation and it commits unless
+ * one of them went unanswered. Replicas only keep the versions of the
+ * snapshot for SNAPSHOT_RETENTION_US, so reads past that fail.
+ */
+void
+Client::BeginReadOnly()
+{
+    Begin();
+    readOnly = true;
+    snapshot = Timestamp(timeServer.GetTime());
+    Debug("BEGIN READ-ONLY [%lu] at %lu", t_id, snapshot.getTimestamp());
+}
+
 /* Returns the value corresponding to the supplied key. */
 int
 Client::Get(const string &key, string &value)
@@ -106,7 +122,17 @@ Client::Get(const string &key, string &value)
 
     // Send the GET operation.
     Promise promise(GET_TIMEOUT);
-    bclient->Get(key, &promise);
+    if (readOnly) {
+        if (!SnapshotRetained()) {
+            snapshotLost = true;
+            value.clear();
+            return REPLY_RETRY;
+        }
+        bclient->GetAt(key, snapshot, &promise);
+        RetrySnapshotReads({key}, {&promise});
+    } else {
+        bclient->Get(key, &promise);
+    }
     value = promise.GetValue();
     return promise.GetReply();
 }
@@ -119,11 +145,49 @@ Client::Get(const string &key)
     return value;
 }
 
+/* Returns the values of the supplied keys, all read in parallel. */
+void
+Client::MultiGet(const vector<string> &keys,
+                 vector<string> &values,
+                 vector<int> &statuses)
+{
+    Debug("MULTIGET [%lu : %lu keys]", t_id, keys.size());
+
+    std::vector<Promise> promises(keys.size());
+    std::vector<Promise *> pps;
+    for (auto &p : promises) {
+        pps.push_back(&p);
+    }
+
+    if (readOnly) {
+        if (!SnapshotRetained()) {
+            snapshotLost = true;
+            values.assign(keys.size(), string());
+            statuses.assign(keys.size(), REPLY_RETRY);
+            return;
+        }
+        bclient->MultiGetAt(keys, snapshot, pps);
+        RetrySnapshotReads(keys, pps);
+    } else {
+        bclient->MultiGet(keys, pps);
+    }
+
+    values.resize(keys.size());
+    statuses.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        values[i] = promises[i].GetValue();
+        statuses[i] = promises[i].GetReply();
+    }
+}
+
 /* Sets the value corresponding to the supplied key. */
 int
 Client::Put(const string &key, const string &value)
 {
     Debug("PUT [%lu : %s]", t_id, key.c_str());
+    if (readOnly) {
+        Panic("PUT in read-only transaction [%lu]", t_id);
+    }
 
     Promise promise(PUT_TIMEOUT);
 
@@ -143,10 +207,62 @@ Client::Prepare(Timestamp &timestamp)
     return status;
 }
 
+/* Whether the replicas still keep the versions of the snapshot */
+bool
+Client::SnapshotRetained()
+{
+    return TrueTime::Earlier(timeServer.GetTime(), SNAPSHOT_RETENTION_US) <=
+           snapshot.getTimestamp();
+}
+
+/* Reads again the keys that replicas asked to retry, because a write
+ * below the snapshot was still prepared there. Reads still without an
+ * answer after that lose the snapshot. */
+void
+Client::RetrySnapshotReads(const vector<string> &keys,
+                           const vector<Promise *> &promises)
+{
+    for (int retry = 0;; retry++) {
+        vector<string> retryKeys;
+        vector<Promise *> retryPromises;
+        for (size_t i = 0; i < keys.size(); i++) {
+            const int reply = promises[i]->GetReply();
+            if (reply == REPLY_RETRY) {
+                retryKeys.push_back(keys[i]);
+                retryPromises.push_back(promises[i]);
+            } else if (reply != REPLY_OK && reply != REPLY_FAIL) {
+                snapshotLost = true;
+            }
+        }
+        if (retryKeys.empty()) {
+            return;
+        }
+        if (retry == GET_RETRIES) {
+            snapshotLost = true;
+            return;
+        }
+        Debug("RETRY [%lu : %lu keys] at %lu", t_id, retryKeys.size(),
+              snapshot.getTimestamp());
+        bclient->MultiGetAt(retryKeys, snapshot, retryPromises);
+    }
+}
+
 /* Attempts to commit the ongoing transaction. */
 bool
 Client::Commit()
 {
+    // Snapshot reads were consistent when they were made, there is
+    // nothing left to check unless some went unanswered
+    if (readOnly) {
+        readOnly = false;
+        if (snapshotLost) {
+            Debug("ABORT READ-ONLY [%lu]", t_id);
+            return false;
+        }
+        Debug("COMMIT READ-ONLY [%lu]", t_id);
+        return true;
+    }
+
     Timestamp timestamp(timeServer.GetTime(), client_id);
     int status = Prepare(timestamp);
 
@@ -165,6 +281,11 @@ void
 Client::Abort()
 {
     Debug("ABORT [%lu]", t_id);
+    if (readOnly) {
+        // the replicas know nothing of the transaction
+        readOnly = false;
+        return;
+    }
     bclient->Abort();
 }
 
@@ -64,9 +64,14 @@ public:
 
     // Overriding functions from ::Client.
     void Begin();
+    // Reads from a quorum at a TrueTime snapshot; Commit sends nothing
+    void BeginReadOnly() override;
     int Get(const std::string &key, std::string &value);
     // Interface added for Java bindings
     std::string Get(const std::string &key);
+    void MultiGet(const std::vector<std::string> &keys,
+                  std::vector<std::string> &values,
+                  std::vector<int> &statuses) override;
     int Put(const std::string &key, const std::string &value);
     bool Commit();
     void Abort();
@@ -86,6 +91,12 @@ private:
     // Buffering client.
     BufferClient *bclient;
 
+    // Is the ongoing transaction read-only, and its snapshot if so?
+    bool readOnly;
+    Timestamp snapshot;
+    // Did a read of the snapshot get no answer, so that it must abort?
+    bool snapshotLost;
+
     // TrueTime server.
     TrueTime timeServer;
 
@@ -95,6 +106,12 @@ private:
 
     // Prepare function
     int Prepare(Timestamp &timestamp);
+
+    bool SnapshotRetained();
+    // Snapshot reads of the keys of promises that got REPLY_RETRY,
+    // until none do or GET_RETRIES rounds are over
+    void RetrySnapshotReads(const std::vector<std::string> &keys,
+                            const std::vector<Promise *> &promises);
 };
 
 } // namespace meerkatir
@@ -52,11 +52,11 @@ void Server::ExecInconsistentUpcall(txnid_t txn_id,
 
     if (commit) {
         if (crt_txn_state->txn_status != COMMITTED)
-            store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn);
+            store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn.view());
         crt_txn_state->txn_status = COMMITTED;
     } else {
         if (crt_txn_state->txn_status != ABORTED)
-            store->Abort(txn_id, crt_txn_state->txn);
+            store->Abort(txn_id, crt_txn_state->txn.view());
         crt_txn_state->txn_status = ABORTED;
     }
 }
@@ -76,12 +76,12 @@ void Server::ExecConsensusUpcall(txnid_t txn_id,
     auto *resp = reinterpret_cast<replication::meerkatir::consensus_response_t *>(respBuf);
 
     if (crt_txn_state->txn_status == NOT_PREPARED) {
-        // TODO: make sure this creates a copy
-        crt_txn_state->txn = Transaction(nr_reads, nr_writes, reqBuf);
+        // keep a copy of the transaction to commit or abort it later
+        crt_txn_state->txn.assign(nr_reads, nr_writes, reqBuf);
         crt_txn_state->ts = Timestamp(timestamp, id);
         //Debug("Prepare at timestamp: %lu", crt_txn_state->ts.getTimestamp());
         status = store->Prepare(txn_id,
-                                crt_txn_state->txn,
+                                TransactionView(nr_reads, nr_writes, reqBuf),
                                 crt_txn_state->ts,
                                 proposed);
         resp->status = status;
@@ -93,7 +93,11 @@ void Server::ExecConsensusUpcall(txnid_t txn_id,
             crt_txn_state->txn_status = PREPARED_ABORT;
         }
     } else {
-        // TODO:
+        // A resend of a prepare we already ran: answer with its outcome
+        // rather than prepare it again.
+        resp->status = (crt_txn_state->txn_status == PREPARED_OK ||
+                        crt_txn_state->txn_status == COMMITTED) ?
+                       REPLY_OK : REPLY_FAIL;
     }
 }
 
@@ -102,16 +106,78 @@ void Server::UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
     std::pair<Timestamp, string> val;
 
     auto *req = reinterpret_cast<replication::meerkatir::unlogged_request_t *>(reqBuf);
-    std::string key = string(req->key, 64);
-    int status = store->Get(key, val);
+    std::string key = string(reinterpret_cast<char *>(req + 1), req->key_len);
+    int status;
+    if (req->timestamp != 0) {
+        status = store->Get(txnid_t(), key, Timestamp(req->timestamp, req->id), val);
+    } else {
+        status = store->Get(key, val);
+    }
 
     auto *resp = reinterpret_cast<replication::meerkatir::unlogged_response_t *>(respBuf);
-    respLen = sizeof(replication::meerkatir::unlogged_response_t);
+    ASSERT(val.second.size() <= MAX_VALUE_SIZE);
+    respLen = sizeof(replication::meerkatir::unlogged_response_t) + val.second.size();
     resp->status = status;
     resp->req_nr = req->req_nr;
     resp->timestamp = val.first.getTimestamp();
     resp->id = val.first.getID();
-    memcpy(resp->value, val.second.c_str(), 64);
+    resp->fingerprint = status == REPLY_OK ? store->Fingerprint(key) : 0;
+    resp->value_len = val.second.size();
+    memcpy(resp + 1, val.second.data(), val.second.size());
+}
+
+void Server::MultiGetUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
+    auto *req = reinterpret_cast<replication::meerkatir::multiget_request_t *>(reqBuf);
+    Debug("Received MultiGet Request for %u keys", req->nr_keys);
+
+    std::vector<std::string> keys;
+    keys.reserve(req->nr_keys);
+    const char *ptr = reinterpret_cast<const char *>(req + 1);
+    for (int i = 0; i < req->nr_keys; i++) {
+        uint16_t key_len;
+        memcpy(&key_len, ptr, sizeof(key_len));
+        ptr += sizeof(key_len);
+        keys.emplace_back(ptr, key_len);
+        ptr += key_len;
+    }
+
+    std::vector<std::pair<Timestamp, string>> values;
+    std::vector<int> statuses;
+    if (req->timestamp != 0) {
+        // snapshot reads check every key on its own
+        const Timestamp snapshot(req->timestamp, req->id);
+        values.resize(keys.size());
+        statuses.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            statuses[i] = store->Get(txnid_t(), keys[i], snapshot, values[i]);
+        }
+    } else {
+        store->MultiGet(keys, values, statuses);
+    }
+
+    // answer as many keys as fit in the response, always at least one
+    auto *resp = reinterpret_cast<replication::meerkatir::multiget_response_t *>(respBuf);
+    resp->req_nr = req->req_nr;
+    char *out = reinterpret_cast<char *>(resp + 1);
+    size_t i = 0;
+    for (; i < keys.size(); i++) {
+        const std::string &value = values[i].second;
+        ASSERT(value.size() <= MAX_VALUE_SIZE);
+        size_t len = sizeof(replication::meerkatir::multiget_result_t) + value.size();
+        if (i > 0 && out + len > respBuf + replication::meerkatir::maxUnloggedRespSize) {
+            break;
+        }
+        auto *result = reinterpret_cast<replication::meerkatir::multiget_result_t *>(out);
+        result->status = statuses[i];
+        result->timestamp = values[i].first.getTimestamp();
+        result->id = values[i].first.getID();
+        result->fingerprint = statuses[i] == REPLY_OK ? store->Fingerprint(keys[i]) : 0;
+        result->value_len = value.size();
+        memcpy(result + 1, value.data(), value.size());
+        out += len;
+    }
+    resp->nr_keys = i;
+    respLen = out - respBuf;
 }
 
 void
@@ -119,6 +185,36 @@ Server::Load(const string &key, const string &value, const Timestamp timestamp)
     store->Load(key, value, timestamp);
 }
 
+void
+Server::Load(const Snapshot &snapshot, uint32_t shard, int nthreads) {
+    store->Load(snapshot, shard, nthreads);
+}
+
+void
+Server::Recover(CommitLog *log) {
+    store->Recover(log);
+}
+
+bool
+Server::Checkpoint(const string &path, uint32_t shard, uint32_t numShards) {
+    return store->Checkpoint(path, shard, numShards);
+}
+
+bool
+Server::SupportsCheckpoints() const {
+    return store->SupportsCheckpoints();
+}
+
+bool
+Server::SupportsSnapshots() const {
+    return store->SupportsSnapshots();
+}
+
+void
+Server::Reserve(size_t n) {
+    store->Reserve(n);
+}
+
 void
 Server::PrintStats() {
     // fprintf(stderr, "%lu\n", store->fake_counter[10].load());
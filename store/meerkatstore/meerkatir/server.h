@@ -33,10 +33,9 @@
 #define _MEERKATSTORE_MEERKATIR_SERVER_H_
 
 #include <memory>
+#include <string>
 
 #include "replication/meerkatir/replica.h"
-#include "store/common/backend/atomic_kvs.h"
-#include "store/common/backend/pthread_kvs.h"
 #include "store/common/backend/thread_safe_kvs.h"
 #include "store/common/timestamp.h"
 #include "store/common/truetime.h"
@@ -48,9 +47,12 @@ namespace meerkatir {
 class Server : public replication::meerkatir::AppReplica
 {
 public:
-    Server()
-        : kvs(new PthreadKvs()),
-          store(new Store(/*twopc=*/false, /*replicated=*/true, kvs.get())) {}
+    // kvsBackend names the backend of the store (see NewThreadSafeKvs).
+    explicit Server(bool fingerprintReads = false,
+                    const std::string &kvsBackend = "pthread")
+        : kvs(NewThreadSafeKvs(kvsBackend)),
+          store(new Store(/*twopc=*/false, /*replicated=*/true, kvs.get(),
+                          fingerprintReads)) {}
 
     // Invoke inconsistent operation, no return value
     void ExecInconsistentUpcall(txnid_t txn_id,
@@ -70,7 +72,22 @@ public:
     // Invoke unreplicated operation
     void UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) override;
 
+    // Invoke unreplicated read of several keys
+    void MultiGetUpcall(char *reqBuf, char *respBuf, size_t &respLen) override;
+
     void Load(const string &key, const string &value, const Timestamp timestamp);
+    // Loads a shard of a snapshot from nthreads threads
+    void Load(const Snapshot &snapshot, uint32_t shard, int nthreads);
+    // Makes room for loading n keys
+    void Reserve(size_t n);
+    // Replays log over the loaded keys and logs the commits to it
+    void Recover(CommitLog *log);
+    // Checkpoints shard to a snapshot at path while serving; returns
+    // false if the key-value store cannot
+    bool Checkpoint(const string &path, uint32_t shard, uint32_t numShards);
+    bool SupportsCheckpoints() const;
+    // Whether the store can serve snapshot reads (see --snapshotReads)
+    bool SupportsSnapshots() const;
 
     void PrintStats();
 
@@ -38,14 +38,17 @@
 #include <numa.h>
 
 #include "store/common/flags.h"
+#include "store/common/commitlog.h"
+#include "store/common/snapshot.h"
 #include "store/meerkatstore/meerkatir/server.h"
+#include "lib/udptransport.h"
 
 #include <boost/thread/thread.hpp>
 
 using namespace std;
 
 // TODO: better way to print stats
-static FastTransport *last_transport;
+static Transport *last_transport;
 static replication::meerkatir::Replica *last_replica;
 static meerkatstore::meerkatir::Server *global_server;
 
@@ -57,19 +60,27 @@ void server_thread_func(meerkatstore::meerkatir::Server *server,
     // for now assume it's round robin
     // TODO: get rid of the hardcoded number of request types
     int ht_ct = boost::thread::hardware_concurrency();
-    FastTransport *transport = new FastTransport(config,
-                                                local_uri,
-                                                FLAGS_numServerThreads,
-                                                //ht_ct,
-                                                4,
-                                                0,
-                                                numa_node,
-                                                thread_id);
+    Transport *transport;
+    if (FLAGS_transport == "udp") {
+        transport = new UDPTransport(config,
+                                     local_uri,
+                                     FLAGS_numServerThreads,
+                                     thread_id);
+    } else {
+        transport = new FastTransport(config,
+                                      local_uri,
+                                      FLAGS_numServerThreads,
+                                      //ht_ct,
+                                      4,
+                                      0,
+                                      numa_node,
+                                      thread_id);
+    }
     last_transport = transport;
 
     replication::meerkatir::Replica *replica = new replication::meerkatir::Replica(
       config, FLAGS_replicaIndex,
-      (FastTransport *)transport,
+      transport,
       server);
 
     last_replica = replica;
@@ -80,6 +91,8 @@ void server_thread_func(meerkatstore::meerkatir::Server *server,
 
 void signal_handler( int signal_num ) {
    last_transport->Stop();
+   FastTransport::PrintLatencyStats();
+   FastTransport::PrintPollStats();
    last_replica->PrintStats();
    global_server->PrintStats();
 
@@ -103,8 +116,26 @@ main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    if (FLAGS_keysFile == "") {
-        fprintf(stderr, "option --keysFile is required\n");
+    if (FLAGS_keysFile == "" && FLAGS_snapshotFile == "") {
+        fprintf(stderr, "option --keysFile or --snapshotFile is required\n");
+        return EXIT_FAILURE;
+    }
+
+    if (FLAGS_durability != "none" && FLAGS_durability != "async" &&
+        FLAGS_durability != "sync") {
+        fprintf(stderr, "unknown durability: %s\n", FLAGS_durability.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (FLAGS_durability != "none" && FLAGS_walDir == "") {
+        fprintf(stderr, "option --walDir is required with --durability\n");
+        return EXIT_FAILURE;
+    }
+
+    if (FLAGS_checkpointInterval > 0 &&
+        (FLAGS_durability == "none" || FLAGS_checkpointFile == "")) {
+        fprintf(stderr, "option --checkpointInterval requires --durability "
+                "and --checkpointFile\n");
         return EXIT_FAILURE;
     }
 
@@ -125,10 +156,30 @@ main(int argc, char **argv)
                 "only %d replicas defined\n", FLAGS_replicaIndex, config.n);
     }
 
-    meerkatstore::meerkatir::Server *server = new meerkatstore::meerkatir::Server();
+    meerkatstore::meerkatir::Server *server = new meerkatstore::meerkatir::Server(FLAGS_fingerprintReads, FLAGS_kvs);
+    if (FLAGS_checkpointInterval > 0 && !server->SupportsCheckpoints()) {
+        fprintf(stderr, "option --checkpointInterval is not supported "
+                "with --kvs=%s\n", FLAGS_kvs.c_str());
+        return EXIT_FAILURE;
+    }
+    if (FLAGS_snapshotReads && !server->SupportsSnapshots()) {
+        fprintf(stderr, "option --snapshotReads is not supported "
+                "with --kvs=%s\n", FLAGS_kvs.c_str());
+        return EXIT_FAILURE;
+    }
 
     // Load keys in memory
-    if (FLAGS_keysFile != "") {
+    if (FLAGS_snapshotFile != "") {
+        Snapshot snapshot(FLAGS_snapshotFile);
+        if (snapshot.NumShards() != FLAGS_numShards) {
+            Panic("Snapshot %s has %u shards, not %u",
+                  FLAGS_snapshotFile.c_str(), snapshot.NumShards(),
+                  FLAGS_numShards);
+        }
+        const int nthreads = FLAGS_loadThreads > 0 ?
+            FLAGS_loadThreads : std::thread::hardware_concurrency();
+        server->Load(snapshot, FLAGS_shardIndex, nthreads);
+    } else if (FLAGS_keysFile != "") {
         string key;
         std::ifstream in;
         in.open(FLAGS_keysFile);
@@ -137,6 +188,9 @@ main(int argc, char **argv)
             exit(0);
         }
 
+        // our share of the keys, with some slack for an uneven split
+        server->Reserve(FLAGS_numKeys / FLAGS_numShards +
+                        FLAGS_numKeys / FLAGS_numShards / 8);
         for (unsigned int i = 0; i < FLAGS_numKeys; i++) {
             getline(in, key);
 
@@ -153,11 +207,22 @@ main(int argc, char **argv)
         in.close();
     }
 
+    // Replay the commits since the keys were saved
+    if (FLAGS_durability != "none") {
+        CommitLog *log = new CommitLog(
+            FLAGS_walDir, FLAGS_numServerThreads, FLAGS_durability == "sync",
+            std::chrono::microseconds(FLAGS_groupCommitUs));
+        server->Recover(log);
+    }
+
     // create replica threads
     // bind round robin on the availlable numa nodes
     if (numa_available() == -1) {
         PPanic("NUMA library not available.");
     }
+    FastTransport::ShareNexusPerNumaNode(FLAGS_shareNexus);
+    FastTransport::SetPollBackoff(FLAGS_pollBackoffUs);
+    FastTransport::SetMaxResponseSize(replication::meerkatir::maxUnloggedRespSize);
 
     //int nn_ct = numa_max_node() + 1;
     //int ht_ct = boost::thread::hardware_concurrency()/boost::thread::physical_concurrency(); // number of hyperthreads
@@ -172,13 +237,38 @@ main(int argc, char **argv)
     //for (uint8_t i = 0; i < ht_ct; i++) {
         // thread_arr[i] = std::thread(server_thread_func, server, config, i%nn_ct, i);
         // erpc::bind_to_core(thread_arr[i], i%nn_ct, i/nn_ct);
-        uint8_t numa_node = (i % 4 < 2)?0:1;
+        uint8_t numa_node = FastTransport::ServerNumaNode(i);
         uint8_t idx = (8 + i/4 + (i % 2) * kMaxThreads/4) % (kMaxThreads / kNumNumas); // starting from core8 to avoid conflicts
         // uint8_t idx = i/4 + (i % 2) * 20;
         thread_arr[i] = std::thread(server_thread_func, server, config, numa_node, i);
         erpc::bind_to_core(thread_arr[i], numa_node, idx);
     }
 
+    if (FLAGS_statsInterval > 0) {
+        std::thread([]() {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(FLAGS_statsInterval));
+                FastTransport::PrintLatencyStats();
+                FastTransport::PrintPollStats();
+            }
+        }).detach();
+    }
+
+    // Checkpoint in the background, so that restarts replay less log
+    if (FLAGS_checkpointInterval > 0) {
+        std::thread([server]() {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(FLAGS_checkpointInterval));
+                if (!server->Checkpoint(FLAGS_checkpointFile, FLAGS_shardIndex,
+                                        FLAGS_numShards)) {
+                    Warning("--kvs=%s does not support checkpoints",
+                            FLAGS_kvs.c_str());
+                    return;
+                }
+            }
+        }).detach();
+    }
+
     for (auto &thread : thread_arr) thread.join();
 
     return 0;
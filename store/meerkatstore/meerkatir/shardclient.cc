@@ -31,6 +31,9 @@
 
 #include "store/meerkatstore/meerkatir/shardclient.h"
 
+#include <algorithm>
+#include <deque>
+
 #include <sys/time.h>
 
 namespace meerkatstore {
@@ -41,7 +44,7 @@ ShardClient::ShardClient(const transport::Configuration &config,
                        Transport *transport, uint64_t client_id, int
                        shard, int closestReplica, bool replicated)
         : config(config), client_id(client_id), transport(transport),
-          shard(shard), replicated(replicated) {
+          shard(shard), replicated(replicated), unresponsive(config.n, false) {
     client = new replication::meerkatir::Client(config, transport, client_id);
 
     if (closestReplica == -1) {
@@ -50,9 +53,6 @@ ShardClient::ShardClient(const transport::Configuration &config,
         replica = closestReplica;
     }
     Debug("Sending unlogged to replica %i", replica);
-
-    waiting = NULL;
-    blockingBegin = NULL;
 }
 
 ShardClient::~ShardClient()
@@ -64,18 +64,20 @@ void ShardClient::Begin(uint64_t txn_nr) {
     Debug("[shard %i] BEGIN: %lu", shard, txn_nr);
 }
 
-void ShardClient::SendUnreplicated(uint64_t txn_nr,
-                                     uint8_t core_id,
-                                     Promise *promise,
-                                     const std::string &request_str,
-                                     replication::meerkatir::unlogged_continuation_t callback,
-                                     replication::meerkatir::error_continuation_t error_callback) {
+replication::meerkatir::req_handle_t
+ShardClient::SendUnreplicated(uint64_t txn_nr,
+                              uint8_t core_id,
+                              Promise *promise,
+                              const std::string &request_str,
+                              replication::meerkatir::unlogged_continuation_t callback,
+                              replication::meerkatir::error_continuation_t error_callback,
+                              const Timestamp &snapshot) {
 
     Debug("Sending unlogged request to replica %d.", replica);
     const int timeout = (promise != nullptr) ? promise->GetTimeout() : 1000;
-    waiting = promise;
-    client->InvokeUnlogged(txn_nr, core_id, replica, request_str, callback,
-                           error_callback, timeout);
+    return client->InvokeUnloggedAsync(txn_nr, core_id, replica, request_str,
+                                       callback, error_callback, timeout,
+                                       snapshot);
 }
 
 void ShardClient::SendConsensus(uint64_t txn_nr, uint8_t core_id, Promise *promise,
@@ -85,7 +87,6 @@ void ShardClient::SendConsensus(uint64_t txn_nr, uint8_t core_id, Promise *promi
                                   replication::meerkatir::error_continuation_t error_callback) {
 
     Debug("Sending consensus request ");
-    waiting = promise;
     client->InvokeConsensus(txn_nr, core_id, txn, timestamp, decide,
                             callback, error_callback);
 }
@@ -101,13 +102,178 @@ void ShardClient::SendInconsistent(uint64_t txn_nr, uint8_t core_id,
 
 void ShardClient::Get(uint64_t txn_nr, uint8_t core_id,
                    const string &key, Promise *promise) {
+    // A zero snapshot reads the latest version
+    GetAt(txn_nr, core_id, key, Timestamp(), promise);
+}
+
+void ShardClient::GetAt(uint64_t txn_nr, uint8_t core_id,
+                        const string &key, const Timestamp &timestamp,
+                        Promise *promise) {
+    // Snapshot reads go to a quorum, see MultiGetAt
+    if (timestamp != Timestamp() && replicated) {
+        MultiGetAt(txn_nr, core_id, {key}, timestamp, {promise});
+        return;
+    }
+
     // Send the GET operation to appropriate shard.
     Debug("[shard %i] Sending GET [%lu : %s]", shard, txn_nr, key.c_str());
 
-    SendUnreplicated(txn_nr, core_id, promise, key,
-      bind(&ShardClient::GetCallback, this,
+    client->Wait(SendUnreplicated(txn_nr, core_id, promise, key,
+      bind(&ShardClient::GetCallback, this, promise,
            placeholders::_1),
-      bind(&ShardClient::GetTimeout, this));
+      bind(&ShardClient::GetTimeout, this, promise), timestamp));
+}
+
+void ShardClient::MultiGet(uint64_t txn_nr, uint8_t core_id,
+                           const std::vector<std::string> &keys,
+                           const std::vector<Promise *> &promises) {
+    MultiGetAt(txn_nr, core_id, keys, Timestamp(), promises);
+}
+
+void ShardClient::MultiGetAt(uint64_t txn_nr, uint8_t core_id,
+                             const std::vector<std::string> &keys,
+                             const Timestamp &timestamp,
+                             const std::vector<Promise *> &promises) {
+    ASSERT(keys.size() == promises.size());
+    if (timestamp == Timestamp() || !replicated) {
+        Debug("[shard %i] Sending MULTIGET of %lu keys [%lu]", shard, keys.size(), txn_nr);
+        MultiGetFrom(txn_nr, core_id, {replica}, keys, timestamp, {promises});
+        return;
+    }
+    Debug("[shard %i] Sending snapshot MULTIGET of %lu keys to a quorum [%lu]",
+          shard, keys.size(), txn_nr);
+
+    // A replica that answers a snapshot read keeps the writes below the
+    // snapshot that it has not prepared yet from preparing, and a write
+    // commits only once a quorum has prepared it. Any quorum shares a
+    // replica with ours, so a write that can still commit below the
+    // snapshot is either prepared at one of our replicas, which asks us
+    // to retry, or applied there: the newest version our replicas have
+    // is the one at the snapshot.
+    // Replicas that did not answer the last time they were asked are
+    // asked last
+    std::vector<int> order;
+    for (bool down : {false, true}) {
+        for (int k = 0; k < config.n; k++) {
+            if (unresponsive[(replica + k) % config.n] == down) {
+                order.push_back((replica + k) % config.n);
+            }
+        }
+    }
+
+    const int quorum = config.QuorumSize();
+    std::vector<int> replicas;
+    std::vector<int> slots;
+    std::deque<Promise> replies;
+    std::vector<std::vector<Promise *>> replyPromises(quorum);
+    for (int q = 0; q < quorum; q++) {
+        replicas.push_back(order[q]);
+        slots.push_back(q);
+        for (size_t i = 0; i < keys.size(); i++) {
+            replies.emplace_back(promises[i]->GetTimeout());
+            replyPromises[q].push_back(&replies.back());
+        }
+    }
+
+    // A replica that does not answer gives its slot in the quorum to
+    // one that was not asked yet, so that reads go on while a minority
+    // of the replicas is down
+    int asked = quorum;
+    while (!slots.empty()) {
+        std::vector<std::vector<Promise *>> slotPromises;
+        for (int q : slots) {
+            slotPromises.push_back(replyPromises[q]);
+        }
+        std::vector<bool> failed = MultiGetFrom(txn_nr, core_id, replicas,
+                                                keys, timestamp, slotPromises);
+
+        std::vector<int> nextReplicas;
+        std::vector<int> nextSlots;
+        for (size_t j = 0; j < slots.size(); j++) {
+            unresponsive[replicas[j]] = failed[j];
+            if (failed[j] && asked < config.n) {
+                Debug("[shard %i] Replica %d did not answer, asking %d",
+                      shard, replicas[j], order[asked]);
+                nextReplicas.push_back(order[asked++]);
+                nextSlots.push_back(slots[j]);
+            }
+        }
+        replicas.swap(nextReplicas);
+        slots.swap(nextSlots);
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        Promise *newest = nullptr;
+        int status = REPLY_FAIL;
+        for (int q = 0; q < quorum; q++) {
+            Promise *reply = replyPromises[q][i];
+            if (reply->GetReply() == REPLY_OK &&
+                (newest == nullptr ||
+                 newest->GetTimestamp() < reply->GetTimestamp())) {
+                newest = reply;
+            } else if (reply->GetReply() != REPLY_OK &&
+                       reply->GetReply() != REPLY_FAIL) {
+                status = reply->GetReply();
+            }
+        }
+        if (status != REPLY_FAIL) {
+            promises[i]->Reply(status);
+        } else if (newest != nullptr) {
+            promises[i]->Reply(REPLY_OK, newest->GetTimestamp(),
+                               newest->GetValue(), newest->GetFingerprint());
+        } else {
+            promises[i]->Reply(REPLY_FAIL);
+        }
+    }
+}
+
+std::vector<bool>
+ShardClient::MultiGetFrom(uint64_t txn_nr, uint8_t core_id,
+                          const std::vector<int> &replicas,
+                          const std::vector<std::string> &keys,
+                          const Timestamp &timestamp,
+                          const std::vector<std::vector<Promise *>> &promises) {
+    // One request per replica reads all the keys; if their values do not
+    // all fit in its response, ask again for the keys that were left out.
+    // The replicas are asked at the same time.
+    std::vector<size_t> answered(replicas.size(), 0);
+    std::vector<size_t> first(replicas.size());
+    std::vector<char> failed(replicas.size(), false);
+    std::vector<replication::meerkatir::req_handle_t> handles(replicas.size());
+    for (;;) {
+        std::vector<size_t> asked;
+        for (size_t r = 0; r < replicas.size(); r++) {
+            if (failed[r] || answered[r] == keys.size()) {
+                continue;
+            }
+            first[r] = answered[r];
+            size_t last = std::min(keys.size(), first[r] + UINT16_MAX);
+            std::vector<std::string> batch(keys.begin() + first[r], keys.begin() + last);
+            handles[r] = client->InvokeMultiGetAsync(txn_nr, core_id, replicas[r], batch,
+              bind(&ShardClient::MultiGetCallback, this, std::cref(promises[r]), first[r],
+                   &answered[r], placeholders::_1),
+              [&failed, r](const string &, replication::meerkatir::ErrorCode) {
+                  failed[r] = true;
+              },
+              promises[r][first[r]]->GetTimeout(), timestamp);
+            asked.push_back(r);
+        }
+        if (asked.empty()) {
+            return std::vector<bool>(failed.begin(), failed.end());
+        }
+
+        for (size_t r : asked) {
+            client->Wait(handles[r]);
+        }
+        for (size_t r : asked) {
+            if (failed[r] || answered[r] == first[r]) {
+                failed[r] = true;
+                for (size_t i = first[r]; i < keys.size(); i++) {
+                    GetTimeout(promises[r][i]);
+                }
+            }
+        }
+    }
 }
 
 void ShardClient::Prepare(uint64_t txn_nr,
@@ -118,7 +284,7 @@ void ShardClient::Prepare(uint64_t txn_nr,
     SendConsensus(txn_nr, core_id, promise, txn, timestamp,
           bind(&ShardClient::MeerkatDecide, this,
                placeholders::_1),
-          bind(&ShardClient::PrepareCallback, this,
+          bind(&ShardClient::PrepareCallback, this, promise,
                placeholders::_1), nullptr);
 }
 
@@ -183,52 +349,65 @@ void ShardClient::Abort(uint64_t txn_nr, uint8_t core_id,
 }
 
 void
-ShardClient::GetTimeout()
+ShardClient::GetTimeout(Promise *promise)
 {
-    if (waiting != NULL) {
-        Promise *w = waiting;
-        waiting = NULL;
-        w->Reply(REPLY_TIMEOUT);
+    if (promise != NULL) {
+        promise->Reply(REPLY_TIMEOUT);
     }
 }
 
 void
-ShardClient::GiveUpTimeout() {
+ShardClient::GiveUpTimeout(Promise *promise) {
     Debug("GiveupTimeout called.");
-    if (waiting != nullptr) {
-        Promise *w = waiting;
-        waiting = nullptr;
-        w->Reply(REPLY_TIMEOUT);
+    if (promise != nullptr) {
+        promise->Reply(REPLY_TIMEOUT);
     }
 }
 
 /* Callback from a shard replica on get operation completion. */
-void ShardClient::GetCallback(char *respBuf) {
+void ShardClient::GetCallback(Promise *promise, char *respBuf) {
     /* Replies back from a replica. */
     auto *resp = reinterpret_cast<replication::meerkatir::unlogged_response_t *>(respBuf);
 
     // Debug("[shard %lu:%i] GET callback [%d]", client_id, shard, reply.status());
-    if (waiting != NULL) {
-        Promise *w = waiting;
-        waiting = NULL;
-        w->Reply(resp->status, Timestamp(resp->timestamp, resp->id), std::string(resp->value, 64));
+    if (promise != NULL) {
+        promise->Reply(resp->status, Timestamp(resp->timestamp, resp->id),
+                       std::string(reinterpret_cast<char *>(resp + 1), resp->value_len),
+                       resp->fingerprint);
     } else {
         Warning("Waiting is null!");
     }
 }
 
+/* Callback from a shard replica on multi-get operation completion; the
+ * results are for the keys of promises from first on. */
+void ShardClient::MultiGetCallback(const std::vector<Promise *> &promises,
+                                   size_t first, size_t *answered,
+                                   char *respBuf) {
+    auto *resp = reinterpret_cast<replication::meerkatir::multiget_response_t *>(respBuf);
+    const char *ptr = reinterpret_cast<const char *>(resp + 1);
+    ASSERT(first + resp->nr_keys <= promises.size());
+    for (size_t i = first; i < first + resp->nr_keys; i++) {
+        auto *result = reinterpret_cast<const replication::meerkatir::multiget_result_t *>(ptr);
+        ptr += sizeof(*result);
+        promises[i]->Reply(result->status, Timestamp(result->timestamp, result->id),
+                           std::string(ptr, result->value_len),
+                           result->fingerprint);
+        ptr += result->value_len;
+    }
+    *answered = first + resp->nr_keys;
+}
+
 /* Callback from a shard replica on prepare operation completion. */
-void ShardClient::PrepareCallback(int decidedStatus) {
+void ShardClient::PrepareCallback(Promise *promise, int decidedStatus) {
     Debug("[shard %lu:%i] PREPARE callback [%d]", client_id, shard, decidedStatus);
 
-    if (waiting != NULL) {
-        Promise *w = waiting;
-        waiting = NULL;
+    if (promise != NULL) {
         // TODO: for now no optimization with RETRY
         //if (reply.has_timestamp()) {
         //    w->Reply(reply.status(), Timestamp(reply.timestamp()));
         //} else {
-            w->Reply(decidedStatus, Timestamp());
+            promise->Reply(decidedStatus, Timestamp());
         //}
     }
 }
@@ -237,10 +416,6 @@ void ShardClient::PrepareCallback(int decidedStatus) {
 void ShardClient::CommitCallback(char *respBuf) {
     // COMMITs always succeed.
     Debug("[shard %lu:%i] COMMIT callback", client_id, shard);
-
-    if (waiting != NULL) {
-        waiting = NULL;
-    }
 }
 
 } // namespace meerkatstore
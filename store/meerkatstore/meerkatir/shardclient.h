@@ -43,6 +43,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace meerkatstore {
 
@@ -64,6 +65,20 @@ public:
              uint8_t core_id,
              const std::string &key,
              Promise *promise = NULL) override;
+    void MultiGet(uint64_t txn_nr,
+                  uint8_t core_id,
+                  const std::vector<std::string> &keys,
+                  const std::vector<Promise *> &promises) override;
+    void GetAt(uint64_t txn_nr,
+               uint8_t core_id,
+               const std::string &key,
+               const Timestamp &timestamp,
+               Promise *promise = NULL) override;
+    void MultiGetAt(uint64_t txn_nr,
+                    uint8_t core_id,
+                    const std::vector<std::string> &keys,
+                    const Timestamp &timestamp,
+                    const std::vector<Promise *> &promises) override;
     void Prepare(uint64_t txn_nr,
                  uint8_t core_id,
                  const Transaction &txn,
@@ -86,19 +101,19 @@ private:
     int shard; // which shard this client accesses
     int replica; // which replica to use for reads
     bool replicated; // Is the database replicated?
+    // Replicas that did not answer the last snapshot read sent to them
+    std::vector<bool> unresponsive;
 
     replication::meerkatir::Client *client; // Client proxy.
-    Promise *waiting; // waiting thread
-    Promise *blockingBegin; // don't start a new transaction until current one
-                            // until finished (limitation on transport --
-                            // can't have more than one outstanding req,
-                            // cause it uses the same send buffer)
 
-    void SendUnreplicated(uint64_t txn_nr,
+    // Every request carries its own promise in its callbacks, so
+    // several of them can be in flight at once
+    replication::meerkatir::req_handle_t SendUnreplicated(uint64_t txn_nr,
                           uint8_t core_id,
                           Promise *promise, const std::string &request_str,
                           replication::meerkatir::unlogged_continuation_t callback,
-                          replication::meerkatir::error_continuation_t error_callback);
+                          replication::meerkatir::error_continuation_t error_callback,
+                          const Timestamp &snapshot = Timestamp());
     void SendInconsistent(uint64_t txn_nr,
                           uint8_t core_id,
                           bool commit,
@@ -113,18 +128,30 @@ private:
                        replication::meerkatir::consensus_continuation_t callback,
                        replication::meerkatir::error_continuation_t error_callback);
 
+    // Reads keys from every replica in replicas at once; promises[r][i]
+    // gets what replicas[r] has of keys[i]. Returns which replicas timed
+    // out before answering all the keys.
+    std::vector<bool> MultiGetFrom(uint64_t txn_nr,
+                                   uint8_t core_id,
+                                   const std::vector<int> &replicas,
+                                   const std::vector<std::string> &keys,
+                                   const Timestamp &timestamp,
+                                   const std::vector<std::vector<Promise *>> &promises);
+    void MultiGetCallback(const std::vector<Promise *> &promises,
+                          size_t first, size_t *answered, char *respBuf);
+
     /* Meerkat's Decide Function. */
     int MeerkatDecide(const boost::unordered_map<int, std::size_t> &results);
 
     /* Timeout for Get requests, which only go to one replica. */
-    void GetTimeout();
+    void GetTimeout(Promise *promise);
     /* Timeout for all the other requests that go to one
      * replica when replicated is false */
-    void GiveUpTimeout();
+    void GiveUpTimeout(Promise *promise);
 
     /* Callbacks for hearing back from a shard for an operation. */
-    void GetCallback(char *respBuf);
-    void PrepareCallback(int decidedStatus);
+    void GetCallback(Promise *promise, char *respBuf);
+    void PrepareCallback(Promise *promise, int decidedStatus);
     void CommitCallback(char *respBuf);
 
     /* Helper Functions for starting and finishing requests */
@@ -0,0 +1,14 @@
+d := $(dir $(lastword $(MAKEFILE_LIST)))
+
+#
+# gtest-based tests
+#
+GTEST_SRCS += $(addprefix $(d), \
+		snapshot_read_test.cc)
+
+$(d)snapshot_read_test: \
+	$(o)snapshot_read_test.o \
+	$(OBJS-meerkatstore-client) $(OBJS-meerkatstore-server) \
+	$(LIB-loopbacktransport) $(GTEST_MAIN)
+
+TEST_BINS += $(d)snapshot_read_test
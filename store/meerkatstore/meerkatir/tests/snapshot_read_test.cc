@@ -0,0 +1,89 @@
+// -*- mode: c++; c-file-style: "k&r"; c-basic-offset: 4 -*-
+/***********************************************************************
+ *
+ * store/meerkatstore/meerkatir/tests/snapshot_read_test.cc
+ *   Test cases for read-only transactions on snapshots, run against
+ *   replicas on the loopback transport.
+ *
+ **********************************************************************/
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "lib/configuration.h"
+#include "lib/loopbacktransport.h"
+#include "replication/meerkatir/replica.h"
+#include "store/meerkatstore/meerkatir/client.h"
+#include "store/meerkatstore/meerkatir/server.h"
+
+namespace {
+
+class SnapshotReadTest : public ::testing::Test {
+protected:
+    SnapshotReadTest()
+        : config(3, 1, {transport::ReplicaAddress("127.0.0.1", "1"),
+                        transport::ReplicaAddress("127.0.0.1", "2"),
+                        transport::ReplicaAddress("127.0.0.1", "3")}) {}
+
+    // Brings up the replicas, leaving out down: it is registered with
+    // the transport, but never serves what is sent to it.
+    void StartReplicas(int down) {
+        for (int r = 0; r < config.n; r++) {
+            auto *server = new meerkatstore::meerkatir::Server(false, "mvcc");
+            for (int k = 0; k < 4; k++) {
+                server->Load("key" + std::to_string(k), "null", Timestamp());
+            }
+            auto *transport = new LoopbackTransport(config, 1, 0);
+            new replication::meerkatir::Replica(config, r, transport, server);
+            transports.push_back(transport);
+            if (r != down) {
+                threads.emplace_back([transport]() { transport->Run(); });
+            }
+        }
+    }
+
+    void TearDown() override {
+        for (LoopbackTransport *transport : transports) {
+            transport->Stop();
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+    }
+
+    transport::Configuration config;
+    std::vector<LoopbackTransport *> transports;
+    std::vector<std::thread> threads;
+};
+
+TEST_F(SnapshotReadTest, ReplicaDownTest) {
+    const int down = 1;
+    StartReplicas(down);
+    LoopbackTransport transport(config, 1, 0);
+    meerkatstore::meerkatir::Client client(config, &transport, 1, 1, down,
+                                           0, 0, false, true);
+
+    client.Begin();
+    client.Put("key0", "v1");
+    client.Put("key1", "v1");
+    ASSERT_TRUE(client.Commit());
+
+    // The replica the client reads from first does not answer; the
+    // others make a quorum.
+    std::string value;
+    client.BeginReadOnly();
+    EXPECT_EQ(client.Get("key0", value), REPLY_OK);
+    EXPECT_EQ(value, "v1");
+    std::vector<std::string> values;
+    std::vector<int> statuses;
+    client.MultiGet({"key1", "key2"}, values, statuses);
+    EXPECT_EQ(statuses, std::vector<int>({REPLY_OK, REPLY_OK}));
+    EXPECT_EQ(values, std::vector<std::string>({"v1", "null"}));
+    EXPECT_EQ(client.Get("key9", value), REPLY_FAIL);
+    EXPECT_TRUE(client.Commit());
+}
+
+}  // namespace
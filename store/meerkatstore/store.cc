@@ -32,6 +32,8 @@
 
 #include "store/meerkatstore/store.h"
 
+#include <thread>
+
 namespace meerkatstore {
 
 using namespace std;
@@ -77,8 +79,87 @@ Store::Get(txnid_t txn_id, const string &key, pair<Timestamp,string> &value)
 int
 Store::Get(txnid_t txn_id, const string &key, const Timestamp &timestamp, pair<Timestamp,string> &value)
 {
-    Panic("Gets at a particular timestamp are not supported by Meerkatstore.");
-    return REPLY_FAIL;
+    Debug("GET %s at <%lu, %lu>", key.c_str(), timestamp.getTimestamp(),
+          timestamp.getID());
+    KeyEntry *entry = FindKey(key);
+    if (entry == nullptr) {
+        return REPLY_FAIL;
+    }
+
+    // The snapshot must already hold every write below it: wait for the
+    // prepared ones to finish, and keep new ones from preparing.
+    Timestamp current_timestamp;
+    store->WriteLock(entry->key, &current_timestamp);
+    if (!entry->writers.empty() && entry->writers.front()->ts <= timestamp) {
+        store->WriteUnlock(entry->key);
+        Debug("Key \"%s\" has a prepared write below the snapshot.",
+              key.c_str());
+        return REPLY_RETRY;
+    }
+    if (entry->snapshotTimestamp < timestamp) {
+        entry->snapshotTimestamp = timestamp;
+    }
+    store->WriteUnlock(entry->key);
+
+    switch (store->GetAt(key, timestamp, &value)) {
+    case ThreadSafeKvs::VERSION_FOUND:
+        return REPLY_OK;
+    case ThreadSafeKvs::VERSION_ABSENT:
+        Debug("Key \"%s\" not found at that timestamp.", key.c_str());
+        return REPLY_FAIL;
+    default:
+        // the version is gone, or this backend never kept it
+        Debug("Key \"%s\" has no version left at that timestamp.",
+              key.c_str());
+        return REPLY_RETRY;
+    }
+}
+
+void
+Store::MultiGet(const vector<string> &keys,
+                vector<pair<Timestamp,string>> &values,
+                vector<int> &statuses)
+{
+    Debug("MULTIGET %lu keys", keys.size());
+
+    vector<bool> found;
+    store->MultiGet(keys, &values, &found);
+    statuses.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        statuses[i] = found[i] ? REPLY_OK : REPLY_FAIL;
+    }
+}
+
+Store::KeyEntry *Store::FindKey(string_view key) {
+    auto it = keys.find(key);
+    if (it == keys.end()) {
+        Warning("Key \"%.*s\" was never loaded.", (int)key.size(), key.data());
+        return nullptr;
+    }
+    return it->second;
+}
+
+Store::KeyEntry *Store::FindFingerprint(uint64_t fingerprint) {
+    auto it = fingerprints.find(fingerprint);
+    if (it == fingerprints.end() || it->second == nullptr) {
+        // we never hand out such fingerprints
+        Warning("Unknown key fingerprint %lx.", fingerprint);
+        return nullptr;
+    }
+    return it->second;
+}
+
+uint64_t Store::Fingerprint(const string &key) {
+    if (!fingerprintReads) {
+        return 0;
+    }
+    uint64_t fingerprint = KeyFingerprint(key);
+    auto it = fingerprints.find(fingerprint);
+    if (it == fingerprints.end() || it->second == nullptr ||
+        it->second->key != key) {
+        return 0;
+    }
+    return fingerprint;
 }
 
 void Store::clean_preparing_transaction(PreparingTransaction *p) {
@@ -86,54 +167,148 @@ void Store::clean_preparing_transaction(PreparingTransaction *p) {
 
     if (p) {
         for (auto node : p->readNodes) {
-            const auto key = node.first;
+            const string &key = node.first->key;
             store->WriteLock(key, &current_timestamp);
-            readers[node.first]->remove(node.second);
+            node.first->readers.remove(node.second);
             store->WriteUnlock(key);
         }
         for (auto node : p->writeNodes) {
-            const auto key = node.first;
+            const string &key = node.first->key;
             store->WriteLock(key, &current_timestamp);
-            writers[node.first]->remove(node.second);
+            node.first->writers.remove(node.second);
             store->WriteUnlock(key);
         }
         delete p;
     }
 }
 
-void Store::clean_transaction(txnid_t txn_id, const Transaction &txn) {
+void Store::clean_transaction(txnid_t txn_id, const TransactionView &txn) {
 
     PreparingTransaction p = {txn_id};
     PreparingTransaction* preparingTransaction = nullptr;
     Timestamp current_timestamp;
 
-    if (!txn.getReadSet().empty()) {
-        auto read_key = txn.getReadSet().begin()->first;
-        store->WriteLock(read_key, &current_timestamp);
-        auto node = readers[read_key]->find(&p);
-        //TODO: grab a lock inside the node->key itself
-        //      to protect against other threads processing this same transaction
-        if (node != readers[read_key]->end()) {
-            preparingTransaction = node->key;
-        }
-        store->WriteUnlock(read_key);
-    } else {
-        auto write_key = txn.getWriteSet().begin()->first;
-        store->WriteLock(write_key, &current_timestamp);
-        auto node = writers[write_key]->find(&p);
-        //TODO: grab a lock inside the node->key itself
-        //      to protect against other threads processing this same transaction
-        if (node != writers[write_key]->end()) {
-            preparingTransaction = node->key;
-        }
-        store->WriteUnlock(write_key);
+    // a prepared transaction is in the readers list of all the keys it
+    // read, or else in the writers list of all the keys it writes
+    KeyEntry *entry = nullptr;
+    bool read = true;
+    if (txn.readSetSize() > 0) {
+        auto first = *txn.getReads().begin();
+        entry = first.fingerprint != 0 ? FindFingerprint(first.fingerprint)
+                                       : FindKey(first.key);
+    } else if (txn.writeSetSize() > 0) {
+        entry = FindKey((*txn.getWrites().begin()).key);
+        read = false;
+    }
+    if (entry == nullptr) {
+        return;
+    }
+
+    DLinkedList<PreparingTransaction> &list = read ? entry->readers : entry->writers;
+    store->WriteLock(entry->key, &current_timestamp);
+    auto node = list.find(&p);
+    //TODO: grab a lock inside the node->key itself
+    //      to protect against other threads processing this same transaction
+    if (node != list.end()) {
+        preparingTransaction = node->key;
     }
+    store->WriteUnlock(entry->key);
 
 	clean_preparing_transaction(preparingTransaction);
 }
 
+bool
+Store::PrepareRead(PreparingTransaction *p, KeyEntry *entry,
+                   const Timestamp &read_timestamp)
+{
+    const txnid_t &txn_id = p->txn_id;
+    const Timestamp &timestamp = p->ts;
+    Timestamp current_timestamp;
+    bool valid = true;
+
+    // use the store's write lock to
+    // protect access to readers and writers list of this key
+    // TODO: this will block Gets -> can we use other locks for this?
+    store->WriteLock(entry->key, &current_timestamp);
+
+    if (read_timestamp < current_timestamp) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu]"
+              " Read check failed due to modified read key;"
+              " ts last wrote= %lu; ts read = %lu",
+              txn_id.first, txn_id.second,
+              current_timestamp.getTimestamp(),
+              read_timestamp.getTimestamp());
+    }
+
+    if (!entry->writers.empty() && timestamp > entry->writers.front()->ts) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu]"
+              " Read check failed due to active conflicting writers",
+              txn_id.first, txn_id.second);
+    }
+
+    if (valid) {
+        // insert into readers while maintaining the list ordered
+        auto newNode = entry->readers.insert_sorted(p);
+        p->readNodes.emplace_back(entry, newNode);
+    }
+
+    store->WriteUnlock(entry->key);
+    return valid;
+}
+
+bool
+Store::PrepareWrite(PreparingTransaction *p, KeyEntry *entry)
+{
+    const txnid_t &txn_id = p->txn_id;
+    const Timestamp &timestamp = p->ts;
+    Timestamp current_timestamp;
+    bool valid = true;
+
+    store->WriteLock(entry->key, &current_timestamp);
+
+    if (timestamp < current_timestamp) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu] [%lu, %lu], [%lu, %lu] key = %s; Write check failed due to too small timestamp",
+              txn_id.first, txn_id.second, timestamp.getTimestamp(), timestamp.getID(), current_timestamp.getTimestamp(), current_timestamp.getID(), entry->key.c_str());
+    }
+
+    // snapshot reads above the proposed timestamp did not see this write
+    if (timestamp <= entry->snapshotTimestamp) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu] Write check failed due to a later snapshot read",
+              txn_id.first, txn_id.second);
+    }
+
+    // if there is a pending read for this key, greater than the
+    // proposed timestamp, abort
+    if (!entry->readers.empty() && timestamp < entry->readers.back()->ts) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu] Write check failed due to active conflicting readers",
+              txn_id.first, txn_id.second);
+    }
+
+    // if there is a pending write for this key, greater than the
+    // proposed timestamp, abort
+    if (!entry->writers.empty() && timestamp < entry->writers.back()->ts) {
+        valid = false;
+        Debug("[MultitapirStore::Prepare] [%lu - %lu] Write check failed due to active conflicting writers",
+              txn_id.first, txn_id.second);
+    }
+
+    if (valid) {
+        // insert into writers while maintaining the list ordered
+        auto newNode = entry->writers.insert_sorted(p);
+        p->writeNodes.emplace_back(entry, newNode);
+    }
+
+    store->WriteUnlock(entry->key);
+    return valid;
+}
+
 int
-Store::Prepare(txnid_t txn_id, const Transaction &txn, const Timestamp &timestamp, Timestamp &proposedTimestamp)
+Store::Prepare(txnid_t txn_id, const TransactionView &txn, const Timestamp &timestamp, Timestamp &proposedTimestamp)
 {
     Debug("[%lu - %lu] START PREPARE", txn_id.first, txn_id.second);
     // TODO: For now assume we do not support inserts
@@ -145,94 +320,27 @@ Store::Prepare(txnid_t txn_id, const Transaction &txn, const Timestamp &timestam
     auto preparingTransaction = new PreparingTransaction();
     preparingTransaction->ts = timestamp;
     preparingTransaction->txn_id = txn_id;
-
-    int valid = true;
+    preparingTransaction->readNodes.reserve(txn.readSetSize());
+    preparingTransaction->writeNodes.reserve(txn.writeSetSize());
 
     // check for conflicts with the read set
     // assume ordered read check
-    for (const auto &read : txn.getReadSet()) {
-        const string& key = read.first;
-        const Timestamp& read_timestamp = read.second;
-        Timestamp current_timestamp;
-
-        // use the store's write lock to
-        // protect access to readers and writers list of this key
-        // TODO: this will block Gets -> can we use other locks for this?
-        store->WriteLock(key, &current_timestamp);
-
-        if (read_timestamp < current_timestamp) {
-            valid = false;
-            Debug("[MultitapirStore::Prepare] [%lu - %lu]"
-                  " Read check failed due to modified read key;"
-                  " ts last wrote= %lu; ts read = %lu",
-                  txn_id.first, txn_id.second,
-                  current_timestamp.getTimestamp(),
-                  read_timestamp.getTimestamp());
-        }
-
-        if (!writers[key]->empty() && timestamp > writers[key]->front()->ts) {
-            valid = false;
-            Debug("[MultitapirStore::Prepare] [%lu - %lu]"
-                  " Read check failed due to active conflicting writers",
-                  txn_id.first, txn_id.second);
-        }
-
-    	if (valid) {
-            // insert into readers while maintaining the list ordered
-            // TODO: any problems if inserting twice the same read key?
-            auto newNode = readers[key]->insert_sorted(preparingTransaction);
-            preparingTransaction->readNodes[key] = newNode;
-    	}
-
-        store->WriteUnlock(key);
-
-        if (!valid) {
-    	    // clean-up metadata
+    for (const auto &read : txn.getReads()) {
+        KeyEntry *entry = read.fingerprint != 0 ? FindFingerprint(read.fingerprint)
+                                                : FindKey(read.key);
+        if (entry == nullptr ||
+            !PrepareRead(preparingTransaction, entry, read.timestamp)) {
+            // clean-up metadata
             clean_preparing_transaction(preparingTransaction);
-	        return REPLY_FAIL;
+            return REPLY_FAIL;
         }
     }
 
     // check for conflicts with the write set
-    for (const auto &write : txn.getWriteSet()) {
-        const string& key = write.first;
-        Timestamp current_timestamp;
-
-        store->WriteLock(key, &current_timestamp);
-
-        if (timestamp < current_timestamp) {
-            valid = false;
-            Debug("[MultitapirStore::Prepare] [%lu - %lu] [%lu, %lu], [%lu, %lu] key = %s; Write check failed due to too small timestamp",
-                  txn_id.first, txn_id.second, timestamp.getTimestamp(), timestamp.getID(), current_timestamp.getTimestamp(), current_timestamp.getID(), key.c_str());
-        }
-
-        // if there is a pending read for this key, greater than the
-        // proposed timestamp, abort
-        if (!readers[key]->empty() && timestamp < readers[key]->back()->ts) {
-            valid = false;
-            Debug("[MultitapirStore::Prepare] [%lu - %lu] Write check failed due to active conflicting readers",
-                  txn_id.first, txn_id.second);
-        }
-
-        // if there is a pending write for this key, greater than the
-        // proposed timestamp, abort
-        if (!writers[key]->empty() && timestamp < writers[key]->back()->ts) {
-            valid = false;
-            Debug("[MultitapirStore::Prepare] [%lu - %lu] Write check failed due to active conflicting writers",
-                  txn_id.first, txn_id.second);
-        }
-
-        if (valid) {
-            // insert into writers while maintaining the list ordered
-            // TODO: any problems if inserting twice the same read key?
-            auto newNode = writers[key]->insert_sorted(preparingTransaction);
-            preparingTransaction->writeNodes[key] = newNode;
-        }
-
-        store->WriteUnlock(key);
-
-        if (!valid) {
-            // clean-up metadata
+    for (const auto &write : txn.getWrites()) {
+        KeyEntry *entry = FindKey(write.key);
+        if (entry == nullptr ||
+            !PrepareWrite(preparingTransaction, entry)) {
             clean_preparing_transaction(preparingTransaction);
             return REPLY_FAIL;
         }
@@ -242,18 +350,38 @@ Store::Prepare(txnid_t txn_id, const Transaction &txn, const Timestamp &timestam
 }
 
 void
-Store::Commit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn)
+Store::apply_writes(const Timestamp &timestamp, const TransactionView &txn)
 {
+    // the writes are logged before anyone can read them
+    shared_lock<shared_mutex> barrier;
+    if (log != nullptr && txn.writeSetSize() > 0) {
+        barrier = shared_lock<shared_mutex>(commitBarrier);
+        log->Append(timestamp, txn);
+    }
 
-    Debug("[%lu - %lu] COMMIT r = %lu, w = %lu; timestamp = %lu", txn_id.first, txn_id.second,
-          txn.getReadSet().size(), txn.getWriteSet().size(), timestamp.getTimestamp());
+    for (const auto &write : txn.getWrites()) {
+        // prepared writes are to loaded keys, whose entries hold the
+        // key as a string already
+        auto it = keys.find(write.key);
+        if (it != keys.end()) {
+            store->Put(it->second->key, string(write.value), timestamp);
+        } else {
+            store->Put(string(write.key), string(write.value), timestamp);
+        }
+    }
+}
+
+void
+Store::Commit(txnid_t txn_id, const Timestamp &timestamp, const TransactionView &txn)
+{
+
+    Debug("[%lu - %lu] COMMIT r = %u, w = %u; timestamp = %lu", txn_id.first, txn_id.second,
+          txn.readSetSize(), txn.writeSetSize(), timestamp.getTimestamp());
 
     // TODO: TICTOC like optimization - maintain and update read timestamp
 
     // insert writes into versioned key-value store
-    for (auto &write : txn.getWriteSet()) {
-        store->Put(write.first, write.second, timestamp);
-    }
+    apply_writes(timestamp, txn);
 
     // clean-up metadata
     // remove transaction from readers and writers
@@ -261,35 +389,177 @@ Store::Commit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn
 }
 
 void
-Store::ForceCommit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn) {
-    Debug("[%lu - %lu] FORCE_COMMIT r = %lu, w = %lu; timestamp = %lu", txn_id.first, txn_id.second,
-          txn.getReadSet().size(), txn.getWriteSet().size(), timestamp.getTimestamp());
+Store::ForceCommit(txnid_t txn_id, const Timestamp &timestamp, const TransactionView &txn) {
+    Debug("[%lu - %lu] FORCE_COMMIT r = %u, w = %u; timestamp = %lu", txn_id.first, txn_id.second,
+          txn.readSetSize(), txn.writeSetSize(), timestamp.getTimestamp());
 
     // TODO: TICTOC like optimization - maintain and update read timestamp
 
     // insert writes into versioned key-value store
-    for (auto &write : txn.getWriteSet()) {
-        store->Put(write.first, write.second, timestamp);
-    }
+    apply_writes(timestamp, txn);
 }
 
 void
-Store::Abort(txnid_t txn_id, const Transaction &txn)
+Store::Abort(txnid_t txn_id, const TransactionView &txn)
 {
-    Debug("[%lu - %lu] ABORT r = %lu, w = %lu", txn_id.first, txn_id.second,
-          txn.getReadSet().size(), txn.getWriteSet().size());
+    Debug("[%lu - %lu] ABORT r = %u, w = %u", txn_id.first, txn_id.second,
+          txn.readSetSize(), txn.writeSetSize());
 
     // clean-up metadata
     // remove transaction from readers and writers
     clean_transaction(txn_id, txn);
 }
 
+void
+Store::Reserve(size_t n)
+{
+    store->Reserve(n);
+    keys.reserve(n);
+    fingerprints.reserve(n);
+}
+
+bool
+Store::IndexKey(KeyEntry *entry, uint64_t fingerprint)
+{
+    if (!keys.emplace(entry->key, entry).second) {
+        return false;
+    }
+    IndexFingerprint(entry, fingerprint);
+    return true;
+}
+
+void
+Store::IndexFingerprint(KeyEntry *entry, uint64_t fingerprint)
+{
+    // keys that share a fingerprint are only validated by key
+    auto ret = fingerprints.emplace(fingerprint, entry);
+    if (!ret.second) {
+        Debug("Keys \"%s\" and \"%s\" have the same fingerprint",
+              entry->key.c_str(), ret.first->second ? ret.first->second->key.c_str() : "");
+        ret.first->second = nullptr;
+    }
+}
+
 void
 Store::Load(const string &key, const string &value, const Timestamp &timestamp)
 {
     store->Put(key, value, timestamp);
-    readers[key] = new DLinkedList<PreparingTransaction>();
-    writers[key] = new DLinkedList<PreparingTransaction>();
+    loaded = max(loaded, timestamp);
+    if (keys.find(key) != keys.end()) {
+        return;
+    }
+
+    KeyEntry *entry = new KeyEntry();
+    entry->key = key;
+    IndexKey(entry, KeyFingerprint(key));
+}
+
+void
+Store::Recover(CommitLog *log)
+{
+    size_t replayed = 0;
+    log->Replay([this, &replayed](const Timestamp &timestamp,
+                                  string_view key, string_view value) {
+        loaded = max(loaded, timestamp);
+        // the loaded keys may have the write already, e.g. when they
+        // come from a snapshot taken after it
+        pair<Timestamp, string> current;
+        if (store->Get(string(key), &current) && timestamp <= current.first) {
+            return;
+        }
+        auto it = keys.find(key);
+        store->Put(it != keys.end() ? it->second->key : string(key),
+                   string(value), timestamp);
+        replayed++;
+    });
+    Notice("Replayed %lu writes from the commit log", replayed);
+    this->log = log;
+}
+
+void
+Store::Load(const Snapshot &snapshot, uint32_t shard, int nthreads)
+{
+    const size_t n = snapshot.NumEntries(shard);
+    Reserve(keys.size() + n);
+    KeyEntry *entries = new KeyEntry[n];
+    loadedEntries.emplace_back(entries);
+
+    // Copying the keys and values is most of the work; every thread
+    // loads its part of the keys without taking any lock.
+    store->StartLoad(nthreads);
+    snapshot.ParallelForEach(shard, nthreads,
+        [this, entries](int t, size_t i, const Snapshot::Entry &e) {
+            entries[i].key.assign(e.key);
+            store->LoadPut(t, entries[i].key, string(e.value), e.timestamp);
+        });
+
+    // Publishing the keys in the key-value store and filling each of our
+    // indexes are single passes over all the keys, which run side by
+    // side. The fingerprints come with the snapshot.
+    thread publish([this]() { store->FinishLoad(); });
+    thread byFingerprint([this, &snapshot, shard, entries, n]() {
+        for (size_t i = 0; i < n; i++) {
+            IndexFingerprint(&entries[i],
+                             snapshot.GetEntry(shard, i).fingerprint);
+        }
+    });
+    for (size_t i = 0; i < n; i++) {
+        // the key-value store was promised distinct new keys
+        if (!keys.emplace(entries[i].key, &entries[i]).second) {
+            Panic("Key %s is loaded twice", entries[i].key.c_str());
+        }
+        loaded = max(loaded, snapshot.GetEntry(shard, i).timestamp);
+    }
+    publish.join();
+    byFingerprint.join();
+}
+
+bool
+Store::Checkpoint(const string &path, uint32_t shard, uint32_t numShards)
+{
+    ASSERT(log != nullptr);
+    ASSERT(shard < numShards);
+    // before we rotate the log, which would leave a file behind
+    if (!store->SupportsCheckpoints()) {
+        return false;
+    }
+
+    // With commits held off, every write so far is in the rotated log
+    // files and in the store, at or below the cut. The writes of later
+    // commits go to the new files, whatever their timestamps.
+    Timestamp cut;
+    {
+        unique_lock<shared_mutex> barrier(commitBarrier);
+        cut = max(loaded, log->Rotate());
+        store->StartCheckpoint(cut);
+    }
+
+    // the other shards of the file stay empty
+    SnapshotWriter writer(path, numShards);
+    size_t n = 0;
+    store->FinishCheckpoint([&writer, &n, shard](string_view key,
+                                                 const string &value,
+                                                 const Timestamp &timestamp) {
+        writer.Add(shard, key, value, timestamp);
+        n++;
+    });
+    writer.Finish();
+    log->DropRotated();
+    Notice("Checkpointed %lu keys at %lu.%lu to %s", n,
+           cut.getTimestamp(), cut.getID(), path.c_str());
+    return true;
+}
+
+bool
+Store::SupportsCheckpoints() const
+{
+    return store->SupportsCheckpoints();
+}
+
+bool
+Store::SupportsSnapshots() const
+{
+    return store->SupportsSnapshots();
 }
 
 } // namespace meerkatstore
@@ -34,31 +34,41 @@
 
 #include "lib/assert.h"
 #include "lib/message.h"
+#include "store/common/commitlog.h"
+#include "store/common/snapshot.h"
 #include "store/common/timestamp.h"
 #include "store/common/transaction.h"
+#include "store/common/transactionview.h"
 #include "store/common/backend/txnstore.h"
 #include "store/common/backend/thread_safe_kvs.h"
 #include "store/common/backend/atomic_kvs.h"
 #include "store/common/backend/pthread_kvs.h"
-#include "store/common/backend/versionstore.h"
 #include "store/meerkatstore/dlinkedlist.h"
 #include "replication/meerkatir/replica.h"
 
+#include <memory>
 #include <set>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <pthread.h>
 #include <mutex>
+#include <shared_mutex>
 
 namespace meerkatstore {
 
 class Store : public TxnStore
 {
+    struct KeyEntry;
+
     struct PreparingTransaction
     {
+        typedef DLinkedList<PreparingTransaction>::Node Node;
+
         txnid_t txn_id;
         Timestamp ts;
-        std::unordered_map<std::string, DLinkedList<PreparingTransaction>::Node*> readNodes;
-        std::unordered_map<std::string, DLinkedList<PreparingTransaction>::Node*> writeNodes;
+        std::vector<std::pair<KeyEntry*, Node*>> readNodes;
+        std::vector<std::pair<KeyEntry*, Node*>> writeNodes;
 
         friend bool operator< (const PreparingTransaction &t1, const PreparingTransaction &t2) {
             return t1.ts < t2.ts;
@@ -73,20 +83,66 @@ class Store : public TxnStore
         };
 
     };
+
+    // Everything Prepare needs to know about a key, found with a single
+    // lookup by key or by fingerprint
+    struct KeyEntry
+    {
+        std::string key;
+        // Ordered list of active readers of the key
+        DLinkedList<PreparingTransaction> readers;
+        // Ordered list of active writers of the key
+        DLinkedList<PreparingTransaction> writers;
+        // Latest snapshot the key was read at; writers below it would
+        // change what the snapshot read
+        Timestamp snapshotTimestamp;
+    };
 public:
-    Store(bool twopc, bool replicated, ThreadSafeKvs *store)
-        : twopc(twopc), replicated(replicated), store(store) {} //{fake_counter[10].store(0);}
+    // With fingerprintReads, Fingerprint hands out key fingerprints that
+    // clients may send in their read sets instead of the keys
+    Store(bool twopc, bool replicated, ThreadSafeKvs *store,
+          bool fingerprintReads = false)
+        : twopc(twopc), replicated(replicated),
+          fingerprintReads(fingerprintReads), store(store), log(nullptr) {} //{fake_counter[10].store(0);}
 
     // Overriding from TxnStore
     void Begin(txnid_t txn_id);
     int Get(const std::string &key, std::pair<Timestamp, std::string> &value);
     int Get(txnid_t txn_id, const std::string &key, std::pair<Timestamp, std::string> &value);
+    // Reads key as of the snapshot timestamp, without validation later;
+    // returns REPLY_RETRY while a writer below the snapshot is prepared
     int Get(txnid_t txn_id, const std::string &key, const Timestamp &timestamp, std::pair<Timestamp, std::string> &value);
-    int Prepare(txnid_t txn_id, const Transaction &txn, const Timestamp &timestamp, Timestamp &proposed);
-    void Commit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn);
-    void ForceCommit(txnid_t txn_id, const Timestamp &timestamp, const Transaction &txn);
-    void Abort(txnid_t txn_id, const Transaction &txn = Transaction());
+    // Reads all of keys at once, with the statuses of Get
+    void MultiGet(const std::vector<std::string> &keys,
+                  std::vector<std::pair<Timestamp, std::string>> &values,
+                  std::vector<int> &statuses);
+    int Prepare(txnid_t txn_id, const TransactionView &txn, const Timestamp &timestamp, Timestamp &proposed);
+    void Commit(txnid_t txn_id, const Timestamp &timestamp, const TransactionView &txn);
+    void ForceCommit(txnid_t txn_id, const Timestamp &timestamp, const TransactionView &txn);
+    void Abort(txnid_t txn_id, const TransactionView &txn = TransactionView());
     void Load(const std::string &key, const std::string &value, const Timestamp &timestamp);
+    // Loads all the keys of a shard of snapshot, from nthreads threads;
+    // none of them may be loaded already
+    void Load(const Snapshot &snapshot, uint32_t shard, int nthreads);
+    // Makes room for loading n keys
+    void Reserve(size_t n);
+    // Replays log on top of the loaded keys, then logs every commit to
+    // it before applying it
+    void Recover(CommitLog *log);
+    // Writes the store, as shard of numShards, to a snapshot at path
+    // while commits go on, then drops the log files it covers; needs
+    // the log of Recover. Returns false if the key-value store does not
+    // support checkpoints.
+    bool Checkpoint(const std::string &path, uint32_t shard,
+                    uint32_t numShards);
+    bool SupportsCheckpoints() const;
+    // Whether the key-value store keeps the older versions that reads at
+    // a snapshot need
+    bool SupportsSnapshots() const;
+
+    // Fingerprint of key to return with a read of key, or 0 if reads of
+    // key must be validated by key
+    uint64_t Fingerprint(const std::string &key);
 
     // volatile std::atomic<uint64_t> fake_counter[20];
 private:
@@ -97,15 +153,46 @@ private:
     // Is our data replicated?
     const bool replicated;
 
+    // Do we hand out key fingerprints?
+    const bool fingerprintReads;
+
     // Data store.
     ThreadSafeKvs* store;
 
-    // Ordered list of active readers of per key
-    std::unordered_map<std::string, DLinkedList<PreparingTransaction>*> readers;
-    // Ordered list of active writers of per key
-    std::unordered_map<std::string, DLinkedList<PreparingTransaction>*> writers;
-
-    void clean_transaction(txnid_t id, const Transaction &txn);
+    // Log of the commits, if they are durable
+    CommitLog *log;
+
+    // Held shared by commits while they log and apply their writes, and
+    // exclusively by Checkpoint while it picks its cut
+    std::shared_mutex commitBarrier;
+
+    // Largest timestamp loaded or replayed
+    Timestamp loaded;
+
+    // Index of the loaded keys, by key and by fingerprint. Fingerprints
+    // shared by several keys map to nullptr; reads of those keys are
+    // always validated by key. The keys of the index are views of the
+    // keys of the entries, so that lookups by the keys of a
+    // TransactionView do not copy them.
+    std::unordered_map<std::string_view, KeyEntry*> keys;
+    std::unordered_map<uint64_t, KeyEntry*> fingerprints;
+
+    // Entries of the keys loaded from snapshots, a shard at a time
+    std::vector<std::unique_ptr<KeyEntry[]>> loadedEntries;
+
+    // Adds entry to the indexes, unless its key is there already;
+    // returns whether it was added
+    bool IndexKey(KeyEntry *entry, uint64_t fingerprint);
+    // Adds entry to the index by fingerprint only
+    void IndexFingerprint(KeyEntry *entry, uint64_t fingerprint);
+    KeyEntry *FindKey(std::string_view key);
+    KeyEntry *FindFingerprint(uint64_t fingerprint);
+    bool PrepareRead(PreparingTransaction *p, KeyEntry *entry,
+                     const Timestamp &read_timestamp);
+    bool PrepareWrite(PreparingTransaction *p, KeyEntry *entry);
+
+    void clean_transaction(txnid_t id, const TransactionView &txn);
+    void apply_writes(const Timestamp &timestamp, const TransactionView &txn);
     void clean_preparing_transaction(PreparingTransaction *p);
 };
 
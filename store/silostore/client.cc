@@ -206,7 +206,7 @@ void Client::Abort() {
     // to send an abort  message to the read-only shards because they don't
     // hold any locks.
     for (int p : participants) {
-        if (!bclient[p]->GetTransaction().getWriteSet().empty()) {
+        if (bclient[p]->GetTransaction().writeSetSize() > 0) {
             Debug("Client is sending abort to shard %d.", p);
             bclient[p]->Abort();
         }
@@ -57,17 +57,18 @@ void ServerIR::LeaderUpcall(txnid_t txn_id,
     }
 
     // TODO: merge status with transaction status
-    crt_txn_state->txn = Transaction(req->nr_reads, req->nr_writes, (char *)(req + 1));
+    crt_txn_state->txn.assign(req->nr_reads, req->nr_writes, (char *)(req + 1));
+    Transaction txn(crt_txn_state->txn.view());
 
     Timestamp proposed_write_ts;
     Timestamp proposed;
     int status = store->PrepareWrite(
-        txn_id, crt_txn_state->txn,
+        txn_id, txn,
         proposed_write_ts);
 
     if (status == REPLY_OK) {
         status = store->PrepareRead(
-         txn_id, crt_txn_state->txn,
+         txn_id, txn,
          proposed_write_ts, proposed);
     }
 
@@ -83,7 +84,7 @@ void ServerIR::LeaderUpcall(txnid_t txn_id,
 
 void ServerIR::LeaderUpcallPostPrepare(txnid_t txn_id,
                             replication::RecordEntry *crt_txn_state) {
-    store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn);
+    store->Commit(txn_id, crt_txn_state->ts, crt_txn_state->txn.view());
 }
 
 void ServerIR::ReplicaUpcall(txnid_t txn_id,
@@ -94,7 +95,7 @@ void ServerIR::ReplicaUpcall(txnid_t txn_id,
         Warning("Trying to commit an un-prepared transaction.");
         return;
     }
-    store->ForceCommit(txn_id, crt_txn_state->ts, crt_txn_state->txn);
+    store->ForceCommit(txn_id, crt_txn_state->ts, crt_txn_state->txn.view());
 }
 
 void ServerIR::UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
@@ -102,16 +103,19 @@ void ServerIR::UnloggedUpcall(char *reqBuf, char *respBuf, size_t &respLen) {
     pair<Timestamp, string> val;
 
     auto *req = reinterpret_cast<replication::leadermeerkatir::unlogged_request_t *>(reqBuf);
-    std::string key = string(req->key, 64);
+    std::string key = string(reinterpret_cast<char *>(req + 1), req->key_len);
     int status = store->Get(key, val);
 
     auto *resp = reinterpret_cast<replication::leadermeerkatir::unlogged_response_t *>(respBuf);
-    respLen = sizeof(replication::leadermeerkatir::unlogged_response_t);
+    ASSERT(val.second.size() <= MAX_VALUE_SIZE);
+    respLen = sizeof(replication::leadermeerkatir::unlogged_response_t) + val.second.size();
     resp->status = status;
     resp->req_nr = req->req_nr;
     resp->timestamp = val.first.getTimestamp();
     resp->id = val.first.getID();
-    memcpy(resp->value, val.second.c_str(), 64);
+    resp->fingerprint = 0;
+    resp->value_len = val.second.size();
+    memcpy(resp + 1, val.second.data(), val.second.size());
 }
 
 void ServerIR::Load(const string &key, const string &value, const Timestamp timestamp) {
@@ -33,10 +33,9 @@
 #define _SILO_SERVER_H_
 
 #include <memory>
+#include <string>
 
 #include "replication/leadermeerkatir/replica.h"
-#include "store/common/backend/atomic_kvs.h"
-#include "store/common/backend/pthread_kvs.h"
 #include "store/common/backend/thread_safe_kvs.h"
 #include "store/common/timestamp.h"
 #include "store/common/truetime.h"
@@ -54,10 +53,11 @@ public:
 
 class ServerIR : public Server, public replication::leadermeerkatir::IRAppReplica {
 public:
-    ServerIR()
+    // kvsBackend names the backend of the store (see NewThreadSafeKvs).
+    explicit ServerIR(const std::string &kvsBackend = "atomic")
         : twopc(twopc),
           replicated(replicated),
-          kvs(new AtomicKvs()),
+          kvs(NewThreadSafeKvs(kvsBackend)),
           store(new Store(/*twopc=*/false, /*replicated=*/true, kvs.get())) {}
 
     void LeaderUpcall(txnid_t txn_id,
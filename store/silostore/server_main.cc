@@ -125,7 +125,7 @@ main(int argc, char **argv)
                 "only %d replicas defined\n", FLAGS_replicaIndex, config.n);
     }
 
-    silostore::Server *server = new silostore::ServerIR();
+    silostore::Server *server = new silostore::ServerIR(FLAGS_kvs);
 
     // Load keys in memory
     if (FLAGS_keysFile != "") {
@@ -158,6 +158,8 @@ main(int argc, char **argv)
     if (numa_available() == -1) {
         PPanic("NUMA library not available.");
     }
+    FastTransport::SetMaxResponseSize(
+        sizeof(replication::leadermeerkatir::unlogged_response_t) + MAX_VALUE_SIZE);
 
     //int nn_ct = numa_max_node() + 1;
     //int ht_ct = boost::thread::hardware_concurrency()/boost::thread::physical_concurrency(); // number of hyperthreads
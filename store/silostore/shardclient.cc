@@ -109,7 +109,9 @@ void ShardClientIR::GetCallback(char *respBuf) {
     if (waiting != NULL) {
         Promise *w = waiting;
         waiting = NULL;
-        w->Reply(resp->status, Timestamp(resp->timestamp, resp->id), std::string(resp->value, 64));
+        w->Reply(resp->status, Timestamp(resp->timestamp, resp->id),
+                 std::string(reinterpret_cast<char *>(resp + 1), resp->value_len),
+                 resp->fingerprint);
     } else {
         Warning("Waiting is null!");
     }
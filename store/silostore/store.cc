@@ -80,11 +80,19 @@ int Store::Get(txnid_t txn_id, const string &key,
 
 int Store::Get(txnid_t txn_id, const string &key, const Timestamp &timestamp,
                pair<Timestamp, string> &value) {
-    Panic("Gets at a particular timestamp are not supported by Silo.");
-    return REPLY_FAIL;
+    Debug("GET %s at <%lu, %lu>", key.c_str(), timestamp.getTimestamp(),
+          timestamp.getID());
+    if (store->GetAt(key, timestamp, &value) ==
+        ThreadSafeKvs::VERSION_FOUND) {
+        return REPLY_OK;
+    } else {
+        Debug("[%lu - %lu] Key %s not found at that timestamp.",
+              txn_id.first, txn_id.second, key.c_str());
+        return REPLY_FAIL;
+    }
 }
 
-int Store::Prepare(txnid_t id, const Transaction &txn,
+int Store::Prepare(txnid_t id, const TransactionView &txn,
                    const Timestamp &timestamp, Timestamp &proposedTimestamp) {
     Panic("Unimplemented");
     return REPLY_FAIL;
@@ -105,8 +113,8 @@ int Store::PrepareWrite(txnid_t txn_id, const Transaction &txn,
     // a non-distributed and non-replicated setting, we perpetually try to
     // acquire locks. In a distributed setting, we conservatively abort to
     // prevent distributed deadlock.
-    for (const pair<const string, string> &write : txn.getWriteSet()) {
-        const string &key = write.first;
+    for (size_t i = 0; i < txn.writeSetSize(); i++) {
+        const string key(txn.getWrite(i).key);
         bool flag_acquired = false;
         Timestamp timestamp;
 
@@ -167,9 +175,10 @@ int Store::PrepareRead(txnid_t txn_id, const Transaction &txn,
     // A timestamp larger than any value read or written by this transaction.
     Timestamp max_tid = write_timestamp;
 
-    for (const pair<const string, Timestamp> &read : txn.getReadSet()) {
-        const string &key = read.first;
-        const Timestamp &read_timestamp = read.second;
+    for (size_t i = 0; i < txn.readSetSize(); i++) {
+        const Transaction::Read read = txn.getRead(i);
+        const string key(read.key);
+        const Timestamp &read_timestamp = read.timestamp;
 
         // // Simulate a visible read.
         // if (fake_visible_reads) {
@@ -181,7 +190,8 @@ int Store::PrepareRead(txnid_t txn_id, const Transaction &txn,
 
         // get the current version from the store
         std::pair<Timestamp, string> timestamped_value;
-        if (txn.getWriteSet().find(key) == txn.getWriteSet().end()) {
+        string_view written;
+        if (!txn.findWrite(key, &written)) {
             if ((replicated && IsLongLocked(key)) || (!replicated && store->IsWriteLocked(key))) {
                 prepare_successful = false;
                 Debug("[%lu - %lu] Key %s is locked by another transaction.",
@@ -215,8 +225,8 @@ int Store::PrepareRead(txnid_t txn_id, const Transaction &txn,
     // If read validation failed, then release all the write locks and clear
     // write_prepared.
     if (!prepare_successful) {
-        for (const pair<const string, string> &p : txn.getWriteSet()) {
-            const string &key = p.first;
+        for (size_t i = 0; i < txn.writeSetSize(); i++) {
+            const string key(txn.getWrite(i).key);
             if (!twopc && !replicated) {
                 // We use the short lock in the store for all concurrency control
                 // purposes.
@@ -247,15 +257,14 @@ int Store::PrepareRead(txnid_t txn_id, const Transaction &txn,
 
 // Assumes we prepared the transaction before and hold the locks
 void Store::Commit(txnid_t txn_id, const Timestamp &timestamp,
-                   const Transaction &txn) {
+                   const TransactionView &txn) {
     Debug("[%lu - %lu] COMMIT at timestamp <%lu, %lu>",
           txn_id.first, txn_id.second, timestamp.getID(), timestamp.getTimestamp());
 
     // Insert writes into versioned key-value store and release all write locks
-    for (const std::pair<const std::string, std::string> &write :
-         txn.getWriteSet()) {
-        const std::string &key = write.first;
-        const std::string &value = write.second;
+    for (const auto &write : txn.getWrites()) {
+        const std::string key(write.key);
+        const std::string value(write.value);
         if (!twopc && !replicated) {
             // We use the short lock in the store for all concurrency control
             // purposes.
@@ -272,28 +281,26 @@ void Store::Commit(txnid_t txn_id, const Timestamp &timestamp,
 // Applies updates without having done a prepare before
 // (i.e., not integrated with the concurrency control mechanism)
 void Store::ForceCommit(txnid_t txn_id, const Timestamp &timestamp,
-                   const Transaction &txn) {
+                   const TransactionView &txn) {
     Debug("[%lu - %lu] FORCE COMMIT at timestamp <%lu, %lu>",
           txn_id.first, txn_id.second, timestamp.getID(), timestamp.getTimestamp());
 
     // Insert writes into versioned key-value store
-    for (const std::pair<const std::string, std::string> &write :
-         txn.getWriteSet()) {
-        const std::string &key = write.first;
-        const std::string &value = write.second;
+    for (const auto &write : txn.getWrites()) {
+        const std::string key(write.key);
+        const std::string value(write.value);
         store->Put(key, value, timestamp);
         Debug("Wrote key: %s", key.c_str());
     }
 }
 
 // Assumes we prepared the transaction before and we hold the locks
-void Store::Abort(txnid_t txn_id, const Transaction &txn) {
+void Store::Abort(txnid_t txn_id, const TransactionView &txn) {
     Debug("[%lu - %lu] ABORT", txn_id.first, txn_id.second);
 
     // Release all the write locks.
-    for (const std::pair<const std::string, std::string> &write :
-         txn.getWriteSet()) {
-        const std::string &key = write.first;
+    for (const auto &write : txn.getWrites()) {
+        const std::string key(write.key);
         if (!twopc && !replicated) {
             // We use the short lock in the store for all concurrency control
             // purposes.
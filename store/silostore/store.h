@@ -35,6 +35,7 @@
 #define _SILO_STORE_H_
 
 #include <atomic>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -46,7 +47,6 @@
 #include "lib/message.h"
 #include "store/common/backend/thread_safe_kvs.h"
 #include "store/common/backend/txnstore.h"
-#include "store/common/backend/versionstore.h"
 #include "store/common/timestamp.h"
 #include "store/common/transaction.h"
 
@@ -65,14 +65,14 @@ public:
             std::pair<Timestamp, std::string> &value) override;
     int Get(txnid_t txn_id, const std::string &key, const Timestamp &timestamp,
             std::pair<Timestamp, std::string> &value) override;
-    int Prepare(txnid_t txn_id, const Transaction &txn,
+    int Prepare(txnid_t txn_id, const TransactionView &txn,
                 const Timestamp &timestamp, Timestamp &proposed) override;
     void Commit(txnid_t txn_id, const Timestamp &timestamp = Timestamp(),
-                const Transaction &txn = Transaction()) override;
+                const TransactionView &txn = TransactionView()) override;
     void ForceCommit(txnid_t txn_id, const Timestamp &timestamp = Timestamp(),
-                   const Transaction &txn = Transaction());
+                   const TransactionView &txn = TransactionView());
     void Abort(txnid_t txn_id,
-               const Transaction &txn = Transaction()) override;
+               const TransactionView &txn = TransactionView()) override;
     void Load(const std::string &key, const std::string &value,
               const Timestamp &timestamp) override;
 